@@ -0,0 +1,54 @@
+#include <format>
+#include <iostream>
+#include <random>
+
+#include "heavy_hitters.h"
+
+// Стоимость учёта частых IMSI и отправителей на пути UDP запроса: одно обновление адреса
+// и одно обновление IMSI на запрос, как в pgw_server. Фон - случайные IMSI, шторм - доля запросов
+// от одного IMSI и одного адреса. Окно закрывается через заданное число запросов.
+// Запуск: heavy_hitters_bench [запросов, по умолчанию 10000000] [доля шторма, по умолчанию 0.1]
+//                             [запросов в окне, по умолчанию 1000000]
+
+using bench_clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]) {
+    const size_t total = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+    const double storm = argc > 2 ? std::stod(argv[2]) : 0.1;
+    const size_t window = argc > 3 ? std::stoull(argv[3]) : 1'000'000;
+    if (total == 0 || window == 0 || storm < 0 || storm > 1) {
+        std::cerr << "Количество запросов и окно должны быть положительными, доля шторма от 0 до 1" << '\n';
+        return 1;
+    }
+
+    // Ключи готовятся заранее, измеряется только учёт
+    std::mt19937_64 rng(1);
+    std::bernoulli_distribution is_storm(storm);
+    std::vector<std::string> imsis(1 << 16);
+    std::vector<uint32_t> addrs(1 << 16);
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        const bool stormy = is_storm(rng);
+        imsis[i] = stormy ? "001010123456789" : std::to_string(250'000'000'000'000ULL + rng() % 100'000'000'000'000ULL);
+        addrs[i] = stormy ? 0x0100000A : static_cast<uint32_t>(rng());
+    }
+
+    std::cout << std::format("{} запросов, доля шторма {}, окно {} запросов\n", total, storm, window)
+              << std::format("{:>8} {:>8} {:>14} {:>16}\n", "top_k", "ширина", "нс/запрос", "шторм за окно");
+    for (const auto& [top_k, width] : {std::pair<size_t, size_t>{20, 4096}, {100, 16384}, {0, 4096}}) {
+        heavy_hitters hitters(top_k, width);
+        const auto start = bench_clock::now();
+        for (size_t i = 0; i < total; ++i) {
+            const size_t slot = i & (imsis.size() - 1);
+            hitters.add_source(addrs[slot]);
+            hitters.add_imsi(imsis[slot], false);
+            if ((i + 1) % window == 0) {
+                hitters.rotate();
+            }
+        }
+        const double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+        const heavy_hitters_report report = hitters.previous();
+        std::cout << std::format("{:>8} {:>8} {:>14.1f} {:>16}\n", top_k, width, ns / static_cast<double>(total),
+            report.imsi.empty() ? 0 : report.imsi[0].count);
+    }
+    return 0;
+}
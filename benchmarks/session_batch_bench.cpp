@@ -0,0 +1,76 @@
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <random>
+
+#include "session_manager.h"
+#include "spdlog/spdlog.h"
+
+// Стоимость запроса на создание сессии в зависимости от размера пакета process_requests.
+// Для каждого размера пакета - новый session_manager и те же случайные IMSI, каждый десятый запрос
+// повторяет недавний IMSI и получает отказ. CDR пишутся в настоящий файл, как в сервере.
+// Первая строка - process_request по одному, для сравнения.
+// Запуск: session_batch_bench [запросов, по умолчанию 1000000]
+
+using bench_clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::off);
+    const size_t total = argc > 1 ? std::stoull(argv[1]) : 1'000'000;
+    if (total == 0) {
+        std::cerr << "Количество запросов должно быть положительным" << '\n';
+        return 1;
+    }
+
+    std::mt19937_64 rng(1);
+    std::vector<std::string> imsis;
+    imsis.reserve(total);
+    for (size_t i = 0; i < total; ++i) {
+        if (i >= 16 && rng() % 10 == 0) {
+            imsis.push_back(imsis[i - 1 - rng() % 16]);
+        } else {
+            imsis.push_back(std::to_string(250'000'000'000'000ULL + rng() % 100'000'000'000'000ULL));
+        }
+    }
+
+    server_config config;
+    config.cdr_file = "batch_bench_cdr.csv";
+    config.session_timeout_sec = 3600;
+    config.max_sessions = static_cast<int>(total);
+    config.graceful_shutdown_rate = 1;
+
+    std::cout << std::format("{} запросов\n", total)
+              << std::format("{:>14} {:>12} {:>14} {:>10}\n", "пакет", "нс/запрос", "запросов/с", "создано");
+
+    // batch 0 - process_request по одному
+    for (const size_t batch : {0, 1, 4, 16, 64, 256, 1024, 4096}) {
+        std::filesystem::remove("logs/" + config.cdr_file);
+        std::filesystem::remove("logs/" + config.cdr_file + ".idx");
+        session_manager manager(config, std::make_shared<manual_session_clock>());
+
+        uint64_t created = 0;
+        const auto start = bench_clock::now();
+        if (batch == 0) {
+            for (const std::string& imsi : imsis) {
+                created += manager.process_request(imsi) == "created";
+            }
+        } else {
+            std::vector<std::string_view> results(batch);
+            for (size_t begin = 0; begin < total; begin += batch) {
+                const size_t count = std::min(batch, total - begin);
+                manager.process_requests(std::span(imsis).subspan(begin, count), std::span(results).first(count));
+                for (size_t i = 0; i < count; ++i) {
+                    created += results[i] == "created";
+                }
+            }
+        }
+        const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        std::cout << std::format("{:>14} {:>12.1f} {:>14.0f} {:>10}\n", batch == 0 ? "1 (по одному)" : std::to_string(batch),
+            seconds * 1e9 / static_cast<double>(total), static_cast<double>(total) / seconds, created);
+    }
+
+    std::filesystem::remove("logs/" + config.cdr_file);
+    std::filesystem::remove("logs/" + config.cdr_file + ".idx");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <random>
+
+#include "session_manager.h"
+#include "spdlog/spdlog.h"
+
+// Моделирование суток работы session_manager на виртуальных часах: равномерный поток запросов
+// со случайными IMSI, чистка раз в виртуальную секунду, как в сервере.
+// Запуск: session_churn_bench [запросов в секунду, по умолчанию 100] [таймаут сессии, с, по умолчанию 1800]
+//                             [часов, по умолчанию 24]
+
+using bench_clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::off);
+    const uint64_t rate = argc > 1 ? std::stoull(argv[1]) : 100;
+    const int timeout_sec = argc > 2 ? std::stoi(argv[2]) : 1800;
+    const uint64_t hours = argc > 3 ? std::stoull(argv[3]) : 24;
+    if (rate == 0 || timeout_sec <= 0 || hours == 0) {
+        std::cerr << "Все параметры должны быть положительными" << '\n';
+        return 1;
+    }
+
+    server_config config;
+    config.cdr_file = "churn_bench_cdr.csv";
+    config.session_timeout_sec = timeout_sec;
+    config.max_sessions = 0;
+    config.graceful_shutdown_rate = 1;
+    std::filesystem::remove("logs/" + config.cdr_file);
+
+    auto clock = std::make_shared<manual_session_clock>();
+    session_manager manager(config, clock);
+    manager.start_cleaning();
+
+    const uint64_t total = rate * hours * 3600;
+    const auto interval = std::chrono::nanoseconds(1'000'000'000 / rate);
+    std::mt19937_64 rng(1);
+    std::cout << std::format("Моделирование {} ч: {} запросов/с, таймаут {} с, всего {} запросов\n",
+        hours, rate, timeout_sec, total);
+
+    uint64_t created = 0;
+    const auto wall_start = bench_clock::now();
+    for (uint64_t i = 0; i < total; ++i) {
+        // Время двигается вместе с проходами чистки, которые выпали на этот интервал
+        clock->advance(interval);
+        const std::string imsi = std::to_string(250'000'000'000'000ULL + rng() % 100'000'000'000'000ULL);
+        if (manager.process_request(imsi) == "created") {
+            ++created;
+        }
+    }
+    const double wall = std::chrono::duration<double>(bench_clock::now() - wall_start).count();
+
+    manager.stop_cleaning();
+    const session_stats stats = manager.stats();
+    std::error_code ec;
+    const auto cdr_bytes = std::filesystem::file_size("logs/" + config.cdr_file, ec);
+    std::filesystem::remove("logs/" + config.cdr_file);
+
+    const double simulated = static_cast<double>(hours * 3600);
+    std::cout << std::format("Реальное время:       {:.2f} с (ускорение {:.0f}x)\n", wall, simulated / wall)
+              << std::format("Запросов в секунду:   {:.0f}\n", static_cast<double>(total) / wall)
+              << std::format("Создано сессий:       {}\n", created)
+              << std::format("Истекло:              {}\n", stats.expired)
+              << std::format("Пик таблицы:          {}\n", stats.peak_sessions)
+              << std::format("Активных в конце:     {}\n", stats.active_sessions)
+              << std::format("CDR:                  {} записей, {} байт\n", stats.created + stats.expired, cdr_bytes);
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <format>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+
+#include "session_table.h"
+#include "spdlog/spdlog.h"
+
+// Сравнение session_table с прежним std::unordered_map<std::string, time_point>:
+// байты на сессию, среднее и худшее время вставки, время поиска.
+// Запуск: session_table_bench [количество сессий, по умолчанию 10000000]
+
+using bench_clock = std::chrono::steady_clock;
+
+// Счётчик байт, выделенных контейнером
+size_t allocated_bytes = 0;
+
+template<typename T>
+struct counting_allocator {
+    using value_type = T;
+
+    counting_allocator() = default;
+    template<typename U>
+    counting_allocator(const counting_allocator<U>&) {}
+
+    T* allocate(size_t n) {
+        allocated_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        allocated_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    bool operator==(const counting_allocator<U>&) const { return true; }
+};
+
+using map_type = std::unordered_map<std::string, bench_clock::time_point, std::hash<std::string>,
+    std::equal_to<>, counting_allocator<std::pair<const std::string, bench_clock::time_point>>>;
+
+struct bench_result {
+    double bytes_per_session;
+    double insert_ns;
+    double insert_max_us;
+    double lookup_hit_ns;
+    double lookup_miss_ns;
+};
+
+// 15-значные IMSI в случайном порядке
+std::vector<std::string> make_imsis(size_t count, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::string> imsis;
+    imsis.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        imsis.push_back(std::to_string(250'000'000'000'000ULL + rng() % 100'000'000'000'000ULL));
+    }
+    return imsis;
+}
+
+template<typename Insert, typename Lookup>
+bench_result run(const std::vector<std::string>& imsis, const std::vector<std::string>& missing,
+    Insert&& insert, Lookup&& lookup, const std::function<size_t()>& memory) {
+    bench_result result{};
+    const auto now = bench_clock::now();
+
+    // Вставка, отдельно замеряем самую долгую (остановка на рехэш)
+    auto start = bench_clock::now();
+    auto prev = start;
+    bench_clock::duration worst{};
+    for (const std::string& imsi : imsis) {
+        insert(imsi, now);
+        auto t = bench_clock::now();
+        worst = std::max(worst, t - prev);
+        prev = t;
+    }
+    auto total = bench_clock::now() - start;
+    result.insert_ns = std::chrono::duration<double, std::nano>(total).count() / imsis.size();
+    result.insert_max_us = std::chrono::duration<double, std::micro>(worst).count();
+    result.bytes_per_session = static_cast<double>(memory()) / imsis.size();
+
+    // Поиск существующих
+    size_t found = 0;
+    start = bench_clock::now();
+    for (const std::string& imsi : imsis) {
+        found += lookup(imsi);
+    }
+    total = bench_clock::now() - start;
+    result.lookup_hit_ns = std::chrono::duration<double, std::nano>(total).count() / imsis.size();
+
+    // Поиск отсутствующих
+    start = bench_clock::now();
+    for (const std::string& imsi : missing) {
+        found += lookup(imsi);
+    }
+    total = bench_clock::now() - start;
+    result.lookup_miss_ns = std::chrono::duration<double, std::nano>(total).count() / missing.size();
+
+    if (found < imsis.size()) {
+        std::cerr << "Найдены не все сессии" << '\n';
+    }
+    return result;
+}
+
+void print(const std::string& name, const bench_result& r) {
+    std::cout << std::format("{:<28} {:>10.1f} {:>12.1f} {:>14.1f} {:>12.1f} {:>12.1f}\n",
+        name, r.bytes_per_session, r.insert_ns, r.insert_max_us, r.lookup_hit_ns, r.lookup_miss_ns);
+}
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::off);
+    const size_t count = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+
+    std::cout << "Генерация " << count << " IMSI..." << '\n';
+    const auto imsis = make_imsis(count, 1);
+    const auto missing = make_imsis(count / 10, 2);
+
+    std::cout << std::format("{:<28} {:>10} {:>12} {:>14} {:>12} {:>12}\n",
+        "контейнер", "байт/сесс", "вставка нс", "худшая мкс", "поиск нс", "промах нс");
+
+    {
+        allocated_bytes = 0;
+        map_type map;
+        auto r = run(imsis, missing,
+            [&map](const std::string& imsi, bench_clock::time_point t) { map.emplace(imsi, t); },
+            [&map](const std::string& imsi) { return map.contains(imsi); },
+            [] { return allocated_bytes; });
+        print("std::unordered_map", r);
+    }
+
+    {
+        session_table table;
+        auto r = run(imsis, missing,
+            [&table](const std::string& imsi, bench_clock::time_point t) { table.insert(imsi, t); },
+            [&table](const std::string& imsi) { return table.contains(imsi); },
+            [&table] { return table.memory_bytes(); });
+        print("session_table (рост)", r);
+    }
+
+    {
+        session_table table(count);
+        auto r = run(imsis, missing,
+            [&table](const std::string& imsi, bench_clock::time_point t) { table.insert(imsi, t); },
+            [&table](const std::string& imsi) { return table.contains(imsi); },
+            [&table] { return table.memory_bytes(); });
+        print("session_table (prealloc)", r);
+    }
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <arpa/inet.h>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <iostream>
+#include <thread>
+
+#include "event_fd_raii.h"
+#include "io_scheduler.h"
+#include "socket_raii.h"
+#include "spdlog/spdlog.h"
+
+// Цикл UDP сервера: epoll с вычитыванием сокета до EAGAIN, как в прежнем pgw_server,
+// против корутины на io_scheduler. Сервер отвечает на каждый пакет, клиент в отдельном потоке
+// держит в полёте окно пакетов и отправляет следующий на каждый ответ. На loopback,
+// время - полное время обмена, занятость - доля времени сервера вне ожидания в epoll.
+// Запуск: udp_loop_bench [пакетов, по умолчанию 1000000] [окно, по умолчанию 64]
+
+using bench_clock = std::chrono::steady_clock;
+
+namespace {
+    constexpr size_t packet_size = 16;
+
+    socket_raii bound_socket(sockaddr_in& addr) {
+        socket_raii fd(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+        addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (fd.get() < 0 || bind(fd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || getsockname(fd.get(), reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            throw std::runtime_error(std::string("Не удалось создать сокет: ") + strerror(errno));
+        }
+        return fd;
+    }
+
+    void echo(int fd, const sockaddr_in& addr, const char* data, size_t size) {
+        sendto(fd, data, size, 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    }
+
+    // Прежний цикл: epoll_wait, затем recvmsg до EAGAIN
+    void run_epoll(int fd, int stop_fd, std::atomic<uint64_t>& busy_ns) {
+        epoll_raii epoll;
+        for (int watched : {fd, stop_fd}) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = watched;
+            epoll_ctl(epoll.get(), EPOLL_CTL_ADD, watched, &event);
+        }
+
+        epoll_event events[64];
+        char buffer[packet_size];
+        while (true) {
+            const int n_events = epoll_wait(epoll.get(), events, 64, -1);
+            const auto busy_start = bench_clock::now();
+            for (int i = 0; i < n_events; i++) {
+                if (events[i].data.fd == stop_fd) {
+                    return;
+                }
+                while (true) {
+                    sockaddr_in addr{};
+                    iovec iov{buffer, sizeof(buffer)};
+                    msghdr msg{};
+                    msg.msg_name = &addr;
+                    msg.msg_namelen = sizeof(addr);
+                    msg.msg_iov = &iov;
+                    msg.msg_iovlen = 1;
+                    const ssize_t n = recvmsg(fd, &msg, 0);
+                    if (n < 0) {
+                        break;
+                    }
+                    echo(fd, addr, buffer, n);
+                }
+            }
+            busy_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                bench_clock::now() - busy_start).count(), std::memory_order_relaxed);
+        }
+    }
+
+    io_task serve(io_scheduler& scheduler, int fd) {
+        char buffer[packet_size];
+        sockaddr_in addr{};
+        iovec iov{buffer, sizeof(buffer)};
+        msghdr msg{};
+        while (true) {
+            msg.msg_name = &addr;
+            msg.msg_namelen = sizeof(addr);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            const ssize_t n = co_await scheduler.recv(fd, msg);
+            if (n > 0) {
+                echo(fd, addr, buffer, n);
+            }
+        }
+    }
+
+    io_task stop_on_event(io_scheduler& scheduler, int stop_fd) {
+        co_await scheduler.readable(stop_fd);
+        scheduler.stop();
+    }
+
+    void run_coroutines(int fd, int stop_fd, std::atomic<uint64_t>& busy_ns) {
+        io_scheduler scheduler;
+        scheduler.spawn(serve(scheduler, fd));
+        scheduler.spawn(stop_on_event(scheduler, stop_fd));
+        scheduler.run(&busy_ns);
+    }
+
+    // Клиент: окно пакетов в полёте, ответ освобождает место следующему
+    void run_client(const sockaddr_in& server, size_t total, size_t window) {
+        sockaddr_in addr{};
+        socket_raii fd = bound_socket(addr);
+        const int flags = fcntl(fd.get(), F_GETFL, 0);
+        fcntl(fd.get(), F_SETFL, flags & ~O_NONBLOCK);
+        connect(fd.get(), reinterpret_cast<const sockaddr*>(&server), sizeof(server));
+
+        char packet[packet_size]{};
+        size_t sent = 0;
+        size_t received = 0;
+        for (; sent < std::min(window, total); ++sent) {
+            send(fd.get(), packet, sizeof(packet), 0);
+        }
+        // Потерянный на loopback пакет заменяется новым по таймауту
+        timeval tv{0, 100'000};
+        setsockopt(fd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        while (received < total) {
+            if (recv(fd.get(), packet, sizeof(packet), 0) > 0 || errno != EAGAIN) {
+                ++received;
+            }
+            if (sent < total) {
+                send(fd.get(), packet, sizeof(packet), 0);
+                ++sent;
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    spdlog::set_level(spdlog::level::off);
+    const size_t total = argc > 1 ? std::stoull(argv[1]) : 1'000'000;
+    const size_t window = argc > 2 ? std::stoull(argv[2]) : 64;
+    if (total == 0 || window == 0) {
+        std::cerr << "Количество пакетов и окно должны быть положительными" << '\n';
+        return 1;
+    }
+
+    std::cout << std::format("{} пакетов, окно {}\n", total, window)
+              << std::format("{:>12} {:>12} {:>14} {:>12}\n", "цикл", "нс/пакет", "пакетов/с", "занятость");
+
+    for (const bool coroutines : {false, true}) {
+        sockaddr_in server_addr{};
+        socket_raii server = bound_socket(server_addr);
+        event_fd_raii stop_event;
+        std::atomic<uint64_t> busy_ns{0};
+
+        const auto start = bench_clock::now();
+        std::jthread server_thread([&] {
+            coroutines ? run_coroutines(server.get(), stop_event.get(), busy_ns)
+                       : run_epoll(server.get(), stop_event.get(), busy_ns);
+        });
+        run_client(server_addr, total, window);
+        const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        stop_event.notify();
+        server_thread.join();
+
+        std::cout << std::format("{:>12} {:>12.1f} {:>14.0f} {:>11.1f}%\n", coroutines ? "корутины" : "epoll",
+            seconds * 1e9 / static_cast<double>(total), static_cast<double>(total) / seconds,
+            100.0 * static_cast<double>(busy_ns.load()) / (seconds * 1e9));
+    }
+    return 0;
+}
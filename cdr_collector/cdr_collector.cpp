@@ -0,0 +1,56 @@
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "cdr_stream.h"
+#include "spdlog/spdlog.h"
+
+// Простой коллектор CDR для потокового приёмника pgw_server (cdr_sink.type = stream):
+// принимает пакеты, подтверждает их и дописывает записи построчно в файл или в stdout
+
+std::atomic running_ = true;
+
+void signal_handler(int) {
+    running_ = false;
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    try {
+        if (argc < 2 || argc > 3) {
+            std::cerr << "Использование: cdr_collector <tcp://ip:port | unix:///путь> [файл, по умолчанию stdout]" << '\n';
+            return 1;
+        }
+
+        std::ofstream file;
+        if (argc == 3) {
+            file.open(argv[2], std::ios::app);
+            if (!file.is_open()) {
+                std::cerr << "Не удалось открыть файл: " << argv[2] << '\n';
+                return 1;
+            }
+        }
+        std::ostream& out = argc == 3 ? file : std::cout;
+
+        // Коллектор отладочный: вывод сбрасывается раз в 200 мс, а не перед подтверждением пакета
+        cdr_collector collector(argv[1], [&out](std::string_view record) {
+            out << record << '\n';
+        });
+        collector.start();
+
+        while (running_) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            out.flush();
+        }
+        collector.stop();
+        out.flush();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
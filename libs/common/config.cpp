@@ -1,6 +1,8 @@
 #include <fstream>
+#include <unordered_set>
 
 #include "config.h"
+#include "spdlog/spdlog.h"
 
 // Парсинг json
 json load_json_from_file(const std::string& path) {
@@ -18,6 +20,180 @@ json load_json_from_file(const std::string& path) {
     return data;
 }
 
+// Проверка порта
+void validate_port(int port, const std::string& what) {
+    if (port < 1 || port > 65535) {
+        throw std::runtime_error("Неверный " + what + " порт: " + std::to_string(port)
+            + ". Порт должен быть от 1 до 65535");
+    }
+}
+
+// Загрузка и валидация секции кластера
+cluster_config load_cluster_config(const json& data) {
+    cluster_config cluster;
+    if (!data.is_object()) {
+        throw std::runtime_error("cluster должен быть объектом");
+    }
+
+    cluster.enabled = true;
+    cluster.node_id = get_required_field<std::string>(data, "node_id");
+
+    cluster.virtual_nodes = get_optional_field<int>(data, "virtual_nodes", 64);
+    if (cluster.virtual_nodes <= 0) {
+        throw std::runtime_error("Количество виртуальных узлов должно быть положительным числом");
+    }
+
+    cluster.forward_timeout_ms = get_optional_field<int>(data, "forward_timeout_ms", 500);
+    if (cluster.forward_timeout_ms <= 0) {
+        throw std::runtime_error("Таймаут пересылки должен быть положительным числом");
+    }
+
+    if (!data.contains("nodes") || !data["nodes"].is_array() || data["nodes"].empty()) {
+        throw std::runtime_error("cluster.nodes должен быть непустым массивом");
+    }
+
+    bool self_found = false;
+    std::unordered_set<std::string> ids;
+    for (const json& node_data : data["nodes"]) {
+        cluster_node node;
+        node.id = get_required_field<std::string>(node_data, "id");
+        node.udp_ip = get_required_field<std::string>(node_data, "udp_ip");
+        node.udp_port = get_required_field<int>(node_data, "udp_port");
+        validate_port(node.udp_port, "UDP");
+        node.http_ip = get_required_field<std::string>(node_data, "http_ip");
+        node.http_port = get_required_field<int>(node_data, "http_port");
+        validate_port(node.http_port, "HTTP");
+
+        if (!ids.insert(node.id).second) {
+            throw std::runtime_error("Повторяющийся id узла кластера: " + node.id);
+        }
+        self_found = self_found || node.id == cluster.node_id;
+        cluster.nodes.push_back(node);
+    }
+
+    if (!self_found) {
+        throw std::runtime_error("node_id " + cluster.node_id + " отсутствует в cluster.nodes");
+    }
+
+    return cluster;
+}
+
+// Загрузка и валидация секции приёмника CDR
+cdr_sink_config load_cdr_sink_config(const json& data) {
+    cdr_sink_config sink;
+    if (!data.is_object()) {
+        throw std::runtime_error("cdr_sink должен быть объектом");
+    }
+
+    sink.type = get_optional_field<std::string>(data, "type", "file");
+    if (sink.type == "file") {
+        return sink;
+    }
+    if (sink.type != "stream") {
+        throw std::runtime_error("Неизвестный тип приёмника CDR: " + sink.type + ". Допустимо file или stream");
+    }
+
+    sink.address = get_required_field<std::string>(data, "address");
+    if (!sink.address.starts_with("tcp://") && !sink.address.starts_with("unix://")) {
+        throw std::runtime_error("Адрес коллектора CDR должен начинаться с tcp:// или unix://: " + sink.address);
+    }
+
+    sink.batch_size = get_optional_field<int>(data, "batch_size", 256);
+    if (sink.batch_size <= 0) {
+        throw std::runtime_error("Размер пакета CDR должен быть положительным числом");
+    }
+
+    sink.flush_interval_ms = get_optional_field<int>(data, "flush_interval_ms", 100);
+    if (sink.flush_interval_ms <= 0) {
+        throw std::runtime_error("Интервал отправки CDR должен быть положительным числом");
+    }
+
+    sink.max_buffered_records = get_optional_field<int>(data, "max_buffered_records", 100000);
+    if (sink.max_buffered_records < sink.batch_size) {
+        throw std::runtime_error("Буфер CDR должен вмещать хотя бы один пакет");
+    }
+
+    sink.spill_file = get_optional_field<std::string>(data, "spill_file", "cdr_spill.bin");
+    if (sink.spill_file.empty()) {
+        throw std::runtime_error("Путь к файлу подкачки CDR не может быть пустым");
+    }
+
+    sink.reconnect_interval_ms = get_optional_field<int>(data, "reconnect_interval_ms", 1000);
+    if (sink.reconnect_interval_ms <= 0) {
+        throw std::runtime_error("Интервал переподключения к коллектору CDR должен быть положительным числом");
+    }
+
+    return sink;
+}
+
+// Загрузка и валидация секции агрегации CDR
+cdr_aggregation_config load_cdr_aggregation_config(const json& data) {
+    cdr_aggregation_config aggregation;
+    if (!data.is_object()) {
+        throw std::runtime_error("cdr_aggregation должен быть объектом");
+    }
+    aggregation.enabled = true;
+
+    aggregation.interval_sec = get_optional_field<int>(data, "interval_sec", 60);
+    if (aggregation.interval_sec <= 0) {
+        throw std::runtime_error("Интервал агрегации CDR должен быть положительным числом");
+    }
+
+    aggregation.mnc_digits = get_optional_field<int>(data, "mnc_digits", 2);
+    if (aggregation.mnc_digits != 2 && aggregation.mnc_digits != 3) {
+        throw std::runtime_error("mnc_digits должен быть 2 или 3");
+    }
+
+    aggregation.sample_rate = get_optional_field<double>(data, "sample_rate", 0.0);
+    if (aggregation.sample_rate < 0.0 || aggregation.sample_rate > 1.0) {
+        throw std::runtime_error("sample_rate должен быть от 0 до 1");
+    }
+
+    aggregation.detail_prefixes = get_optional_field<std::vector<std::string>>(data, "detail_prefixes", {});
+    for (const auto& prefix : aggregation.detail_prefixes) {
+        if (prefix.empty() || prefix.size() > 15 || prefix.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::runtime_error("Неправильный префикс IMSI в detail_prefixes: " + prefix);
+        }
+    }
+
+    return aggregation;
+}
+
+// Загрузка и валидация секции репликации
+replication_config load_replication_config(const json& data) {
+    replication_config replication;
+    if (!data.is_object()) {
+        throw std::runtime_error("replication должен быть объектом");
+    }
+
+    replication.enabled = true;
+    replication.role = get_required_field<std::string>(data, "role");
+    if (replication.role != "primary" && replication.role != "standby") {
+        throw std::runtime_error("Неизвестная роль репликации: " + replication.role + ". Допустимо primary или standby");
+    }
+
+    replication.ip = get_required_field<std::string>(data, "ip");
+    replication.port = get_required_field<int>(data, "port");
+    validate_port(replication.port, "репликации");
+
+    replication.batch_interval_ms = get_optional_field<int>(data, "batch_interval_ms", 10);
+    if (replication.batch_interval_ms <= 0) {
+        throw std::runtime_error("Интервал пакетов репликации должен быть положительным числом");
+    }
+
+    replication.max_lag_events = get_optional_field<int>(data, "max_lag_events", 100000);
+    if (replication.max_lag_events <= 0) {
+        throw std::runtime_error("Максимальное отставание репликации должно быть положительным числом");
+    }
+
+    replication.failover_timeout_ms = get_optional_field<int>(data, "failover_timeout_ms", 1000);
+    if (replication.failover_timeout_ms <= replication.batch_interval_ms) {
+        throw std::runtime_error("Таймаут переключения на резерв должен быть больше интервала пакетов репликации");
+    }
+
+    return replication;
+}
+
 // Функция загрузки конфига для сервера
 server_config load_server_config(const std::string& path) {
     json data = load_json_from_file(path);
@@ -26,16 +202,14 @@ server_config load_server_config(const std::string& path) {
 
     // Загрузка и валидация UDP
     config.udp_ip = get_required_field<std::string>(data, "udp_ip");
+    // Порт 0 - свободный порт, который выберет ядро (тесты в одном процессе с сервером)
     config.udp_port = get_required_field<int>(data, "udp_port");
-    if (config.udp_port < 1 || config.udp_port > 65535) {
+    if (config.udp_port < 0 || config.udp_port > 65535) {
         throw std::runtime_error("Неверный UDP порт: " + std::to_string(config.udp_port) +
-            ". Порт должен быть от 1 до 65535");
+            ". Порт должен быть от 0 до 65535");
     }
 
     config.udp_buffer_size = get_optional_field<int>(data, "udp_buffer_size", 1024);
-    if (config.udp_buffer_size < 512 || config.udp_buffer_size > 65536) {
-        throw std::runtime_error("Размер UDP буфера должен быть от 512 до 65536 байт");
-    }
 
     // Загрузка и валидация epoll
     config.epoll_max_events = get_optional_field<int>(data, "epoll_max_events", 10);
@@ -43,15 +217,25 @@ server_config load_server_config(const std::string& path) {
         throw std::runtime_error("Количество событий epoll должно быть положительным числом");
     }
 
-    config.epoll_timeout_sec = get_optional_field<int>(data, "epoll_timeout_sec", 1);
-    if (config.epoll_timeout_sec <= 0) {
-        throw std::runtime_error("Время epoll таймера должно быть положительным числом");
+    // Потоки UDP: у каждого свой сокет в группе SO_REUSEPORT и своя часть сессий
+    config.udp_workers = get_optional_field<int>(data, "udp_workers", 1);
+    if (config.udp_workers < 1 || config.udp_workers > 1024) {
+        throw std::runtime_error("Число потоков UDP должно быть от 1 до 1024");
     }
 
-    // Загрузка и валидация таймаута сессии
     config.session_timeout_sec = get_optional_field<int>(data, "session_timeout_sec", 5);
-    if (config.session_timeout_sec <= 0) {
-        throw std::runtime_error("Таймаут сессии должен быть положительным числом");
+
+    // Загрузка и валидация ограничения на количество сессий (0 - без ограничения),
+    // под него заранее выделяется таблица
+    config.max_sessions = get_optional_field<int>(data, "max_sessions", 0);
+    if (config.max_sessions < 0) {
+        throw std::runtime_error("Максимальное количество сессий не может быть отрицательным");
+    }
+
+    config.session_limit_policy = get_optional_field<std::string>(data, "session_limit_policy", "reject");
+    if (config.session_limit_policy != "reject" && config.session_limit_policy != "evict_oldest") {
+        throw std::runtime_error("Неизвестная политика при достижении max_sessions: " + config.session_limit_policy
+            + ". Допустимо reject или evict_oldest");
     }
 
     // Загрузка и валидация cdr файла
@@ -60,25 +244,98 @@ server_config load_server_config(const std::string& path) {
         throw std::runtime_error("Путь к CDR файлу не может быть пустым");
     }
 
+    if (data.contains("cdr_sink")) {
+        config.cdr_sink = load_cdr_sink_config(data["cdr_sink"]);
+    }
+    if (data.contains("cdr_aggregation")) {
+        config.cdr_aggregation = load_cdr_aggregation_config(data["cdr_aggregation"]);
+    }
+
     // Загрузка и валидация HTTP
     config.http_ip = get_required_field<std::string>(data, "http_ip");
     config.http_port = get_required_field<int>(data, "http_port");
-    if (config.http_port < 1 || config.http_port > 65535) {
+    if (config.http_port < 0 || config.http_port > 65535) {
         throw std::runtime_error("Неверный HTTP порт: " + std::to_string(config.http_port)
-            +". Порт должен быть от 1 до 65535");
+            +". Порт должен быть от 0 до 65535");
     }
 
-    // Проверка, что UDP и HTTP порты разные
-    if (config.udp_port == config.http_port) {
+    // Проверка, что UDP и HTTP порты разные. Два порта 0 получат от ядра разные порты
+    if (config.udp_port != 0 && config.udp_port == config.http_port) {
         throw std::runtime_error("UDP и HTTP порты должны быть разными");
     }
 
-    // Загрузка и валидация graceful shutdown rate
+    // Пул потоков и keep-alive HTTP сервера (0 потоков - по умолчанию cpp-httplib)
+    config.http_threads = get_optional_field<int>(data, "http_threads", 0);
+    if (config.http_threads < 0) {
+        throw std::runtime_error("Число потоков HTTP не может быть отрицательным");
+    }
+
+    config.http_keep_alive_max_count = get_optional_field<int>(data, "http_keep_alive_max_count", 100);
+    if (config.http_keep_alive_max_count <= 0) {
+        throw std::runtime_error("Число запросов на keep-alive соединение должно быть положительным числом");
+    }
+
+    config.http_keep_alive_timeout_sec = get_optional_field<int>(data, "http_keep_alive_timeout_sec", 5);
+    if (config.http_keep_alive_timeout_sec <= 0) {
+        throw std::runtime_error("Таймаут keep-alive должен быть положительным числом");
+    }
+
+    config.http_max_batch = get_optional_field<int>(data, "http_max_batch", 100000);
+    if (config.http_max_batch <= 0) {
+        throw std::runtime_error("Размер пакетной проверки должен быть положительным числом");
+    }
+
     config.graceful_shutdown_rate = get_optional_field<int>(data, "graceful_shutdown_rate", 10);
-    if (config.graceful_shutdown_rate <= 0) {
-        throw std::runtime_error("Graceful shutdown rate должен быть положительным числом");
+
+    // Загрузка и валидация кэша ретрансмитов (0 отключает кэш)
+    config.retransmit_cache_size = get_optional_field<int>(data, "retransmit_cache_size", 4096);
+    if (config.retransmit_cache_size < 0) {
+        throw std::runtime_error("Размер кэша ретрансмитов не может быть отрицательным");
+    }
+
+    config.retransmit_cache_ttl_ms = get_optional_field<int>(data, "retransmit_cache_ttl_ms", 2000);
+
+    // Загрузка и валидация учёта частых IMSI и отправителей (top_k = 0 отключает учёт)
+    config.heavy_hitters_top_k = get_optional_field<int>(data, "heavy_hitters_top_k", 20);
+    if (config.heavy_hitters_top_k < 0 || config.heavy_hitters_top_k > 1000) {
+        throw std::runtime_error("heavy_hitters_top_k должен быть от 0 до 1000");
+    }
+
+    config.heavy_hitters_window_sec = get_optional_field<int>(data, "heavy_hitters_window_sec", 10);
+    if (config.heavy_hitters_window_sec <= 0) {
+        throw std::runtime_error("Окно учёта частых IMSI должно быть положительным числом");
+    }
+
+    config.heavy_hitters_sketch_width = get_optional_field<int>(data, "heavy_hitters_sketch_width", 4096);
+    if (config.heavy_hitters_sketch_width < 64 || config.heavy_hitters_sketch_width > (1 << 24)) {
+        throw std::runtime_error("heavy_hitters_sketch_width должен быть от 64 до 16777216");
+    }
+
+    // Загрузка и валидация ленты событий сессий (0 подписчиков отключает ленту)
+    config.event_stream_max_subscribers = get_optional_field<int>(data, "event_stream_max_subscribers", 4);
+    if (config.event_stream_max_subscribers < 0 || config.event_stream_max_subscribers > 64) {
+        throw std::runtime_error("event_stream_max_subscribers должен быть от 0 до 64");
+    }
+
+    config.event_stream_buffer = get_optional_field<int>(data, "event_stream_buffer", 16384);
+    if (config.event_stream_buffer <= 0) {
+        throw std::runtime_error("Буфер подписчика ленты событий должен быть положительным числом");
+    }
+
+    // Гистограммы задержек по этапам обработки запроса
+    config.latency_tracing = get_optional_field<bool>(data, "latency_tracing", false);
+
+    // Сегмент разделяемой памяти со статистикой для pgw_top (пустая строка отключает)
+    config.stats_shm_name = get_optional_field<std::string>(data, "stats_shm_name", "/pgw_stats");
+    if (!config.stats_shm_name.empty()
+        && (config.stats_shm_name[0] != '/' || config.stats_shm_name.find('/', 1) != std::string::npos)) {
+        throw std::runtime_error("Имя сегмента статистики должно начинаться с / и не содержать других /: "
+            + config.stats_shm_name);
     }
 
+    // Файл захвата входящих UDP пакетов для pgw_replay (пустая строка отключает)
+    config.capture_file = get_optional_field<std::string>(data, "capture_file", "");
+
     // Загрузка и валидация логгера
     config.log_file = get_optional_field<std::string>(data, "log_file", "server.log");
     if (config.log_file.empty()) {
@@ -86,6 +343,10 @@ server_config load_server_config(const std::string& path) {
     }
     config.log_level = get_optional_field<std::string>(data, "log_level", "info");
 
+    // Валидация настроек, которые меняются без перезапуска: таймаут сессии, скорость закрытия
+    // при выключении, размер UDP буфера, TTL кэша ретрансмитов и уровень логирования
+    validate_tunables(tunables_of(config));
+
     // Загрузка блэклиста
     if (data.contains("blacklist")) {
         if (!data["blacklist"].is_array()) {
@@ -96,9 +357,84 @@ server_config load_server_config(const std::string& path) {
         config.blacklist = std::vector<std::string>{};
     }
 
+    // Загрузка кластера
+    if (data.contains("cluster")) {
+        config.cluster = load_cluster_config(data["cluster"]);
+    }
+
+    // Загрузка репликации
+    if (data.contains("replication")) {
+        config.replication = load_replication_config(data["replication"]);
+    }
+
+    // Пересылка в кластере, репликация и захват работают с одной таблицей сессий в одном потоке
+    if (config.udp_workers > 1
+        && (config.cluster.enabled || config.replication.enabled || !config.capture_file.empty())) {
+        throw std::runtime_error("udp_workers больше 1 несовместим с cluster, replication и capture_file");
+    }
+
     return config;
 }
 
+runtime_tunables tunables_of(const server_config& config) {
+    return {config.session_timeout_sec, config.graceful_shutdown_rate, config.udp_buffer_size,
+        config.retransmit_cache_ttl_ms, config.log_level};
+}
+
+void validate_tunables(const runtime_tunables& tunables) {
+    if (tunables.session_timeout_sec <= 0) {
+        throw std::runtime_error("Таймаут сессии должен быть положительным числом");
+    }
+    if (tunables.graceful_shutdown_rate <= 0) {
+        throw std::runtime_error("Graceful shutdown rate должен быть положительным числом");
+    }
+    if (tunables.udp_buffer_size < 512 || tunables.udp_buffer_size > 65536) {
+        throw std::runtime_error("Размер UDP буфера должен быть от 512 до 65536 байт");
+    }
+    if (tunables.retransmit_cache_ttl_ms <= 0) {
+        throw std::runtime_error("TTL кэша ретрансмитов должен быть положительным числом");
+    }
+    // off в from_str - и выключение, и признак неизвестного имени, как в setup_logger
+    if (spdlog::level::from_str(tunables.log_level) == spdlog::level::off) {
+        throw std::runtime_error("Несуществующий уровень логирования: " + tunables.log_level);
+    }
+}
+
+runtime_tunables merge_tunables(const runtime_tunables& base, const json& changes) {
+    if (!changes.is_object()) {
+        throw std::runtime_error("Изменения настроек должны быть JSON объектом");
+    }
+
+    runtime_tunables merged = base;
+    for (const auto& [key, value] : changes.items()) {
+        if (key == "session_timeout_sec") {
+            merged.session_timeout_sec = get_required_field<int>(changes, key);
+        } else if (key == "graceful_shutdown_rate") {
+            merged.graceful_shutdown_rate = get_required_field<int>(changes, key);
+        } else if (key == "udp_buffer_size") {
+            merged.udp_buffer_size = get_required_field<int>(changes, key);
+        } else if (key == "retransmit_cache_ttl_ms") {
+            merged.retransmit_cache_ttl_ms = get_required_field<int>(changes, key);
+        } else if (key == "log_level") {
+            merged.log_level = get_required_field<std::string>(changes, key);
+        } else {
+            throw std::runtime_error("Поле " + key + " нельзя изменить без перезапуска");
+        }
+    }
+    validate_tunables(merged);
+    return merged;
+}
+
+json tunables_to_json(const runtime_tunables& tunables) {
+    return {
+        {"session_timeout_sec", tunables.session_timeout_sec},
+        {"graceful_shutdown_rate", tunables.graceful_shutdown_rate},
+        {"udp_buffer_size", tunables.udp_buffer_size},
+        {"retransmit_cache_ttl_ms", tunables.retransmit_cache_ttl_ms},
+        {"log_level", tunables.log_level}
+    };
+}
+
 // Функция загрузки конфига для клиента
 client_config load_client_config(const std::string& path) {
     json data = load_json_from_file(path);
@@ -124,6 +460,20 @@ client_config load_client_config(const std::string& path) {
         throw std::runtime_error("Время таймера должно быть положительным числом");
     }
 
+    // Загрузка и валидация повторов и окна запросов
+    config.retransmit_interval_ms = get_optional_field<int>(data, "retransmit_interval_ms", 500);
+    if (config.retransmit_interval_ms <= 0) {
+        throw std::runtime_error("Интервал повтора запроса должен быть положительным числом");
+    }
+    config.retransmit_backoff = get_optional_field<double>(data, "retransmit_backoff", 2.0);
+    if (config.retransmit_backoff < 1.0) {
+        throw std::runtime_error("Множитель интервала повтора не может быть меньше 1");
+    }
+    config.max_in_flight = get_optional_field<int>(data, "max_in_flight", 1024);
+    if (config.max_in_flight <= 0) {
+        throw std::runtime_error("Число запросов в полёте должно быть положительным числом");
+    }
+
     // Загрузка и валидация логгера
     config.log_file = get_optional_field<std::string>(data, "log_file", "client.log");
     if (config.log_file.empty()) {
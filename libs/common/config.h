@@ -30,34 +30,123 @@ T get_optional_field(const json& data, const std::string& field_name, const T& d
     }
 }
 
+// Узел кластера и адреса, по которым до него достучаться
+struct cluster_node {
+    std::string id;
+    std::string udp_ip;
+    int udp_port{};
+    std::string http_ip;
+    int http_port{};
+};
+
+// Настройки кластера, без секции cluster сервер работает один
+struct cluster_config {
+    bool enabled{};
+    std::string node_id;
+    int virtual_nodes{};
+    int forward_timeout_ms{};
+    std::vector<cluster_node> nodes;
+};
+
+// Настройки репликации сессий на резервный узел, без секции replication узел работает один
+struct replication_config {
+    bool enabled{};
+    std::string role;          // primary или standby
+    std::string ip;            // primary: адрес прослушивания, standby: адрес основного узла
+    int port{};
+    int batch_interval_ms{};
+    int max_lag_events{};
+    int failover_timeout_ms{};
+};
+
+// Куда пишутся CDR: file - файл logs/<cdr_file>, stream - коллектор по TCP или Unix сокету
+struct cdr_sink_config {
+    std::string type = "file";
+    std::string address;            // tcp://host:port или unix:///путь
+    int batch_size{};               // записей в одном пакете
+    int flush_interval_ms{};        // как часто отправлять неполный пакет
+    int max_buffered_records{};     // сверх этого записи уходят в файл подкачки
+    std::string spill_file;         // файл подкачки в logs/, пока коллектор недоступен
+    int reconnect_interval_ms{};
+};
+
+// Агрегация CDR: вместо записи на каждое событие - счётчики по MCC/MNC и действию за интервал.
+// Полные записи остаются для выборки абонентов и для префиксов из detail_prefixes
+struct cdr_aggregation_config {
+    bool enabled{};
+    int interval_sec{};
+    int mnc_digits{};                           // 2 или 3, MCC всегда 3 цифры
+    double sample_rate{};                       // доля абонентов с полными записями, 0 - никого
+    std::vector<std::string> detail_prefixes;   // IMSI с этими префиксами пишутся полностью
+};
+
 // Структура конфига для сервера
 struct server_config {
     std::string udp_ip;
     int udp_port{};
     int udp_buffer_size{};
     int epoll_max_events{};
-    int epoll_timeout_sec{};
+    int udp_workers{};                  // больше 1 - поток на ядро со своей частью сессий
     int session_timeout_sec{};
+    int max_sessions{};
+    std::string session_limit_policy;
     std::string cdr_file;
+    cdr_sink_config cdr_sink;
+    cdr_aggregation_config cdr_aggregation;
     std::string http_ip;
     int http_port{};
+    int http_threads{};                 // 0 - по умолчанию cpp-httplib
+    int http_keep_alive_max_count{};
+    int http_keep_alive_timeout_sec{};
+    int http_max_batch{};               // IMSI в одном запросе /check_subscribers
     int graceful_shutdown_rate{};
+    int retransmit_cache_size{};
+    int retransmit_cache_ttl_ms{};
+    int heavy_hitters_top_k{};          // 0 - учёт частых IMSI и отправителей выключен
+    int heavy_hitters_window_sec{};
+    int heavy_hitters_sketch_width{};
+    int event_stream_max_subscribers{}; // 0 - лента событий /events выключена
+    int event_stream_buffer{};          // событий в буфере одного подписчика
+    bool latency_tracing{};
+    std::string stats_shm_name;
+    std::string capture_file;
     std::string log_file;
     std::string log_level;
     std::vector<std::string> blacklist;
+    cluster_config cluster;
+    replication_config replication;
 
     server_config() = default;
 };
 
+// Настройки, которые меняются на работающем сервере через /admin/config без перезапуска
+struct runtime_tunables {
+    int session_timeout_sec{};
+    int graceful_shutdown_rate{};
+    int udp_buffer_size{};
+    int retransmit_cache_ttl_ms{};
+    std::string log_level;
+};
+
 // Структура конфига для клиента
 struct client_config {
     std::string server_ip;
     int server_port{};
     int udp_buffer_size{};
-    int udp_timer_sec{};
+    int udp_timer_sec{};            // дедлайн запроса, с учётом повторов
+    int retransmit_interval_ms{};
+    double retransmit_backoff{};
+    int max_in_flight{};
     std::string log_file;
     std::string log_level;
 };
 
 server_config load_server_config(const std::string& path);
+
+runtime_tunables tunables_of(const server_config& config);
+// Проверка значений, runtime_error с тем же текстом, что при загрузке конфига
+void validate_tunables(const runtime_tunables& tunables);
+// Изменения из JSON объекта поверх base. Поле вне runtime_tunables, неверный тип или значение - runtime_error
+runtime_tunables merge_tunables(const runtime_tunables& base, const json& changes);
+json tunables_to_json(const runtime_tunables& tunables);
 client_config load_client_config(const std::string& path);
\ No newline at end of file
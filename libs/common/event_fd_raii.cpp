@@ -0,0 +1,56 @@
+#include <cstring>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "event_fd_raii.h"
+#include "spdlog/spdlog.h"
+
+event_fd_raii::event_fd_raii() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("Не удалось создать eventfd: ") + strerror(errno));
+    }
+}
+
+event_fd_raii::~event_fd_raii() {
+    if (fd_ >= 0) {
+        close(fd_);
+        spdlog::debug("eventfd {} закрыт", fd_);
+    }
+}
+
+event_fd_raii::event_fd_raii(event_fd_raii &&other) noexcept : fd_(other.fd_) {
+    other.fd_ = -1;
+}
+
+event_fd_raii& event_fd_raii::operator=(event_fd_raii &&other) noexcept {
+    if (this != &other) {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+int event_fd_raii::get() const {
+    return fd_;
+}
+
+void event_fd_raii::notify() const {
+    const uint64_t one = 1;
+    // EAGAIN только при переполнении счётчика, fd и так читаемый
+    if (write(fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        spdlog::error("Ошибка записи в eventfd {}: {}", fd_, strerror(errno));
+    }
+}
+
+uint64_t event_fd_raii::consume() const {
+    uint64_t value = 0;
+    if (read(fd_, &value, sizeof(value)) < 0) {
+        return 0;
+    }
+    return value;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// eventfd для пробуждения потоков, которые ждут в epoll. Неблокирующий,
+// notify безопасно вызывать из любого потока
+class event_fd_raii {
+    int fd_;
+
+public:
+    explicit event_fd_raii();
+    ~event_fd_raii();
+
+    // Запрещаем копирование
+    event_fd_raii(const event_fd_raii&) = delete;
+    event_fd_raii& operator=(const event_fd_raii&) = delete;
+
+    // Разрешаем перемещение
+    event_fd_raii(event_fd_raii&& other) noexcept;
+    event_fd_raii& operator=(event_fd_raii&& other) noexcept;
+
+    int get() const;
+
+    // Делает fd читаемым до следующего consume
+    void notify() const;
+    // Сбрасывает счётчик, возвращает число notify с прошлого сброса
+    uint64_t consume() const;
+};
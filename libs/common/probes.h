@@ -0,0 +1,23 @@
+#pragma once
+
+// Статические точки трассировки USDT (провайдер pgw) для bpftrace и perf.
+// Включаются опцией CMake PGW_ENABLE_USDT, без неё макрос ничего не генерирует.
+// Аргументы вычисляются только когда опция включена, поэтому они должны быть дешёвыми.
+//
+// Точки:
+//   udp_receive(bytes)                      пакет принят из UDP сокета
+//   udp_reply(bytes)                        ответ отправлен клиенту
+//   session_blacklisted(imsi)               отказ, imsi в блэклисте
+//   session_rejected_limit(imsi)            отказ, достигнут max_sessions
+//   session_evicted(imsi)                   сессия вытеснена по max_sessions
+//   session_duplicate(imsi)                 отказ, сессия уже есть
+//   session_created(imsi)                   сессия создана
+//   sessions_expired(count, remaining)      пачка сессий удалена по таймауту
+//   cdr_write(imsi, action)                 начало записи CDR
+//   cdr_flush(ok)                           запись CDR сброшена на диск, ok = 0 при ошибке
+#ifdef PGW_ENABLE_USDT
+#include <sys/sdt.h>
+#define PGW_PROBE(name, ...) STAP_PROBEV(pgw, name __VA_OPT__(,) __VA_ARGS__)
+#else
+#define PGW_PROBE(name, ...) do {} while (false)
+#endif
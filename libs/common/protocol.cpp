@@ -0,0 +1,74 @@
+#include <stdexcept>
+
+#include "protocol.h"
+
+bool is_framed_packet(std::string_view packet) {
+    return !packet.empty() && static_cast<uint8_t>(packet[0]) == packet_marker;
+}
+
+// Разбор заголовка расширенного пакета, данные начинаются с packet_header_size
+std::optional<packet_header> parse_packet_header(std::string_view packet) {
+    if (packet.size() < packet_header_size || !is_framed_packet(packet)) {
+        return std::nullopt;
+    }
+
+    packet_header header;
+    header.opcode = static_cast<uint8_t>(packet[1]);
+    for (size_t i = 2; i < packet_header_size; ++i) {
+        header.seq = header.seq << 8 | static_cast<uint8_t>(packet[i]);
+    }
+    return header;
+}
+
+// Сборка расширенного пакета
+std::string make_packet(uint8_t opcode, uint64_t seq, std::string_view payload) {
+    std::string packet;
+    packet.reserve(packet_header_size + payload.size());
+    packet.push_back(static_cast<char>(packet_marker));
+    packet.push_back(static_cast<char>(opcode));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        packet.push_back(static_cast<char>(seq >> shift & 0xFF));
+    }
+    packet.append(payload);
+    return packet;
+}
+
+// Данные запроса статуса, invalid_argument при пустом или слишком длинном BCD IMSI
+std::string make_status_query(const std::vector<std::vector<uint8_t>>& bcd_imsis) {
+    std::string payload;
+    for (const auto& bcd : bcd_imsis) {
+        if (bcd.empty() || bcd.size() > max_bcd_imsi_size) {
+            throw std::invalid_argument("Неверная длина IMSI в BCD: " + std::to_string(bcd.size()));
+        }
+        payload.push_back(static_cast<char>(bcd.size()));
+        payload.append(bcd.begin(), bcd.end());
+    }
+    return payload;
+}
+
+std::optional<std::vector<std::string_view>> parse_status_query(std::string_view payload) {
+    std::vector<std::string_view> imsis;
+    while (!payload.empty()) {
+        const size_t size = static_cast<uint8_t>(payload[0]);
+        if (size == 0 || size > max_bcd_imsi_size || payload.size() < 1 + size) {
+            return std::nullopt;
+        }
+        imsis.push_back(payload.substr(1, size));
+        payload.remove_prefix(1 + size);
+    }
+    return imsis;
+}
+
+std::string make_status_bitmap(const std::vector<bool>& active) {
+    std::string bitmap((active.size() + 7) / 8, '\0');
+    for (size_t i = 0; i < active.size(); ++i) {
+        if (active[i]) {
+            bitmap[i / 8] = static_cast<char>(static_cast<uint8_t>(bitmap[i / 8]) | 0x80 >> i % 8);
+        }
+    }
+    return bitmap;
+}
+
+bool status_bit(std::string_view bitmap, size_t index) {
+    return index / 8 < bitmap.size() && (static_cast<uint8_t>(bitmap[index / 8]) & 0x80 >> index % 8) != 0;
+}
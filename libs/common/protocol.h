@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Расширенный формат UDP пакета. Обычный запрос - это просто IMSI в BCD.
+// Расширенный начинается с байта 0xFF, который невозможен в BCD IMSI (младшая тетрада - цифра),
+// за ним код операции и 64-битный номер запроса (big endian), дальше данные операции.
+constexpr uint8_t packet_marker = 0xFF;
+constexpr size_t packet_header_size = 10;
+
+// Коды операций, у ответа установлен старший бит
+constexpr uint8_t opcode_create = 0x01;           // создание сессии, данные - IMSI в BCD
+constexpr uint8_t opcode_forwarded_create = 0x02; // создание, пересланное другим узлом кластера
+constexpr uint8_t opcode_status = 0x03;           // проверка сессий, данные - список IMSI, ответ - битовая карта
+constexpr uint8_t opcode_response_flag = 0x80;
+
+struct packet_header {
+    uint8_t opcode{};
+    uint64_t seq{};
+};
+
+bool is_framed_packet(std::string_view packet);
+std::optional<packet_header> parse_packet_header(std::string_view packet);
+std::string make_packet(uint8_t opcode, uint64_t seq, std::string_view payload);
+
+// Данные запроса статуса: для каждого IMSI байт длины (1 - 8) и IMSI в BCD.
+// Данные ответа: по биту на IMSI в порядке запроса, IMSI 0 - старший бит первого байта, 1 - сессия активна
+constexpr size_t max_bcd_imsi_size = 8;
+
+std::string make_status_query(const std::vector<std::vector<uint8_t>>& bcd_imsis);
+// BCD IMSI из данных запроса, указывают в payload. nullopt при неверной длине
+std::optional<std::vector<std::string_view>> parse_status_query(std::string_view payload);
+std::string make_status_bitmap(const std::vector<bool>& active);
+bool status_bit(std::string_view bitmap, size_t index);
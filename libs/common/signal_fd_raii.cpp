@@ -0,0 +1,59 @@
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "signal_fd_raii.h"
+#include "spdlog/spdlog.h"
+
+signal_fd_raii::signal_fd_raii(std::initializer_list<int> signals) : fd_(-1) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int sig : signals) {
+        sigaddset(&mask, sig);
+    }
+
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        throw std::runtime_error("Не удалось заблокировать сигналы");
+    }
+    fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("Не удалось создать signalfd: ") + strerror(errno));
+    }
+}
+
+signal_fd_raii::~signal_fd_raii() {
+    if (fd_ >= 0) {
+        close(fd_);
+        spdlog::debug("signalfd {} закрыт", fd_);
+    }
+}
+
+signal_fd_raii::signal_fd_raii(signal_fd_raii &&other) noexcept : fd_(other.fd_) {
+    other.fd_ = -1;
+}
+
+signal_fd_raii& signal_fd_raii::operator=(signal_fd_raii &&other) noexcept {
+    if (this != &other) {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+int signal_fd_raii::get() const {
+    return fd_;
+}
+
+int signal_fd_raii::consume() const {
+    signalfd_siginfo info{};
+    if (read(fd_, &info, sizeof(info)) != sizeof(info)) {
+        return 0;
+    }
+    return static_cast<int>(info.ssi_signo);
+}
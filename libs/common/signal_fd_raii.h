@@ -0,0 +1,27 @@
+#pragma once
+
+#include <initializer_list>
+
+// signalfd для приёма сигналов событием в epoll вместо асинхронного обработчика.
+// Конструктор блокирует сигналы в вызывающем потоке, поэтому объект создаётся в main
+// до запуска остальных потоков: они наследуют маску и сигналы не перехватывают
+class signal_fd_raii {
+    int fd_;
+
+public:
+    explicit signal_fd_raii(std::initializer_list<int> signals);
+    ~signal_fd_raii();
+
+    // Запрещаем копирование
+    signal_fd_raii(const signal_fd_raii&) = delete;
+    signal_fd_raii& operator=(const signal_fd_raii&) = delete;
+
+    // Разрешаем перемещение
+    signal_fd_raii(signal_fd_raii&& other) noexcept;
+    signal_fd_raii& operator=(signal_fd_raii&& other) noexcept;
+
+    int get() const;
+
+    // Номер пришедшего сигнала, 0 если сигналов нет
+    int consume() const;
+};
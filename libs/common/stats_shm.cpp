@@ -0,0 +1,168 @@
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats_shm.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    constexpr size_t snapshot_words = sizeof(stats_snapshot) / sizeof(uint64_t);
+    constexpr int read_attempts = 100;
+
+    // Копирование по словам через atomic_ref: читатель может читать одновременно с писателем
+    void copy_words(uint64_t* dst, const uint64_t* src, bool atomic_dst) {
+        for (size_t i = 0; i < snapshot_words; ++i) {
+            if (atomic_dst) {
+                std::atomic_ref(dst[i]).store(src[i], std::memory_order_relaxed);
+            } else {
+                dst[i] = std::atomic_ref(const_cast<uint64_t&>(src[i])).load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Сегмент с тем же именем оставлен завершившимся сервером: заголовок заполнен, процесса pid больше нет.
+    // Сегмент работающего сервера, недозаполненный или чужой не считается брошенным
+    bool is_abandoned_segment(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st{};
+        int64_t pid = 0;
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(stats_shm_segment))) {
+            void* data = mmap(nullptr, sizeof(stats_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                auto* segment = static_cast<stats_shm_segment*>(data);
+                if (std::atomic_ref(segment->magic).load(std::memory_order_acquire) == stats_shm_magic) {
+                    pid = segment->pid;
+                }
+                munmap(data, sizeof(stats_shm_segment));
+            }
+        }
+        close(fd);
+        return pid > 0 && kill(static_cast<pid_t>(pid), 0) < 0 && errno == ESRCH;
+    }
+}
+
+// Создание сегмента разделяемой памяти
+stats_shm_writer::stats_shm_writer(const std::string &name) : name_(name), segment_(nullptr) {
+    spdlog::debug("stats_shm_writer конструктор, name: {}. Начало функции", name);
+
+    // O_EXCL: второй сервер на той же машине не затирает и не удаляет сегмент первого
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && is_abandoned_segment(name)) {
+        spdlog::warn("Сегмент статистики {} остался от завершившегося процесса и будет пересоздан", name);
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0 && errno == EEXIST) {
+        throw std::runtime_error("Сегмент статистики " + name + " уже занят другим процессом, задайте другой "
+            "stats_shm_name или удалите /dev/shm" + name);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Не удалось создать сегмент статистики " + name + ": " + strerror(errno));
+    }
+    if (ftruncate(fd, sizeof(stats_shm_segment)) < 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Не удалось задать размер сегмента статистики " + name + ": " + strerror(errno));
+    }
+
+    void* data = mmap(nullptr, sizeof(stats_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Не удалось отобразить сегмент статистики " + name + ": " + strerror(errno));
+    }
+
+    segment_ = new (data) stats_shm_segment{};
+    segment_->version = stats_shm_version;
+    segment_->snapshot_size = sizeof(stats_snapshot);
+    segment_->pid = getpid();
+    // magic последним: читатель не примет наполовину заполненный заголовок
+    std::atomic_ref(segment_->magic).store(stats_shm_magic, std::memory_order_release);
+
+    spdlog::info("Статистика публикуется в разделяемой памяти {}", name);
+    spdlog::debug("stats_shm_writer конструктор, name: {}. Конец функции", name);
+}
+
+stats_shm_writer::~stats_shm_writer() {
+    if (segment_) {
+        munmap(segment_, sizeof(stats_shm_segment));
+        shm_unlink(name_.c_str());
+        spdlog::debug("Сегмент статистики {} удалён", name_);
+    }
+}
+
+void stats_shm_writer::publish(const stats_snapshot &snapshot) {
+    const uint64_t seq = segment_->seq.load(std::memory_order_relaxed);
+    segment_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    copy_words(reinterpret_cast<uint64_t*>(&segment_->snapshot), reinterpret_cast<const uint64_t*>(&snapshot), true);
+
+    segment_->seq.store(seq + 2, std::memory_order_release);
+}
+
+// Открытие сегмента, созданного сервером
+stats_shm_reader::stats_shm_reader(const std::string &name) : segment_(nullptr) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Сегмент статистики " + name + " не найден: " + strerror(errno));
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(stats_shm_segment)) {
+        close(fd);
+        throw std::runtime_error("Сегмент статистики " + name + " неполный или другой версии");
+    }
+
+    void* data = mmap(nullptr, sizeof(stats_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Не удалось отобразить сегмент статистики " + name + ": " + strerror(errno));
+    }
+
+    segment_ = static_cast<const stats_shm_segment*>(data);
+    const uint64_t magic = std::atomic_ref(const_cast<uint64_t&>(segment_->magic)).load(std::memory_order_acquire);
+    if (magic != stats_shm_magic || segment_->version != stats_shm_version
+        || segment_->snapshot_size != sizeof(stats_snapshot)) {
+        munmap(data, sizeof(stats_shm_segment));
+        segment_ = nullptr;
+        throw std::runtime_error("Сегмент статистики " + name + " другой версии, ожидается версия "
+            + std::to_string(stats_shm_version));
+    }
+}
+
+stats_shm_reader::~stats_shm_reader() {
+    if (segment_) {
+        munmap(const_cast<stats_shm_segment*>(segment_), sizeof(stats_shm_segment));
+    }
+}
+
+std::optional<stats_snapshot> stats_shm_reader::read() const {
+    stats_snapshot snapshot;
+    for (int attempt = 0; attempt < read_attempts; ++attempt) {
+        const uint64_t before = segment_->seq.load(std::memory_order_acquire);
+        if (before % 2 == 1) {
+            continue;
+        }
+
+        copy_words(reinterpret_cast<uint64_t*>(&snapshot), reinterpret_cast<const uint64_t*>(&segment_->snapshot),
+            false);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment_->seq.load(std::memory_order_relaxed) == before) {
+            return snapshot;
+        }
+    }
+    return std::nullopt;
+}
+
+int64_t stats_shm_reader::pid() const {
+    return segment_->pid;
+}
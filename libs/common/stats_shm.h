@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Живые счётчики сервера в разделяемой памяти (/dev/shm/<имя>).
+// Сервер периодически публикует снимок под seqlock, читатель (pgw_top) берёт согласованную
+// копию без системных вызовов и без участия сервера. При несовместимом изменении
+// структуры увеличивается stats_shm_version.
+constexpr uint64_t stats_shm_magic = 0x5354415453574750; // "PGWSTATS"
+constexpr uint32_t stats_shm_version = 1;
+constexpr size_t stats_shm_max_threads = 8;
+
+// Нагрузка потока или группы потоков сервера
+struct stats_thread_load {
+    std::array<char, 16> name{};
+    uint64_t busy_ns{};  // время в работе с запуска сервера
+    uint64_t handled{};  // обработано пакетов или запросов
+};
+
+// Снимок счётчиков. Только целые и символы без указателей: копируется по 8 байт
+struct stats_snapshot {
+    uint64_t timestamp_ns{};        // steady_clock сервера на момент публикации
+    uint64_t start_timestamp_ns{};  // steady_clock при запуске сервера
+    uint64_t udp_requests{};
+    uint64_t http_requests{};
+    uint64_t created{};
+    uint64_t rejected_blacklist{};
+    uint64_t rejected_duplicate{};
+    uint64_t rejected_limit{};
+    uint64_t evicted{};
+    uint64_t expired{};
+    uint64_t active_sessions{};
+    uint64_t max_sessions{};
+    uint64_t expiry_backlog{};      // сессии старше таймаута, которые ещё не удалены
+    uint64_t cdr_queue_depth{};     // записи CDR, ждущие файла
+    uint64_t retransmit_hits{};
+    uint64_t thread_count{};
+    std::array<stats_thread_load, stats_shm_max_threads> threads{};
+};
+
+static_assert(sizeof(stats_snapshot) % sizeof(uint64_t) == 0);
+
+// Заголовок и данные сегмента
+struct stats_shm_segment {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t snapshot_size;
+    int64_t pid;
+    std::atomic<uint64_t> seq;  // нечётное значение - снимок в процессе записи
+    stats_snapshot snapshot;
+};
+
+// Создаёт сегмент и удаляет его при разрушении
+class stats_shm_writer {
+    std::string name_;
+    stats_shm_segment* segment_;
+
+public:
+    explicit stats_shm_writer(const std::string& name);
+    ~stats_shm_writer();
+
+    // Запрещаем копирование
+    stats_shm_writer(const stats_shm_writer&) = delete;
+    stats_shm_writer& operator=(const stats_shm_writer&) = delete;
+
+    // Вызывать из одного потока
+    void publish(const stats_snapshot& snapshot);
+};
+
+// Открывает сегмент только для чтения, после конструктора системных вызовов нет
+class stats_shm_reader {
+    const stats_shm_segment* segment_;
+
+public:
+    explicit stats_shm_reader(const std::string& name);
+    ~stats_shm_reader();
+
+    // Запрещаем копирование
+    stats_shm_reader(const stats_shm_reader&) = delete;
+    stats_shm_reader& operator=(const stats_shm_reader&) = delete;
+
+    // Согласованный снимок, nullopt если писатель всё время был посреди записи
+    std::optional<stats_snapshot> read() const;
+    int64_t pid() const;
+};
@@ -0,0 +1,63 @@
+#include <cstring>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "timer_fd_raii.h"
+#include "spdlog/spdlog.h"
+
+timer_fd_raii::timer_fd_raii(std::chrono::nanoseconds period)
+    : fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("Не удалось создать timerfd: ") + strerror(errno));
+    }
+    if (period <= std::chrono::nanoseconds::zero()) {
+        close(fd_);
+        throw std::invalid_argument("Период таймера должен быть положительным");
+    }
+
+    itimerspec spec{};
+    spec.it_interval.tv_sec = static_cast<time_t>(period.count() / 1'000'000'000);
+    spec.it_interval.tv_nsec = static_cast<long>(period.count() % 1'000'000'000);
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(fd_, 0, &spec, nullptr) < 0) {
+        const std::string error = strerror(errno);
+        close(fd_);
+        throw std::runtime_error("Не удалось запустить timerfd: " + error);
+    }
+}
+
+timer_fd_raii::~timer_fd_raii() {
+    if (fd_ >= 0) {
+        close(fd_);
+        spdlog::debug("timerfd {} закрыт", fd_);
+    }
+}
+
+timer_fd_raii::timer_fd_raii(timer_fd_raii &&other) noexcept : fd_(other.fd_) {
+    other.fd_ = -1;
+}
+
+timer_fd_raii& timer_fd_raii::operator=(timer_fd_raii &&other) noexcept {
+    if (this != &other) {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+int timer_fd_raii::get() const {
+    return fd_;
+}
+
+uint64_t timer_fd_raii::consume() const {
+    uint64_t expirations = 0;
+    if (read(fd_, &expirations, sizeof(expirations)) < 0) {
+        return 0;
+    }
+    return expirations;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Периодический таймер timerfd на CLOCK_MONOTONIC: срабатывания приходят событием EPOLLIN,
+// поток не просыпается между ними. Первое срабатывание через period после создания
+class timer_fd_raii {
+    int fd_;
+
+public:
+    explicit timer_fd_raii(std::chrono::nanoseconds period);
+    ~timer_fd_raii();
+
+    // Запрещаем копирование
+    timer_fd_raii(const timer_fd_raii&) = delete;
+    timer_fd_raii& operator=(const timer_fd_raii&) = delete;
+
+    // Разрешаем перемещение
+    timer_fd_raii(timer_fd_raii&& other) noexcept;
+    timer_fd_raii& operator=(timer_fd_raii&& other) noexcept;
+
+    int get() const;
+
+    // Число срабатываний с прошлого вызова, больше одного - обработчик не успевал
+    uint64_t consume() const;
+};
@@ -0,0 +1,350 @@
+#include <arpa/inet.h>
+#include <cstring>
+#include <random>
+#include <sys/epoll.h>
+
+#include "async_client.h"
+#include "bcd.h"
+#include "protocol.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    // Сколько датаграмм передаётся ядру за один sendmmsg/recvmmsg
+    constexpr size_t mmsg_batch = 64;
+
+    void watch(const epoll_raii& epoll, int fd) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll.get(), EPOLL_CTL_ADD, fd, &event) < 0) {
+            throw std::runtime_error(std::string("Не удалось добавить fd в epoll: ") + strerror(errno));
+        }
+    }
+}
+
+// Конструктор клиента: сокет привязан к адресу сервера, ответы от других адресов ядро не пропускает
+async_client::async_client(const client_config &config)
+: config_(config), fd_(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) {
+    spdlog::debug("async_client конструктор. Начало функции");
+
+    if (fd_.get() < 0) {
+        throw std::runtime_error(std::string("Не удалось создать UDP сокет: ") + strerror(errno));
+    }
+
+    sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config_.server_port);
+    if (inet_pton(AF_INET, config_.server_ip.c_str(), &server_addr.sin_addr) <= 0) {
+        throw std::runtime_error("Неправильный IP адрес " + config_.server_ip);
+    }
+    if (connect(fd_.get(), reinterpret_cast<sockaddr*>(&server_addr), sizeof(server_addr)) < 0) {
+        throw std::runtime_error(std::string("Не удалось привязать сокет к серверу: ") + strerror(errno));
+    }
+
+    watch(epoll_, fd_.get());
+    watch(epoll_, wakeup_.get());
+    watch(epoll_, stop_.get());
+
+    // Случайный первый номер: новый клиент на том же порту не получит ответ из кэша ретрансмитов,
+    // сохранённый сервером для прошлого клиента
+    std::random_device random;
+    next_seq_ = static_cast<uint64_t>(random()) << 32 | random();
+    rx_buffers_.resize(mmsg_batch * config_.udp_buffer_size);
+
+    thread_ = std::jthread([this] { run(); });
+
+    spdlog::info("Клиент PGW {}:{}: повтор через {} мс (x{}), дедлайн {} с, в полёте до {} запросов",
+        config_.server_ip, config_.server_port, config_.retransmit_interval_ms, config_.retransmit_backoff,
+        config_.udp_timer_sec, config_.max_in_flight);
+    spdlog::debug("async_client конструктор. Конец функции");
+}
+
+async_client::~async_client() {
+    spdlog::debug("async_client деструктор. Начало функции");
+
+    stop_.notify();
+    thread_.join();
+
+    std::map<uint64_t, pending_request> pending;
+    {
+        std::lock_guard lock(mutex_);
+        pending.swap(pending_);
+        timers_.clear();
+    }
+    space_cv_.notify_all();
+
+    const auto now = clock::now();
+    for (auto &[seq, request] : pending) {
+        request.on_done({request.imsi, client_status::closed, {}, request.attempts, now - request.started});
+    }
+
+    spdlog::debug("async_client деструктор. Конец функции, прервано запросов: {}", pending.size());
+}
+
+// Таймер запроса - ближайшее из повтора и дедлайна. Вызывается под mutex_
+void async_client::arm_locked(uint64_t seq, const pending_request &request) {
+    timers_.emplace(std::min(request.next_send, request.deadline), seq);
+}
+
+void async_client::disarm_locked(uint64_t seq, const pending_request &request) {
+    timers_.erase({std::min(request.next_send, request.deadline), seq});
+}
+
+void async_client::send(const std::string &imsi, callback on_done) {
+    std::vector<callback> callbacks;
+    callbacks.push_back(std::move(on_done));
+    submit({imsi}, std::move(callbacks));
+}
+
+std::future<client_result> async_client::send(const std::string &imsi) {
+    auto promise = std::make_shared<std::promise<client_result>>();
+    std::future<client_result> future = promise->get_future();
+    send(imsi, [promise](const client_result &result) {
+        promise->set_value(result);
+    });
+    return future;
+}
+
+void async_client::send_batch(const std::vector<std::string> &imsis, const callback &on_done) {
+    submit(imsis, std::vector(imsis.size(), on_done));
+}
+
+std::vector<std::future<client_result>> async_client::send_batch(const std::vector<std::string> &imsis) {
+    std::vector<std::future<client_result>> futures;
+    std::vector<callback> callbacks;
+    futures.reserve(imsis.size());
+    callbacks.reserve(imsis.size());
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        auto promise = std::make_shared<std::promise<client_result>>();
+        futures.push_back(promise->get_future());
+        callbacks.emplace_back([promise](const client_result &result) {
+            promise->set_value(result);
+        });
+    }
+    submit(imsis, std::move(callbacks));
+    return futures;
+}
+
+// Регистрация и отправка запросов, callbacks[i] - для imsis[i]
+void async_client::submit(const std::vector<std::string> &imsis, std::vector<callback> callbacks) {
+    // Кодирование до регистрации: неверный IMSI бросает исключение, ничего не отправив
+    std::vector<std::vector<uint8_t>> bcds;
+    bcds.reserve(imsis.size());
+    for (const std::string &imsi : imsis) {
+        bcds.push_back(imsi_to_bcd(imsi));
+    }
+
+    const size_t max_in_flight = config_.max_in_flight;
+    size_t next = 0;
+    while (next < imsis.size()) {
+        std::vector<std::string> packets;
+        bool wake = false;
+        {
+            std::unique_lock lock(mutex_);
+            space_cv_.wait(lock, [this, max_in_flight] { return pending_.size() < max_in_flight; });
+
+            const size_t count = std::min(imsis.size() - next, max_in_flight - pending_.size());
+            const auto now = clock::now();
+            const auto interval = std::chrono::milliseconds(config_.retransmit_interval_ms);
+            for (size_t i = next; i < next + count; ++i) {
+                const uint64_t seq = next_seq_++;
+                const std::string_view bcd(reinterpret_cast<const char*>(bcds[i].data()), bcds[i].size());
+                pending_request request{imsis[i], make_packet(opcode_create, seq, bcd), std::move(callbacks[i]),
+                    now, now + std::chrono::seconds(config_.udp_timer_sec), now + interval, interval, 1};
+                packets.push_back(request.packet);
+
+                // Поток клиента спит до ближайшего таймера, более ранний новый таймер его будит
+                const auto due = std::min(request.next_send, request.deadline);
+                wake = wake || timers_.empty() || due < timers_.begin()->first;
+                arm_locked(seq, request);
+                pending_.emplace(seq, std::move(request));
+            }
+            next += count;
+        }
+
+        sent_.fetch_add(packets.size(), std::memory_order_relaxed);
+        if (wake) {
+            wakeup_.notify();
+        }
+        send_packets(packets);
+    }
+}
+
+// Отправка пачками sendmmsg. Что не ушло из-за переполненного буфера сокета, уйдёт повтором по таймеру
+void async_client::send_packets(const std::vector<std::string> &packets) {
+    for (size_t begin = 0; begin < packets.size();) {
+        const size_t count = std::min(mmsg_batch, packets.size() - begin);
+        iovec iov[mmsg_batch];
+        mmsghdr msgs[mmsg_batch]{};
+        for (size_t i = 0; i < count; ++i) {
+            iov[i] = {const_cast<char*>(packets[begin + i].data()), packets[begin + i].size()};
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int sent = sendmmsg(fd_.get(), msgs, count, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == ENOBUFS) {
+                spdlog::debug("Буфер сокета заполнен, {} запросов уйдут повтором", packets.size() - begin);
+            } else {
+                spdlog::error("Не удалось отправить запросы: {}", strerror(errno));
+            }
+            return;
+        }
+        begin += sent;
+    }
+}
+
+// Цикл потока клиента: ответы сервера, таймеры повторов и дедлайнов, остановка
+void async_client::run() {
+    while (true) {
+        int timeout_ms = -1;
+        {
+            std::lock_guard lock(mutex_);
+            if (!timers_.empty()) {
+                const auto wait = timers_.begin()->first - clock::now();
+                timeout_ms = static_cast<int>(std::max<int64_t>(0,
+                    std::chrono::ceil<std::chrono::milliseconds>(wait).count()));
+            }
+        }
+
+        epoll_event events[3];
+        const int n_events = epoll_wait(epoll_.get(), events, 3, timeout_ms);
+        if (n_events < 0 && errno != EINTR) {
+            spdlog::critical("Ошибка epoll_wait в клиенте: {}", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n_events; i++) {
+            if (events[i].data.fd == stop_.get()) {
+                return;
+            }
+            if (events[i].data.fd == wakeup_.get()) {
+                wakeup_.consume();
+            } else if (events[i].data.fd == fd_.get()) {
+                receive();
+            }
+        }
+        fire_timers();
+    }
+}
+
+void async_client::receive() {
+    while (true) {
+        iovec iov[mmsg_batch];
+        mmsghdr msgs[mmsg_batch]{};
+        for (size_t i = 0; i < mmsg_batch; ++i) {
+            iov[i] = {rx_buffers_.data() + i * config_.udp_buffer_size, static_cast<size_t>(config_.udp_buffer_size)};
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int received = recvmmsg(fd_.get(), msgs, mmsg_batch, 0, nullptr);
+        if (received < 0) {
+            // Сервер недоступен: ICMP port unreachable приходит ошибкой сокета, запросы ждут повтора
+            if (errno == ECONNREFUSED || errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                spdlog::error("Ошибка recvmmsg: {}", strerror(errno));
+            }
+            return;
+        }
+
+        std::vector<std::pair<callback, client_result>> done;
+        {
+            std::lock_guard lock(mutex_);
+            const auto now = clock::now();
+            for (int i = 0; i < received; ++i) {
+                const std::string_view reply(static_cast<const char*>(iov[i].iov_base), msgs[i].msg_len);
+                const auto header = parse_packet_header(reply);
+                if (!header || header->opcode != (opcode_create | opcode_response_flag)) {
+                    spdlog::warn("Получен ответ неизвестного формата длиной {} байт", reply.size());
+                    unmatched_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                auto it = pending_.find(header->seq);
+                if (it == pending_.end()) {
+                    // Ответ на повтор, когда первый ответ уже получен, или после дедлайна
+                    spdlog::debug("Ответ на запрос {} без ожидающего запроса", header->seq);
+                    unmatched_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                pending_request &request = it->second;
+                disarm_locked(it->first, request);
+                done.emplace_back(std::move(request.on_done), client_result{std::move(request.imsi), client_status::ok,
+                    std::string(reply.substr(packet_header_size)), request.attempts, now - request.started});
+                pending_.erase(it);
+            }
+        }
+
+        replies_.fetch_add(done.size(), std::memory_order_relaxed);
+        if (!done.empty()) {
+            space_cv_.notify_all();
+        }
+        for (auto &[on_done, result] : done) {
+            on_done(result);
+        }
+    }
+}
+
+void async_client::fire_timers() {
+    std::vector<std::string> packets;
+    std::vector<std::pair<callback, client_result>> done;
+    {
+        std::lock_guard lock(mutex_);
+        const auto now = clock::now();
+        while (!timers_.empty() && timers_.begin()->first <= now) {
+            const uint64_t seq = timers_.begin()->second;
+            timers_.erase(timers_.begin());
+            auto it = pending_.find(seq);
+            pending_request &request = it->second;
+
+            if (request.deadline <= now) {
+                spdlog::warn("Нет ответа на запрос imsi {} за {} с, отправок: {}", request.imsi,
+                    config_.udp_timer_sec, request.attempts);
+                done.emplace_back(std::move(request.on_done), client_result{std::move(request.imsi),
+                    client_status::timeout, {}, request.attempts, now - request.started});
+                pending_.erase(it);
+                continue;
+            }
+
+            // Повтор с тем же номером, следующий интервал длиннее
+            packets.push_back(request.packet);
+            ++request.attempts;
+            request.interval = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                request.interval * config_.retransmit_backoff);
+            request.next_send = now + request.interval;
+            arm_locked(seq, request);
+        }
+    }
+
+    retransmits_.fetch_add(packets.size(), std::memory_order_relaxed);
+    timeouts_.fetch_add(done.size(), std::memory_order_relaxed);
+    send_packets(packets);
+    if (!done.empty()) {
+        space_cv_.notify_all();
+    }
+    for (auto &[on_done, result] : done) {
+        on_done(result);
+    }
+}
+
+client_stats async_client::stats() {
+    client_stats stats;
+    stats.sent = sent_.load(std::memory_order_relaxed);
+    stats.retransmits = retransmits_.load(std::memory_order_relaxed);
+    stats.replies = replies_.load(std::memory_order_relaxed);
+    stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+    stats.unmatched = unmatched_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard lock(mutex_);
+        stats.in_flight = pending_.size();
+    }
+    return stats;
+}
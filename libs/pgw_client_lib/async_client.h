@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "epoll_raii.h"
+#include "event_fd_raii.h"
+#include "socket_raii.h"
+
+// Итог запроса
+enum class client_status : uint8_t {
+    ok = 1,       // получен ответ сервера
+    timeout = 2,  // ответа нет до дедлайна, с учётом всех повторов
+    closed = 3    // клиент уничтожен раньше, чем пришёл ответ
+};
+
+struct client_result {
+    std::string imsi;
+    client_status status{};
+    std::string response;               // "created" или "rejected" при status ok
+    uint32_t attempts{};                // отправок, включая повторы
+    std::chrono::nanoseconds latency{}; // от первой отправки до ответа или дедлайна
+};
+
+// Счётчики клиента
+struct client_stats {
+    uint64_t sent{};          // запросы, без повторов
+    uint64_t retransmits{};
+    uint64_t replies{};
+    uint64_t timeouts{};
+    uint64_t unmatched{};     // ответы без запроса: опоздавшие после дедлайна или чужие
+    size_t in_flight{};
+};
+
+// Асинхронный UDP клиент PGW: много запросов одновременно через один сокет.
+// Запросы идут в расширенном формате (protocol.h) с номером, ответ находит свой запрос по номеру,
+// поэтому порядок ответов не важен. Запрос без ответа отправляется повторно с тем же номером
+// через retransmit_interval_ms, каждый следующий интервал в retransmit_backoff раз длиннее;
+// сервер отвечает на повтор из кэша ретрансмитов, сессия не создаётся дважды.
+// Через udp_timer_sec после первой отправки запрос завершается с client_status::timeout.
+// Обратные вызовы выполняются в потоке клиента и не должны надолго его задерживать.
+// Пока в полёте max_in_flight запросов, отправка ждёт освобождения места
+class async_client {
+public:
+    using callback = std::function<void(const client_result&)>;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct pending_request {
+        std::string imsi;
+        std::string packet;
+        callback on_done;
+        clock::time_point started;
+        clock::time_point deadline;
+        clock::time_point next_send;
+        std::chrono::nanoseconds interval;
+        uint32_t attempts{};
+    };
+
+    client_config config_;
+    socket_raii fd_;
+    epoll_raii epoll_;
+    event_fd_raii wakeup_;
+    event_fd_raii stop_;
+
+    std::mutex mutex_;
+    std::condition_variable space_cv_;
+    std::map<uint64_t, pending_request> pending_;
+    std::set<std::pair<clock::time_point, uint64_t>> timers_; // ближайший повтор или дедлайн
+    uint64_t next_seq_;
+    std::vector<char> rx_buffers_;  // только поток клиента
+
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> retransmits_{0};
+    std::atomic<uint64_t> replies_{0};
+    std::atomic<uint64_t> timeouts_{0};
+    std::atomic<uint64_t> unmatched_{0};
+
+    // Объявлен последним: останавливается до уничтожения остальных полей
+    std::jthread thread_;
+
+    void submit(const std::vector<std::string>& imsis, std::vector<callback> callbacks);
+    void run();
+    void receive();
+    void fire_timers();
+    void send_packets(const std::vector<std::string>& packets);
+    void arm_locked(uint64_t seq, const pending_request& request);
+    void disarm_locked(uint64_t seq, const pending_request& request);
+public:
+    explicit async_client(const client_config& config);
+    // Незавершённые запросы получают client_status::closed
+    ~async_client();
+
+    async_client(const async_client&) = delete;
+    async_client& operator=(const async_client&) = delete;
+
+    void send(const std::string& imsi, callback on_done);
+    std::future<client_result> send(const std::string& imsi);
+
+    // Пакет запросов одним sendmmsg, on_done вызывается для каждого запроса
+    void send_batch(const std::vector<std::string>& imsis, const callback& on_done);
+    std::vector<std::future<client_result>> send_batch(const std::vector<std::string>& imsis);
+
+    client_stats stats();
+};
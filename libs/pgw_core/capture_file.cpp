@@ -0,0 +1,142 @@
+#include <cstring>
+
+#include "capture_file.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    constexpr size_t magic_size = sizeof(capture_magic) - 1;
+    constexpr size_t write_buffer_size = 1 << 20;
+
+    void put_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    std::optional<uint64_t> get_varint(std::istream& in) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const int byte = in.get();
+            if (byte == std::char_traits<char>::eof()) {
+                return std::nullopt;
+            }
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+}
+
+// Создание файла захвата, старое содержимое перезаписывается
+capture_writer::capture_writer(const std::string &path) : buffer_(write_buffer_size) {
+    spdlog::debug("capture_writer конструктор, path: {}. Начало функции", path);
+
+    file_.rdbuf()->pubsetbuf(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        spdlog::critical("Не удалось открыть файл захвата: {}", path);
+        throw std::runtime_error("Не удалось открыть файл захвата: " + path);
+    }
+
+    file_.write(capture_magic, magic_size);
+    file_.put(static_cast<char>(capture_version >> 8));
+    file_.put(static_cast<char>(capture_version & 0xFF));
+
+    spdlog::info("Входящие UDP пакеты записываются в {}", path);
+    spdlog::debug("capture_writer конструктор, path: {}. Конец функции", path);
+}
+
+capture_writer::~capture_writer() {
+    flush();
+    spdlog::info("Файл захвата закрыт, записано {} пакетов", records_);
+}
+
+void capture_writer::append(int64_t timestamp_ns, const sockaddr_in &addr, std::string_view data) {
+    if (failed_) {
+        return;
+    }
+
+    // Время может идти назад при переводе часов, такие пакеты считаем одновременными
+    const int64_t delta = records_ == 0 ? timestamp_ns : std::max<int64_t>(0, timestamp_ns - last_timestamp_ns_);
+    last_timestamp_ns_ = std::max(last_timestamp_ns_, timestamp_ns);
+
+    std::string record;
+    record.reserve(data.size() + 20);
+    put_varint(record, delta);
+    record.append(reinterpret_cast<const char*>(&addr.sin_addr.s_addr), 4);
+    record.append(reinterpret_cast<const char*>(&addr.sin_port), 2);
+    put_varint(record, data.size());
+    record.append(data);
+
+    file_.write(record.data(), static_cast<std::streamsize>(record.size()));
+    if (file_.fail()) {
+        spdlog::error("Ошибка записи в файл захвата, захват остановлен");
+        failed_ = true;
+        return;
+    }
+    ++records_;
+}
+
+void capture_writer::flush() {
+    if (failed_) {
+        return;
+    }
+    if (!file_.flush()) {
+        spdlog::error("Ошибка записи в файл захвата, захват остановлен");
+        failed_ = true;
+    }
+}
+
+uint64_t capture_writer::records() const {
+    return records_;
+}
+
+// Открытие файла захвата с проверкой заголовка
+capture_reader::capture_reader(const std::string &path) {
+    file_.open(path, std::ios::binary);
+    if (!file_.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл захвата: " + path);
+    }
+
+    char header[magic_size + 2];
+    if (!file_.read(header, sizeof(header)) || memcmp(header, capture_magic, magic_size) != 0) {
+        throw std::runtime_error("Файл " + path + " не является файлом захвата pgw");
+    }
+
+    const uint16_t version = static_cast<uint8_t>(header[magic_size]) << 8 | static_cast<uint8_t>(header[magic_size + 1]);
+    if (version != capture_version) {
+        throw std::runtime_error("Неподдерживаемая версия файла захвата: " + std::to_string(version));
+    }
+}
+
+std::optional<captured_datagram> capture_reader::next() {
+    auto delta = get_varint(file_);
+    if (!delta) {
+        return std::nullopt;
+    }
+
+    captured_datagram datagram;
+    datagram.addr.sin_family = AF_INET;
+    char addr[6];
+    auto length = file_.read(addr, sizeof(addr)) ? get_varint(file_) : std::nullopt;
+    if (!length || *length > 65535) {
+        spdlog::warn("Файл захвата обрезан на середине записи");
+        return std::nullopt;
+    }
+    memcpy(&datagram.addr.sin_addr.s_addr, addr, 4);
+    memcpy(&datagram.addr.sin_port, addr + 4, 2);
+
+    datagram.data.resize(*length);
+    if (!file_.read(datagram.data.data(), static_cast<std::streamsize>(*length))) {
+        spdlog::warn("Файл захвата обрезан на середине записи");
+        return std::nullopt;
+    }
+
+    last_timestamp_ns_ += static_cast<int64_t>(*delta);
+    datagram.timestamp_ns = last_timestamp_ns_;
+    return datagram;
+}
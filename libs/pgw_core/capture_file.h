@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+// Файл захвата UDP трафика для воспроизведения в pgw_replay.
+// Заголовок: "PGWCAP" и версия (u16 big endian). Дальше записи подряд:
+// varint разница времени приёма с прошлой записью (нс, у первой - время от эпохи) |
+// 4 байта IPv4 и 2 байта порта отправителя (сетевой порядок) | varint длина | данные
+constexpr char capture_magic[] = "PGWCAP";
+constexpr uint16_t capture_version = 1;
+
+struct captured_datagram {
+    int64_t timestamp_ns{};  // CLOCK_REALTIME приёма
+    sockaddr_in addr{};
+    std::string data;
+};
+
+// Как часто сервер сбрасывает буфер захвата в файл. При падении или SIGKILL теряются только пакеты
+// последнего интервала и не больше 1 МиБ: заполненный буфер уходит в файл сразу
+constexpr std::chrono::milliseconds capture_flush_interval{100};
+
+// Дописывает датаграммы в файл, вызывать из одного потока
+class capture_writer {
+    std::vector<char> buffer_;
+    std::ofstream file_;
+    int64_t last_timestamp_ns_{};
+    uint64_t records_{};
+    bool failed_{};
+
+public:
+    explicit capture_writer(const std::string& path);
+    ~capture_writer();
+
+    void append(int64_t timestamp_ns, const sockaddr_in& addr, std::string_view data);
+    // Передача буфера ядру, после неё записи переживают падение процесса
+    void flush();
+    uint64_t records() const;
+};
+
+class capture_reader {
+    std::ifstream file_;
+    int64_t last_timestamp_ns_{};
+
+public:
+    explicit capture_reader(const std::string& path);
+
+    // Следующая датаграмма, nullopt в конце файла или на обрезанной записи
+    std::optional<captured_datagram> next();
+};
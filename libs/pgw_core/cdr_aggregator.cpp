@@ -0,0 +1,116 @@
+#include <format>
+
+#include "cdr_aggregator.h"
+#include "hash_ring.h"
+#include "spdlog/spdlog.h"
+
+// Конструктор агрегации CDR
+cdr_aggregator::cdr_aggregator(const cdr_aggregation_config &config, std::unique_ptr<cdr_sink> inner,
+    std::shared_ptr<session_clock> clock)
+: config_(config), inner_(std::move(inner)), clock_(std::move(clock)),
+sample_per_million_(static_cast<uint64_t>(config.sample_rate * 1'000'000)) {
+    spdlog::debug("cdr_aggregator конструктор. Начало функции");
+
+    flush_task_ = clock_->schedule_every(std::chrono::seconds(config_.interval_sec), [this] {
+        flush();
+    });
+
+    spdlog::info("Агрегация CDR: интервал {} с, выборка {}, префиксов с полными записями {}",
+        config_.interval_sec, config_.sample_rate, config_.detail_prefixes.size());
+    spdlog::debug("cdr_aggregator конструктор. Конец функции");
+}
+
+cdr_aggregator::~cdr_aggregator() {
+    spdlog::debug("cdr_aggregator деструктор. Начало функции");
+
+    flush_task_.reset();
+    flush();
+
+    spdlog::debug("cdr_aggregator деструктор. Конец функции");
+}
+
+bool cdr_aggregator::detailed(const std::string &imsi) const {
+    for (const auto &prefix : config_.detail_prefixes) {
+        if (imsi.starts_with(prefix)) {
+            return true;
+        }
+    }
+    return hash_ring::hash(imsi) % 1'000'000 < sample_per_million_;
+}
+
+// Событие учитывается в счётчике, полная запись - только для выборки
+void cdr_aggregator::write(const std::string &imsi, const std::string &action) {
+    spdlog::debug("Запись cdr_aggregator, imsi: {}, action: {}. Начало функции", imsi, action);
+
+    const size_t plmn_size = 3 + config_.mnc_digits;
+    {
+        std::lock_guard lock(mutex_);
+        ++counters_[{imsi.substr(0, plmn_size), action}];
+    }
+    events_.fetch_add(1, std::memory_order_relaxed);
+
+    if (detailed(imsi)) {
+        detailed_.fetch_add(1, std::memory_order_relaxed);
+        inner_->write(imsi, action);
+    }
+
+    spdlog::debug("Запись cdr_aggregator, imsi: {}, action: {}. Конец функции", imsi, action);
+}
+
+void cdr_aggregator::write_batch(const std::vector<cdr_event> &events) {
+    const size_t plmn_size = 3 + config_.mnc_digits;
+    {
+        std::lock_guard lock(mutex_);
+        for (const cdr_event &event : events) {
+            ++counters_[{event.imsi.substr(0, plmn_size), event.action}];
+        }
+    }
+    events_.fetch_add(events.size(), std::memory_order_relaxed);
+
+    std::vector<cdr_event> detailed_events;
+    for (const cdr_event &event : events) {
+        if (detailed(event.imsi)) {
+            detailed_events.push_back(event);
+        }
+    }
+    if (!detailed_events.empty()) {
+        detailed_.fetch_add(detailed_events.size(), std::memory_order_relaxed);
+        inner_->write_batch(detailed_events);
+    }
+}
+
+void cdr_aggregator::write_record(const std::string &record) {
+    inner_->write_record(record);
+}
+
+uint64_t cdr_aggregator::pending() const {
+    return inner_->pending();
+}
+
+void cdr_aggregator::flush() {
+    std::map<std::pair<std::string, std::string>, uint64_t> counters;
+    {
+        std::lock_guard lock(mutex_);
+        counters.swap(counters_);
+    }
+    if (counters.empty()) {
+        return;
+    }
+
+    // Запись в приёмник вне мьютекса, чтобы не задерживать обработку запросов
+    for (const auto &[key, count] : counters) {
+        const auto &[plmn, action] = key;
+        inner_->write_record(format_cdr_record("summary",
+            std::format("{},{},{},{}", plmn, action, count, config_.interval_sec)));
+    }
+    summaries_.fetch_add(counters.size(), std::memory_order_relaxed);
+    spdlog::debug("Выпущено {} сводных записей CDR", counters.size());
+}
+
+cdr_aggregation_stats cdr_aggregator::stats() const {
+    cdr_aggregation_stats stats;
+    stats.events = events_.load(std::memory_order_relaxed);
+    stats.detailed = detailed_.load(std::memory_order_relaxed);
+    stats.summaries = summaries_.load(std::memory_order_relaxed);
+    return stats;
+}
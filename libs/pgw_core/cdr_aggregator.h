@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "cdr_sink.h"
+
+// Счётчики агрегации CDR
+struct cdr_aggregation_stats {
+    uint64_t events{};      // все события, попавшие в сводки
+    uint64_t detailed{};    // из них записаны полностью (выборка и detail_prefixes)
+    uint64_t summaries{};   // выпущено сводных записей
+};
+
+// Агрегация перед приёмником CDR. Каждое событие учитывается в счётчике (MCC+MNC, действие)
+// текущего интервала, раз в interval_sec по clock счётчики выпускаются сводными записями:
+//   время,summary,<MCC+MNC>,<действие>,<число событий>,<интервал в секундах>
+// Полные записи пишутся только для абонентов из выборки sample_rate (по хэшу IMSI, поэтому
+// у абонента в выборке видны все его события) и для IMSI с префиксами из detail_prefixes.
+// Сводки считают все события, включая записанные полностью, поэтому итоги по ним не теряются
+class cdr_aggregator : public cdr_sink {
+    cdr_aggregation_config config_;
+    std::unique_ptr<cdr_sink> inner_;
+    std::shared_ptr<session_clock> clock_;
+    uint64_t sample_per_million_;
+
+    std::mutex mutex_;
+    std::map<std::pair<std::string, std::string>, uint64_t> counters_;  // упорядочен для стабильного вывода
+
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> detailed_{0};
+    std::atomic<uint64_t> summaries_{0};
+
+    // Объявлена последней: отменяется до уничтожения счётчиков и приёмника
+    std::unique_ptr<periodic_task> flush_task_;
+
+    bool detailed(const std::string& imsi) const;
+public:
+    cdr_aggregator(const cdr_aggregation_config& config, std::unique_ptr<cdr_sink> inner,
+        std::shared_ptr<session_clock> clock);
+    // Выпускает сводки неполного последнего интервала
+    ~cdr_aggregator() override;
+
+    void write(const std::string& imsi, const std::string& action) override;
+    // Счётчики пакета обновляются под одним захватом мьютекса, полные записи уходят одним пакетом
+    void write_batch(const std::vector<cdr_event>& events) override;
+    // Готовые строки проходят без агрегации
+    void write_record(const std::string& record) override;
+    uint64_t pending() const override;
+
+    // Выпуск сводок за текущий интервал и обнуление счётчиков
+    void flush();
+    cdr_aggregation_stats stats() const;
+};
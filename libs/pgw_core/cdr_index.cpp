@@ -0,0 +1,256 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <span>
+
+#include "cdr_index.h"
+#include "file_mmap_raii.h"
+#include "hash_ring.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    constexpr std::array<char, 8> index_magic = {'P', 'G', 'W', 'C', 'D', 'R', 'I', 'X'};
+    constexpr uint32_t index_version = 1;
+
+    static_assert(sizeof(cdr_index_header) == 16);
+    static_assert(sizeof(cdr_index_entry) % alignof(cdr_index_entry) == 0);
+
+    // IMSI - второе поле записи "время,imsi,действие"
+    std::string_view record_imsi(std::string_view record) {
+        const size_t first = record.find(',');
+        if (first == std::string_view::npos) {
+            return {};
+        }
+        const size_t second = record.find(',', first + 1);
+        return record.substr(first + 1, second == std::string_view::npos ? std::string_view::npos : second - first - 1);
+    }
+
+    std::pair<size_t, size_t> bloom_bits(std::string_view imsi) {
+        const uint64_t h = hash_ring::hash(imsi);
+        return {h % cdr_index_bloom_bits, (h >> 32) % cdr_index_bloom_bits};
+    }
+
+    bool bloom_test(const cdr_index_entry& entry, std::string_view imsi) {
+        const auto [a, b] = bloom_bits(imsi);
+        return (entry.bloom[a / 64] >> (a % 64) & 1) && (entry.bloom[b / 64] >> (b % 64) & 1);
+    }
+
+    bool header_ok(const file_mmap_raii& index) {
+        if (index.size() < sizeof(cdr_index_header)) {
+            return false;
+        }
+        cdr_index_header header{};
+        std::memcpy(&header, index.data(), sizeof(header));
+        return header.magic == index_magic && header.version == index_version
+            && header.block_records == cdr_index_block_records;
+    }
+
+    // Записи индекса, если заголовок совпадает, иначе пустой диапазон
+    std::span<const cdr_index_entry> index_entries(const file_mmap_raii& index) {
+        if (!header_ok(index)) {
+            return {};
+        }
+        const size_t count = (index.size() - sizeof(cdr_index_header)) / sizeof(cdr_index_entry);
+        return {reinterpret_cast<const cdr_index_entry*>(index.data() + sizeof(cdr_index_header)), count};
+    }
+
+    // Данные до последнего перевода строки: недописанная запись в поиск не попадает
+    std::string_view complete_lines(std::string_view data) {
+        const size_t last = data.rfind('\n');
+        return last == std::string_view::npos ? std::string_view{} : data.substr(0, last + 1);
+    }
+}
+
+int64_t parse_cdr_time(std::string_view text) {
+    if (text.size() < 19 || text[4] != '-' || text[7] != '-' || text[10] != ' ' || text[13] != ':' || text[16] != ':') {
+        return -1;
+    }
+
+    auto number = [&text](size_t pos, size_t len) {
+        int value = 0;
+        for (size_t i = pos; i < pos + len; ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                return -1;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return value;
+    };
+
+    const int year = number(0, 4), month = number(5, 2), day = number(8, 2);
+    const int hour = number(11, 2), minute = number(14, 2), second = number(17, 2);
+    if (year < 0 || month < 0 || day < 0 || hour < 0 || minute < 0 || second < 0) {
+        return -1;
+    }
+
+    const std::chrono::year_month_day date{std::chrono::year{year}, std::chrono::month(month), std::chrono::day(day)};
+    if (!date.ok() || hour > 23 || minute > 59 || second > 60) {
+        return -1;
+    }
+    return std::chrono::sys_days(date).time_since_epoch().count() * 86400LL + hour * 3600 + minute * 60 + second;
+}
+
+// Открытие индекса и дочитывание хвоста CDR файла
+cdr_index_writer::cdr_index_writer(const std::string &cdr_path) : index_path_(cdr_path + ".idx") {
+    spdlog::debug("cdr_index_writer конструктор, cdr_path: {}. Начало функции", cdr_path);
+
+    const uint64_t cdr_size = std::filesystem::exists(cdr_path) ? std::filesystem::file_size(cdr_path) : 0;
+    bool valid = false;
+    if (std::filesystem::exists(index_path_)) {
+        uint64_t valid_size = 0;
+        {
+            const file_mmap_raii index(index_path_);
+            const auto entries = index_entries(index);
+            const uint64_t covered = entries.empty() ? 0 : entries.back().end;
+            if (header_ok(index) && covered <= cdr_size) {
+                valid = true;
+                offset_ = covered;
+                valid_size = sizeof(cdr_index_header) + entries.size() * sizeof(cdr_index_entry);
+            }
+        }
+        // Недописанная запись индекса отрезается
+        if (valid && std::filesystem::file_size(index_path_) != valid_size) {
+            std::filesystem::resize_file(index_path_, valid_size);
+        }
+    }
+
+    if (!valid) {
+        spdlog::info("Индекс CDR {} отсутствует или не совпадает с файлом, строится заново", index_path_);
+        std::ofstream create(index_path_, std::ios::binary | std::ios::trunc);
+        const cdr_index_header header{index_magic, index_version, cdr_index_block_records};
+        create.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!create) {
+            throw std::runtime_error("Не удалось создать индекс CDR: " + index_path_);
+        }
+        offset_ = 0;
+    }
+
+    index_.open(index_path_, std::ios::binary | std::ios::app);
+    if (!index_.is_open()) {
+        throw std::runtime_error("Не удалось открыть индекс CDR: " + index_path_);
+    }
+    reset_block();
+
+    // Хвост, записанный после последнего полного блока, попадает в текущий блок
+    if (cdr_size > offset_) {
+        const file_mmap_raii cdr(cdr_path);
+        std::string_view tail = cdr.view().substr(offset_);
+        size_t records = 0;
+        for (size_t end = tail.find('\n'); end != std::string_view::npos; end = tail.find('\n')) {
+            add(tail.substr(0, end));
+            tail.remove_prefix(end + 1);
+            ++records;
+        }
+        // Обрывок записи без перевода строки пропускается, следующая запись допишется после него
+        offset_ += tail.size();
+        spdlog::info("В индекс CDR добавлено {} записей из файла", records);
+    }
+
+    spdlog::debug("cdr_index_writer конструктор. Конец функции");
+}
+
+void cdr_index_writer::reset_block() {
+    block_ = {};
+    block_.min_time = std::numeric_limits<int64_t>::max();
+    block_.max_time = std::numeric_limits<int64_t>::min();
+}
+
+void cdr_index_writer::flush_block() {
+    index_.write(reinterpret_cast<const char*>(&block_), sizeof(block_));
+    index_.flush();
+    if (index_.fail()) {
+        spdlog::error("Ошибка записи в индекс CDR {}", index_path_);
+        index_.clear();
+    }
+    reset_block();
+}
+
+void cdr_index_writer::add(std::string_view record) {
+    if (block_.records == 0) {
+        block_.begin = offset_;
+    }
+
+    const int64_t time = parse_cdr_time(record);
+    if (time >= 0) {
+        block_.min_time = std::min(block_.min_time, time);
+        block_.max_time = std::max(block_.max_time, time);
+    }
+    const auto [a, b] = bloom_bits(record_imsi(record));
+    block_.bloom[a / 64] |= uint64_t{1} << (a % 64);
+    block_.bloom[b / 64] |= uint64_t{1} << (b % 64);
+
+    offset_ += record.size() + 1;
+    block_.end = offset_;
+    if (++block_.records == cdr_index_block_records) {
+        flush_block();
+    }
+}
+
+uint64_t cdr_index_writer::offset() const {
+    return offset_;
+}
+
+cdr_search_result search_cdr(const std::string &cdr_path, const std::string &imsi, int64_t from, int64_t to,
+    size_t limit) {
+    cdr_search_result result;
+    if (!std::filesystem::exists(cdr_path)) {
+        return result;
+    }
+
+    // Сначала CDR файл, потом индекс: блоки индекса, вышедшие за отображённый файл, не используются
+    const file_mmap_raii cdr(cdr_path);
+    const std::string_view data = complete_lines(cdr.view());
+    std::optional<file_mmap_raii> index;
+    if (const std::string index_path = cdr_path + ".idx"; std::filesystem::exists(index_path)) {
+        index.emplace(index_path);
+    }
+    const auto entries = index ? index_entries(*index) : std::span<const cdr_index_entry>{};
+    result.blocks_total = entries.size();
+
+    const std::string needle = ',' + imsi + ',';
+    // false - достигнут limit
+    auto scan = [&](std::string_view block) {
+        for (size_t pos = block.find(needle); pos != std::string_view::npos; pos = block.find(needle, pos + 1)) {
+            const size_t newline = block.rfind('\n', pos);
+            const size_t line_begin = newline == std::string_view::npos ? 0 : newline + 1;
+            if (block.find(',', line_begin) != pos) {
+                continue;   // совпадение не в поле IMSI
+            }
+            const size_t line_end = block.find('\n', pos);
+            const std::string_view line = block.substr(line_begin, line_end - line_begin);
+            const int64_t time = parse_cdr_time(line);
+            if (time < from || time > to) {
+                continue;
+            }
+            if (result.records.size() == limit) {
+                result.truncated = true;
+                return false;
+            }
+            result.records.emplace_back(line);
+        }
+        return true;
+    };
+
+    uint64_t tail_begin = 0;
+    for (const cdr_index_entry &entry : entries) {
+        if (entry.end > data.size() || entry.begin > entry.end) {
+            break;
+        }
+        tail_begin = entry.end;
+
+        const bool has_time = entry.min_time <= entry.max_time;
+        if ((has_time && (entry.max_time < from || entry.min_time > to)) || !bloom_test(entry, imsi)) {
+            continue;
+        }
+        ++result.blocks_scanned;
+        if (!scan(data.substr(entry.begin, entry.end - entry.begin))) {
+            return result;
+        }
+    }
+
+    // Хвост, ещё не попавший в индекс: не больше одного блока, если индекс в порядке
+    scan(data.substr(tail_begin));
+    return result;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Разреженный индекс CDR файла: рядом с logs/cdr.csv лежит logs/cdr.csv.idx.
+// Файл CDR делится на блоки по cdr_index_block_records записей, для каждого блока в индексе
+// хранятся границы в байтах, диапазон времени записей и битовая карта хэшей IMSI (фильтр Блума
+// с двумя хэшами). Поиск читает индекс и сканирует только блоки, которые подходят по времени
+// и по карте, плюс неполный хвост после последнего блока. Оба файла только дописываются.
+// Числа в индексе в порядке байт машины, индекс не переносится между машинами, а пересоздаётся
+inline constexpr uint32_t cdr_index_block_records = 256;
+inline constexpr size_t cdr_index_bloom_bits = 4096;
+
+struct cdr_index_header {
+    std::array<char, 8> magic;      // "PGWCDRIX"
+    uint32_t version;
+    uint32_t block_records;
+};
+
+struct cdr_index_entry {
+    uint64_t begin;                 // смещение первой записи блока в CDR файле
+    uint64_t end;                   // смещение после последней записи
+    int64_t min_time;               // секунды unix (UTC) самой ранней и самой поздней записи
+    int64_t max_time;
+    uint32_t records;
+    uint32_t reserved;
+    std::array<uint64_t, cdr_index_bloom_bits / 64> bloom;
+};
+
+// Время записи CDR "ГГГГ-ММ-ДД ЧЧ:ММ:СС" в секундах unix, -1 если формат не тот
+int64_t parse_cdr_time(std::string_view text);
+
+// Ведение индекса при записи. При открытии дочитывает хвост CDR файла, не попавший в индекс
+// (а при отсутствии или несовпадении индекса строит его заново). Один писатель на файл
+class cdr_index_writer {
+    std::string index_path_;
+    std::ofstream index_;
+    cdr_index_entry block_{};
+    uint64_t offset_{};             // конец CDR файла по данным индекса
+
+    void reset_block();
+    void flush_block();
+public:
+    explicit cdr_index_writer(const std::string& cdr_path);
+
+    // record без перевода строки, в файле он занимает record.size() + 1 байт с текущего конца
+    void add(std::string_view record);
+    uint64_t offset() const;
+};
+
+// Результат поиска
+struct cdr_search_result {
+    std::vector<std::string> records;   // в порядке записи в файл
+    size_t blocks_total{};
+    size_t blocks_scanned{};
+    bool truncated{};                   // упёрлись в limit
+};
+
+// Поиск записей IMSI за [from, to] (секунды unix, включительно) в отображённых в память CDR файле и индексе.
+// Не держит никаких блокировок писателя: видит файлы такими, какими они были на момент вызова
+cdr_search_result search_cdr(const std::string& cdr_path, const std::string& imsi, int64_t from, int64_t to,
+    size_t limit);
@@ -0,0 +1,31 @@
+#include <chrono>
+#include <format>
+
+#include "cdr_aggregator.h"
+#include "cdr_sink.h"
+#include "cdr_stream.h"
+#include "cdr_writer.h"
+
+std::string format_cdr_record(const std::string &imsi, const std::string &action) {
+    return std::format("{:%Y-%m-%d %H:%M:%S}", std::chrono::system_clock::now()) + ',' + imsi + ',' + action;
+}
+
+void cdr_sink::write_batch(const std::vector<cdr_event> &events) {
+    for (const cdr_event &event : events) {
+        write(event.imsi, event.action);
+    }
+}
+
+std::unique_ptr<cdr_sink> make_cdr_sink(const server_config &config, std::shared_ptr<session_clock> clock) {
+    std::unique_ptr<cdr_sink> sink;
+    if (config.cdr_sink.type == "stream") {
+        sink = std::make_unique<stream_cdr_sink>(config.cdr_sink);
+    } else {
+        sink = std::make_unique<cdr_writer>(config.cdr_file);
+    }
+
+    if (config.cdr_aggregation.enabled) {
+        sink = std::make_unique<cdr_aggregator>(config.cdr_aggregation, std::move(sink), std::move(clock));
+    }
+    return sink;
+}
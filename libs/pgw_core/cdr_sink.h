@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "session_clock.h"
+
+// Событие для пакетной записи CDR
+struct cdr_event {
+    std::string imsi;
+    std::string action;
+};
+
+// Приёмник CDR. Запись вызывается из потоков обработки запросов и чистки,
+// поэтому реализация должна быть потокобезопасной и не блокироваться надолго
+class cdr_sink {
+public:
+    virtual ~cdr_sink() = default;
+
+    virtual void write(const std::string& imsi, const std::string& action) = 0;
+    // Готовая строка CDR без перевода строки, например сводная запись агрегации
+    virtual void write_record(const std::string& record) = 0;
+    // Пакет событий одним блоком, в том же порядке. По умолчанию - write для каждого
+    virtual void write_batch(const std::vector<cdr_event>& events);
+
+    // Записи, которые ещё не доставлены
+    virtual uint64_t pending() const = 0;
+};
+
+// Строка CDR без перевода строки: "время,imsi,действие"
+std::string format_cdr_record(const std::string& imsi, const std::string& action);
+
+// Приёмник по секции cdr_sink: файл logs/<cdr_file> или поток на коллектор.
+// С секцией cdr_aggregation перед ним ставится агрегация, интервалы которой отсчитываются по clock
+std::unique_ptr<cdr_sink> make_cdr_sink(const server_config& config, std::shared_ptr<session_clock> clock);
@@ -0,0 +1,645 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cdr_stream.h"
+#include "probes.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    constexpr auto io_timeout = std::chrono::seconds(5);
+    constexpr uint32_t max_frame_size = 64 * 1024 * 1024;
+    constexpr size_t spill_buffer_size = 64 * 1024;
+
+    // Разобранный адрес коллектора: tcp://ip:port или unix:///путь
+    struct endpoint {
+        bool is_unix{};
+        sockaddr_in in{};
+        sockaddr_un un{};
+    };
+
+    endpoint parse_address(const std::string& address) {
+        endpoint ep;
+        if (address.starts_with("unix://")) {
+            const std::string path = address.substr(7);
+            if (path.empty() || path.size() >= sizeof(ep.un.sun_path)) {
+                throw std::runtime_error("Неправильный путь Unix сокета коллектора CDR: " + address);
+            }
+            ep.is_unix = true;
+            ep.un.sun_family = AF_UNIX;
+            std::memcpy(ep.un.sun_path, path.data(), path.size());
+            return ep;
+        }
+
+        if (!address.starts_with("tcp://")) {
+            throw std::runtime_error("Адрес коллектора CDR должен начинаться с tcp:// или unix://: " + address);
+        }
+        const std::string host_port = address.substr(6);
+        const size_t colon = host_port.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::runtime_error("В адресе коллектора CDR нет порта: " + address);
+        }
+
+        int port = -1;
+        try {
+            port = std::stoi(host_port.substr(colon + 1));
+        } catch (const std::exception&) {
+        }
+        if (port < 0 || port > 65535) {
+            throw std::runtime_error("Неправильный порт коллектора CDR: " + address);
+        }
+
+        ep.in.sin_family = AF_INET;
+        ep.in.sin_port = htons(port);
+        if (inet_pton(AF_INET, host_port.substr(0, colon).c_str(), &ep.in.sin_addr) <= 0) {
+            throw std::runtime_error("Неправильный IP адрес коллектора CDR: " + address);
+        }
+        return ep;
+    }
+
+    const sockaddr* endpoint_addr(const endpoint& ep) {
+        return ep.is_unix ? reinterpret_cast<const sockaddr*>(&ep.un) : reinterpret_cast<const sockaddr*>(&ep.in);
+    }
+
+    socklen_t endpoint_len(const endpoint& ep) {
+        return ep.is_unix ? sizeof(ep.un) : sizeof(ep.in);
+    }
+
+    void put_u32(std::string& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>(value >> shift & 0xFF));
+        }
+    }
+
+    uint32_t get_u32(const char* data) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value = value << 8 | static_cast<uint8_t>(data[i]);
+        }
+        return value;
+    }
+
+    bool send_all(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    // С stop_token ожидание прерывается остановкой, без него ограничено таймаутом сокета
+    bool read_exact(int fd, char* data, size_t size, const std::stop_token* stop_token = nullptr) {
+        size_t received = 0;
+        while (received < size) {
+            if (stop_token) {
+                pollfd pfd{fd, POLLIN, 0};
+                int ready = poll(&pfd, 1, 100);
+                if (stop_token->stop_requested()) {
+                    return false;
+                }
+                if (ready == 0 || (ready < 0 && errno == EINTR)) {
+                    continue;
+                }
+                if (ready < 0) {
+                    return false;
+                }
+            }
+            ssize_t n = recv(fd, data + received, size - received, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            received += n;
+        }
+        return true;
+    }
+
+    void set_socket_timeout(int fd, int option, std::chrono::milliseconds timeout) {
+        timeval tv{};
+        tv.tv_sec = timeout.count() / 1000;
+        tv.tv_usec = timeout.count() % 1000 * 1000;
+        setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+    }
+
+    // Записи файла подкачки: u32 длина | строка CDR
+    uint64_t count_spilled(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        uint64_t count = 0;
+        char header[4];
+        while (file.read(header, sizeof(header))) {
+            if (!file.seekg(get_u32(header), std::ios::cur)) {
+                break;
+            }
+            ++count;
+        }
+        return count;
+    }
+}
+
+// Конструктор потокового приёмника CDR
+stream_cdr_sink::stream_cdr_sink(const cdr_sink_config &config)
+: config_(config), spill_path_("logs/" + config.spill_file), sending_path_(spill_path_ + ".sending"), fd_(-1) {
+    spdlog::debug("stream_cdr_sink конструктор, address: {}. Начало функции", config_.address);
+
+    parse_address(config_.address);
+    std::filesystem::create_directories(std::filesystem::path(spill_path_).parent_path());
+
+    // Остатки с прошлого запуска будут отправлены первыми
+    spilled_ = count_spilled(spill_path_) + count_spilled(sending_path_);
+    if (spilled_ > 0) {
+        spdlog::warn("В файле подкачки CDR {} записей с прошлого запуска", spilled_.load());
+    }
+
+    thread_ = std::jthread([this](const std::stop_token &stop_token) {
+        run(stop_token);
+    });
+
+    spdlog::info("CDR отправляются на коллектор {}, пакетами до {} записей", config_.address, config_.batch_size);
+    spdlog::debug("stream_cdr_sink конструктор. Конец функции");
+}
+
+stream_cdr_sink::~stream_cdr_sink() {
+    spdlog::debug("stream_cdr_sink деструктор. Начало функции");
+
+    thread_.request_stop();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    spdlog::debug("stream_cdr_sink деструктор. Конец функции");
+}
+
+// Запись кладётся в буфер, отправляет её поток отправки
+void stream_cdr_sink::write(const std::string &imsi, const std::string &action) {
+    spdlog::debug("Запись stream_cdr_sink, imsi: {}, action: {}. Начало функции", imsi, action);
+
+    PGW_PROBE(cdr_write, imsi.c_str(), action.c_str());
+    write_record(format_cdr_record(imsi, action));
+
+    spdlog::debug("Запись stream_cdr_sink, imsi: {}, action: {}. Конец функции", imsi, action);
+}
+
+void stream_cdr_sink::write_record(const std::string &record) {
+    std::lock_guard lock(mutex_);
+    push_locked(record);
+}
+
+void stream_cdr_sink::write_batch(const std::vector<cdr_event> &events) {
+    std::vector<std::string> records;
+    records.reserve(events.size());
+    for (const cdr_event &event : events) {
+        PGW_PROBE(cdr_write, event.imsi.c_str(), event.action.c_str());
+        records.push_back(format_cdr_record(event.imsi, event.action));
+    }
+
+    std::lock_guard lock(mutex_);
+    for (std::string &record : records) {
+        push_locked(std::move(record));
+    }
+}
+
+// Запись в буфер или, если он полон, в файл подкачки, вызывается под mutex_
+void stream_cdr_sink::push_locked(std::string record) {
+    if (buffer_.size() >= static_cast<size_t>(config_.max_buffered_records)) {
+        spill_locked(record);
+        return;
+    }
+    buffer_.push_back(std::move(record));
+    buffered_.store(buffer_.size(), std::memory_order_relaxed);
+    if (buffer_.size() >= static_cast<size_t>(config_.batch_size)) {
+        cv_.notify_one();
+    }
+}
+
+// Дописывание записи в буфер файла подкачки, вызывается под mutex_. Файл пишется блоками,
+// сброс - в потоке отправки или раз в spill_flush_records записей
+void stream_cdr_sink::spill_locked(const std::string &record) {
+    if (!spill_.is_open()) {
+        spill_buffer_.resize(spill_buffer_size);
+        spill_.rdbuf()->pubsetbuf(spill_buffer_.data(), static_cast<std::streamsize>(spill_buffer_.size()));
+        spill_.open(spill_path_, std::ios::binary | std::ios::app);
+        if (!spill_.is_open()) {
+            spdlog::error("Не удалось открыть файл подкачки CDR {}, запись потеряна: {}", spill_path_, record);
+            return;
+        }
+        spdlog::warn("Буфер CDR заполнен, записи сбрасываются в {}", spill_path_);
+    }
+
+    std::string framed;
+    put_u32(framed, record.size());
+    framed += record;
+    spill_.write(framed.data(), static_cast<std::streamsize>(framed.size()));
+    if (spill_.fail()) {
+        spdlog::error("Ошибка записи в файл подкачки CDR, запись потеряна: {}", record);
+        spill_.clear();
+        return;
+    }
+    spilled_.fetch_add(1, std::memory_order_relaxed);
+    if (++spill_unflushed_ >= spill_flush_records) {
+        flush_spill_locked();
+    }
+}
+
+// Передача буфера файла подкачки ядру, вызывается под mutex_
+void stream_cdr_sink::flush_spill_locked() {
+    if (spill_unflushed_ == 0 || !spill_.is_open()) {
+        return;
+    }
+    if (!spill_.flush()) {
+        spdlog::error("Ошибка записи в файл подкачки CDR, потеряно до {} записей", spill_unflushed_);
+        spilled_.fetch_sub(std::min(spill_unflushed_, spilled_.load(std::memory_order_relaxed)),
+            std::memory_order_relaxed);
+        spill_.clear();
+    }
+    spill_unflushed_ = 0;
+}
+
+bool stream_cdr_sink::connect_collector() {
+    const endpoint ep = parse_address(config_.address);
+    socket_raii fd(socket(ep.is_unix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0));
+    if (fd.get() < 0) {
+        spdlog::error("Не удалось создать сокет для коллектора CDR: {}", strerror(errno));
+        return false;
+    }
+
+    // Неблокирующее подключение, чтобы недоступный коллектор не держал поток дольше интервала переподключения
+    if (connect(fd.get(), endpoint_addr(ep), endpoint_len(ep)) < 0) {
+        if (errno != EINPROGRESS) {
+            spdlog::debug("Коллектор CDR {} недоступен: {}", config_.address, strerror(errno));
+            return false;
+        }
+        pollfd pfd{fd.get(), POLLOUT, 0};
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (poll(&pfd, 1, config_.reconnect_interval_ms) <= 0
+            || getsockopt(fd.get(), SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 || error != 0) {
+            spdlog::debug("Коллектор CDR {} недоступен: {}", config_.address, strerror(error ? error : ETIMEDOUT));
+            return false;
+        }
+    }
+
+    fcntl(fd.get(), F_SETFL, fcntl(fd.get(), F_GETFL) & ~O_NONBLOCK);
+    set_socket_timeout(fd.get(), SO_SNDTIMEO, io_timeout);
+    set_socket_timeout(fd.get(), SO_RCVTIMEO, io_timeout);
+    if (!ep.is_unix) {
+        int nodelay = 1;
+        setsockopt(fd.get(), IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+
+    fd_ = std::move(fd);
+    connected_ = true;
+    connections_.fetch_add(1, std::memory_order_relaxed);
+    spdlog::info("Подключено к коллектору CDR {}", config_.address);
+    return true;
+}
+
+void stream_cdr_sink::disconnect() {
+    if (connected_) {
+        spdlog::warn("Соединение с коллектором CDR {} потеряно, записи копятся в буфере", config_.address);
+    }
+    fd_ = socket_raii(-1);
+    connected_ = false;
+}
+
+// Отправка пакета и ожидание подтверждения
+bool stream_cdr_sink::send_batch(const std::vector<std::string> &records) {
+    std::string frame;
+    put_u32(frame, 0);
+    put_u32(frame, records.size());
+    for (const auto &record : records) {
+        put_u32(frame, record.size());
+        frame += record;
+    }
+    const uint32_t length = frame.size() - 4;
+    for (int i = 0; i < 4; ++i) {
+        frame[i] = static_cast<char>(length >> (24 - i * 8) & 0xFF);
+    }
+
+    char ack[4];
+    const bool ok = send_all(fd_.get(), frame) && read_exact(fd_.get(), ack, sizeof(ack))
+        && get_u32(ack) == records.size();
+    PGW_PROBE(cdr_flush, ok ? 1 : 0);
+    if (!ok) {
+        return false;
+    }
+
+    sent_records_.fetch_add(records.size(), std::memory_order_relaxed);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Отправка файла подкачки. Файл переименовывается, чтобы новые записи шли в свежий файл,
+// и удаляется только после подтверждения всех пакетов. При обрыве отправляется заново целиком
+bool stream_cdr_sink::send_spill() {
+    {
+        std::lock_guard lock(mutex_);
+        if (spill_.is_open()) {
+            flush_spill_locked();
+            spill_.close();
+        }
+        if (!std::filesystem::exists(sending_path_)) {
+            if (!std::filesystem::exists(spill_path_)) {
+                spilled_.store(0, std::memory_order_relaxed);
+                return true;
+            }
+            std::filesystem::rename(spill_path_, sending_path_);
+        }
+    }
+
+    std::ifstream file(sending_path_, std::ios::binary);
+    std::vector<std::string> batch;
+    uint64_t total = 0;
+    char header[4];
+    while (file.read(header, sizeof(header))) {
+        std::string record(get_u32(header), '\0');
+        if (!file.read(record.data(), static_cast<std::streamsize>(record.size()))) {
+            spdlog::warn("Обрезанная запись в конце файла подкачки CDR, пропущена");
+            break;
+        }
+        batch.push_back(std::move(record));
+        if (batch.size() == static_cast<size_t>(config_.batch_size)) {
+            if (!send_batch(batch)) {
+                return false;
+            }
+            total += batch.size();
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        if (!send_batch(batch)) {
+            return false;
+        }
+        total += batch.size();
+    }
+
+    file.close();
+    std::filesystem::remove(sending_path_);
+    const uint64_t spilled = spilled_.load(std::memory_order_relaxed);
+    spilled_.fetch_sub(std::min(total, spilled), std::memory_order_relaxed);
+    spdlog::info("Из файла подкачки отправлено {} записей CDR", total);
+    return true;
+}
+
+// Поток отправки: подключение, файл подкачки, затем пакеты из памяти
+void stream_cdr_sink::run(const std::stop_token &stop_token) {
+    const auto flush_interval = std::chrono::milliseconds(config_.flush_interval_ms);
+    const auto reconnect_interval = std::chrono::milliseconds(config_.reconnect_interval_ms);
+    const auto batch_size = static_cast<size_t>(config_.batch_size);
+
+    auto take_batch = [&](std::vector<std::string> &batch) {
+        while (!buffer_.empty() && batch.size() < batch_size) {
+            batch.push_back(std::move(buffer_.front()));
+            buffer_.pop_front();
+        }
+        in_flight_.store(batch.size(), std::memory_order_relaxed);
+        buffered_.store(buffer_.size(), std::memory_order_relaxed);
+    };
+    auto return_batch = [&](std::vector<std::string> &batch) {
+        std::lock_guard lock(mutex_);
+        for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+            buffer_.push_front(std::move(*it));
+        }
+        in_flight_.store(0, std::memory_order_relaxed);
+        buffered_.store(buffer_.size(), std::memory_order_relaxed);
+    };
+
+    while (!stop_token.stop_requested()) {
+        // Записи, сброшенные в подкачку с прошлого круга, уходят в файл блоком
+        {
+            std::lock_guard lock(mutex_);
+            flush_spill_locked();
+        }
+
+        if (!connected_ && !connect_collector()) {
+            std::unique_lock lock(mutex_);
+            cv_.wait_for(lock, stop_token, reconnect_interval, [] { return false; });
+            continue;
+        }
+
+        if (spilled_.load(std::memory_order_relaxed) > 0 && !send_spill()) {
+            disconnect();
+            continue;
+        }
+
+        std::vector<std::string> batch;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait_for(lock, stop_token, flush_interval, [&] { return buffer_.size() >= batch_size; });
+            take_batch(batch);
+        }
+        if (batch.empty()) {
+            continue;
+        }
+        if (!send_batch(batch)) {
+            return_batch(batch);
+            disconnect();
+            continue;
+        }
+        in_flight_.store(0, std::memory_order_relaxed);
+    }
+
+    // Остановка: всё, что не удалось отправить, остаётся в файле подкачки до следующего запуска
+    if (connected_ && (spilled_.load(std::memory_order_relaxed) == 0 || send_spill())) {
+        while (true) {
+            std::vector<std::string> batch;
+            {
+                std::lock_guard lock(mutex_);
+                take_batch(batch);
+            }
+            if (batch.empty()) {
+                break;
+            }
+            if (!send_batch(batch)) {
+                return_batch(batch);
+                break;
+            }
+            in_flight_.store(0, std::memory_order_relaxed);
+        }
+    }
+    disconnect();
+
+    std::lock_guard lock(mutex_);
+    for (const auto &record : buffer_) {
+        spill_locked(record);
+    }
+    buffer_.clear();
+    buffered_.store(0, std::memory_order_relaxed);
+    flush_spill_locked();
+    spill_.close();
+    if (spilled_.load(std::memory_order_relaxed) > 0) {
+        spdlog::warn("В файле подкачки CDR остались неотправленные записи: {}", spilled_.load());
+    }
+}
+
+uint64_t stream_cdr_sink::pending() const {
+    return buffered_.load(std::memory_order_relaxed) + in_flight_.load(std::memory_order_relaxed)
+        + spilled_.load(std::memory_order_relaxed);
+}
+
+cdr_stream_stats stream_cdr_sink::stats() const {
+    cdr_stream_stats stats;
+    stats.connected = connected_.load();
+    stats.sent_records = sent_records_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.buffered = buffered_.load(std::memory_order_relaxed) + in_flight_.load(std::memory_order_relaxed);
+    stats.spilled = spilled_.load(std::memory_order_relaxed);
+    stats.connections = connections_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Конструктор коллектора
+cdr_collector::cdr_collector(std::string address, std::function<void(std::string_view)> on_record)
+: address_(std::move(address)), on_record_(std::move(on_record)), listen_fd_(-1) {
+}
+
+cdr_collector::~cdr_collector() {
+    stop();
+}
+
+void cdr_collector::start() {
+    spdlog::debug("cdr_collector start, address: {}. Начало функции", address_);
+
+    if (thread_.joinable()) {
+        spdlog::warn("Повторный запуск коллектора CDR");
+        return;
+    }
+
+    const endpoint ep = parse_address(address_);
+    listen_fd_ = socket_raii(socket(ep.is_unix ? AF_UNIX : AF_INET, SOCK_STREAM, 0));
+    if (listen_fd_.get() < 0) {
+        throw std::runtime_error("Не удалось создать сокет коллектора CDR: " + std::string(strerror(errno)));
+    }
+
+    if (ep.is_unix) {
+        unlink(ep.un.sun_path);
+    } else {
+        int reuse = 1;
+        setsockopt(listen_fd_.get(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    if (bind(listen_fd_.get(), endpoint_addr(ep), endpoint_len(ep)) < 0 || listen(listen_fd_.get(), 8) < 0) {
+        throw std::runtime_error("Не удалось открыть адрес коллектора CDR " + address_ + ": " + strerror(errno));
+    }
+
+    if (!ep.is_unix) {
+        sockaddr_in addr{};
+        socklen_t addr_len = sizeof(addr);
+        getsockname(listen_fd_.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len);
+        port_ = ntohs(addr.sin_port);
+    }
+
+    thread_ = std::jthread([this](const std::stop_token &stop_token) {
+        run(stop_token);
+    });
+    spdlog::info("Коллектор CDR слушает {}", address_);
+}
+
+void cdr_collector::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    thread_.request_stop();
+    thread_.join();
+    listen_fd_ = socket_raii(-1);
+
+    const endpoint ep = parse_address(address_);
+    if (ep.is_unix) {
+        unlink(ep.un.sun_path);
+    }
+    spdlog::info("Коллектор CDR остановлен, принято {} записей", records_.load());
+}
+
+void cdr_collector::run(const std::stop_token &stop_token) {
+    while (!stop_token.stop_requested()) {
+        pollfd pfd{listen_fd_.get(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        socket_raii fd(accept(listen_fd_.get(), nullptr, nullptr));
+        if (fd.get() < 0) {
+            continue;
+        }
+        spdlog::info("К коллектору CDR подключился отправитель");
+        serve(fd.get(), stop_token);
+        spdlog::info("Отправитель отключился от коллектора CDR");
+    }
+}
+
+// Приём пакетов одного отправителя до разрыва соединения
+void cdr_collector::serve(int fd, const std::stop_token &stop_token) {
+    std::string payload;
+    char header[8];
+    while (read_exact(fd, header, sizeof(header), &stop_token)) {
+        const uint32_t length = get_u32(header);
+        const uint32_t count = get_u32(header + 4);
+        if (length < 4 || length > max_frame_size) {
+            spdlog::error("Неправильная длина пакета CDR: {}", length);
+            return;
+        }
+
+        // У каждой записи есть хотя бы 4 байта длины, иначе число записей из заголовка недостоверно
+        if (count > (length - 4) / 4) {
+            spdlog::error("Неправильное число записей в пакете CDR: {} при длине {}", count, length);
+            return;
+        }
+
+        payload.resize(length - 4);
+        if (!read_exact(fd, payload.data(), payload.size(), &stop_token)) {
+            return;
+        }
+
+        std::vector<std::string_view> records;
+        records.reserve(count);
+        size_t offset = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (payload.size() - offset < 4) {
+                break;
+            }
+            const uint32_t size = get_u32(payload.data() + offset);
+            offset += 4;
+            if (payload.size() - offset < size) {
+                break;
+            }
+            records.emplace_back(payload.data() + offset, size);
+            offset += size;
+        }
+        if (records.size() != count || offset != payload.size()) {
+            spdlog::error("Повреждённый пакет CDR, ожидалось {} записей", count);
+            return;
+        }
+
+        for (const auto record : records) {
+            on_record_(record);
+        }
+        records_.fetch_add(count, std::memory_order_relaxed);
+
+        std::string ack;
+        put_u32(ack, count);
+        if (!send_all(fd, ack)) {
+            return;
+        }
+    }
+}
+
+int cdr_collector::port() const {
+    return port_;
+}
+
+uint64_t cdr_collector::records() const {
+    return records_.load(std::memory_order_relaxed);
+}
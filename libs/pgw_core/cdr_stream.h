@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "cdr_sink.h"
+#include "socket_raii.h"
+
+// Счётчики потокового приёмника CDR
+struct cdr_stream_stats {
+    bool connected{};
+    uint64_t sent_records{};     // подтверждены коллектором
+    uint64_t batches{};
+    uint64_t buffered{};         // в памяти
+    uint64_t spilled{};          // в файле подкачки
+    uint64_t connections{};      // установленные соединения, больше одного - были переподключения
+};
+
+// Потоковый приёмник: отправляет CDR пакетами на коллектор по TCP или Unix сокету.
+// Пакет (числа big endian): u32 длина остатка | u32 число записей | записи (u32 длина | строка CDR).
+// Коллектор подтверждает пакет ответом u32 с числом принятых записей, только после этого пакет считается доставленным.
+// Пока коллектор недоступен, записи копятся в памяти до max_buffered_records, дальше дописываются
+// в файл подкачки и отправляются первыми после переподключения. Файл дописывается через буфер:
+// его сбрасывает поток отправки на каждом круге (не реже flush_interval_ms и reconnect_interval_ms)
+// и пишущий поток каждые spill_flush_records записей, поэтому при падении процесса теряются записи
+// подкачки только за это окно. Доставка не реже одного раза: пакет, подтверждение которого потерялось,
+// будет отправлен повторно.
+class stream_cdr_sink : public cdr_sink {
+public:
+    static constexpr uint64_t spill_flush_records = 1024;
+
+private:
+    cdr_sink_config config_;
+    std::string spill_path_;
+    std::string sending_path_;    // файл подкачки, который сейчас отправляется
+
+    std::mutex mutex_;
+    std::condition_variable_any cv_;
+    std::deque<std::string> buffer_;
+    std::ofstream spill_;
+    std::vector<char> spill_buffer_;
+    uint64_t spill_unflushed_{};  // записи в буфере spill_, ещё не переданные ядру
+    socket_raii fd_;              // только поток отправки
+
+    std::atomic<bool> connected_{false};
+    std::atomic<uint64_t> sent_records_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> buffered_{0};
+    std::atomic<uint64_t> in_flight_{0};
+    std::atomic<uint64_t> spilled_{0};
+    std::atomic<uint64_t> connections_{0};
+
+    // Объявлен последним: останавливается до уничтожения остальных полей
+    std::jthread thread_;
+
+    void run(const std::stop_token& stop_token);
+    bool connect_collector();
+    void disconnect();
+    bool send_batch(const std::vector<std::string>& records);
+    bool send_spill();
+    void spill_locked(const std::string& record);
+    void flush_spill_locked();
+    void push_locked(std::string record);
+public:
+    explicit stream_cdr_sink(const cdr_sink_config& config);
+    // Отправляет накопленное, если коллектор доступен, остальное сбрасывает в файл подкачки
+    ~stream_cdr_sink() override;
+
+    void write(const std::string& imsi, const std::string& action) override;
+    void write_record(const std::string& record) override;
+    // Пакет кладётся в буфер под одним захватом мьютекса
+    void write_batch(const std::vector<cdr_event>& events) override;
+    uint64_t pending() const override;
+
+    cdr_stream_stats stats() const;
+};
+
+// Приёмная сторона протокола stream_cdr_sink: коллектор для тестов и отладки.
+// Соединения обслуживаются по очереди, каждая запись передаётся в on_record
+class cdr_collector {
+    std::string address_;
+    std::function<void(std::string_view)> on_record_;
+    socket_raii listen_fd_;
+    int port_{};
+    std::jthread thread_;
+    std::atomic<uint64_t> records_{0};
+
+    void run(const std::stop_token& stop_token);
+    void serve(int fd, const std::stop_token& stop_token);
+public:
+    // address в том же формате, что и у приёмника: tcp://ip:port или unix:///путь
+    cdr_collector(std::string address, std::function<void(std::string_view)> on_record);
+    ~cdr_collector();
+
+    void start();
+    void stop();
+
+    // Фактический порт для tcp, полезно при порте 0
+    int port() const;
+    uint64_t records() const;
+};
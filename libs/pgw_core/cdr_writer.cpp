@@ -1,6 +1,7 @@
 #include <filesystem>
 
 #include "cdr_writer.h"
+#include "probes.h"
 
 // Конструктор писателя cdr
 cdr_writer::cdr_writer(const std::string &filename) {
@@ -12,6 +13,7 @@ cdr_writer::cdr_writer(const std::string &filename) {
         spdlog::critical("Не удалось открыть cdr файл: {}", filename);
         throw std::runtime_error("Не удалось открыть cdr файл:" + filename);
     }
+    index_ = std::make_unique<cdr_index_writer>("logs/" + filename);
 
     spdlog::debug("cdr_writer конструктор, filename: {}. Конец функции", filename);
 }
@@ -20,13 +22,62 @@ cdr_writer::cdr_writer(const std::string &filename) {
 void cdr_writer::write(const std::string &imsi, const std::string &action) {
     spdlog::debug("Запись cdr_writer, imsi: {}, action: {}. Начало функции", imsi, action);
 
+    PGW_PROBE(cdr_write, imsi.c_str(), action.c_str());
+    write_record(format_cdr_record(imsi, action));
+
+    spdlog::debug("Запись cdr_writer, imsi: {}, action: {}. Конец функции", imsi, action);
+}
+
+// Запись готовой строки в cdr
+void cdr_writer::write_record(const std::string &record) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
     std::lock_guard lock(mutex_);
-    file_ << std::format("{:%Y-%m-%d %H:%M:%S}", std::chrono::system_clock::now()) << ','
-    << imsi << ',' << action << std::endl;
+    file_ << record << '\n';
+    file_.flush();
+    PGW_PROBE(cdr_flush, file_.fail() ? 0 : 1);
 
     if (file_.fail()) {
-        spdlog::error("Ошибка записи в cdr файл, imsi: {}, action: {}", imsi, action);
+        spdlog::error("Ошибка записи в cdr файл: {}", record);
+        file_.clear();
+    } else {
+        index_->add(record);
     }
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+}
 
-    spdlog::debug("Запись cdr_writer, imsi: {}, action: {}. Конец функции", imsi, action);
+// Запись пакета в cdr
+void cdr_writer::write_batch(const std::vector<cdr_event> &events) {
+    if (events.empty()) {
+        return;
+    }
+
+    std::vector<std::string> records;
+    records.reserve(events.size());
+    std::string block;
+    for (const cdr_event &event : events) {
+        PGW_PROBE(cdr_write, event.imsi.c_str(), event.action.c_str());
+        records.push_back(format_cdr_record(event.imsi, event.action));
+        block += records.back();
+        block += '\n';
+    }
+
+    pending_.fetch_add(records.size(), std::memory_order_relaxed);
+    std::lock_guard lock(mutex_);
+    file_.write(block.data(), static_cast<std::streamsize>(block.size()));
+    file_.flush();
+    PGW_PROBE(cdr_flush, file_.fail() ? 0 : 1);
+
+    if (file_.fail()) {
+        spdlog::error("Ошибка записи в cdr файл пакета из {} записей", records.size());
+        file_.clear();
+    } else {
+        for (const std::string &record : records) {
+            index_->add(record);
+        }
+    }
+    pending_.fetch_sub(records.size(), std::memory_order_relaxed);
+}
+
+uint64_t cdr_writer::pending() const {
+    return pending_.load(std::memory_order_relaxed);
 }
\ No newline at end of file
@@ -1,14 +1,27 @@
 #pragma once
 
+#include <atomic>
 #include <fstream>
 
+#include "cdr_index.h"
+#include "cdr_sink.h"
 #include "spdlog/spdlog.h"
 
-class cdr_writer {
+// Приёмник CDR в локальный файл, каждая запись сбрасывается на диск сразу.
+// Рядом ведётся разреженный индекс для поиска по IMSI и времени (cdr_index.h)
+class cdr_writer : public cdr_sink {
     std::ofstream file_;
+    std::unique_ptr<cdr_index_writer> index_;
     std::mutex mutex_;
+    std::atomic<uint64_t> pending_{0};
 
 public:
     explicit cdr_writer(const std::string& filename);
-    void write(const std::string& imsi, const std::string& action);
+    void write(const std::string& imsi, const std::string& action) override;
+    void write_record(const std::string& record) override;
+    // Весь пакет одной записью в файл и одним сбросом на диск
+    void write_batch(const std::vector<cdr_event>& events) override;
+
+    // Записи, которые сейчас ждут файла или пишутся
+    uint64_t pending() const override;
 };
\ No newline at end of file
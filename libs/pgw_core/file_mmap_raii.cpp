@@ -0,0 +1,74 @@
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_mmap_raii.h"
+#include "spdlog/spdlog.h"
+
+// Пустой файл отображается как пустая область без mmap
+file_mmap_raii::file_mmap_raii(const std::string &path) : data_(nullptr), size_(0) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Не удалось открыть файл " + path + ": " + strerror(errno));
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0) {
+        const int error = errno;
+        close(fd);
+        throw std::runtime_error("Не удалось получить размер файла " + path + ": " + strerror(error));
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    const int error = errno;
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        size_ = 0;
+        throw std::runtime_error("Не удалось отобразить файл " + path + ": " + strerror(error));
+    }
+    spdlog::debug("file_mmap_raii, {} отображён, {} байт", path, size_);
+}
+
+file_mmap_raii::~file_mmap_raii() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+file_mmap_raii::file_mmap_raii(file_mmap_raii &&other) noexcept : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+file_mmap_raii& file_mmap_raii::operator=(file_mmap_raii &&other) noexcept {
+    if (this != &other) {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+        }
+
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+const char* file_mmap_raii::data() const {
+    return static_cast<const char*>(data_);
+}
+
+size_t file_mmap_raii::size() const {
+    return size_;
+}
+
+std::string_view file_mmap_raii::view() const {
+    return {data(), size_};
+}
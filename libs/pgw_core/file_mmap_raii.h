@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Файл, отображённый в память только для чтения. Размер фиксируется при открытии,
+// дописанное позже в отображение не попадает
+class file_mmap_raii {
+    void* data_;
+    size_t size_;
+
+public:
+    explicit file_mmap_raii(const std::string& path);
+    ~file_mmap_raii();
+
+    // Запрещаем копирование
+    file_mmap_raii(const file_mmap_raii&) = delete;
+    file_mmap_raii& operator=(const file_mmap_raii&) = delete;
+
+    // Разрешаем перемещение
+    file_mmap_raii(file_mmap_raii&& other) noexcept;
+    file_mmap_raii& operator=(file_mmap_raii&& other) noexcept;
+
+    const char* data() const;
+    size_t size() const;
+    std::string_view view() const;
+};
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "hash_ring.h"
+#include "spdlog/spdlog.h"
+
+// Построение кольца
+hash_ring::hash_ring(const std::vector<std::string> &nodes, int virtual_nodes) : nodes_(nodes) {
+    spdlog::debug("hash_ring конструктор, узлов: {}, виртуальных узлов: {}", nodes.size(), virtual_nodes);
+    if (nodes_.empty() || virtual_nodes <= 0) {
+        throw std::invalid_argument("Кольцо должно содержать хотя бы один узел и одну точку на узел");
+    }
+
+    points_.reserve(nodes_.size() * virtual_nodes);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        for (int v = 0; v < virtual_nodes; ++v) {
+            points_.emplace_back(hash(nodes_[i] + "#" + std::to_string(v)), i);
+        }
+    }
+    std::ranges::sort(points_);
+}
+
+// FNV-1a с финальным перемешиванием, чтобы близкие IMSI расходились по кольцу
+uint64_t hash_ring::hash(std::string_view key) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const char c : key) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Индекс узла-владельца IMSI
+size_t hash_ring::owner_index(std::string_view imsi) const {
+    const uint64_t h = hash(imsi);
+    auto it = std::ranges::lower_bound(points_, h, {}, &std::pair<uint64_t, size_t>::first);
+    if (it == points_.end()) {
+        it = points_.begin();
+    }
+    return it->second;
+}
+
+const std::string& hash_ring::owner(std::string_view imsi) const {
+    return nodes_[owner_index(imsi)];
+}
+
+const std::vector<std::string>& hash_ring::nodes() const {
+    return nodes_;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Консистентное хэширование IMSI по узлам кластера.
+// Каждый узел ставит на кольцо virtual_nodes точек, IMSI принадлежит узлу первой точки по часовой стрелке.
+// Хэш не зависит от платформы, все узлы с одинаковым списком получают одинаковое разбиение.
+class hash_ring {
+    std::vector<std::pair<uint64_t, size_t>> points_; // точка на кольце и индекс узла
+    std::vector<std::string> nodes_;
+
+public:
+    hash_ring(const std::vector<std::string>& nodes, int virtual_nodes);
+
+    static uint64_t hash(std::string_view key);
+
+    size_t owner_index(std::string_view imsi) const;
+    const std::string& owner(std::string_view imsi) const;
+    const std::vector<std::string>& nodes() const;
+};
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <bit>
+#include <limits>
+#include <stdexcept>
+
+#include "heavy_hitters.h"
+
+namespace {
+    constexpr size_t max_depth = 16;
+
+    // Индексы строк двойным хэшированием: h1 + row * h2, h2 нечётный, ширина - степень двойки
+    struct row_hashes {
+        uint32_t h1;
+        uint32_t h2;
+
+        explicit row_hashes(uint64_t hash) {
+            hash ^= hash >> 33;
+            hash *= 0xFF51AFD7ED558CCDULL;
+            hash ^= hash >> 33;
+            h1 = static_cast<uint32_t>(hash);
+            h2 = static_cast<uint32_t>(hash >> 32) | 1;
+        }
+
+        size_t operator()(size_t row) const {
+            return h1 + static_cast<uint32_t>(row) * h2;
+        }
+    };
+
+    std::vector<heavy_hitter> format_addresses(std::vector<heavy_hitter> hitters) {
+        for (heavy_hitter& hitter : hitters) {
+            in_addr addr{};
+            hitter.key.copy(reinterpret_cast<char*>(&addr.s_addr), sizeof(addr.s_addr));
+            char text[INET_ADDRSTRLEN]{};
+            inet_ntop(AF_INET, &addr, text, sizeof(text));
+            hitter.key = text;
+        }
+        return hitters;
+    }
+}
+
+count_min_sketch::count_min_sketch(size_t width, size_t depth) : depth_(depth) {
+    if (width == 0 || depth == 0 || depth > max_depth) {
+        throw std::invalid_argument("Недопустимые размеры count-min sketch");
+    }
+    width = std::bit_ceil(width);
+    width_mask_ = width - 1;
+    counters_.assign(width * depth, 0);
+}
+
+uint32_t count_min_sketch::add(uint64_t hash) {
+    const size_t width = width_mask_ + 1;
+    const row_hashes index(hash);
+    uint32_t* cells[max_depth];
+    uint32_t min = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < depth_; ++row) {
+        cells[row] = &counters_[row * width + (index(row) & width_mask_)];
+        min = std::min(min, *cells[row]);
+    }
+    if (min == std::numeric_limits<uint32_t>::max()) {
+        return min;
+    }
+
+    // Консервативное обновление: счётчики выше новой оценки уже учитывают этот ключ
+    const uint32_t updated = min + 1;
+    for (size_t row = 0; row < depth_; ++row) {
+        *cells[row] = std::max(*cells[row], updated);
+    }
+    return updated;
+}
+
+uint32_t count_min_sketch::estimate(uint64_t hash) const {
+    const size_t width = width_mask_ + 1;
+    const row_hashes index(hash);
+    uint32_t min = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < depth_; ++row) {
+        min = std::min(min, counters_[row * width + (index(row) & width_mask_)]);
+    }
+    return min;
+}
+
+void count_min_sketch::clear() {
+    std::ranges::fill(counters_, 0);
+}
+
+size_t count_min_sketch::width() const {
+    return width_mask_ + 1;
+}
+
+size_t count_min_sketch::depth() const {
+    return depth_;
+}
+
+heavy_hitter_tracker::heavy_hitter_tracker(size_t top_k, size_t width, size_t depth)
+    : sketch_(width, depth), top_k_(top_k) {
+    top_.reserve(top_k);
+}
+
+void heavy_hitter_tracker::update_min() {
+    min_index_ = std::ranges::min_element(top_, {}, &entry::count) - top_.begin();
+    min_count_ = top_[min_index_].count;
+}
+
+void heavy_hitter_tracker::add(std::string_view key, bool rejected) {
+    if (top_k_ == 0) {
+        return;
+    }
+    const uint64_t hash = std::hash<std::string_view>{}(key);
+    const uint32_t estimate = sketch_.add(hash);
+
+    // Ключ из топа после обновления всегда выше минимума, остальные ключи ниже него отсекаются сразу,
+    // без блокировки: топ меняет только этот поток
+    if (estimate <= min_count_) {
+        return;
+    }
+
+    std::lock_guard lock(top_mutex_);
+    const bool full = top_.size() == top_k_;
+    const auto found = std::ranges::find_if(top_, [hash, key](const entry& e) {
+        return e.hash == hash && e.key == key;
+    });
+    if (found != top_.end()) {
+        found->count = estimate;
+        found->rejected += rejected ? 1 : 0;
+        if (full && found - top_.begin() == static_cast<ptrdiff_t>(min_index_)) {
+            update_min();
+        }
+        return;
+    }
+
+    if (!full) {
+        top_.push_back({hash, std::string(key), estimate, rejected ? 1u : 0u});
+        if (top_.size() == top_k_) {
+            update_min();
+        }
+        return;
+    }
+
+    // Вытесняется ключ с минимальной оценкой
+    top_[min_index_] = {hash, std::string(key), estimate, rejected ? 1u : 0u};
+    update_min();
+}
+
+std::vector<heavy_hitter> heavy_hitter_tracker::top() const {
+    std::vector<heavy_hitter> hitters;
+    std::lock_guard lock(top_mutex_);
+    hitters.reserve(top_.size());
+    for (const entry& e : top_) {
+        hitters.push_back({e.key, e.count, e.rejected});
+    }
+    std::ranges::sort(hitters, std::greater{}, &heavy_hitter::count);
+    return hitters;
+}
+
+void heavy_hitter_tracker::clear() {
+    sketch_.clear();
+    std::lock_guard lock(top_mutex_);
+    top_.clear();
+    min_index_ = 0;
+    min_count_ = 0;
+}
+
+// Выключенный учёт не держит sketch полного размера
+heavy_hitters::heavy_hitters(size_t top_k, size_t width, size_t depth)
+    : imsi_(top_k, top_k > 0 ? width : 1, depth), source_(top_k, top_k > 0 ? width : 1, depth),
+    window_start_(std::chrono::steady_clock::now()), enabled_(top_k > 0) {}
+
+void heavy_hitters::add_source(uint32_t addr) {
+    if (!enabled_) {
+        return;
+    }
+    source_.add(std::string_view(reinterpret_cast<const char*>(&addr), sizeof(addr)));
+}
+
+void heavy_hitters::add_imsi(std::string_view imsi, bool rejected) {
+    if (!enabled_) {
+        return;
+    }
+    imsi_.add(imsi, rejected);
+}
+
+void heavy_hitters::rotate() {
+    if (!enabled_) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    heavy_hitters_report closed{std::chrono::milliseconds(0), imsi_.top(), format_addresses(source_.top())};
+    imsi_.clear();
+    source_.clear();
+
+    std::lock_guard lock(mutex_);
+    closed.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - window_start_);
+    previous_ = std::move(closed);
+    window_start_ = now;
+}
+
+heavy_hitters_report heavy_hitters::current() const {
+    heavy_hitters_report report{std::chrono::milliseconds(0), imsi_.top(), format_addresses(source_.top())};
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - window_start_);
+    return report;
+}
+
+heavy_hitters_report heavy_hitters::previous() const {
+    std::lock_guard lock(mutex_);
+    return previous_;
+}
+
+bool heavy_hitters::enabled() const {
+    return enabled_;
+}
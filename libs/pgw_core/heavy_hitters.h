@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Count-Min sketch: оценка числа появлений ключа в фиксированной памяти depth x width счётчиков.
+// Оценка не бывает меньше истинного числа, переоценка растёт с числом ключей за окно.
+// Консервативное обновление увеличивает только минимальные из счётчиков ключа, это уменьшает переоценку
+class count_min_sketch {
+    std::vector<uint32_t> counters_;
+    size_t width_mask_;
+    size_t depth_;
+
+public:
+    // width округляется вверх до степени двойки, depth от 1 до 16, иначе invalid_argument
+    count_min_sketch(size_t width, size_t depth);
+
+    // Добавление одного появления ключа с хэшем hash, возвращает новую оценку
+    uint32_t add(uint64_t hash);
+    uint32_t estimate(uint64_t hash) const;
+    void clear();
+
+    size_t width() const;
+    size_t depth() const;
+};
+
+struct heavy_hitter {
+    std::string key;
+    uint64_t count{};       // оценка числа запросов за окно
+    uint64_t rejected{};    // отклонённые запросы с момента попадания ключа в топ
+};
+
+// Топ-K ключей по оценке sketch. В топ попадает ключ, оценка которого выше минимальной в топе,
+// поэтому для подавляющего большинства ключей обновление - только хэш и depth счётчиков без блокировок.
+// add и clear вызывает один поток-писатель, top можно читать из любого потока: мьютекс защищает
+// только топ и берётся писателем лишь при его изменении
+class heavy_hitter_tracker {
+    struct entry {
+        uint64_t hash;
+        std::string key;
+        uint32_t count;
+        uint64_t rejected;
+    };
+
+    count_min_sketch sketch_;
+    size_t top_k_;
+    mutable std::mutex top_mutex_;
+    std::vector<entry> top_;
+    size_t min_index_ = 0;   // запись с минимальной оценкой, когда топ заполнен
+    uint32_t min_count_ = 0; // её оценка, до заполнения топа 0. Меняет и читает только писатель
+
+    void update_min();
+
+public:
+    heavy_hitter_tracker(size_t top_k, size_t width, size_t depth = 4);
+
+    void add(std::string_view key, bool rejected = false);
+    std::vector<heavy_hitter> top() const;  // по убыванию оценки
+    void clear();
+};
+
+// Отчёт за окно: топ IMSI и адресов отправителей
+struct heavy_hitters_report {
+    std::chrono::milliseconds elapsed{0};
+    std::vector<heavy_hitter> imsi;
+    std::vector<heavy_hitter> source;
+};
+
+// Самые частые IMSI и адреса отправителей UDP запросов по окнам фиксированной длины.
+// add_* и rotate вызывает поток UDP - владелец, отчёты читает поток HTTP.
+// Окно закрывается вызовом rotate по таймеру потока UDP: топ закрытого окна сохраняется как previous
+class heavy_hitters {
+    heavy_hitter_tracker imsi_;
+    heavy_hitter_tracker source_;
+    mutable std::mutex mutex_;  // начало окна и прошлое окно
+    std::chrono::steady_clock::time_point window_start_;
+    heavy_hitters_report previous_;
+    bool enabled_;
+
+public:
+    // top_k = 0 отключает учёт
+    heavy_hitters(size_t top_k, size_t width, size_t depth = 4);
+
+    // Адрес отправителя - 4 байта IPv4 в порядке сети
+    void add_source(uint32_t addr);
+    void add_imsi(std::string_view imsi, bool rejected);
+    void rotate();
+
+    heavy_hitters_report current() const;
+    heavy_hitters_report previous() const;
+    bool enabled() const;
+};
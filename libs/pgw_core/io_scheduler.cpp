@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+
+#include "io_scheduler.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    // Куча таймеров: ближайший срок наверху
+    bool later(const auto& a, const auto& b) {
+        return a.due > b.due;
+    }
+
+    // Результат системного вызова операции: false - EAGAIN, нужно ждать готовности fd
+    bool complete_with(ssize_t n, ssize_t& result) {
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            result = -errno;
+            return true;
+        }
+        result = n;
+        return true;
+    }
+}
+
+// Исключение из корутины некому передать, как и из потока: процесс завершается
+void io_task::promise_type::unhandled_exception() {
+    try {
+        throw;
+    } catch (const std::exception& e) {
+        spdlog::critical("Необработанное исключение в корутине: {}", e.what());
+    } catch (...) {
+        spdlog::critical("Необработанное исключение в корутине");
+    }
+    std::terminate();
+}
+
+io_task::~io_task() {
+    if (handle_) {
+        handle_.destroy();
+    }
+}
+
+bool io_operation::await_ready() {
+    return scheduler_.take_budget() && try_complete();
+}
+
+void io_operation::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    scheduler_.suspend(*this);
+}
+
+bool io_scheduler::recv_awaitable::try_complete() {
+    ssize_t n;
+    do {
+        n = recvmsg(fd_, &msg_, MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    return complete_with(n, result_);
+}
+
+bool io_scheduler::send_awaitable::try_complete() {
+    ssize_t n;
+    do {
+        n = sendmsg(fd_, &msg_, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return complete_with(n, result_);
+}
+
+bool io_scheduler::readable_awaitable::try_complete() {
+    pollfd pfd{fd_, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+void io_scheduler::sleep_awaitable::await_suspend(std::coroutine_handle<> handle) {
+    scheduler_.timers_.push_back({due_, handle});
+    std::ranges::push_heap(scheduler_.timers_, later<timer, timer>);
+}
+
+io_scheduler::io_scheduler(size_t max_events) : events_(max_events) {
+    if (epoll_.get() < 0) {
+        throw std::runtime_error(std::string("Не удалось создать epoll: ") + strerror(errno));
+    }
+}
+
+// Каждая приостановленная корутина лежит ровно в одном месте: в очереди, у fd, среди отложенных или таймеров
+io_scheduler::~io_scheduler() {
+    for (std::coroutine_handle<> handle : ready_) {
+        handle.destroy();
+    }
+    for (io_operation* operation : deferred_) {
+        operation->handle_.destroy();
+    }
+    for (const auto& [fd, state] : fds_) {
+        if (state->reader) {
+            state->reader->handle_.destroy();
+        }
+        if (state->writer) {
+            state->writer->handle_.destroy();
+        }
+    }
+    for (const timer& t : timers_) {
+        t.handle.destroy();
+    }
+}
+
+void io_scheduler::spawn(io_task task) {
+    ready_.push_back(std::exchange(task.handle_, {}));
+}
+
+bool io_scheduler::take_budget() {
+    if (budget_ == 0) {
+        return false;
+    }
+    --budget_;
+    return true;
+}
+
+// Бюджет исчерпан - операция откладывается на следующий круг, иначе ждёт готовности fd
+void io_scheduler::suspend(io_operation &operation) {
+    if (budget_ == 0) {
+        deferred_.push_back(&operation);
+    } else {
+        wait(operation);
+    }
+}
+
+io_scheduler::fd_state& io_scheduler::state(int fd) {
+    auto it = fds_.find(fd);
+    if (it != fds_.end()) {
+        return *it->second;
+    }
+
+    auto state = std::make_unique<fd_state>();
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = state.get();
+    if (epoll_ctl(epoll_.get(), EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw std::runtime_error("Не удалось добавить fd " + std::to_string(fd) + " в epoll: " + strerror(errno));
+    }
+    return *fds_.emplace(fd, std::move(state)).first->second;
+}
+
+void io_scheduler::wait(io_operation &operation) {
+    fd_state &s = state(operation.fd_);
+    io_operation *&waiter = operation.write_ ? s.writer : s.reader;
+    bool &ready = operation.write_ ? s.writable : s.readable;
+    if (waiter != nullptr) {
+        throw std::logic_error("На fd " + std::to_string(operation.fd_) + " уже ждёт другая операция");
+    }
+
+    // Событие пришло, когда никто не ждал: в режиме EPOLLET повторно оно не придёт, пробуем ещё раз
+    if (ready) {
+        ready = false;
+        deferred_.push_back(&operation);
+        return;
+    }
+    waiter = &operation;
+}
+
+void io_scheduler::dispatch(fd_state &state, uint32_t events) {
+    auto wake = [this](io_operation *&waiter, bool &ready) {
+        if (waiter == nullptr) {
+            ready = true;
+            return;
+        }
+        // Ложное пробуждение: операция остаётся ждать
+        if (waiter->try_complete()) {
+            ready_.push_back(std::exchange(waiter, nullptr)->handle_);
+        }
+    };
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+        wake(state.reader, state.readable);
+    }
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+        wake(state.writer, state.writable);
+    }
+}
+
+void io_scheduler::fire_timers() {
+    const auto now = clock::now();
+    while (!timers_.empty() && timers_.front().due <= now) {
+        std::ranges::pop_heap(timers_, later<timer, timer>);
+        ready_.push_back(timers_.back().handle);
+        timers_.pop_back();
+    }
+}
+
+void io_scheduler::run(std::atomic<uint64_t> *busy_ns) {
+    stopped_ = false;
+    std::vector<io_operation*> retry;
+    while (true) {
+        const auto busy_start = clock::now();
+
+        // Отложенные операции пробуются снова, прежде чем выполнять готовые корутины
+        retry.swap(deferred_);
+        for (io_operation *operation : retry) {
+            budget_ = io_budget;
+            if (operation->try_complete()) {
+                ready_.push_back(operation->handle_);
+            } else {
+                wait(*operation);
+            }
+        }
+        retry.clear();
+
+        running_.swap(ready_);
+        for (size_t i = 0; i < running_.size(); ++i) {
+            if (stopped_) {
+                ready_.insert(ready_.end(), running_.begin() + static_cast<ptrdiff_t>(i), running_.end());
+                break;
+            }
+            budget_ = io_budget;
+            running_[i].resume();
+        }
+        running_.clear();
+
+        if (busy_ns) {
+            busy_ns->fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - busy_start).count(), std::memory_order_relaxed);
+        }
+        if (stopped_) {
+            return;
+        }
+
+        // Есть готовые - только собираем события, не засыпая
+        int timeout_ms = -1;
+        if (!ready_.empty() || !deferred_.empty()) {
+            timeout_ms = 0;
+        } else if (!timers_.empty()) {
+            timeout_ms = static_cast<int>(std::max<int64_t>(0,
+                std::chrono::ceil<std::chrono::milliseconds>(timers_.front().due - clock::now()).count()));
+        }
+
+        const int n_events = epoll_wait(epoll_.get(), events_.data(), static_cast<int>(events_.size()), timeout_ms);
+        if (n_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Ошибка epoll_wait: ") + strerror(errno));
+        }
+        for (int i = 0; i < n_events; i++) {
+            dispatch(*static_cast<fd_state*>(events_[i].data.ptr), events_[i].events);
+        }
+        fire_timers();
+    }
+}
+
+void io_scheduler::stop() {
+    stopped_ = true;
+}
+
+io_scheduler::recv_awaitable io_scheduler::recv(int fd, msghdr &msg) {
+    return {*this, fd, msg};
+}
+
+io_scheduler::send_awaitable io_scheduler::send(int fd, const msghdr &msg) {
+    return {*this, fd, msg};
+}
+
+io_scheduler::readable_awaitable io_scheduler::readable(int fd) {
+    return {*this, fd};
+}
+
+io_scheduler::sleep_awaitable io_scheduler::sleep_until(clock::time_point due) {
+    return {*this, due};
+}
+
+io_scheduler::sleep_awaitable io_scheduler::sleep_for(std::chrono::nanoseconds duration) {
+    return {*this, clock::now() + std::chrono::duration_cast<clock::duration>(duration)};
+}
+
+size_t io_scheduler::waiting() const {
+    size_t count = ready_.size() + deferred_.size() + timers_.size();
+    for (const auto& [fd, state] : fds_) {
+        count += (state->reader != nullptr) + (state->writer != nullptr);
+    }
+    return count;
+}
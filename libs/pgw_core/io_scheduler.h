@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "epoll_raii.h"
+
+// Корутина, запущенная в io_scheduler. Кадр выделяется один раз при создании корутины,
+// сами операции ввода-вывода живут в кадре и памяти не выделяют.
+// Корутина не возвращает значения, по завершении кадр освобождается сам
+class io_task {
+public:
+    struct promise_type {
+        io_task get_return_object() {
+            return io_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        // Запускает планировщик в spawn, а не вызывающий
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+    };
+
+    io_task(io_task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    io_task& operator=(io_task&&) = delete;
+    // Корутина, не переданная в spawn, уничтожается вместе с объектом
+    ~io_task();
+
+private:
+    friend class io_scheduler;
+    explicit io_task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+class io_scheduler;
+
+// Операция над fd для co_await. try_complete пробует её без блокировки:
+// false - ядро ответило EAGAIN, корутина ждёт события epoll
+class io_operation {
+public:
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+
+    virtual bool try_complete() = 0;
+
+protected:
+    friend class io_scheduler;
+    io_scheduler& scheduler_;
+    int fd_;
+    bool write_;
+    std::coroutine_handle<> handle_;
+
+    io_operation(io_scheduler& scheduler, int fd, bool write) : scheduler_(scheduler), fd_(fd), write_(write) {}
+    ~io_operation() = default;
+};
+
+// Однопоточный планировщик корутин поверх epoll: у каждого потока ввода-вывода свой.
+// fd регистрируется в epoll один раз при первом ожидании, в режиме EPOLLET; на fd одновременно
+// ждут не больше одного чтения и одной записи. Операции сначала выполняются сразу и приостанавливают
+// корутину только при EAGAIN. Чтобы поток пакетов на одном сокете не занимал планировщик целиком,
+// после io_budget выполненных сразу операций корутина уступает очередь остальным.
+// Таймеры - куча в векторе, точность миллисекунда (таймаут epoll_wait).
+// Все методы вызываются из потока, в котором работает run
+class io_scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr size_t io_budget = 256;
+
+private:
+    // Ожидающие операции fd и события, пришедшие без ожидающих
+    struct fd_state {
+        io_operation* reader = nullptr;
+        io_operation* writer = nullptr;
+        bool readable = false;
+        bool writable = false;
+    };
+
+    struct timer {
+        clock::time_point due;
+        std::coroutine_handle<> handle;
+    };
+
+    epoll_raii epoll_;
+    std::vector<epoll_event> events_;
+    std::unordered_map<int, std::unique_ptr<fd_state>> fds_;
+    std::vector<std::coroutine_handle<>> ready_;
+    std::vector<std::coroutine_handle<>> running_;
+    std::vector<io_operation*> deferred_;  // уступили очередь, выполняются на следующем круге
+    std::vector<timer> timers_;            // куча по due
+    size_t budget_ = io_budget;
+    bool stopped_ = false;
+
+    fd_state& state(int fd);
+    void wait(io_operation& operation);
+    void dispatch(fd_state& state, uint32_t events);
+    void fire_timers();
+
+    friend class io_operation;
+    bool take_budget();
+    void suspend(io_operation& operation);
+public:
+    explicit io_scheduler(size_t max_events = 64);
+    // Уничтожает корутины, которые ещё ждут: их локальные объекты освобождаются
+    ~io_scheduler();
+
+    io_scheduler(const io_scheduler&) = delete;
+    io_scheduler& operator=(const io_scheduler&) = delete;
+
+    void spawn(io_task task);
+
+    // Выполнение корутин до stop(). busy_ns - куда добавлять время работы корутин без ожидания в epoll
+    void run(std::atomic<uint64_t>* busy_ns = nullptr);
+    void stop();
+
+    // Операции для co_await. recv и send возвращают результат recvmsg/sendmsg или -errno.
+    // msghdr и буферы должны жить до завершения операции, обычно это локальные переменные корутины
+    class recv_awaitable;
+    class send_awaitable;
+    class readable_awaitable;
+    class sleep_awaitable;
+
+    recv_awaitable recv(int fd, msghdr& msg);
+    send_awaitable send(int fd, const msghdr& msg);
+    // Ждёт, пока fd станет читаемым, не читая из него: например, eventfd остановки, общий для потоков
+    readable_awaitable readable(int fd);
+    sleep_awaitable sleep_until(clock::time_point due);
+    sleep_awaitable sleep_for(std::chrono::nanoseconds duration);
+
+    // Ожидание операций и таймеров: для тестов и отладки
+    size_t waiting() const;
+};
+
+class io_scheduler::recv_awaitable final : public io_operation {
+    msghdr& msg_;
+    ssize_t result_ = 0;
+
+public:
+    recv_awaitable(io_scheduler& scheduler, int fd, msghdr& msg) : io_operation(scheduler, fd, false), msg_(msg) {}
+    bool try_complete() override;
+    ssize_t await_resume() const { return result_; }
+};
+
+class io_scheduler::send_awaitable final : public io_operation {
+    const msghdr& msg_;
+    ssize_t result_ = 0;
+
+public:
+    send_awaitable(io_scheduler& scheduler, int fd, const msghdr& msg)
+        : io_operation(scheduler, fd, true), msg_(msg) {}
+    bool try_complete() override;
+    ssize_t await_resume() const { return result_; }
+};
+
+class io_scheduler::readable_awaitable final : public io_operation {
+public:
+    readable_awaitable(io_scheduler& scheduler, int fd) : io_operation(scheduler, fd, false) {}
+    bool try_complete() override;
+    void await_resume() const {}
+};
+
+class io_scheduler::sleep_awaitable {
+    io_scheduler& scheduler_;
+    clock::time_point due_;
+
+public:
+    sleep_awaitable(io_scheduler& scheduler, clock::time_point due) : scheduler_(scheduler), due_(due) {}
+    bool await_ready() const { return due_ <= clock::now(); }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const {}
+};
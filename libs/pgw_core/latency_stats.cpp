@@ -0,0 +1,117 @@
+#include <bit>
+#include <thread>
+
+#include "latency_stats.h"
+
+std::string_view latency_stage_name(latency_stage stage) {
+    switch (stage) {
+        case latency_stage::queueing: return "queueing";
+        case latency_stage::decode: return "decode";
+        case latency_stage::checks: return "checks";
+        case latency_stage::lock_wait: return "lock_wait";
+        case latency_stage::table_op: return "table_op";
+        case latency_stage::cdr: return "cdr";
+        case latency_stage::send: return "send";
+        case latency_stage::total: return "total";
+        case latency_stage::count: break;
+    }
+    return "unknown";
+}
+
+// Частоту TSC меряем по steady_clock на коротком интервале
+double tsc::ns_per_tick() {
+    static const double value = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        const auto clock_start = std::chrono::steady_clock::now();
+        const uint64_t tsc_start = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const uint64_t tsc_end = now();
+        const auto clock_end = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(clock_end - clock_start).count();
+        return tsc_end > tsc_start ? ns / static_cast<double>(tsc_end - tsc_start) : 1.0;
+#else
+        return 1.0;
+#endif
+    }();
+    return value;
+}
+
+void latency_histogram::record(uint64_t ns) {
+    // Корзина i хранит значения меньше 2^i нс
+    const size_t bucket = std::min<size_t>(std::bit_width(ns), bucket_count - 1);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+}
+
+uint64_t latency_histogram::count() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::sum_ns() const {
+    return sum_ns_.load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::max_ns() const {
+    return max_ns_.load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::percentile_ns(double percentile) const {
+    const uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    const auto target = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen > target || seen == total) {
+            return std::min(uint64_t{1} << i, max_ns());
+        }
+    }
+    return max_ns();
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> latency_histogram::buckets() const {
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        if (uint64_t n = buckets_[i].load(std::memory_order_relaxed); n > 0) {
+            result.emplace_back(uint64_t{1} << i, n);
+        }
+    }
+    return result;
+}
+
+// Тики переводятся в наносекунды только здесь, на горячем пути их нет
+void latency_stats::record(const request_trace& trace) {
+    const double ns_per_tick = tsc::ns_per_tick();
+    auto to_ns = [ns_per_tick](uint64_t ticks) {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * ns_per_tick);
+    };
+
+    for (size_t i = 0; i < latency_stage_count; ++i) {
+        const auto stage = static_cast<latency_stage>(i);
+        if (stage == latency_stage::queueing || stage == latency_stage::total) {
+            continue;
+        }
+        if (uint64_t ticks = trace.ticks(stage); ticks > 0) {
+            histograms_[i].record(to_ns(ticks));
+        }
+    }
+
+    uint64_t total_ns = to_ns(trace.elapsed_ticks());
+    if (trace.queueing_ns() >= 0) {
+        histograms_[static_cast<size_t>(latency_stage::queueing)].record(trace.queueing_ns());
+        total_ns += trace.queueing_ns();
+    }
+    histograms_[static_cast<size_t>(latency_stage::total)].record(total_ns);
+}
+
+const latency_histogram& latency_stats::histogram(latency_stage stage) const {
+    return histograms_[static_cast<size_t>(stage)];
+}
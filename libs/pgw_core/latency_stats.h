@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Этапы обработки UDP запроса
+enum class latency_stage : uint8_t {
+    queueing,   // от приёма пакета ядром до recvmsg (SO_TIMESTAMPNS)
+    decode,     // разбор пакета, кэш ретрансмитов и BCD
+    checks,     // блэклист и проверка IMSI
+    lock_wait,  // ожидание мьютекса session_manager
+    table_op,   // операции с таблицей сессий и события
+    cdr,        // запись CDR
+    send,       // формирование и отправка ответа
+    total,      // от приёма ядром (или recvmsg) до отправки
+    count
+};
+
+constexpr size_t latency_stage_count = static_cast<size_t>(latency_stage::count);
+
+std::string_view latency_stage_name(latency_stage stage);
+
+// Дешёвые метки времени: TSC на x86, иначе steady_clock
+namespace tsc {
+    inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Наносекунд в одном тике, калибруется один раз при первом вызове
+    double ns_per_tick();
+}
+
+// Метки этапов одного запроса. Живёт на стеке потока, который обрабатывает запрос
+class request_trace {
+    uint64_t start_;
+    uint64_t last_;
+    std::array<uint64_t, latency_stage_count> ticks_{};
+    int64_t queueing_ns_{-1};
+public:
+    request_trace() : start_(tsc::now()), last_(start_) {}
+
+    // Время с прошлой метки относится к этапу stage
+    void mark(latency_stage stage) {
+        const uint64_t now = tsc::now();
+        ticks_[static_cast<size_t>(stage)] += now - last_;
+        last_ = now;
+    }
+
+    void set_queueing_ns(int64_t ns) {
+        queueing_ns_ = ns;
+    }
+
+    int64_t queueing_ns() const {
+        return queueing_ns_;
+    }
+
+    uint64_t ticks(latency_stage stage) const {
+        return ticks_[static_cast<size_t>(stage)];
+    }
+
+    uint64_t elapsed_ticks() const {
+        return last_ - start_;
+    }
+};
+
+// Гистограмма с корзинами по степеням двойки наносекунд, запись без блокировок
+class latency_histogram {
+public:
+    static constexpr size_t bucket_count = 40; // до ~9 минут
+
+    void record(uint64_t ns);
+
+    uint64_t count() const;
+    uint64_t sum_ns() const;
+    uint64_t max_ns() const;
+    // Верхняя граница корзины, в которую попадает перцентиль
+    uint64_t percentile_ns(double percentile) const;
+    // Пары (верхняя граница корзины, количество), только непустые
+    std::vector<std::pair<uint64_t, uint64_t>> buckets() const;
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+// Гистограммы всех этапов
+class latency_stats {
+    std::array<latency_histogram, latency_stage_count> histograms_;
+public:
+    void record(const request_trace& trace);
+
+    const latency_histogram& histogram(latency_stage stage) const;
+};
@@ -0,0 +1,74 @@
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+
+#include "mmap_raii.h"
+#include "spdlog/spdlog.h"
+
+namespace {
+    constexpr size_t huge_page_size = 2 * 1024 * 1024;
+}
+
+mmap_raii::mmap_raii() : data_(nullptr), size_(0) {}
+
+// Память приходит обнулённой, это используется таблицей сессий
+mmap_raii::mmap_raii(size_t size) : data_(nullptr), size_(size) {
+    if (size_ == 0) {
+        return;
+    }
+
+    // Сначала пробуем явные huge pages, если они зарезервированы в системе
+    if (size_ % huge_page_size == 0) {
+        data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data_ != MAP_FAILED) {
+            spdlog::debug("mmap_raii, выделено {} байт в huge pages", size_);
+            return;
+        }
+    }
+
+    data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        spdlog::critical("Не удалось выделить {} байт через mmap: {}", size_, strerror(errno));
+        throw std::bad_alloc();
+    }
+
+    // Иначе просим transparent huge pages для больших областей
+    if (size_ >= huge_page_size) {
+        madvise(data_, size_, MADV_HUGEPAGE);
+    }
+    spdlog::debug("mmap_raii, выделено {} байт", size_);
+}
+
+mmap_raii::~mmap_raii() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+mmap_raii::mmap_raii(mmap_raii &&other) noexcept : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+mmap_raii& mmap_raii::operator=(mmap_raii &&other) noexcept {
+    if (this != &other) {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+        }
+
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void* mmap_raii::get() const {
+    return data_;
+}
+
+size_t mmap_raii::size() const {
+    return size_;
+}
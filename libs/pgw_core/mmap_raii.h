@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+// Анонимная память через mmap, для больших выделений просим huge pages
+class mmap_raii {
+    void* data_;
+    size_t size_;
+
+public:
+    mmap_raii();
+    explicit mmap_raii(size_t size);
+    ~mmap_raii();
+
+    // Запрещаем копирование
+    mmap_raii(const mmap_raii&) = delete;
+    mmap_raii& operator=(const mmap_raii&) = delete;
+
+    // Разрешаем перемещение
+    mmap_raii(mmap_raii&& other) noexcept;
+    mmap_raii& operator=(mmap_raii&& other) noexcept;
+
+    void* get() const;
+    size_t size() const;
+};
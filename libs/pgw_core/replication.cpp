@@ -0,0 +1,603 @@
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "replication.h"
+#include "spdlog/spdlog.h"
+
+// Формат пакета репликации (все числа big endian):
+// u32 длина остатка | u64 время отправки (ns) | u64 время постановки старейшего события (ns) | u32 число записей
+// запись: u8 тип | u64 возраст сессии (мс) | u8 длина imsi | imsi
+// Тип - session_event_type, 0 - сброс таблицы перед снимком, 255 - основной узел отключает отставший
+// резервный: это не потеря основного узла, резервный переподключается и получает свежий снимок
+namespace {
+    constexpr size_t batch_header_size = 4 + 8 + 8 + 4;
+    constexpr size_t max_batch_events = 4096;
+    constexpr uint8_t reset_type = 0;
+    constexpr uint8_t resync_type = 255;
+
+    int64_t system_now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void put_uint(std::string& out, uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>(value >> shift & 0xFF));
+        }
+    }
+
+    uint64_t get_uint(const char* data, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value = value << 8 | static_cast<uint8_t>(data[i]);
+        }
+        return value;
+    }
+
+    // Запись в неблокирующий сокет начиная с offset, пока он принимает. false - ошибка соединения
+    bool send_some(int fd, const std::string& data, size_t& offset) {
+        while (offset < data.size()) {
+            ssize_t n = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            offset += n;
+        }
+        return true;
+    }
+
+    // Ожидание событий fd, пока не сработал wake_fd. false - остановка, ошибка или таймаут
+    bool wait_ready(int fd, short events, int wake_fd, std::chrono::milliseconds timeout) {
+        pollfd pfds[2] = {{fd, events, 0}, {wake_fd, POLLIN, 0}};
+        int ready;
+        do {
+            ready = poll(pfds, 2, static_cast<int>(timeout.count()));
+        } while (ready < 0 && errno == EINTR);
+        return ready > 0 && pfds[1].revents == 0;
+    }
+
+    enum class read_status {
+        ok,
+        closed,  // соединение закрыто или сброшено
+        silent   // тишина дольше таймаута или остановка
+    };
+
+    // Чтение из неблокирующего сокета. Тишина дольше timeout или пробуждение через wake_fd прерывают чтение
+    read_status read_exact(int fd, char* data, size_t size, int wake_fd, std::chrono::milliseconds timeout) {
+        size_t received = 0;
+        while (received < size) {
+            ssize_t n = recv(fd, data + received, size - received, 0);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!wait_ready(fd, POLLIN, wake_fd, timeout)) {
+                    return read_status::silent;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return read_status::closed;
+            }
+            received += n;
+        }
+        return read_status::ok;
+    }
+
+    // Пакет из count событий, начиная с events
+    template<typename It>
+    std::string encode_batch(It events, size_t count, std::chrono::steady_clock::time_point now) {
+        std::string batch;
+        batch.reserve(batch_header_size + count * 26);
+        put_uint(batch, 0, 4);
+        put_uint(batch, system_now_ns(), 8);
+        put_uint(batch, count > 0 ? events->enqueued_ns : 0, 8);
+        put_uint(batch, count, 4);
+        for (size_t i = 0; i < count; ++i, ++events) {
+            const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - events->created).count();
+            const bool service = events->type == reset_type || events->type == resync_type;
+            put_uint(batch, events->type, 1);
+            put_uint(batch, service ? 0 : std::max<int64_t>(age, 0), 8);
+            put_uint(batch, events->imsi.size(), 1);
+            batch.append(events->imsi);
+        }
+
+        const uint32_t length = batch.size() - 4;
+        for (int i = 0; i < 4; ++i) {
+            batch[i] = static_cast<char>(length >> (24 - i * 8) & 0xFF);
+        }
+        return batch;
+    }
+}
+
+// Конструктор основного узла репликации
+replication_publisher::replication_publisher(session_manager &manager, const replication_config &config)
+: manager_(manager), config_(config), listen_fd_(-1) {
+    spdlog::debug("replication_publisher конструктор. Начало функции");
+
+    manager_.add_event_listener([this](const session_event &event) {
+        on_event(event);
+    });
+
+    spdlog::debug("replication_publisher конструктор. Конец функции");
+}
+
+replication_publisher::~replication_publisher() {
+    stop();
+}
+
+// Событие кладётся в очередь каждого резервного узла, вызывается под мьютексом session_manager
+void replication_publisher::on_event(const session_event &event) {
+    std::lock_guard lock(mutex_);
+    if (standbys_.empty()) {
+        return;
+    }
+
+    const int64_t now_ns = system_now_ns();
+    for (const auto &sb : standbys_) {
+        if (sb->overflow) {
+            continue;
+        }
+        sb->pending.push_back({static_cast<uint8_t>(event.type), std::string(event.imsi), event.created, now_ns});
+        if (sb->pending.size() > sb->limit) {
+            sb->overflow = true;
+        }
+    }
+}
+
+// Запуск прослушивания и потока рассылки
+void replication_publisher::start() {
+    spdlog::debug("replication_publisher start. Начало функции");
+
+    if (thread_.joinable()) {
+        spdlog::warn("Повторный запуск рассылки репликации");
+        return;
+    }
+
+    listen_fd_ = socket_raii(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0));
+    if (listen_fd_.get() < 0) {
+        throw std::runtime_error("Не удалось создать сокет репликации: " + std::string(strerror(errno)));
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd_.get(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config_.port);
+    if (inet_pton(AF_INET, config_.ip.c_str(), &addr.sin_addr) <= 0) {
+        throw std::runtime_error("Неправильный IP адрес репликации: " + config_.ip);
+    }
+    if (bind(listen_fd_.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(listen_fd_.get(), 8) < 0) {
+        throw std::runtime_error("Не удалось открыть порт репликации: " + std::string(strerror(errno)));
+    }
+
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd_.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    port_ = ntohs(addr.sin_port);
+
+    thread_ = std::jthread([this](const std::stop_token &stop_token) {
+        run(stop_token);
+    });
+    spdlog::info("Рассылка репликации запущена на {}:{}", config_.ip, port_);
+}
+
+// Остановка с отправкой всего накопленного
+void replication_publisher::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    thread_.request_stop();
+    thread_.join();
+
+    std::lock_guard lock(mutex_);
+    standbys_.clear();
+    listen_fd_ = socket_raii(-1);
+    spdlog::info("Рассылка репликации остановлена");
+}
+
+int replication_publisher::port() const {
+    return port_;
+}
+
+void replication_publisher::run(const std::stop_token &stop_token) {
+    spdlog::debug("replication_publisher run. Начало функции");
+
+    const std::chrono::milliseconds batch_interval(config_.batch_interval_ms);
+    auto next_batch = std::chrono::steady_clock::now() + batch_interval;
+    std::vector<pollfd> pfds;
+    while (!stop_token.stop_requested()) {
+        // Слушатель и резервные узлы с недописанным пакетом: поток ждёт готовности всех сокетов сразу
+        pfds.assign(1, {listen_fd_.get(), POLLIN, 0});
+        for (const auto &sb : standbys_) {
+            if (sb->out_offset < sb->out.size()) {
+                pfds.push_back({sb->fd.get(), POLLOUT, 0});
+            }
+        }
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(next_batch - std::chrono::steady_clock::now());
+        poll(pfds.data(), pfds.size(), static_cast<int>(std::max<int64_t>(wait.count(), 0)));
+
+        const auto now = std::chrono::steady_clock::now();
+        const bool batch_due = now >= next_batch;
+        if (batch_due) {
+            next_batch = now + batch_interval;
+        }
+        flush_all(now, batch_due);
+        if (pfds[0].revents & POLLIN) {
+            accept_standbys();
+        }
+    }
+    drain();
+
+    spdlog::debug("replication_publisher run. Конец функции");
+}
+
+// Новый резервный узел получает снимок таблицы, согласованный с потоком событий.
+// Под мьютексом session_manager снимок только копируется, отправляет его цикл poll
+void replication_publisher::accept_standbys() {
+    while (true) {
+        sockaddr_in addr{};
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept4(listen_fd_.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                spdlog::error("Ошибка accept репликации: {}", strerror(errno));
+            }
+            return;
+        }
+
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        auto sb = std::make_unique<standby>(socket_raii(fd));
+        sb->last_send = std::chrono::steady_clock::now();
+
+        size_t snapshot_size = 0;
+        manager_.snapshot([&](const session_table &table) {
+            const int64_t now_ns = system_now_ns();
+            sb->pending.push_back({reset_type, {}, {}, now_ns});
+            table.for_each_oldest_first([&](std::string_view imsi, std::chrono::steady_clock::time_point created) {
+                sb->pending.push_back({static_cast<uint8_t>(session_event_type::created), std::string(imsi),
+                    created, now_ns});
+            });
+            snapshot_size = sb->pending.size();
+            sb->limit = snapshot_size + config_.max_lag_events;
+
+            // Регистрация под тем же захватом session_manager: ни одно событие не потеряется между снимком и очередью
+            std::lock_guard lock(mutex_);
+            standbys_.push_back(std::move(sb));
+        });
+
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        spdlog::info("Подключён резервный узел {}:{}, снимок {} сессий", ip, ntohs(addr.sin_port), snapshot_size - 1);
+    }
+}
+
+// Отправка накопленного резервным узлам, отставшие и отвалившиеся отключаются
+void replication_publisher::flush_all(std::chrono::steady_clock::time_point now, bool batch_due) {
+    for (size_t i = 0; i < standbys_.size();) {
+        if (flush(*standbys_[i], now, batch_due)) {
+            ++i;
+            continue;
+        }
+
+        std::lock_guard lock(mutex_);
+        standbys_.erase(standbys_.begin() + static_cast<ptrdiff_t>(i));
+    }
+}
+
+// Сокет пишется без ожидания: недописанный пакет остаётся в sb.out до POLLOUT, поэтому медленный
+// резервный узел не задерживает пакеты и heartbeat остальным. Следующий пакет берётся из очереди,
+// когда предыдущий ушёл целиком: по расписанию или сразу, если набран полный пакет, как при снимке
+bool replication_publisher::flush(standby &sb, std::chrono::steady_clock::time_point now, bool batch_due) {
+    bool overflow;
+    {
+        std::lock_guard lock(mutex_);
+        overflow = sb.overflow;
+    }
+    if (overflow) {
+        // Без этой записи резервный узел принял бы закрытие соединения за падение основного.
+        // Отправка без ожидания: если буфер сокета полон, резервный узел увидит закрытие после прочитанного
+        // и тоже переподключится, ведь основной узел доступен
+        const queued_event resync{resync_type, {}, {}, system_now_ns()};
+        sb.out += encode_batch(&resync, 1, now);
+        send_some(sb.fd.get(), sb.out, sb.out_offset);
+        spdlog::warn("Резервный узел отстал больше чем на {} событий и отключён до нового снимка",
+            config_.max_lag_events);
+        dropped_standbys_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const std::chrono::milliseconds failover_timeout(config_.failover_timeout_ms);
+    if (sb.out_offset < sb.out.size() && now - sb.last_progress > failover_timeout) {
+        spdlog::warn("Резервный узел не читает данные дольше {} мс и отключён", config_.failover_timeout_ms);
+        dropped_standbys_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Без событий время от времени шлём пустой пакет, чтобы резервный узел знал, что основной жив
+    const auto heartbeat_interval = std::chrono::milliseconds(config_.failover_timeout_ms / 4);
+    while (true) {
+        if (sb.out_offset == sb.out.size()) {
+            std::vector<queued_event> events;
+            {
+                std::lock_guard lock(mutex_);
+                if (batch_due || sb.pending.size() >= max_batch_events) {
+                    const auto last = sb.pending.begin()
+                        + static_cast<ptrdiff_t>(std::min(max_batch_events, sb.pending.size()));
+                    events.assign(std::make_move_iterator(sb.pending.begin()), std::make_move_iterator(last));
+                    sb.pending.erase(sb.pending.begin(), last);
+                }
+            }
+            if (events.empty() && (!batch_due || now - sb.last_send < heartbeat_interval)) {
+                return true;
+            }
+
+            sb.out = encode_batch(events.begin(), events.size(), now);
+            sb.out_offset = 0;
+            sb.last_send = now;
+            sb.last_progress = now;
+            events_.fetch_add(events.size(), std::memory_order_relaxed);
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            bytes_.fetch_add(sb.out.size(), std::memory_order_relaxed);
+        }
+
+        const size_t offset = sb.out_offset;
+        if (!send_some(sb.fd.get(), sb.out, sb.out_offset)) {
+            spdlog::warn("Резервный узел отключился: {}", strerror(errno));
+            return false;
+        }
+        if (sb.out_offset == offset) {
+            return true;  // буфер сокета полон, ждём POLLOUT
+        }
+        sb.last_progress = now;
+    }
+}
+
+// Остановка: накопленное дописывается с ожиданием готовности сокетов, но не дольше failover_timeout_ms
+void replication_publisher::drain() {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.failover_timeout_ms);
+    std::vector<pollfd> pfds;
+    while (true) {
+        const auto now = std::chrono::steady_clock::now();
+        flush_all(now, true);
+
+        pfds.clear();
+        for (const auto &sb : standbys_) {
+            if (sb->out_offset < sb->out.size()) {
+                pfds.push_back({sb->fd.get(), POLLOUT, 0});
+            }
+        }
+        if (pfds.empty() || now >= deadline) {
+            return;
+        }
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+        poll(pfds.data(), pfds.size(), static_cast<int>(wait.count()));
+    }
+}
+
+replication_stats replication_publisher::stats() {
+    replication_stats stats;
+    {
+        std::lock_guard lock(mutex_);
+        stats.standbys = standbys_.size();
+        for (const auto &sb : standbys_) {
+            stats.queued_events += sb->pending.size();
+        }
+    }
+    stats.events = events_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.dropped_standbys = dropped_standbys_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Конструктор резервного узла репликации
+replication_subscriber::replication_subscriber(session_manager &manager, const replication_config &config,
+    std::function<void()> on_primary_lost)
+: manager_(manager), config_(config), on_primary_lost_(std::move(on_primary_lost)) {}
+
+replication_subscriber::~replication_subscriber() {
+    stop();
+}
+
+void replication_subscriber::start() {
+    if (thread_.joinable()) {
+        spdlog::warn("Повторный запуск приёма репликации");
+        return;
+    }
+
+    stop_event_.consume();
+    thread_ = std::jthread([this](const std::stop_token &stop_token) {
+        run(stop_token);
+    });
+    spdlog::info("Приём репликации с {}:{} запущен", config_.ip, config_.port);
+}
+
+// Остановка: поток ждёт подключения и данных в poll вместе с stop_event_
+void replication_subscriber::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    thread_.request_stop();
+    stop_event_.notify();
+    thread_.join();
+    spdlog::info("Приём репликации остановлен");
+}
+
+void replication_subscriber::run(const std::stop_token &stop_token) {
+    spdlog::debug("replication_subscriber run. Начало функции");
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config_.port);
+    if (inet_pton(AF_INET, config_.ip.c_str(), &addr.sin_addr) <= 0) {
+        spdlog::critical("Неправильный IP адрес основного узла: {}", config_.ip);
+        return;
+    }
+
+    // Ждём, пока основной узел поднимется
+    socket_raii fd(-1);
+    while (!stop_token.stop_requested() && (fd = connect_primary(addr)).get() < 0) {
+        pollfd wake{stop_event_.get(), POLLIN, 0};
+        poll(&wake, 1, 100);
+    }
+
+    while (!stop_token.stop_requested()) {
+        connected_ = true;
+        spdlog::info("Подключились к основному узлу {}:{}", config_.ip, config_.port);
+
+        batch_status status;
+        do {
+            status = receive_batch(fd.get());
+        } while (status == batch_status::applied && !stop_token.stop_requested());
+
+        connected_ = false;
+        if (stop_token.stop_requested()) {
+            break;
+        }
+
+        // Закрытие соединения ещё не потеря основного узла: он отключает отставший резервный узел
+        // или перезапускает рассылку. Переключаемся, только если он молчит или не принимает подключение
+        if (status == batch_status::silent) {
+            spdlog::warn("Нет данных от основного узла {}:{} дольше {} мс", config_.ip, config_.port,
+                config_.failover_timeout_ms);
+        } else {
+            spdlog::warn("Основной узел {}:{} закрыл соединение{}, переподключаемся за снимком", config_.ip,
+                config_.port, status == batch_status::resync ? " из-за отставания" : "");
+            fd = connect_primary(addr);
+            if (fd.get() >= 0) {
+                resyncs_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (stop_token.stop_requested()) {
+                break;
+            }
+            spdlog::warn("Основной узел {}:{} недоступен", config_.ip, config_.port);
+        }
+
+        if (on_primary_lost_) {
+            on_primary_lost_();
+        }
+        break;
+    }
+
+    spdlog::debug("replication_subscriber run. Конец функции");
+}
+
+socket_raii replication_subscriber::connect_primary(const sockaddr_in &addr) {
+    socket_raii fd(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0));
+    if (fd.get() < 0) {
+        spdlog::error("Не удалось создать сокет репликации: {}", strerror(errno));
+        return fd;
+    }
+
+    // Недоступный основной узел не держит поток дольше failover_timeout_ms, остановка прерывает ожидание сразу
+    if (connect(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            return socket_raii(-1);
+        }
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (!wait_ready(fd.get(), POLLOUT, stop_event_.get(), std::chrono::milliseconds(config_.failover_timeout_ms))
+            || getsockopt(fd.get(), SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 || error != 0) {
+            return socket_raii(-1);
+        }
+    }
+    return fd;
+}
+
+// Приём и применение одного пакета. Тишина дольше failover_timeout_ms означает потерю основного узла,
+// испорченный пакет - закрытие соединения, после которого нужен свежий снимок
+replication_subscriber::batch_status replication_subscriber::receive_batch(int fd) {
+    const std::chrono::milliseconds timeout(config_.failover_timeout_ms);
+    const auto lost = [](read_status status) {
+        return status == read_status::silent ? batch_status::silent : batch_status::closed;
+    };
+
+    char length_bytes[4];
+    if (const read_status status = read_exact(fd, length_bytes, sizeof(length_bytes), stop_event_.get(), timeout);
+        status != read_status::ok) {
+        return lost(status);
+    }
+
+    const uint32_t length = get_uint(length_bytes, 4);
+    if (length < batch_header_size - 4) {
+        spdlog::error("Некорректный пакет репликации длиной {}", length);
+        return batch_status::closed;
+    }
+
+    std::string batch(length, '\0');
+    if (const read_status status = read_exact(fd, batch.data(), length, stop_event_.get(), timeout);
+        status != read_status::ok) {
+        return lost(status);
+    }
+
+    const char *data = batch.data();
+    const int64_t oldest_enqueued_ns = static_cast<int64_t>(get_uint(data + 8, 8));
+    const uint32_t count = get_uint(data + 16, 4);
+    size_t pos = 20;
+
+    const auto now = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (pos + 10 > batch.size()) {
+            spdlog::error("Обрезанная запись в пакете репликации");
+            return batch_status::closed;
+        }
+        const uint8_t type = static_cast<uint8_t>(data[pos]);
+        const auto age = std::chrono::milliseconds(get_uint(data + pos + 1, 8));
+        const uint8_t imsi_length = static_cast<uint8_t>(data[pos + 9]);
+        pos += 10;
+        if (pos + imsi_length > batch.size()) {
+            spdlog::error("Обрезанная запись в пакете репликации");
+            return batch_status::closed;
+        }
+        const std::string_view imsi(data + pos, imsi_length);
+        pos += imsi_length;
+
+        if (type == resync_type) {
+            spdlog::warn("Репликация: основной узел отключает резервный из-за отставания");
+            return batch_status::resync;
+        }
+        if (type == reset_type) {
+            spdlog::info("Репликация: получен снимок таблицы, локальная копия сброшена");
+            manager_.clear_replica();
+            continue;
+        }
+        manager_.apply_replica_event({static_cast<session_event_type>(type), imsi, now - age});
+    }
+
+    if (count > 0) {
+        const uint64_t lag = std::max<int64_t>(0, (system_now_ns() - oldest_enqueued_ns) / 1'000'000);
+        lag_ms_.store(lag, std::memory_order_relaxed);
+        if (lag > max_lag_ms_.load(std::memory_order_relaxed)) {
+            max_lag_ms_.store(lag, std::memory_order_relaxed);
+        }
+    }
+    events_.fetch_add(count, std::memory_order_relaxed);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(length + 4, std::memory_order_relaxed);
+    return batch_status::applied;
+}
+
+replication_stats replication_subscriber::stats() {
+    replication_stats stats;
+    stats.connected = connected_.load();
+    stats.events = events_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.lag_ms = lag_ms_.load(std::memory_order_relaxed);
+    stats.max_lag_ms = max_lag_ms_.load(std::memory_order_relaxed);
+    stats.resyncs = resyncs_.load(std::memory_order_relaxed);
+    return stats;
+}
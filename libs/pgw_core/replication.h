@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <netinet/in.h>
+#include <thread>
+
+#include "event_fd_raii.h"
+#include "session_manager.h"
+#include "socket_raii.h"
+
+// Счётчики репликации
+struct replication_stats {
+    size_t standbys{};            // primary: подключённые резервные узлы
+    bool connected{};             // standby: есть соединение с основным узлом
+    uint64_t events{};            // primary: отправлено событий, standby: применено
+    uint64_t batches{};
+    uint64_t bytes{};
+    uint64_t queued_events{};     // primary: события, ещё не отправленные резервным узлам
+    uint64_t dropped_standbys{};  // primary: резервные узлы, отключённые за превышение отставания
+    uint64_t lag_ms{};            // standby: отставание последнего пакета от основного узла
+    uint64_t max_lag_ms{};
+    uint64_t resyncs{};           // standby: переподключения за свежим снимком без переключения
+};
+
+// Основной узел: асинхронно рассылает события сессий резервным узлам по TCP.
+// Новый резервный узел сначала получает полный снимок таблицы, затем поток событий.
+// События копятся в очереди и отправляются пакетами раз в batch_interval_ms.
+// Резервный узел, отставший больше чем на max_lag_events событий, получает запись resync
+// и отключается, а при переподключении получает свежий снимок.
+// Сокеты резервных узлов неблокирующие: поток рассылки ждёт их готовности в poll вместе со слушателем,
+// поэтому снимок для нового или медленный резервный узел не задерживают пакеты и heartbeat остальным.
+class replication_publisher {
+    struct queued_event {
+        uint8_t type;                                   // 0 - сброс таблицы перед снимком
+        std::string imsi;
+        std::chrono::steady_clock::time_point created;
+        int64_t enqueued_ns;                            // system_clock, для оценки отставания
+    };
+
+    struct standby {
+        socket_raii fd;
+        std::deque<queued_event> pending;               // под mutex_
+        size_t limit{};
+        bool overflow{};
+        // Дальше только поток рассылки: недописанный пакет и время последней записи в сокет
+        std::string out;
+        size_t out_offset{};
+        std::chrono::steady_clock::time_point last_send;
+        std::chrono::steady_clock::time_point last_progress;
+    };
+
+    session_manager& manager_;
+    replication_config config_;
+    socket_raii listen_fd_;
+    int port_{};
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<standby>> standbys_;
+    std::jthread thread_;
+
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> dropped_standbys_{0};
+
+    void on_event(const session_event& event);
+    void run(const std::stop_token& stop_token);
+    void accept_standbys();
+    bool flush(standby& sb, std::chrono::steady_clock::time_point now, bool batch_due);
+    void flush_all(std::chrono::steady_clock::time_point now, bool batch_due);
+    void drain();
+public:
+    // Слушатель событий регистрируется сразу, publisher должен жить не меньше manager
+    replication_publisher(session_manager& manager, const replication_config& config);
+    ~replication_publisher();
+
+    void start();
+    void stop();
+
+    // Фактический порт, полезно при port = 0
+    int port() const;
+    replication_stats stats();
+};
+
+// Резервный узел: держит тёплую копию таблицы сессий основного узла.
+// Если от основного узла нет данных дольше failover_timeout_ms или после закрытия соединения
+// он не принимает подключение, вызывается on_primary_lost и узел может принять нагрузку со всеми сессиями.
+// Закрытие соединения доступным основным узлом (отставание, перезапуск рассылки) - повод переподключиться
+// за свежим снимком, а не переключаться: иначе оба узла обслуживали бы одни и те же сессии.
+class replication_subscriber {
+    enum class batch_status {
+        applied,
+        resync,  // основной узел отключает резервный из-за отставания
+        closed,  // соединение закрыто или пакет испорчен
+        silent   // нет данных дольше failover_timeout_ms
+    };
+
+    session_manager& manager_;
+    replication_config config_;
+    std::function<void()> on_primary_lost_;
+    // Будит поток в poll при остановке, сокет остаётся только у потока. Объявлен до потока, чтобы его пережить
+    event_fd_raii stop_event_;
+    std::jthread thread_;
+
+    std::atomic<bool> connected_{false};
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> lag_ms_{0};
+    std::atomic<uint64_t> max_lag_ms_{0};
+    std::atomic<uint64_t> resyncs_{0};
+
+    void run(const std::stop_token& stop_token);
+    // Неблокирующее подключение, -1 при ошибке, таймауте или остановке
+    socket_raii connect_primary(const sockaddr_in& addr);
+    batch_status receive_batch(int fd);
+public:
+    replication_subscriber(session_manager& manager, const replication_config& config,
+        std::function<void()> on_primary_lost);
+    ~replication_subscriber();
+
+    void start();
+    void stop();
+
+    replication_stats stats();
+};
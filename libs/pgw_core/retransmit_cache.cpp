@@ -0,0 +1,92 @@
+#include "retransmit_cache.h"
+#include "spdlog/spdlog.h"
+
+// Конструктор кэша ретрансмитов, capacity = 0 отключает кэш
+retransmit_cache::retransmit_cache(size_t capacity, std::chrono::milliseconds ttl) : entries_(capacity), ttl_ms_(ttl.count()) {
+    spdlog::debug("retransmit_cache конструктор, capacity: {}, ttl: {} мс", capacity, ttl.count());
+}
+
+// FNV-1a по адресу, порту и байтам запроса
+uint64_t retransmit_cache::hash(const sockaddr_in &addr, std::string_view request) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&h](const uint8_t byte) {
+        h ^= byte;
+        h *= 1099511628211ULL;
+    };
+
+    const auto *addr_bytes = reinterpret_cast<const uint8_t*>(&addr.sin_addr.s_addr);
+    for (size_t i = 0; i < sizeof(addr.sin_addr.s_addr); ++i) {
+        mix(addr_bytes[i]);
+    }
+    const auto *port_bytes = reinterpret_cast<const uint8_t*>(&addr.sin_port);
+    for (size_t i = 0; i < sizeof(addr.sin_port); ++i) {
+        mix(port_bytes[i]);
+    }
+    for (const char c : request) {
+        mix(static_cast<uint8_t>(c));
+    }
+    return h;
+}
+
+// Поиск сохранённого ответа на такой же запрос от того же отправителя
+std::optional<std::string> retransmit_cache::find(const sockaddr_in &addr, std::string_view request) {
+    if (entries_.empty()) {
+        return std::nullopt;
+    }
+
+    const uint64_t h = hash(addr, request);
+    const std::chrono::milliseconds ttl(ttl_ms_.load(std::memory_order_relaxed));
+    std::lock_guard lock(mutex_);
+    const entry &e = entries_[h % entries_.size()];
+
+    if (e.used && e.hash == h && e.addr == addr.sin_addr.s_addr && e.port == addr.sin_port
+        && e.request == request && std::chrono::steady_clock::now() - e.stored_at <= ttl) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return e.response;
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+// Сохранение ответа, запись по тому же индексу вытесняется
+void retransmit_cache::store(const sockaddr_in &addr, std::string_view request, std::string_view response) {
+    if (entries_.empty()) {
+        return;
+    }
+
+    const uint64_t h = hash(addr, request);
+    std::lock_guard lock(mutex_);
+    entry &e = entries_[h % entries_.size()];
+
+    e.hash = h;
+    e.addr = addr.sin_addr.s_addr;
+    e.port = addr.sin_port;
+    e.used = true;
+    e.stored_at = std::chrono::steady_clock::now();
+    e.request.assign(request);
+    e.response.assign(response);
+}
+
+void retransmit_cache::set_ttl(std::chrono::milliseconds ttl) {
+    ttl_ms_.store(ttl.count(), std::memory_order_relaxed);
+}
+
+bool retransmit_cache::enabled() const {
+    return !entries_.empty();
+}
+
+uint64_t retransmit_cache::hits() const {
+    return hits_.load(std::memory_order_relaxed);
+}
+
+uint64_t retransmit_cache::misses() const {
+    return misses_.load(std::memory_order_relaxed);
+}
+
+// Доля запросов, на которые ответ был взят из кэша
+double retransmit_cache::hit_rate() const {
+    const uint64_t h = hits();
+    const uint64_t total = h + misses();
+    return total == 0 ? 0.0 : static_cast<double>(h) / static_cast<double>(total);
+}
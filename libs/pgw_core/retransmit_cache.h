@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+// Кэш ответов на повторные UDP запросы (ретрансмиты).
+// Ключ - адрес отправителя и хэш содержимого пакета, запись живёт ttl.
+// Размер фиксирован: при коллизии старая запись перезаписывается.
+class retransmit_cache {
+    struct entry {
+        uint64_t hash{};
+        uint32_t addr{};
+        uint16_t port{};
+        bool used{};
+        std::chrono::steady_clock::time_point stored_at;
+        std::string request;
+        std::string response;
+    };
+
+    std::vector<entry> entries_;
+    std::atomic<int64_t> ttl_ms_;  // меняется на ходу через set_ttl
+    std::mutex mutex_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    static uint64_t hash(const sockaddr_in& addr, std::string_view request);
+public:
+    retransmit_cache(size_t capacity, std::chrono::milliseconds ttl);
+
+    std::optional<std::string> find(const sockaddr_in& addr, std::string_view request);
+    void store(const sockaddr_in& addr, std::string_view request, std::string_view response);
+
+    // Новый TTL действует и для уже сохранённых ответов
+    void set_ttl(std::chrono::milliseconds ttl);
+
+    bool enabled() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+    double hit_rate() const;
+};
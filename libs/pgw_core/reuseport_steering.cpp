@@ -0,0 +1,68 @@
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+
+#include "reuseport_steering.h"
+
+namespace {
+    constexpr uint32_t key_multiplier = 2654435761u; // 2^32 / φ
+    constexpr uint32_t key_shift = 16;
+
+    // Цифры BCD хранятся младшей первой, нечётный IMSI дополняется F - как в imsi_to_bcd
+    uint8_t bcd_digit(char c) {
+        return c >= '0' && c <= '9' ? static_cast<uint8_t>(c - '0') : 0x0F;
+    }
+
+    size_t shard_of(uint32_t key, size_t shards) {
+        return (static_cast<uint32_t>(key * key_multiplier) >> key_shift) % shards;
+    }
+}
+
+size_t steering_shard(std::string_view datagram, size_t shards) {
+    if (datagram.size() < 4) {
+        return 0;
+    }
+    uint32_t key = 0;
+    for (const char byte : datagram.substr(datagram.size() - 4)) {
+        key = key << 8 | static_cast<uint8_t>(byte);
+    }
+    return shard_of(key, shards);
+}
+
+size_t imsi_shard(std::string_view imsi, size_t shards) {
+    std::string bcd;
+    for (size_t i = 0; i < imsi.size(); i += 2) {
+        const uint8_t high = i + 1 < imsi.size() ? bcd_digit(imsi[i + 1]) : 0x0F;
+        bcd.push_back(static_cast<char>(bcd_digit(imsi[i]) | high << 4));
+    }
+    return steering_shard(bcd, shards);
+}
+
+std::vector<sock_filter> make_steering_program(size_t shards) {
+    if (shards == 0 || shards > UINT32_MAX) {
+        throw std::invalid_argument("Число потоков для программы распределения должно быть от 1");
+    }
+
+    // Данные пакета для программы SO_REUSEPORT начинаются после заголовка UDP
+    return {
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),                     // A = длина датаграммы
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 4, 1, 0),              // короче 4 байт -
+        BPF_STMT(BPF_RET | BPF_K, 0),                              //   в сокет 0
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 4),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),                           // X = длина - 4
+        BPF_STMT(BPF_LD | BPF_W | BPF_IND, 0),                     // A = последние 4 байта, big endian
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, key_multiplier),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, key_shift),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(shards)),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+}
+
+void attach_steering_program(int fd, size_t shards) {
+    std::vector<sock_filter> program = make_steering_program(shards);
+    const sock_fprog fprog{static_cast<unsigned short>(program.size()), program.data()};
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) < 0) {
+        throw std::runtime_error(std::string("Не удалось подключить программу распределения SO_REUSEPORT: ")
+            + strerror(errno));
+    }
+}
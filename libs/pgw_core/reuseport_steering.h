@@ -0,0 +1,24 @@
+#pragma once
+
+#include <linux/filter.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Распределение UDP запросов по потокам в режиме udp_workers > 1.
+// Ключ - последние 4 байта датаграммы: хвост BCD IMSI и в простом, и в расширенном пакете (protocol.h).
+// Ключ перемешивается умножением, поток - старшие биты по модулю числа потоков.
+// То же вычисление выполняет классическая BPF программа группы SO_REUSEPORT,
+// поэтому ядро сразу кладёт пакет в сокет потока-владельца IMSI
+size_t steering_shard(std::string_view datagram, size_t shards);
+
+// Поток-владелец IMSI для HTTP запросов: совпадает с потоком простого пакета с этим IMSI.
+// Для расширенного пакета с IMSI короче 7 цифр хвост захватывает заголовок и поток может
+// отличаться, такой пакет поток передаёт владельцу сам
+size_t imsi_shard(std::string_view imsi, size_t shards);
+
+// Программа для SO_ATTACH_REUSEPORT_CBPF: возвращает номер сокета в группе
+std::vector<sock_filter> make_steering_program(size_t shards);
+
+// Подключение программы к группе SO_REUSEPORT сокета fd, runtime_error при ошибке
+void attach_steering_program(int fd, size_t shards);
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstring>
+#include <sys/epoll.h>
+#include <thread>
+
+#include "epoll_raii.h"
+#include "event_fd_raii.h"
+#include "io_scheduler.h"
+#include "session_clock.h"
+#include "spdlog/spdlog.h"
+#include "timer_fd_raii.h"
+
+namespace {
+    // Поток, выполняющий задачу по срабатываниям timerfd. Отмена будит его через eventfd
+    class steady_periodic_task final : public periodic_task {
+        timer_fd_raii timer_;
+        event_fd_raii cancel_;
+        epoll_raii epoll_;
+        std::jthread thread_;
+
+    public:
+        steady_periodic_task(std::chrono::nanoseconds period, std::function<void()> task) : timer_(period) {
+            for (int fd : {timer_.get(), cancel_.get()}) {
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                if (epoll_ctl(epoll_.get(), EPOLL_CTL_ADD, fd, &event) < 0) {
+                    throw std::runtime_error(std::string("Не удалось добавить fd в epoll: ") + strerror(errno));
+                }
+            }
+
+            thread_ = std::jthread([this, task = std::move(task)] {
+                while (true) {
+                    epoll_event event{};
+                    if (epoll_wait(epoll_.get(), &event, 1, -1) < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        // Без этого потока чистка сессий и CDR о закрытии по времени больше не выполняются
+                        spdlog::critical("Ошибка epoll_wait, периодическая задача остановлена: {}", strerror(errno));
+                        break;
+                    }
+                    if (event.data.fd == cancel_.get()) {
+                        break;
+                    }
+
+                    // Пропущенные срабатывания не догоняются пачкой: задача выполняется один раз
+                    if (timer_.consume() > 0) {
+                        task();
+                    }
+                }
+            });
+        }
+
+        ~steady_periodic_task() override {
+            cancel_.notify();
+        }
+    };
+
+    // Отмена задачи корутины планировщика: флаг проверяется под тем же мьютексом, под которым
+    // выполняется задача. Мьютекс рекурсивный, чтобы задачу можно было отменить из неё самой
+    struct scheduled_cancel {
+        std::recursive_mutex mutex;
+        bool cancelled = false;
+    };
+
+    class scheduler_periodic_task final : public periodic_task {
+        std::shared_ptr<scheduled_cancel> cancel_;
+
+    public:
+        explicit scheduler_periodic_task(std::shared_ptr<scheduled_cancel> cancel) : cancel_(std::move(cancel)) {}
+
+        ~scheduler_periodic_task() override {
+            std::lock_guard lock(cancel_->mutex);
+            cancel_->cancelled = true;
+        }
+    };
+
+    // Пропущенные из-за занятости потока сроки не догоняются: следующий срок - через period после задачи
+    io_task run_every(io_scheduler& scheduler, std::chrono::nanoseconds period, std::function<void()> task,
+        std::shared_ptr<scheduled_cancel> cancel) {
+        while (true) {
+            co_await scheduler.sleep_for(period);
+            std::lock_guard lock(cancel->mutex);
+            if (cancel->cancelled) {
+                co_return;
+            }
+            task();
+        }
+    }
+}
+
+std::unique_ptr<periodic_task> steady_session_clock::schedule_every(std::chrono::nanoseconds period,
+    std::function<void()> task) {
+    return std::make_unique<steady_periodic_task>(period, std::move(task));
+}
+
+class manual_session_clock::handle final : public periodic_task {
+    manual_session_clock& clock_;
+    uint64_t id_;
+
+public:
+    handle(manual_session_clock& clock, uint64_t id) : clock_(clock), id_(id) {}
+
+    ~handle() override {
+        clock_.cancel(id_);
+    }
+};
+
+std::unique_ptr<periodic_task> manual_session_clock::schedule_every(std::chrono::nanoseconds period,
+    std::function<void()> task) {
+    std::lock_guard lock(mutex_);
+    const uint64_t id = next_id_++;
+    tasks_.push_back({id, now() + std::chrono::duration_cast<time_point::duration>(period), period, std::move(task)});
+    return std::make_unique<handle>(*this, id);
+}
+
+void manual_session_clock::cancel(uint64_t id) {
+    std::lock_guard run_lock(run_mutex_);
+    std::lock_guard lock(mutex_);
+    std::erase_if(tasks_, [id](const scheduled& s) { return s.id == id; });
+}
+
+void manual_session_clock::advance_to(time_point target) {
+    std::lock_guard run_lock(run_mutex_);
+    while (true) {
+        std::function<void()> task;
+        {
+            std::lock_guard lock(mutex_);
+            auto due = std::ranges::min_element(tasks_, {}, &scheduled::due);
+            if (due == tasks_.end() || due->due > target) {
+                break;
+            }
+
+            if (due->due > now()) {
+                ticks_.store(due->due.time_since_epoch().count(), std::memory_order_release);
+            }
+            due->due += std::chrono::duration_cast<time_point::duration>(due->period);
+            task = due->task;
+        }
+        task();
+    }
+
+    if (target > now()) {
+        ticks_.store(target.time_since_epoch().count(), std::memory_order_release);
+    }
+}
+
+void manual_session_clock::advance(std::chrono::nanoseconds delta) {
+    advance_to(now() + std::chrono::duration_cast<time_point::duration>(delta));
+}
+
+std::unique_ptr<periodic_task> scheduler_session_clock::schedule_every(std::chrono::nanoseconds period,
+    std::function<void()> task) {
+    auto cancel = std::make_shared<scheduled_cancel>();
+    scheduler_.spawn(run_every(scheduler_, period, std::move(task), cancel));
+    return std::make_unique<scheduler_periodic_task>(std::move(cancel));
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class io_scheduler;
+
+// Периодическая задача, отменяется при уничтожении. После деструктора задача больше не выполняется
+class periodic_task {
+public:
+    virtual ~periodic_task() = default;
+};
+
+// Источник времени и планировщик для session_manager. В работе - steady_clock и поток с таймером,
+// в реплее, тестах и моделировании - виртуальное время, которое двигают вручную
+class session_clock {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    virtual ~session_clock() = default;
+    virtual time_point now() const = 0;
+
+    // Запуск task каждые period, первый раз через period от now()
+    virtual std::unique_ptr<periodic_task> schedule_every(std::chrono::nanoseconds period,
+        std::function<void()> task) = 0;
+};
+
+class steady_session_clock final : public session_clock {
+public:
+    time_point now() const override {
+        return std::chrono::steady_clock::now();
+    }
+
+    // Задача выполняется в отдельном потоке, отмена не ждёт конца периода
+    std::unique_ptr<periodic_task> schedule_every(std::chrono::nanoseconds period,
+        std::function<void()> task) override;
+};
+
+// Виртуальное время: стоит на месте, пока его не сдвинут. Задачи выполняются в потоке,
+// который двигает время, по порядку сроков и с now(), равным сроку задачи.
+// Так сутки работы с чисткой раз в секунду моделируются за время самих проходов чистки
+class manual_session_clock final : public session_clock {
+    struct scheduled {
+        uint64_t id;
+        time_point due;
+        std::chrono::nanoseconds period;
+        std::function<void()> task;
+    };
+
+    class handle;
+
+    std::atomic<time_point::rep> ticks_;
+    std::mutex mutex_;                // защищает tasks_
+    std::recursive_mutex run_mutex_;  // держится на время выполнения задачи, отмена его ждёт
+    std::vector<scheduled> tasks_;
+    uint64_t next_id_ = 1;
+
+    void cancel(uint64_t id);
+public:
+    explicit manual_session_clock(time_point start = time_point{}) : ticks_(start.time_since_epoch().count()) {}
+
+    time_point now() const override {
+        return time_point(time_point::duration(ticks_.load(std::memory_order_acquire)));
+    }
+
+    std::unique_ptr<periodic_task> schedule_every(std::chrono::nanoseconds period,
+        std::function<void()> task) override;
+
+    // Сдвиг времени вперёд с выполнением всех задач, срок которых наступил. Назад время не идёт
+    void advance_to(time_point target);
+    void advance(std::chrono::nanoseconds delta);
+};
+
+// Время steady_clock, задачи - корутины io_scheduler в его потоке, без отдельного потока на задачу.
+// schedule_every вызывается до запуска run или из потока планировщика; отмена возможна из любого потока
+// и ждёт окончания выполняющейся задачи
+class scheduler_session_clock final : public session_clock {
+    io_scheduler& scheduler_;
+
+public:
+    explicit scheduler_session_clock(io_scheduler& scheduler) : scheduler_(scheduler) {}
+
+    time_point now() const override {
+        return std::chrono::steady_clock::now();
+    }
+
+    std::unique_ptr<periodic_task> schedule_every(std::chrono::nanoseconds period,
+        std::function<void()> task) override;
+};
@@ -0,0 +1,113 @@
+#include <algorithm>
+
+#include "session_event_stream.h"
+
+const char* session_event_name(session_event_type type) {
+    switch (type) {
+        case session_event_type::created:
+            return "created";
+        case session_event_type::released:
+            return "released";
+        case session_event_type::expired:
+            return "expired";
+        case session_event_type::evicted:
+            return "evicted";
+    }
+    return "unknown";
+}
+
+session_event_stream::subscription::subscription(session_event_stream& stream, size_t capacity, std::string prefix)
+    : stream_(stream), ring_(capacity), prefix_(std::move(prefix)) {}
+
+// Подписчик уходит из ленты, события ему больше не копируются
+session_event_stream::subscription::~subscription() {
+    std::lock_guard lock(stream_.mutex_);
+    std::erase(stream_.subscribers_, this);
+}
+
+bool session_event_stream::subscription::wait(std::vector<stream_event>& out, uint64_t& dropped,
+    std::chrono::milliseconds timeout) {
+    std::unique_lock lock(stream_.mutex_);
+    stream_.ready_.wait_for(lock, timeout, [this] { return stream_.closed_ || size_ > 0 || dropped_ > 0; });
+    // Накопленное до закрытия отдаётся, например закрытие сессий при выключении
+    if (stream_.closed_ && size_ == 0 && dropped_ == 0) {
+        return false;
+    }
+
+    out.clear();
+    out.reserve(size_);
+    for (; size_ > 0; --size_) {
+        out.push_back(std::move(ring_[head_]));
+        head_ = (head_ + 1) % ring_.size();
+    }
+    stream_.delivered_ += out.size();
+    dropped = std::exchange(dropped_, 0);
+    return true;
+}
+
+uint64_t session_event_stream::subscription::dropped_total() const {
+    std::lock_guard lock(stream_.mutex_);
+    return dropped_total_;
+}
+
+session_event_stream::session_event_stream(size_t buffer_events, size_t max_subscribers)
+    : buffer_events_(std::max<size_t>(buffer_events, 1)), max_subscribers_(max_subscribers) {}
+
+void session_event_stream::attach(session_manager& manager) {
+    manager.add_event_listener([this](const session_event& event) {
+        on_event(event);
+    });
+}
+
+// Вызывается под мьютексом session_manager: только копирование в буферы, форматирует поток подписчика
+void session_event_stream::on_event(const session_event& event) {
+    std::lock_guard lock(mutex_);
+    const uint64_t seq = next_seq_++;
+    if (subscribers_.empty()) {
+        return;
+    }
+
+    const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    bool woken = false;
+    for (subscription* sub : subscribers_) {
+        if (!event.imsi.starts_with(sub->prefix_)) {
+            continue;
+        }
+        if (sub->size_ == sub->ring_.size()) {
+            ++sub->dropped_;
+            ++sub->dropped_total_;
+            ++dropped_;
+        } else {
+            sub->ring_[(sub->head_ + sub->size_) % sub->ring_.size()] = {seq, event.type, std::string(event.imsi), now_ms};
+            ++sub->size_;
+        }
+        woken = true;
+    }
+    if (woken) {
+        ready_.notify_all();
+    }
+}
+
+std::unique_ptr<session_event_stream::subscription> session_event_stream::subscribe(std::string prefix) {
+    std::lock_guard lock(mutex_);
+    if (closed_ || subscribers_.size() >= max_subscribers_) {
+        return nullptr;
+    }
+    auto sub = std::make_unique<subscription>(*this, buffer_events_, std::move(prefix));
+    subscribers_.push_back(sub.get());
+    return sub;
+}
+
+void session_event_stream::close() {
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    ready_.notify_all();
+}
+
+event_stream_stats session_event_stream::stats() const {
+    std::lock_guard lock(mutex_);
+    return {subscribers_.size(), next_seq_ - 1, delivered_, dropped_};
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "session_manager.h"
+
+// Событие сессии в ленте подписчика
+struct stream_event {
+    uint64_t seq;
+    session_event_type type;
+    std::string imsi;
+    int64_t time_ms;    // system_clock, когда событие произошло
+};
+
+// Счётчики ленты событий
+struct event_stream_stats {
+    size_t subscribers{};
+    uint64_t events{};      // событий с момента запуска
+    uint64_t delivered{};   // отдано подписчикам
+    uint64_t dropped{};     // потеряно из-за переполнения буферов подписчиков
+};
+
+const char* session_event_name(session_event_type type);
+
+// Лента событий сессий для внешних подписчиков: создание, вытеснение, истечение и закрытие при выключении.
+// Подключается слушателем к session_manager, как рассылка репликации: событие копируется в буфер
+// каждого подписчика под мьютексом ленты, а забирает его поток подписчика. Буфер подписчика ограничен,
+// при переполнении новое событие теряется и учитывается в dropped подписчика и ленты
+class session_event_stream {
+public:
+    class subscription {
+        friend class session_event_stream;
+
+        session_event_stream& stream_;
+        std::vector<stream_event> ring_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+        uint64_t dropped_ = 0;          // не сообщённые подписчику потери
+        uint64_t dropped_total_ = 0;
+        std::string prefix_;
+
+    public:
+        subscription(session_event_stream& stream, size_t capacity, std::string prefix);
+        ~subscription();
+
+        // Ждёт событий не дольше timeout и переносит накопленные в out, dropped - потери с прошлого вызова.
+        // false - лента закрыта и всё накопленное уже забрано
+        bool wait(std::vector<stream_event>& out, uint64_t& dropped, std::chrono::milliseconds timeout);
+        uint64_t dropped_total() const;
+    };
+
+private:
+    size_t buffer_events_;
+    size_t max_subscribers_;
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<subscription*> subscribers_;
+    bool closed_ = false;
+    uint64_t next_seq_ = 1;
+    uint64_t delivered_ = 0;
+    uint64_t dropped_ = 0;
+
+    void on_event(const session_event& event);
+
+public:
+    // buffer_events - размер буфера одного подписчика
+    session_event_stream(size_t buffer_events, size_t max_subscribers);
+
+    // Подписка на события всех менеджеров, только до начала обработки запросов. Лента должна жить
+    // не меньше менеджеров
+    void attach(session_manager& manager);
+
+    // Новый подписчик на события IMSI с префиксом prefix, nullptr при достижении max_subscribers
+    // или после close
+    std::unique_ptr<subscription> subscribe(std::string prefix = {});
+    // Будит всех ждущих подписчиков, wait после этого возвращает false
+    void close();
+
+    event_stream_stats stats() const;
+};
@@ -1,14 +1,22 @@
+#include "probes.h"
 #include "session_manager.h"
 
 // Конструктор для session_manager
-session_manager::session_manager(const server_config &config) {
+session_manager::session_manager(const server_config &config, std::shared_ptr<session_clock> clock)
+: evict_oldest_(config.session_limit_policy == "evict_oldest"), sessions_(config.max_sessions),
+clock_(clock ? std::move(clock) : std::make_shared<steady_session_clock>()),
+session_timeout_sec_(config.session_timeout_sec), graceful_shutdown_rate_(config.graceful_shutdown_rate) {
     spdlog::debug("session_manager конструктор. Начало функции");
 
     config_ = config;
-    cdr_writer_ = std::make_unique<cdr_writer>(config.cdr_file);
+    cdr_sink_ = make_cdr_sink(config, clock_);
     blacklist_ = {config_.blacklist.begin(), config_.blacklist.end()};
 
     spdlog::info("session_manager проинициализирован, в блэклисте {} абонентов", blacklist_.size());
+    if (config_.max_sessions > 0) {
+        spdlog::info("Ограничение {} сессий, при достижении: {}", config_.max_sessions,
+            evict_oldest_ ? "вытеснение самой старой" : "отказ");
+    }
     spdlog::debug("session_manager конструктор. Конец функции");
 }
 
@@ -16,69 +24,179 @@ session_manager::session_manager(const server_config &config) {
 session_manager::~session_manager() {
     spdlog::debug("session_manager деструктор. Начало функции");
 
-    // jthread автоматически запросит остановку через stop_token
-    // и дождется завершения потока при уничтожении
+    // Задача чистки отменяется при уничтожении cleaning_task_
 
     spdlog::debug("session_manager деструктор. Конец функции");
 }
 
-// Запуск потока, который будет завершать сессии по таймеру
+// Запуск периодической задачи, которая будет завершать сессии по таймеру
 void session_manager::start_cleaning() {
     spdlog::debug("start_cleaning. Начало функции");
 
-    if (cleaning_thread_.joinable()) {
+    if (cleaning_task_) {
         spdlog::warn("start_cleaning. Повторное начало чистки сессий");
         spdlog::debug("start_cleaning. Конец функции");
         return;
     }
 
-    cleaning_thread_ = std::jthread(&session_manager::clean_expired_sessions, this);
+    cleaning_task_ = clock_->schedule_every(std::chrono::seconds(1), [this] {
+        expire_sessions();
+    });
 
-    spdlog::info("Очистка сессий в потоке началась");
+    spdlog::info("Очистка сессий началась");
     spdlog::debug("start_cleaning. Конец функции");
 }
 
-// Остановка потока для чистки
+// Остановка чистки
 void session_manager::stop_cleaning() {
     spdlog::debug("stop_cleaning. Начало функции");
 
-    if (cleaning_thread_.joinable()) {
-        cleaning_thread_.request_stop(); // Запрашиваем остановку
-        cleaning_thread_.join();         // Ждем завершения
+    if (cleaning_task_) {
+        cleaning_task_.reset(); // Отмена ждёт завершения текущего прохода
     } else {
-        spdlog::warn("Остановка неработающего потока чистки");
+        spdlog::warn("Остановка неработающей чистки");
         spdlog::debug("stop_cleaning. Конец функции");
         return;
     }
 
-    spdlog::info("Очистка сессий в потоке завершилась");
+    spdlog::info("Очистка сессий завершилась");
     spdlog::debug("stop_cleaning. Конец функции");
 }
 
-// Обработка запроса на создание сессии
-std::string session_manager::process_request(const std::string &imsi) {
-    spdlog::info("Получен запрос на создание сессии от imsi {}", imsi);
-
+// Проверки без мьютекса: блэклист и длина IMSI
+bool session_manager::accept_request(const std::string &imsi) {
     // Если imsi в блэклисте
     if (blacklist_.contains(imsi)) {
         spdlog::info("imsi {} в блэклисте, запрос отклонён", imsi);
-        return "rejected";
+        PGW_PROBE(session_blacklisted, imsi.c_str());
+        rejected_blacklist_.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
-    std::lock_guard lock(mutex_);
-    // Если уже создана сессия
-    if (sessions_.contains(imsi)) {
+    // Если imsi не может быть настоящим
+    if (!session_table::is_valid_imsi(imsi)) {
+        spdlog::warn("imsi {} длиннее {} цифр, запрос отклонён", imsi, session_table::max_imsi_length);
+        return false;
+    }
+    return true;
+}
+
+// Создание сессии под mutex_. CDR не пишутся сразу, а дописываются в cdr
+std::string_view session_manager::create_session_locked(const std::string &imsi, std::vector<cdr_event> &cdr) {
+    // Достигнуто ограничение на количество сессий
+    if (config_.max_sessions > 0 && sessions_.size() >= static_cast<size_t>(config_.max_sessions)
+        && !sessions_.contains(imsi)) {
+        if (!evict_oldest_) {
+            spdlog::warn("Достигнуто ограничение {} сессий, запрос imsi {} отклонён", config_.max_sessions, imsi);
+            rejected_limit_.fetch_add(1, std::memory_order_relaxed);
+            PGW_PROBE(session_rejected_limit, imsi.c_str());
+            return "rejected";
+        }
+
+        // Вытесняем самую старую сессию
+        auto [oldest, oldest_created] = *sessions_.oldest();
+        std::string evicted(oldest);
+        notify(session_event_type::evicted, evicted, oldest_created);
+        sessions_.erase(evicted);
+        evicted_.fetch_add(1, std::memory_order_relaxed);
+        PGW_PROBE(session_evicted, evicted.c_str());
+        spdlog::info("Достигнуто ограничение {} сессий, сессия с imsi {} вытеснена", config_.max_sessions, evicted);
+        cdr.push_back({std::move(evicted), "Сессия вытеснена"});
+    }
+
+    // Новая сессия, если её ещё нет
+    const auto now = clock_->now();
+    if (!sessions_.insert(imsi, now)) {
         spdlog::info("Сессия с imsi {} уже существует", imsi);
+        rejected_duplicate_.fetch_add(1, std::memory_order_relaxed);
+        PGW_PROBE(session_duplicate, imsi.c_str());
         return "rejected";
     }
 
-    // Новая сессия
-    sessions_[imsi] = std::chrono::steady_clock::now();
+    created_.fetch_add(1, std::memory_order_relaxed);
+    if (sessions_.size() > peak_sessions_.load(std::memory_order_relaxed)) {
+        peak_sessions_.store(sessions_.size(), std::memory_order_relaxed);
+    }
+    notify(session_event_type::created, imsi, now);
+    PGW_PROBE(session_created, imsi.c_str());
     spdlog::info("Новая сессия с imsi {} создана", imsi);
-    cdr_writer_->write(imsi, "Сессия создана");
+    cdr.push_back({imsi, "Сессия создана"});
     return "created";
 }
 
+// Обработка запроса на создание сессии
+std::string session_manager::process_request(const std::string &imsi, request_trace *trace) {
+    spdlog::info("Получен запрос на создание сессии от imsi {}", imsi);
+
+    if (!accept_request(imsi)) {
+        return "rejected";
+    }
+
+    if (trace) {
+        trace->mark(latency_stage::checks);
+    }
+
+    // Не больше двух записей: вытеснение и создание
+    thread_local std::vector<cdr_event> cdr;
+    cdr.clear();
+
+    std::lock_guard lock(mutex_);
+    if (trace) {
+        trace->mark(latency_stage::lock_wait);
+    }
+
+    const std::string_view result = create_session_locked(imsi, cdr);
+    if (trace) {
+        trace->mark(latency_stage::table_op);
+    }
+    if (!cdr.empty()) {
+        cdr_sink_->write_batch(cdr);
+        if (trace) {
+            trace->mark(latency_stage::cdr);
+        }
+    }
+    return std::string(result);
+}
+
+// Пакетная обработка: те же проверки и тот же порядок, что у process_request по очереди
+void session_manager::process_requests(std::span<const std::string> imsis, std::span<std::string_view> results) {
+    if (results.size() != imsis.size()) {
+        throw std::invalid_argument("Число ответов не совпадает с числом запросов в пакете");
+    }
+    spdlog::debug("Получен пакет из {} запросов на создание сессий", imsis.size());
+
+    std::vector<size_t> accepted;
+    accepted.reserve(imsis.size());
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        if (accept_request(imsis[i])) {
+            accepted.push_back(i);
+        } else {
+            results[i] = "rejected";
+        }
+    }
+    if (accepted.empty()) {
+        return;
+    }
+
+    std::vector<cdr_event> cdr;
+    cdr.reserve(accepted.size());
+
+    // Слоты индекса подгружаются на prefetch_distance запросов вперёд: пока обрабатывается
+    // текущий, нужные следующим строки кэша уже едут из памяти
+    constexpr size_t prefetch_distance = 8;
+    std::lock_guard lock(mutex_);
+    for (size_t k = 0; k < std::min(prefetch_distance, accepted.size()); ++k) {
+        sessions_.prefetch(imsis[accepted[k]]);
+    }
+    for (size_t k = 0; k < accepted.size(); ++k) {
+        if (k + prefetch_distance < accepted.size()) {
+            sessions_.prefetch(imsis[accepted[k + prefetch_distance]]);
+        }
+        results[accepted[k]] = create_session_locked(imsis[accepted[k]], cdr);
+    }
+    cdr_sink_->write_batch(cdr);
+}
+
 // Проверка на существование сессии
 bool session_manager::is_session_active(const std::string &imsi) {
     spdlog::debug("Пришёл запрос на проверку существовании сессии с imsi {}", imsi);
@@ -93,37 +211,131 @@ bool session_manager::is_session_active(const std::string &imsi) {
     return false;
 }
 
-// Очистка устаревших сессий
-void session_manager::clean_expired_sessions(const std::stop_token &stop_token) {
-    spdlog::debug("clean_expired_sessions. Начало функции");
-
-    while (!stop_token.stop_requested()) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+std::vector<bool> session_manager::are_sessions_active(const std::vector<std::string> &imsis) {
+    spdlog::debug("Пришёл запрос на проверку {} сессий", imsis.size());
 
-        // Проверяем остановку чистки после засыпания потока
-        if (stop_token.stop_requested()) {
-            break;
+    constexpr size_t lock_chunk = 1024;
+    std::vector<bool> active(imsis.size());
+    for (size_t begin = 0; begin < imsis.size(); begin += lock_chunk) {
+        const size_t end = std::min(imsis.size(), begin + lock_chunk);
+        std::lock_guard lock(mutex_);
+        for (size_t i = begin; i < end; ++i) {
+            active[i] = imsis[i].size() <= session_table::max_imsi_length && sessions_.contains(imsis[i]);
         }
+    }
+    return active;
+}
+
+std::optional<size_t> session_manager::export_sessions(size_t cursor, size_t scan_count, std::string_view prefix,
+    std::chrono::milliseconds min_age, std::vector<session_export_entry> &out) {
+    const std::chrono::seconds timeout(session_timeout_sec_.load(std::memory_order_relaxed));
 
-        // Ищем устаревшие сессии
-        {
-            std::lock_guard lock(mutex_);
-            auto now = std::chrono::steady_clock::now();
-
-            for (auto it = sessions_.begin(); it != sessions_.end();) {
-                auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - it->second);
-                if (duration.count() > config_.session_timeout_sec) {
-                    spdlog::info("Сессия с imsi {} устарела и была удалена", it->first);
-                    cdr_writer_->write(it->first, "Сессия закрыта по времени");
-                    it = sessions_.erase(it);
-                } else {
-                    ++it;
-                }
-            }
+    std::lock_guard lock(mutex_);
+    const auto now = clock_->now();
+    return sessions_.for_each_from(cursor, scan_count, [&](std::string_view imsi,
+        std::chrono::steady_clock::time_point created) {
+        const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - created);
+        if (age < min_age || !imsi.starts_with(prefix)) {
+            return;
         }
+        out.push_back({std::string(imsi), age, std::max(timeout - age, std::chrono::milliseconds::zero())});
+    });
+}
+
+// Счётчики и заполненность таблицы сессий
+session_stats session_manager::stats() {
+    session_stats stats;
+    {
+        std::lock_guard lock(mutex_);
+        stats.active_sessions = sessions_.size();
+
+        // Сессии упорядочены по времени создания, считаем только те, что чистка удалит при следующем проходе
+        const auto deadline = clock_->now()
+            - std::chrono::seconds(session_timeout_sec_.load(std::memory_order_relaxed) + 1);
+        stats.expiry_backlog = sessions_.count_oldest_while([deadline](std::string_view,
+            std::chrono::steady_clock::time_point created) {
+            return created <= deadline;
+        });
+    }
+    stats.max_sessions = config_.max_sessions;
+    stats.created = created_.load(std::memory_order_relaxed);
+    stats.rejected_blacklist = rejected_blacklist_.load(std::memory_order_relaxed);
+    stats.rejected_duplicate = rejected_duplicate_.load(std::memory_order_relaxed);
+    stats.rejected_limit = rejected_limit_.load(std::memory_order_relaxed);
+    stats.evicted = evicted_.load(std::memory_order_relaxed);
+    stats.expired = expired_.load(std::memory_order_relaxed);
+    stats.peak_sessions = peak_sessions_.load(std::memory_order_relaxed);
+    stats.cdr_pending = cdr_sink_->pending();
+    return stats;
+}
+
+// Рассылка события слушателям, вызывается под mutex_
+void session_manager::notify(session_event_type type, std::string_view imsi,
+    std::chrono::steady_clock::time_point created) {
+    if (listeners_.empty()) {
+        return;
     }
 
-    spdlog::debug("clean_expired_sessions. Конец функции");
+    const session_event event{type, imsi, created};
+    for (const auto &listener : listeners_) {
+        listener(event);
+    }
+}
+
+void session_manager::add_event_listener(session_event_listener listener) {
+    std::lock_guard lock(mutex_);
+    listeners_.push_back(std::move(listener));
+}
+
+void session_manager::snapshot(const std::function<void(const session_table&)> &f) {
+    std::lock_guard lock(mutex_);
+    f(sessions_);
+}
+
+// Резервный узел повторяет изменения основного, время создания приходит с основного
+void session_manager::apply_replica_event(const session_event &event) {
+    std::lock_guard lock(mutex_);
+    if (!session_table::is_valid_imsi(event.imsi)) {
+        spdlog::warn("Репликация: пропущен слишком длинный imsi {}", event.imsi);
+        return;
+    }
+
+    if (event.type == session_event_type::created) {
+        sessions_.insert(event.imsi, event.created);
+    } else {
+        sessions_.erase(event.imsi);
+    }
+    notify(event.type, event.imsi, event.created);
+}
+
+void session_manager::clear_replica() {
+    std::lock_guard lock(mutex_);
+    sessions_.clear();
+}
+
+// Удаление устаревших сессий на текущий момент clock_
+size_t session_manager::expire_sessions() {
+    const int timeout_sec = session_timeout_sec_.load(std::memory_order_relaxed);
+    std::lock_guard lock(mutex_);
+    const auto now = clock_->now();
+
+    // Сессии упорядочены по времени создания, поэтому идём от самой старой до первой живой
+    size_t expired = sessions_.erase_oldest_while([this, now, timeout_sec](std::string_view imsi,
+        std::chrono::steady_clock::time_point created) {
+        auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - created);
+        if (duration.count() > timeout_sec) {
+            spdlog::info("Сессия с imsi {} устарела и была удалена", imsi);
+            cdr_sink_->write(std::string(imsi), "Сессия закрыта по времени");
+            notify(session_event_type::expired, imsi, created);
+            return true;
+        }
+        return false;
+    });
+    expired_.fetch_add(expired, std::memory_order_relaxed);
+    if (expired > 0) {
+        PGW_PROBE(sessions_expired, expired, sessions_.size());
+    }
+    return expired;
 }
 
 // Остановка session_manager
@@ -140,22 +352,31 @@ void session_manager::graceful_shutdown() {
             return;
         }
 
-        for (const auto &imsi: sessions_ | std::views::keys) {
-            sessions_to_close.push_back(imsi);
-        }
+        sessions_to_close.reserve(sessions_.size());
+        sessions_.for_each([this, &sessions_to_close](std::string_view imsi,
+            std::chrono::steady_clock::time_point created) {
+            sessions_to_close.emplace_back(imsi);
+            notify(session_event_type::released, imsi, created);
+        });
         sessions_.clear();
     }
 
     spdlog::info("Закрываем {} активных сессий со скоростью {} сессий в секунду...",
-                sessions_to_close.size(), config_.graceful_shutdown_rate);
-    const auto delay = std::chrono::milliseconds(1000 / config_.graceful_shutdown_rate);
+                sessions_to_close.size(), graceful_shutdown_rate_.load(std::memory_order_relaxed));
 
-    // Записываем CDR
+    // Записываем CDR. Скорость можно поменять, пока идёт закрытие
     for (const auto& imsi : sessions_to_close) {
         spdlog::info("Сессия с imsi {} закрыта", imsi);
-        cdr_writer_->write(imsi, "Сессия закрыта по выключению");
-        std::this_thread::sleep_for(delay);
+        cdr_sink_->write(imsi, "Сессия закрыта по выключению");
+        const int rate = graceful_shutdown_rate_.load(std::memory_order_relaxed);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / rate));
     }
 
     spdlog::info("session_manager остановлен");
-}
\ No newline at end of file
+}
+
+// Новые таймаут и скорость закрытия из /admin/config, читаются при следующем использовании
+void session_manager::apply_tunables(const runtime_tunables& tunables) {
+    session_timeout_sec_.store(tunables.session_timeout_sec, std::memory_order_relaxed);
+    graceful_shutdown_rate_.store(tunables.graceful_shutdown_rate, std::memory_order_relaxed);
+}
@@ -1,28 +1,128 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
 #include <unordered_set>
 
-#include "cdr_writer.h"
+#include "cdr_sink.h"
 #include "config.h"
+#include "latency_stats.h"
+#include "session_clock.h"
+#include "session_table.h"
+#include "spdlog/spdlog.h"
+
+// Счётчики session_manager
+struct session_stats {
+    size_t active_sessions{};
+    size_t max_sessions{};      // 0 - без ограничения
+    uint64_t created{};
+    uint64_t rejected_blacklist{};
+    uint64_t rejected_duplicate{};
+    uint64_t rejected_limit{};  // отказы из-за max_sessions
+    uint64_t evicted{};         // вытеснения из-за max_sessions
+    uint64_t expired{};
+    size_t peak_sessions{};     // максимум активных сессий с запуска
+    uint64_t expiry_backlog{};  // сессии старше таймаута, которые чистка ещё не удалила
+    uint64_t cdr_pending{};     // записи CDR, ещё не доставленные приёмнику
+};
+
+// Сессия в выгрузке /sessions
+struct session_export_entry {
+    std::string imsi;
+    std::chrono::milliseconds age;
+    std::chrono::milliseconds remaining;    // до истечения таймаута, 0 - ждёт чистки
+};
+
+// События жизненного цикла сессии
+enum class session_event_type : uint8_t {
+    created = 1,
+    released = 2, // закрыта при выключении
+    expired = 3,
+    evicted = 4
+};
+
+// imsi действителен только во время вызова слушателя
+struct session_event {
+    session_event_type type;
+    std::string_view imsi;
+    std::chrono::steady_clock::time_point created;
+};
+
+// Слушатель вызывается под мьютексом session_manager, поэтому должен быть быстрым
+using session_event_listener = std::function<void(const session_event&)>;
 
 class session_manager {
     std::unordered_set<std::string> blacklist_;
     server_config config_;
+    bool evict_oldest_;
     std::mutex mutex_;
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> sessions_;
-    std::unique_ptr<cdr_writer> cdr_writer_;
-    std::jthread cleaning_thread_;
+    session_table sessions_;
+    std::unique_ptr<cdr_sink> cdr_sink_;
+    std::shared_ptr<session_clock> clock_;
+
+    std::atomic<uint64_t> created_{0};
+    std::atomic<uint64_t> rejected_blacklist_{0};
+    std::atomic<uint64_t> rejected_duplicate_{0};
+    std::atomic<uint64_t> rejected_limit_{0};
+    std::atomic<uint64_t> evicted_{0};
+    std::atomic<uint64_t> expired_{0};
+    std::atomic<size_t> peak_sessions_{0};
+
+    // Меняются на ходу через apply_tunables, читаются без мьютекса
+    std::atomic<int> session_timeout_sec_;
+    std::atomic<int> graceful_shutdown_rate_;
 
-    void clean_expired_sessions(const std::stop_token &stop_token);
+    std::vector<session_event_listener> listeners_;
+
+    // Объявлена последней: отменяется до уничтожения всего, что использует чистка
+    std::unique_ptr<periodic_task> cleaning_task_;
+
+    void notify(session_event_type type, std::string_view imsi, std::chrono::steady_clock::time_point created);
+    bool accept_request(const std::string& imsi);
+    std::string_view create_session_locked(const std::string& imsi, std::vector<cdr_event>& cdr);
 public:
-    explicit session_manager(const server_config& config);
+    // Без clock используется steady_clock и поток для чистки
+    explicit session_manager(const server_config& config, std::shared_ptr<session_clock> clock = nullptr);
     ~session_manager();
 
-    std::string process_request(const std::string& imsi);
+    // trace - необязательные метки этапов для гистограмм задержек
+    std::string process_request(const std::string& imsi, request_trace* trace = nullptr);
+    // Пакет запросов на создание сессий: results[i] - ответ на imsis[i] ("created" или "rejected"),
+    // такой же, как у вызовов process_request по порядку, включая повторы IMSI внутри пакета.
+    // Мьютекс берётся один раз на пакет, CDR пакета пишутся одним блоком
+    void process_requests(std::span<const std::string> imsis, std::span<std::string_view> results);
     bool is_session_active(const std::string& imsi);
+    // Проверка списка IMSI за один вызов, результат в том же порядке. Мьютекс берётся
+    // порциями, чтобы длинный список не задерживал обработку UDP
+    std::vector<bool> are_sessions_active(const std::vector<std::string>& imsis);
+    session_stats stats();
+
+    // Порция выгрузки сессий: просматривает до scan_count записей таблицы с позиции cursor
+    // под одним коротким захватом мьютекса и дописывает подходящие под фильтры в out.
+    // Возвращает позицию для следующей порции или nullopt, если таблица пройдена
+    std::optional<size_t> export_sessions(size_t cursor, size_t scan_count, std::string_view prefix,
+        std::chrono::milliseconds min_age, std::vector<session_export_entry>& out);
+
+    // Подписка на события сессий, только до начала обработки запросов
+    void add_event_listener(session_event_listener listener);
+    // Вызов f под тем же мьютексом, под которым рассылаются события: снимок согласован с ними
+    void snapshot(const std::function<void(const session_table&)>& f);
+    // Применение события с основного узла на резервном, без CDR и проверок
+    void apply_replica_event(const session_event& event);
+    void clear_replica();
+
+    // Один проход чистки по текущему времени clock, возвращает число удалённых сессий.
+    // Чистка вызывает его раз в секунду по времени clock
+    size_t expire_sessions();
 
     void start_cleaning();
     void stop_cleaning();
 
+    // Таймаут сессии действует со следующего прохода чистки, скорость закрытия - со следующей сессии
+    void apply_tunables(const runtime_tunables& tunables);
+
     void graceful_shutdown();
 };
\ No newline at end of file
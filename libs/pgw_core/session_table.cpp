@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#include "session_table.h"
+#include "spdlog/spdlog.h"
+
+// Конструктор, индекс и пул сразу рассчитаны на expected_sessions сессий
+session_table::session_table(size_t expected_sessions) {
+    spdlog::debug("session_table конструктор, expected_sessions: {}. Начало функции", expected_sessions);
+
+    // Держим заполнение индекса не выше 3/4
+    index_ = make_index(std::max(min_index_capacity, std::bit_ceil(expected_sessions * 4 / 3 + 1)));
+
+    const size_t blocks = (expected_sessions + block_size - 1) / block_size;
+    for (size_t i = 0; i < blocks; ++i) {
+        blocks_.emplace_back(sizeof(block));
+    }
+    free_ids_.reserve(expected_sessions);
+
+    spdlog::debug("session_table конструктор, индекс на {} слотов, блоков в пуле {}. Конец функции",
+        index_.mask + 1, blocks_.size());
+}
+
+bool session_table::is_valid_imsi(std::string_view imsi) {
+    return imsi.length() <= max_imsi_length;
+}
+
+session_table::imsi_key session_table::make_key(std::string_view imsi) {
+    if (!is_valid_imsi(imsi)) {
+        throw std::invalid_argument("imsi длиннее " + std::to_string(max_imsi_length) + " символов");
+    }
+
+    imsi_key key;
+    std::memcpy(key.digits.data(), imsi.data(), imsi.length());
+    key.length = static_cast<uint8_t>(imsi.length());
+    return key;
+}
+
+// Ключ дополнен нулями до 16 байт, поэтому хэшируем его как два 64-битных слова
+uint32_t session_table::hash_key(const imsi_key &key) {
+    uint64_t words[2];
+    std::memcpy(words, &key, sizeof(words));
+
+    uint64_t h = words[0] * 0x9E3779B97F4A7C15ULL ^ std::rotl(words[1] * 0xC2B2AE3D27D4EB4FULL, 31);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h >> 32);
+}
+
+session_table::index session_table::make_index(size_t capacity) {
+    index idx;
+    idx.memory = mmap_raii(capacity * sizeof(uint64_t));
+    idx.slots = static_cast<uint64_t*>(idx.memory.get());
+    idx.mask = capacity - 1;
+    return idx;
+}
+
+session_table::imsi_key& session_table::key_at(uint32_t id) {
+    return static_cast<block*>(blocks_[id / block_size].get())->keys[id % block_size];
+}
+
+const session_table::imsi_key& session_table::key_at(uint32_t id) const {
+    return static_cast<const block*>(blocks_[id / block_size].get())->keys[id % block_size];
+}
+
+session_table::clock::time_point& session_table::created_at(uint32_t id) {
+    return static_cast<block*>(blocks_[id / block_size].get())->created[id % block_size];
+}
+
+const session_table::clock::time_point& session_table::created_at(uint32_t id) const {
+    return static_cast<const block*>(blocks_[id / block_size].get())->created[id % block_size];
+}
+
+uint32_t& session_table::prev_at(uint32_t id) {
+    return static_cast<block*>(blocks_[id / block_size].get())->prev[id % block_size];
+}
+
+uint32_t& session_table::next_at(uint32_t id) {
+    return static_cast<block*>(blocks_[id / block_size].get())->next[id % block_size];
+}
+
+uint32_t session_table::next_at(uint32_t id) const {
+    return static_cast<const block*>(blocks_[id / block_size].get())->next[id % block_size];
+}
+
+// Слот хранит хэш в старших 32 битах и номер записи + 1 в младших
+uint64_t* session_table::find_slot(index &idx, const imsi_key &key, uint32_t hash) const {
+    if (idx.slots == nullptr) {
+        return nullptr;
+    }
+
+    for (size_t pos = hash & idx.mask;; pos = (pos + 1) & idx.mask) {
+        const uint64_t slot = idx.slots[pos];
+        if (slot == empty_slot) {
+            return nullptr;
+        }
+        if (slot != deleted_slot && static_cast<uint32_t>(slot >> 32) == hash
+            && key_at(static_cast<uint32_t>(slot) - 1) == key) {
+            return &idx.slots[pos];
+        }
+    }
+}
+
+// Во время переноса запись может быть ещё в старом индексе
+uint64_t* session_table::find_slot(const imsi_key &key, uint32_t hash) const {
+    auto &self = const_cast<session_table&>(*this);
+    if (uint64_t *slot = find_slot(self.index_, key, hash)) {
+        return slot;
+    }
+    return find_slot(self.old_index_, key, hash);
+}
+
+void session_table::insert_slot(index &idx, uint32_t hash, uint32_t id) {
+    for (size_t pos = hash & idx.mask;; pos = (pos + 1) & idx.mask) {
+        uint64_t &slot = idx.slots[pos];
+        if (slot == empty_slot || slot == deleted_slot) {
+            if (slot == empty_slot) {
+                ++idx.used;
+            }
+            slot = static_cast<uint64_t>(hash) << 32 | (id + 1);
+            return;
+        }
+    }
+}
+
+// Номер свободной записи в пуле, при нехватке добавляется новый блок
+uint32_t session_table::allocate_id() {
+    if (!free_ids_.empty()) {
+        const uint32_t id = free_ids_.back();
+        free_ids_.pop_back();
+        return id;
+    }
+
+    if (high_water_ >= 0xFFFFFFFE) {
+        throw std::length_error("Превышено максимальное количество сессий в таблице");
+    }
+    if (high_water_ / block_size >= blocks_.size()) {
+        blocks_.emplace_back(sizeof(block));
+        spdlog::debug("session_table, добавлен блок пула, всего блоков {}", blocks_.size());
+    }
+    return high_water_++;
+}
+
+// Освобождение слота индекса и записи пула, запись исключается из списка
+void session_table::release(uint64_t *slot) {
+    const uint32_t id = static_cast<uint32_t>(*slot) - 1;
+    *slot = deleted_slot;
+
+    const uint32_t prev = prev_at(id);
+    const uint32_t next = next_at(id);
+    (prev == no_id ? head_ : next_at(prev)) = next;
+    (next == no_id ? tail_ : prev_at(next)) = prev;
+
+    key_at(id).length = free_length;
+    free_ids_.push_back(id);
+    --size_;
+}
+
+void session_table::erase_id(uint32_t id) {
+    const imsi_key &key = key_at(id);
+    if (uint64_t *slot = find_slot(key, hash_key(key))) {
+        release(slot);
+    }
+    migrate_step();
+}
+
+// Начало переноса в новый индекс: вдвое больший, либо того же размера для чистки удалённых слотов
+void session_table::start_rehash() {
+    while (old_index_.slots != nullptr) {
+        migrate_step();
+    }
+
+    const size_t capacity = index_.mask + 1;
+    const size_t new_capacity = (size_ + 1) * 2 > capacity ? capacity * 2 : capacity;
+    spdlog::debug("session_table, перенос индекса {} -> {} слотов", capacity, new_capacity);
+
+    old_index_ = std::move(index_);
+    index_ = make_index(new_capacity);
+    migrate_pos_ = 0;
+}
+
+// Перенос очередной порции слотов, перенесённые помечаются удалёнными,
+// чтобы не рвать цепочки поиска в старом индексе
+void session_table::migrate_step() {
+    if (old_index_.slots == nullptr) {
+        return;
+    }
+
+    const size_t end = std::min(migrate_pos_ + rehash_step, old_index_.mask + 1);
+    for (; migrate_pos_ < end; ++migrate_pos_) {
+        uint64_t &slot = old_index_.slots[migrate_pos_];
+        if (slot != empty_slot && slot != deleted_slot) {
+            insert_slot(index_, static_cast<uint32_t>(slot >> 32), static_cast<uint32_t>(slot) - 1);
+            slot = deleted_slot;
+        }
+    }
+
+    if (migrate_pos_ > old_index_.mask) {
+        old_index_ = index{};
+        spdlog::debug("session_table, перенос индекса завершён");
+    }
+}
+
+// Вставка новой сессии, false если сессия уже есть
+bool session_table::insert(std::string_view imsi, clock::time_point created) {
+    const imsi_key key = make_key(imsi);
+    const uint32_t hash = hash_key(key);
+
+    migrate_step();
+    if (find_slot(key, hash) != nullptr) {
+        return false;
+    }
+
+    if ((index_.used + 1) * 4 > (index_.mask + 1) * 3) {
+        start_rehash();
+    }
+
+    const uint32_t id = allocate_id();
+    key_at(id) = key;
+    created_at(id) = created;
+    insert_slot(index_, hash, id);
+
+    // Новая сессия становится самой новой в списке
+    prev_at(id) = tail_;
+    next_at(id) = no_id;
+    (tail_ == no_id ? head_ : next_at(tail_)) = id;
+    tail_ = id;
+    ++size_;
+    return true;
+}
+
+void session_table::prefetch(std::string_view imsi) const {
+    if (!is_valid_imsi(imsi) || index_.slots == nullptr) {
+        return;
+    }
+    const uint32_t hash = hash_key(make_key(imsi));
+    __builtin_prefetch(&index_.slots[hash & index_.mask]);
+}
+
+bool session_table::contains(std::string_view imsi) const {
+    return find(imsi).has_value();
+}
+
+std::optional<session_table::clock::time_point> session_table::find(std::string_view imsi) const {
+    if (!is_valid_imsi(imsi)) {
+        return std::nullopt;
+    }
+
+    const imsi_key key = make_key(imsi);
+    if (const uint64_t *slot = find_slot(key, hash_key(key))) {
+        return created_at(static_cast<uint32_t>(*slot) - 1);
+    }
+    return std::nullopt;
+}
+
+bool session_table::erase(std::string_view imsi) {
+    if (!is_valid_imsi(imsi)) {
+        return false;
+    }
+
+    const imsi_key key = make_key(imsi);
+    uint64_t *slot = find_slot(key, hash_key(key));
+    if (slot == nullptr) {
+        return false;
+    }
+
+    release(slot);
+    migrate_step();
+    return true;
+}
+
+// Очистка без освобождения памяти, ёмкость сохраняется
+void session_table::clear() {
+    if (old_index_.slots != nullptr) {
+        old_index_ = index{};
+    }
+    std::memset(index_.slots, 0, (index_.mask + 1) * sizeof(uint64_t));
+    index_.used = 0;
+
+    free_ids_.clear();
+    high_water_ = 0;
+    head_ = no_id;
+    tail_ = no_id;
+    size_ = 0;
+}
+
+size_t session_table::size() const {
+    return size_;
+}
+
+bool session_table::empty() const {
+    return size_ == 0;
+}
+
+size_t session_table::index_capacity() const {
+    return index_.mask + 1;
+}
+
+bool session_table::rehashing() const {
+    return old_index_.slots != nullptr;
+}
+
+// Память под пул, индексы и список свободных записей
+size_t session_table::memory_bytes() const {
+    size_t bytes = blocks_.size() * sizeof(block);
+    bytes += index_.memory.size() + old_index_.memory.size();
+    bytes += free_ids_.capacity() * sizeof(uint32_t);
+    return bytes;
+}
+
+std::optional<std::pair<std::string_view, session_table::clock::time_point>> session_table::oldest() const {
+    if (head_ == no_id) {
+        return std::nullopt;
+    }
+
+    const imsi_key &key = key_at(head_);
+    return std::make_pair(std::string_view(key.digits.data(), key.length), created_at(head_));
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "mmap_raii.h"
+
+// Плоская таблица сессий с открытой адресацией.
+// Сессии лежат в пуле блоками (ключи, время создания и связи списка отдельными массивами),
+// индекс хранит только 32-битный хэш и номер записи в пуле.
+// Записи связаны в двусвязный список в порядке создания: самая старая сессия берётся за O(1).
+// Рост индекса инкрементальный: старый индекс переносится по частям при вставках и удалениях.
+// Таблица не потокобезопасна, синхронизация на стороне session_manager.
+class session_table {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // IMSI не бывает длиннее 15 цифр
+    static constexpr size_t max_imsi_length = 15;
+
+private:
+    struct imsi_key {
+        std::array<char, max_imsi_length> digits{};
+        uint8_t length{};
+
+        bool operator==(const imsi_key&) const = default;
+    };
+    static_assert(sizeof(imsi_key) == 16);
+
+    // Длина-маркер свободной записи в пуле
+    static constexpr uint8_t free_length = 0xFF;
+
+    // 2^18 записей по 32 байта - ровно 8 МБ, кратно размеру huge page
+    static constexpr size_t block_size = 1 << 18;
+
+    struct block {
+        imsi_key keys[block_size];
+        clock::time_point created[block_size];
+        uint32_t prev[block_size];
+        uint32_t next[block_size];
+    };
+
+    // Отсутствие записи в списке
+    static constexpr uint32_t no_id = 0xFFFFFFFF;
+
+    struct index {
+        mmap_raii memory;
+        uint64_t* slots = nullptr;
+        size_t mask = 0;
+        size_t used = 0; // занятые слоты вместе с удалёнными
+    };
+
+    static constexpr uint64_t empty_slot = 0;
+    static constexpr uint64_t deleted_slot = ~0ULL;
+    static constexpr size_t min_index_capacity = 1024;
+    static constexpr size_t rehash_step = 256;
+
+    std::vector<mmap_raii> blocks_;
+    std::vector<uint32_t> free_ids_;
+    uint32_t high_water_ = 0;
+    uint32_t head_ = no_id; // самая старая сессия
+    uint32_t tail_ = no_id; // самая новая сессия
+    size_t size_ = 0;
+    index index_;
+    index old_index_;
+    size_t migrate_pos_ = 0;
+
+    static imsi_key make_key(std::string_view imsi);
+    static uint32_t hash_key(const imsi_key& key);
+    static index make_index(size_t capacity);
+
+    imsi_key& key_at(uint32_t id);
+    const imsi_key& key_at(uint32_t id) const;
+    clock::time_point& created_at(uint32_t id);
+    const clock::time_point& created_at(uint32_t id) const;
+    uint32_t& prev_at(uint32_t id);
+    uint32_t& next_at(uint32_t id);
+    uint32_t next_at(uint32_t id) const;
+
+    uint64_t* find_slot(index& idx, const imsi_key& key, uint32_t hash) const;
+    uint64_t* find_slot(const imsi_key& key, uint32_t hash) const;
+    static void insert_slot(index& idx, uint32_t hash, uint32_t id);
+    uint32_t allocate_id();
+    void release(uint64_t* slot);
+    void erase_id(uint32_t id);
+    void start_rehash();
+    void migrate_step();
+
+public:
+    explicit session_table(size_t expected_sessions = 0);
+
+    // Запрещаем копирование
+    session_table(const session_table&) = delete;
+    session_table& operator=(const session_table&) = delete;
+
+    static bool is_valid_imsi(std::string_view imsi);
+
+    bool insert(std::string_view imsi, clock::time_point created);
+    bool contains(std::string_view imsi) const;
+    std::optional<clock::time_point> find(std::string_view imsi) const;
+    bool erase(std::string_view imsi);
+    void clear();
+
+    // Подгрузка в кэш первого слота индекса для imsi. При пакетной обработке вызывается
+    // на несколько IMSI вперёд, чтобы поиск не ждал памяти. Таблицу не меняет
+    void prefetch(std::string_view imsi) const;
+
+    size_t size() const;
+    bool empty() const;
+    size_t index_capacity() const;
+    bool rehashing() const;
+    size_t memory_bytes() const;
+
+    // Самая старая сессия: imsi и время создания
+    std::optional<std::pair<std::string_view, clock::time_point>> oldest() const;
+
+    // Удаление самых старых сессий, пока pred(imsi, created) возвращает true.
+    // Работает за количество удалённых сессий, а не за размер таблицы
+    template<typename P>
+    size_t erase_oldest_while(P&& pred) {
+        size_t erased = 0;
+        while (head_ != no_id) {
+            const imsi_key& key = key_at(head_);
+            if (!pred(std::string_view(key.digits.data(), key.length), created_at(head_))) {
+                break;
+            }
+            erase_id(head_);
+            ++erased;
+        }
+        return erased;
+    }
+
+    // Количество самых старых сессий, для которых pred(imsi, created) возвращает true подряд
+    template<typename P>
+    size_t count_oldest_while(P&& pred) const {
+        size_t counted = 0;
+        for (uint32_t id = head_; id != no_id; id = next_at(id)) {
+            const imsi_key& key = key_at(id);
+            if (!pred(std::string_view(key.digits.data(), key.length), created_at(id))) {
+                break;
+            }
+            ++counted;
+        }
+        return counted;
+    }
+
+    // Обход сессий от самой старой к самой новой: f(imsi, created)
+    template<typename F>
+    void for_each_oldest_first(F&& f) const {
+        for (uint32_t id = head_; id != no_id; id = next_at(id)) {
+            const imsi_key& key = key_at(id);
+            f(std::string_view(key.digits.data(), key.length), created_at(id));
+        }
+    }
+
+    // Обход всех сессий подряд по пулу: f(imsi, created)
+    template<typename F>
+    void for_each(F&& f) const {
+        for (uint32_t id = 0; id < high_water_; ++id) {
+            const imsi_key& key = key_at(id);
+            if (key.length != free_length) {
+                f(std::string_view(key.digits.data(), key.length), created_at(id));
+            }
+        }
+    }
+
+    // Обход части пула с номера begin, не больше count записей пула: f(imsi, created).
+    // Возвращает номер, с которого продолжать, или nullopt, если пул пройден. Номер записи
+    // не меняется, пока сессия жива, поэтому обход можно продолжать после изменений таблицы:
+    // сессия, жившая всё время обхода, встретится ровно один раз
+    template<typename F>
+    std::optional<size_t> for_each_from(size_t begin, size_t count, F&& f) const {
+        const size_t end = std::min<size_t>(high_water_, begin + count);
+        for (size_t id = begin; id < end; ++id) {
+            const imsi_key& key = key_at(static_cast<uint32_t>(id));
+            if (key.length != free_length) {
+                f(std::string_view(key.digits.data(), key.length), created_at(static_cast<uint32_t>(id)));
+            }
+        }
+        return end < high_water_ ? std::optional(end) : std::nullopt;
+    }
+
+    // Удаление сессий, для которых pred(imsi, created) вернул true
+    template<typename P>
+    size_t erase_if(P&& pred) {
+        size_t erased = 0;
+        for (uint32_t id = 0; id < high_water_; ++id) {
+            const imsi_key& key = key_at(id);
+            if (key.length != free_length
+                && pred(std::string_view(key.digits.data(), key.length), created_at(id))) {
+                erase_id(id);
+                ++erased;
+            }
+        }
+        return erased;
+    }
+};
@@ -0,0 +1,36 @@
+#include "shard_mailbox.h"
+
+bool shard_mailbox::post(std::move_only_function<void()> task) {
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) {
+            return false;
+        }
+        tasks_.push_back(std::move(task));
+    }
+    event_.notify();
+    return true;
+}
+
+size_t shard_mailbox::drain() {
+    // Сначала сбрасывается eventfd: задача, пришедшая после этого, разбудит владельца снова
+    event_.consume();
+    {
+        std::lock_guard lock(mutex_);
+        running_.swap(tasks_);
+    }
+    for (auto& task : running_) {
+        task();
+    }
+    const size_t count = running_.size();
+    running_.clear();
+    return count;
+}
+
+void shard_mailbox::close() {
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    drain();
+}
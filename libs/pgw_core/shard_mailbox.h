@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "event_fd_raii.h"
+
+// Почтовый ящик потока-владельца: другие потоки передают ему задачи, а не обращаются к его данным сами.
+// Поток-владелец ждёт готовности fd() (например, co_await io_scheduler::readable) и вызывает drain
+class shard_mailbox {
+    std::mutex mutex_;
+    std::vector<std::move_only_function<void()>> tasks_;
+    std::vector<std::move_only_function<void()>> running_;  // только поток-владелец
+    bool closed_ = false;
+    event_fd_raii event_;
+
+public:
+    int fd() const {
+        return event_.get();
+    }
+
+    // false - ящик закрыт, задача не будет выполнена
+    bool post(std::move_only_function<void()> task);
+
+    // Выполнение f в потоке-владельце с ожиданием результата. Исключение из f передаётся вызывающему,
+    // закрытый ящик - runtime_error
+    template<typename F>
+    std::invoke_result_t<F&> call(F&& f) {
+        std::packaged_task<std::invoke_result_t<F&>()> task(std::forward<F>(f));
+        auto result = task.get_future();
+        if (!post(std::move(task))) {
+            throw std::runtime_error("Поток-владелец остановлен");
+        }
+        return result.get();
+    }
+
+    // Выполнение накопленных задач в потоке-владельце, возвращает их число
+    size_t drain();
+
+    // Новые задачи больше не принимаются, накопленные выполняются. Вызывается потоком-владельцем при выходе
+    void close();
+};
@@ -0,0 +1,321 @@
+#include <charconv>
+#include <filesystem>
+#include <iostream>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include "bcd.h"
+#include "capture_file.h"
+#include "config.h"
+#include "protocol.h"
+#include "session_manager.h"
+#include "socket_raii.h"
+#include "stats_shm.h"
+
+// Воспроизведение файла захвата pgw_server.
+// Без --target пакеты идут прямо в session_manager с виртуальными часами: время берётся из захвата,
+// чистка сессий срабатывает раз в виртуальную секунду, как в сервере, поэтому истечение сессий
+// воспроизводится точно на любой скорости. С --target пакеты уходят живому серверу по UDP.
+
+namespace {
+    const std::string replay_cdr_file = "replay_cdr.csv";
+
+    struct replay_options {
+        std::string capture;
+        double speed = 1.0;  // 0 - максимальная скорость
+        std::string config = "configs/server.json";
+        std::string target;
+        std::string stats_shm;
+    };
+
+    struct replay_report {
+        uint64_t datagrams{};
+        uint64_t malformed{};
+        uint64_t created{};
+        uint64_t rejected{};
+        uint64_t replies{};
+        uint64_t peak_sessions{};
+        uint64_t active_sessions{};
+        uint64_t expired{};
+        uint64_t evicted{};
+        uint64_t cdr_records{};
+        uint64_t cdr_bytes{};
+        std::chrono::nanoseconds capture_duration{};
+        std::chrono::nanoseconds wall_duration{};
+    };
+
+    void usage() {
+        std::cerr << "Использование: pgw_replay <файл захвата> [--speed 1|N|max] [--config путь к конфигу сервера]\n"
+                     "                          [--target ip:порт [--stats-shm имя сегмента]]\n";
+    }
+
+    replay_options parse_options(int argc, char* argv[]) {
+        if (argc < 2) {
+            throw std::invalid_argument("Не указан файл захвата");
+        }
+
+        replay_options options;
+        options.capture = argv[1];
+        for (int i = 2; i < argc; i += 2) {
+            const std::string_view key = argv[i];
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Нет значения для " + std::string(key));
+            }
+            const std::string value = argv[i + 1];
+
+            if (key == "--speed") {
+                if (value == "max") {
+                    options.speed = 0;
+                    continue;
+                }
+                auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), options.speed);
+                if (ec != std::errc() || end != value.data() + value.size() || options.speed <= 0) {
+                    throw std::invalid_argument("Скорость должна быть положительным числом или max: " + value);
+                }
+            } else if (key == "--config") {
+                options.config = value;
+            } else if (key == "--target") {
+                options.target = value;
+            } else if (key == "--stats-shm") {
+                options.stats_shm = value;
+            } else {
+                throw std::invalid_argument("Неизвестный параметр " + std::string(key));
+            }
+        }
+        return options;
+    }
+
+    // Выдерживание темпа: пакет с меткой offset от начала захвата уходит не раньше wall_start + offset / speed
+    void pace(double speed, std::chrono::steady_clock::time_point wall_start, std::chrono::nanoseconds offset) {
+        if (speed <= 0) {
+            return;
+        }
+        const auto target = wall_start + std::chrono::duration_cast<std::chrono::nanoseconds>(offset / speed);
+        std::this_thread::sleep_until(target);
+    }
+
+    // IMSI из пакета так же, как его разбирает сервер
+    std::optional<std::string> decode_imsi(std::string_view request) {
+        std::string_view payload = request;
+        if (is_framed_packet(request)) {
+            auto header = parse_packet_header(request);
+            if (!header || (header->opcode != opcode_create && header->opcode != opcode_forwarded_create)) {
+                return std::nullopt;
+            }
+            payload.remove_prefix(packet_header_size);
+        }
+        if (payload.empty()) {
+            return std::nullopt;
+        }
+        return bcd_to_imsi(std::vector<uint8_t>(payload.begin(), payload.end()));
+    }
+
+    // Прямо в session_manager, время виртуальное
+    replay_report replay_in_process(const replay_options& options) {
+        server_config config = load_server_config(options.config);
+        config.cdr_file = replay_cdr_file;
+        std::filesystem::remove("logs/" + replay_cdr_file);
+
+        auto clock = std::make_shared<manual_session_clock>();
+        session_manager manager(config, clock);
+        manager.start_cleaning();
+
+        capture_reader reader(options.capture);
+        replay_report report;
+        int64_t first_ns = -1;
+        int64_t last_ns = 0;
+        const auto wall_start = std::chrono::steady_clock::now();
+
+        while (auto datagram = reader.next()) {
+            if (first_ns < 0) {
+                first_ns = datagram->timestamp_ns;
+            }
+            last_ns = datagram->timestamp_ns;
+            const auto offset = std::chrono::nanoseconds(datagram->timestamp_ns - first_ns);
+            pace(options.speed, wall_start, offset);
+
+            // Вместе со временем выполняются проходы чистки, которые сервер сделал бы до этого пакета
+            clock->advance_to(session_clock::time_point(offset));
+
+            ++report.datagrams;
+            auto imsi = decode_imsi(datagram->data);
+            if (!imsi) {
+                ++report.malformed;
+                continue;
+            }
+            if (manager.process_request(*imsi) == "created") {
+                ++report.created;
+            } else {
+                ++report.rejected;
+            }
+        }
+
+        report.wall_duration = std::chrono::steady_clock::now() - wall_start;
+        report.capture_duration = std::chrono::nanoseconds(first_ns < 0 ? 0 : last_ns - first_ns);
+        report.replies = report.created + report.rejected;
+
+        manager.stop_cleaning();
+        const session_stats stats = manager.stats();
+        report.peak_sessions = stats.peak_sessions;
+        report.active_sessions = stats.active_sessions;
+        report.expired = stats.expired;
+        report.evicted = stats.evicted;
+        report.cdr_records = stats.created + stats.expired + stats.evicted;
+        std::error_code ec;
+        report.cdr_bytes = std::filesystem::file_size("logs/" + replay_cdr_file, ec);
+        return report;
+    }
+
+    // Живому серверу по UDP, время настоящее
+    replay_report replay_to_server(const replay_options& options) {
+        const size_t colon = options.target.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("Адрес сервера должен быть в виде ip:порт: " + options.target);
+        }
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(std::stoi(options.target.substr(colon + 1)));
+        if (inet_pton(AF_INET, options.target.substr(0, colon).c_str(), &server_addr.sin_addr) <= 0) {
+            throw std::invalid_argument("Неправильный IP адрес сервера: " + options.target);
+        }
+
+        socket_raii sockfd(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+        if (sockfd.get() < 0 || connect(sockfd.get(), reinterpret_cast<sockaddr*>(&server_addr), sizeof(server_addr)) < 0) {
+            throw std::runtime_error("Не удалось создать UDP сокет: " + std::string(strerror(errno)));
+        }
+
+        // Счётчики сервера до и после берём из разделяемой памяти, если она указана
+        std::unique_ptr<stats_shm_reader> stats;
+        std::optional<stats_snapshot> before;
+        if (!options.stats_shm.empty()) {
+            stats = std::make_unique<stats_shm_reader>(options.stats_shm);
+            before = stats->read();
+        }
+
+        replay_report report;
+        char buffer[65536];
+        auto receive_replies = [&] {
+            while (true) {
+                ssize_t n = recv(sockfd.get(), buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    return;
+                }
+                ++report.replies;
+                std::string_view reply(buffer, n);
+                if (is_framed_packet(reply) && reply.size() >= packet_header_size) {
+                    reply.remove_prefix(packet_header_size);
+                }
+                ++(reply == "created" ? report.created : report.rejected);
+            }
+        };
+        auto sample_stats = [&] {
+            if (stats) {
+                if (auto snapshot = stats->read()) {
+                    report.peak_sessions = std::max(report.peak_sessions, snapshot->active_sessions);
+                }
+            }
+        };
+
+        capture_reader reader(options.capture);
+        int64_t first_ns = -1;
+        int64_t last_ns = 0;
+        const auto wall_start = std::chrono::steady_clock::now();
+        auto next_sample = wall_start;
+        while (auto datagram = reader.next()) {
+            if (first_ns < 0) {
+                first_ns = datagram->timestamp_ns;
+            }
+            last_ns = datagram->timestamp_ns;
+            pace(options.speed, wall_start, std::chrono::nanoseconds(datagram->timestamp_ns - first_ns));
+
+            // Полный буфер сокета на максимальной скорости: ждём, пока он освободится
+            while (send(sockfd.get(), datagram->data.data(), datagram->data.size(), 0) < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    throw std::runtime_error("Не удалось отправить пакет: " + std::string(strerror(errno)));
+                }
+                pollfd writable{sockfd.get(), POLLOUT, 0};
+                poll(&writable, 1, 10);
+                receive_replies();
+            }
+            ++report.datagrams;
+            receive_replies();
+
+            if (const auto now = std::chrono::steady_clock::now(); now >= next_sample) {
+                sample_stats();
+                next_sample = now + std::chrono::milliseconds(100);
+            }
+        }
+
+        // Ответы на последние пакеты
+        for (int i = 0; i < 100 && report.replies < report.datagrams; ++i) {
+            pollfd readable{sockfd.get(), POLLIN, 0};
+            poll(&readable, 1, 10);
+            receive_replies();
+        }
+        report.wall_duration = std::chrono::steady_clock::now() - wall_start;
+        report.capture_duration = std::chrono::nanoseconds(first_ns < 0 ? 0 : last_ns - first_ns);
+
+        // Сервер публикует счётчики раз в 100 мс
+        if (stats) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            sample_stats();
+            if (auto after = stats->read(); after && before) {
+                report.active_sessions = after->active_sessions;
+                report.expired = after->expired - before->expired;
+                report.evicted = after->evicted - before->evicted;
+                report.cdr_records = after->created - before->created + report.expired + report.evicted;
+            }
+        }
+        return report;
+    }
+
+    void print_report(const replay_report& report, bool has_server_stats) {
+        const double wall = std::chrono::duration<double>(report.wall_duration).count();
+        const double captured = std::chrono::duration<double>(report.capture_duration).count();
+
+        std::cout << "Пакетов:               " << report.datagrams << " (некорректных " << report.malformed << ")\n"
+                  << "Длительность захвата:  " << captured << " с\n"
+                  << "Время воспроизведения: " << wall << " с (ускорение " << (wall > 0 ? captured / wall : 0) << "x)\n"
+                  << "Пропускная способность: " << (wall > 0 ? static_cast<double>(report.datagrams) / wall : 0)
+                  << " запросов/с\n"
+                  << "Ответов:               " << report.replies << " (created " << report.created
+                  << ", rejected " << report.rejected << ")\n";
+        if (!has_server_stats) {
+            std::cout << "Счётчики сервера недоступны, укажите --stats-shm\n";
+            return;
+        }
+        std::cout << "Пик таблицы сессий:    " << report.peak_sessions << '\n'
+                  << "Активных в конце:      " << report.active_sessions << '\n'
+                  << "Истекло:               " << report.expired << ", вытеснено " << report.evicted << '\n'
+                  << "Записей CDR:           " << report.cdr_records;
+        if (report.cdr_bytes > 0) {
+            std::cout << " (" << report.cdr_bytes << " байт)";
+        }
+        std::cout << '\n';
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        replay_options options;
+        try {
+            options = parse_options(argc, argv);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << '\n';
+            usage();
+            return 1;
+        }
+
+        // session_manager пишет в лог каждый запрос, при воспроизведении это только мешает
+        spdlog::set_level(spdlog::level::warn);
+
+        const bool in_process = options.target.empty();
+        const replay_report report = in_process ? replay_in_process(options) : replay_to_server(options);
+        print_report(report, in_process || !options.stats_shm.empty());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include <iostream>
+
+#include "logger.h"
+#include "pgw_server.h"
+#include "signal_fd_raii.h"
+
+int main(int argc, char* argv[]) {
+    try {
+        // SIGINT и SIGTERM читаются из signalfd в цикле управления. Блокируются до создания
+        // потоков, иначе сигнал может достаться потоку, который его не ждёт
+        const signal_fd_raii signals({SIGINT, SIGTERM});
+
+        if (argc > 2) {
+            std::cerr << "Использование: pgw_server [путь к конфигу]" << '\n';
+            return 1;
+        }
+
+        server_config config = load_server_config(argc == 2 ? argv[1] : "configs/server.json");
+        setup_logger(config.log_file, config.log_level);
+        spdlog::info("Конфиг и логгер загружен");
+
+        pgw_server server(config);
+        server.start(signals);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
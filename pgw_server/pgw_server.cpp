@@ -1,238 +1,1534 @@
-#include <httplib.h>
+#include <charconv>
+#include <numeric>
+#include <sched.h>
 #include <sys/epoll.h>
 
 #include "bcd.h"
-#include "epoll_raii.h"
+#include "cdr_index.h"
 #include "logger.h"
-#include "session_manager.h"
-#include "socket_raii.h"
+#include "pgw_server.h"
+#include "probes.h"
+#include "reuseport_steering.h"
 #include "spdlog/spdlog.h"
+#include "timer_fd_raii.h"
 
-std::atomic running_ = false;
+namespace {
+    // Регистрация fd в epoll на чтение
+    void watch(const epoll_raii& epoll, int fd) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll.get(), EPOLL_CTL_ADD, fd, &event) < 0) {
+            throw std::runtime_error(std::string("Не удалось добавить fd в epoll: ") + strerror(errno));
+        }
+    }
+
+    // Файл части сессий: cdr.csv -> cdr.0.csv
+    std::string shard_file(const std::string& file, size_t index) {
+        const std::filesystem::path path(file);
+        return (path.parent_path() / (path.stem().string() + "." + std::to_string(index)
+            + path.extension().string())).string();
+    }
+
+    // Конфиг части сессий потока: свои файлы CDR и доля max_sessions
+    server_config shard_config(const server_config& config, size_t index) {
+        if (config.udp_workers == 1) {
+            return config;
+        }
+        server_config shard = config;
+        shard.cdr_file = shard_file(config.cdr_file, index);
+        shard.cdr_sink.spill_file = shard_file(config.cdr_sink.spill_file, index);
+        shard.max_sessions = (config.max_sessions + config.udp_workers - 1) / config.udp_workers;
+        return shard;
+    }
+
+    // Отправка ответа клиенту
+    void send_reply(int sockfd, const sockaddr_in& addr, std::string_view reply) {
+        if (sendto(sockfd, reply.data(), reply.length(), 0, reinterpret_cast<const sockaddr*> (&addr), sizeof(addr)) < 0) {
+            spdlog::error("Не удалось отправить ответ: {}", strerror(errno));
+            return;
+        }
+        PGW_PROBE(udp_reply, reply.size());
+    }
+
+    // IMSI из HTTP запроса: от 1 до 15 цифр. Только такие пересылаются владельцу без кодирования
+    bool is_digits_imsi(std::string_view imsi) {
+        return !imsi.empty() && imsi.size() <= session_table::max_imsi_length
+            && imsi.find_first_not_of("0123456789") == std::string_view::npos;
+    }
+
+    // Тело /check_subscribers: IMSI по одному в строке, JSON массив или {"imsis": [...]}
+    std::optional<std::vector<std::string>> parse_imsi_list(const std::string& body) {
+        std::vector<std::string> imsis;
+        const size_t first = body.find_first_not_of(" \t\r\n");
+        if (first != std::string::npos && (body[first] == '[' || body[first] == '{')) {
+            try {
+                json data = json::parse(body);
+                if (data.is_object()) {
+                    data = data.at("imsis");
+                }
+                imsis = data.get<std::vector<std::string>>();
+            } catch (const json::exception&) {
+                return std::nullopt;
+            }
+            return imsis;
+        }
+
+        std::string_view rest = body;
+        while (!rest.empty()) {
+            const size_t end = std::min(rest.find('\n'), rest.size());
+            std::string_view line = rest.substr(0, end);
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+                line.remove_suffix(1);
+            }
+            if (!line.empty()) {
+                imsis.emplace_back(line);
+            }
+        }
+        return imsis;
+    }
+
+    // Неотрицательное целое из параметра запроса: вся строка - число, без переполнения
+    std::optional<int64_t> parse_non_negative(std::string_view text) {
+        int64_t value = 0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size() || value < 0) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    // Время в запросе /cdr: секунды unix, "ГГГГ-ММ-ДД", "ГГГГ-ММ-ДД ЧЧ:ММ:СС" или с T вместо пробела, UTC
+    std::optional<int64_t> parse_query_time(std::string text) {
+        if (!text.empty() && text.find_first_not_of("0123456789") == std::string::npos) {
+            try {
+                return std::stoll(text);
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+        }
+        if (text.size() == 10) {
+            text += " 00:00:00";
+        }
+        if (text.size() > 10 && text[10] == 'T') {
+            text[10] = ' ';
+        }
+        const int64_t time = text.size() == 19 ? parse_cdr_time(text) : -1;
+        return time < 0 ? std::nullopt : std::optional(time);
+    }
+
+    int64_t realtime_now_ns() {
+        timespec ts{};
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+    }
+
+    // Буфер приёма пакета в кадре корутины. Вместе с пакетом приходит время приёма ядром, если включено
+    struct datagram_buffer {
+        std::vector<char> data;
+        sockaddr_in addr{};
+        iovec iov{};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec))]{};
+        msghdr msg{};
+
+        // msghdr для очередного recvmsg: ядро меняет длины адреса и управляющих данных.
+        // size - текущий udp_buffer_size, буфер меняет размер, если его изменили через /admin/config
+        msghdr& prepare(size_t size) {
+            if (data.size() != size) {
+                data.resize(size);
+            }
+            iov = {data.data(), data.size()};
+            msg = {};
+            msg.msg_name = &addr;
+            msg.msg_namelen = sizeof(addr);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            return msg;
+        }
+
+        int64_t kernel_rx_ns() {
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec ts{};
+                    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    return ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+                }
+            }
+            return 0;
+        }
+    };
+
+    // Приём одного пакета. false - ошибка сокета, она уже записана в лог
+    bool received(ssize_t n, const datagram_buffer& buffer) {
+        if (n < 0) {
+            spdlog::error("Ошибка recvmsg: {}", strerror(static_cast<int>(-n)));
+            return false;
+        }
+        if (static_cast<size_t>(n) == buffer.data.size()) {
+            spdlog::warn("Возможно, запрос был обрезан (получено максимум байт)");
+        }
+        return true;
+    }
+}
+
+pgw_server::udp_worker::udp_worker(const server_config& config, size_t index) : index(index),
+    scheduler(config.epoll_max_events),
+    cache(config.retransmit_cache_size, std::chrono::milliseconds(config.retransmit_cache_ttl_ms)),
+    hitters(config.heavy_hitters_top_k, config.heavy_hitters_sketch_width),
+    sessions(std::make_shared<session_manager>(shard_config(config, index), config.udp_workers > 1
+        ? std::make_shared<scheduler_session_clock>(scheduler) : nullptr)) {}
+
+pgw_server::peer_pool::peer_pool(const cluster_node& node, std::chrono::milliseconds timeout) : node_(node),
+    timeout_(timeout) {}
+
+std::unique_ptr<httplib::Client> pgw_server::peer_pool::acquire() {
+    {
+        std::lock_guard lock(mutex_);
+        if (!idle_.empty()) {
+            std::unique_ptr<httplib::Client> client = std::move(idle_.back());
+            idle_.pop_back();
+            return client;
+        }
+    }
+    auto client = std::make_unique<httplib::Client>(node_.http_ip, node_.http_port);
+    client->set_keep_alive(true);
+    client->set_connection_timeout(timeout_);
+    client->set_read_timeout(timeout_);
+    return client;
+}
 
-// Обработка sigint и sigterm
-void signal_handler(int sig) {
-    spdlog::warn("Получен сигнал: {}.", sig);
-    running_ = false;
+void pgw_server::peer_pool::release(std::unique_ptr<httplib::Client> client) {
+    std::lock_guard lock(mutex_);
+    if (idle_.size() < max_idle) {
+        idle_.push_back(std::move(client));
+    }
 }
 
-class pgw_server {
-    server_config config_;
-    std::shared_ptr<session_manager> session_manager_;
-    httplib::Server http_server_;
-    std::jthread udp_thread_;
-    std::jthread http_thread_;
+pgw_server::pgw_server(const server_config& config) : config_(config), udp_buffer_size_(config.udp_buffer_size) {
+    tunables_history_.push_back({1, tunables_of(config_)});
+    for (int i = 0; i < config_.udp_workers; ++i) {
+        workers_.push_back(std::make_unique<udp_worker>(config_, i));
+    }
+    if (workers_.size() > 1) {
+        spdlog::info("Потоков UDP: {}, у каждого своя часть сессий до {} и свой файл CDR", workers_.size(),
+            shard_config(config_, 0).max_sessions);
+    }
+
+    // Лента подключается ко всем частям сессий до начала обработки запросов
+    if (config_.event_stream_max_subscribers > 0) {
+        event_stream_ = std::make_unique<session_event_stream>(config_.event_stream_buffer,
+            config_.event_stream_max_subscribers);
+        for (const auto& worker : workers_) {
+            event_stream_->attach(*worker->sessions);
+        }
+    }
+
+    if (config_.latency_tracing) {
+        latency_stats_ = std::make_unique<latency_stats>();
+        spdlog::info("Гистограммы задержек включены, наносекунд в тике TSC: {:.3f}", tsc::ns_per_tick());
+    }
+
+    if (!config_.capture_file.empty()) {
+        capture_ = std::make_unique<capture_writer>(config_.capture_file);
+    }
+
+    // Без сегмента статистики сервер работает дальше, pgw_top просто не к чему подключиться
+    if (!config_.stats_shm_name.empty()) {
+        try {
+            stats_shm_ = std::make_unique<stats_shm_writer>(config_.stats_shm_name);
+        } catch (const std::exception& e) {
+            spdlog::error("Статистика в разделяемой памяти отключена: {}", e.what());
+        }
+    }
+
+    if (config_.replication.enabled) {
+        if (config_.replication.role == "primary") {
+            replication_publisher_ = std::make_unique<replication_publisher>(*workers_[0]->sessions, config_.replication);
+        } else {
+            replication_subscriber_ = std::make_unique<replication_subscriber>(*workers_[0]->sessions,
+                config_.replication, [this] {
+                    spdlog::warn("Основной узел недоступен, резервный узел принимает нагрузку");
+                    promoted_ = true;
+                    promote_event_.notify();
+                });
+        }
+    }
 
-    // Остановка PGW сервера
-    void stop() {
-        spdlog::info("PGW сервер выключается...");
+    if (!config_.cluster.enabled) {
+        return;
+    }
 
-        // Останавливаем все потоки
-        session_manager_->graceful_shutdown();
-        if (udp_thread_.joinable()) {
-            udp_thread_.join();
+    // Кольцо строится по порядку узлов из конфига, он должен совпадать на всех узлах
+    std::vector<std::string> ids;
+    for (const cluster_node& node : config_.cluster.nodes) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(node.udp_port);
+        if (inet_pton(AF_INET, node.udp_ip.c_str(), &addr.sin_addr) <= 0) {
+            throw std::runtime_error("Неправильный IP адрес узла кластера " + node.id + ": " + node.udp_ip);
         }
-        http_server_.stop();
-        if (http_thread_.joinable()) {
-            http_thread_.join();
+        if (node.id == config_.cluster.node_id) {
+            self_index_ = ids.size();
         }
+        node_addrs_.push_back(addr);
+        peer_pools_.push_back(node.id == config_.cluster.node_id ? nullptr
+            : std::make_unique<peer_pool>(node, std::chrono::milliseconds(config_.cluster.forward_timeout_ms)));
+        ids.push_back(node.id);
+    }
+    hash_ring_ = std::make_unique<hash_ring>(ids, config_.cluster.virtual_nodes);
+    spdlog::info("Режим кластера: узел {}, всего узлов {}", config_.cluster.node_id, ids.size());
+}
+
+uint64_t pgw_server::udp_requests() const {
+    uint64_t requests = 0;
+    for (const auto& worker : workers_) {
+        requests += worker->requests.load(std::memory_order_relaxed);
+    }
+    return requests;
+}
+
+session_stats pgw_server::sessions_stats() {
+    session_stats total;
+    for (const auto& worker : workers_) {
+        const session_stats shard = worker->sessions->stats();
+        total.active_sessions += shard.active_sessions;
+        total.max_sessions += shard.max_sessions;
+        total.created += shard.created;
+        total.rejected_blacklist += shard.rejected_blacklist;
+        total.rejected_duplicate += shard.rejected_duplicate;
+        total.rejected_limit += shard.rejected_limit;
+        total.evicted += shard.evicted;
+        total.expired += shard.expired;
+        total.peak_sessions += shard.peak_sessions;
+        total.expiry_backlog += shard.expiry_backlog;
+        total.cdr_pending += shard.cdr_pending;
+    }
+    return total;
+}
 
-        spdlog::info("PGW сервер выключился");
+void pgw_server::apply_tunables(const runtime_tunables& tunables) {
+    spdlog::set_level(spdlog::level::from_str(tunables.log_level));
+    udp_buffer_size_.store(tunables.udp_buffer_size, std::memory_order_relaxed);
+    for (const auto& worker : workers_) {
+        worker->sessions->apply_tunables(tunables);
+        worker->cache.set_ttl(std::chrono::milliseconds(tunables.retransmit_cache_ttl_ms));
     }
+}
 
-    // Запуск UDP сервера
-    void run_udp_server() {
-        spdlog::info("UDP сервер {}:{} запускается", config_.udp_ip, config_.udp_port);
+json pgw_server::push_tunables_locked(const runtime_tunables& tunables) {
+    constexpr size_t max_tunables_history = 32;
+    apply_tunables(tunables);
+    tunables_history_.push_back({tunables_history_.back().version + 1, tunables});
+    if (tunables_history_.size() > max_tunables_history) {
+        tunables_history_.pop_front();
+    }
+    spdlog::warn("Применены настройки версии {}: {}", tunables_history_.back().version,
+        tunables_to_json(tunables).dump());
+    return {{"version", tunables_history_.back().version}, {"tunables", tunables_to_json(tunables)}};
+}
+
+void pgw_server::stop() {
+    spdlog::info("PGW сервер выключается...");
+
+    // Останавливаем все потоки
+    if (replication_subscriber_) {
+        replication_subscriber_->stop();
+    }
+    // Резервный узел не закрывает чужие сессии, их CDR пишет основной
+    if (!replication_subscriber_ || promoted_) {
+        for (const auto& worker : workers_) {
+            worker->sessions->graceful_shutdown();
+        }
+    }
+    // Закрытие сессий тоже уходит на резервный узел
+    if (replication_publisher_) {
+        replication_publisher_->stop();
+    }
+    for (std::jthread& thread : udp_threads_) {
+        thread.join();
+    }
+    // Подписчики получают накопленные события и отключаются
+    if (event_stream_) {
+        event_stream_->close();
+    }
+    http_server_.stop();
+    if (http_thread_.joinable()) {
+        http_thread_.join();
+    }
+    if (stats_thread_.joinable()) {
+        stats_thread_.join();
+    }
 
-        // Создаём сокет с RAII
-        socket_raii sockfd(socket(AF_INET, SOCK_DGRAM, 0));
-        if (sockfd.get() < 0) {
-            spdlog::critical("Не удалось создать UDP сокет: {}", strerror(errno));
-            running_ = false;
+    spdlog::info("PGW сервер выключился");
+}
+
+void pgw_server::handle_request(udp_worker& worker, int forward_fd, const sockaddr_in& client_addr,
+    std::string_view request, int64_t kernel_rx_ns) {
+    PGW_PROBE(udp_receive, request.size());
+    const int sockfd = worker.socket.get();
+
+    // Запрос статуса только читает сессии: без кэша ретрансмитов, гистограмм и передачи владельцу
+    if (is_framed_packet(request)) {
+        if (const auto header = parse_packet_header(request); header && header->opcode == opcode_status) {
+            answer_status_query(worker, client_addr, header->seq, request.substr(packet_header_size));
             return;
         }
-        spdlog::debug("Создан сокет");
+    }
+
+    // Метки этапов ставятся только при включённых гистограммах
+    std::optional<request_trace> trace;
+    if (latency_stats_) {
+        trace.emplace();
+        if (kernel_rx_ns > 0) {
+            trace->set_queueing_ns(std::max<int64_t>(0, realtime_now_ns() - kernel_rx_ns));
+        }
+    }
 
-        // Делаем сокет неблокирующим
-        int flags = fcntl(sockfd.get(), F_GETFL, 0);
-        if (flags == -1) {
-            spdlog::critical("Не удалось получить флаги сокета: {}", strerror(errno));
-            running_ = false;
+    // Расширенный пакет несёт код операции и номер запроса перед IMSI
+    std::optional<packet_header> header;
+    std::string_view payload = request;
+    if (is_framed_packet(request)) {
+        header = parse_packet_header(request);
+        if (!header || (header->opcode != opcode_create && header->opcode != opcode_forwarded_create)) {
+            spdlog::warn("Получен некорректный расширенный пакет длиной {} байт", request.size());
             return;
         }
-        if (fcntl(sockfd.get(), F_SETFL, flags | O_NONBLOCK) == -1) {
-            spdlog::critical("Не удалось установить неблокирующий режим для сокета: {}", strerror(errno));
-            running_ = false;
+        // Пересланным считается только пакет с адреса узла кластера, иначе клиент обошёл бы проверку владельца
+        if (header->opcode == opcode_forwarded_create && !from_cluster_node(client_addr)) {
+            spdlog::debug("Пересланный запрос не от узла кластера обрабатывается как обычный");
+            header->opcode = opcode_create;
+        }
+        payload.remove_prefix(packet_header_size);
+    }
+
+    // Декодируем bcd
+    std::vector<uint8_t> bcd(payload.begin(), payload.end());
+    std::string imsi = bcd_to_imsi(bcd);
+    spdlog::debug("Получен UDP запрос для imsi {}", imsi);
+
+    // Пакет не в сокете владельца: программа распределения ещё не подключена или не подключилась,
+    // либо короткий IMSI в расширенном пакете. Запрос передаётся владельцу целиком, до кэша ретрансмитов:
+    // кэш этого потока владельцу не нужен, и промах считается только в кэше владельца
+    if (workers_.size() > 1) {
+        if (const size_t owner = imsi_shard(imsi, workers_.size()); owner != worker.index) {
+            hand_off(*workers_[owner], client_addr, request, kernel_rx_ns);
             return;
         }
-        spdlog::debug("Сокет переведен в неблокирующий режим");
+    }
 
-        // Создаем epoll
-        epoll_raii epollfd;
-        spdlog::debug("Epoll создан0");
+    // Повторный запрос получает тот же ответ без обращения к session_manager. Шторм ретрансмитов -
+    // частый сигнальный шторм, поэтому IMSI учитывается в частых и на этом пути
+    if (auto cached = worker.cache.find(client_addr, request)) {
+        spdlog::debug("Ретрансмит запроса, ответ взят из кэша");
+        worker.hitters.add_imsi(imsi, cached->ends_with("rejected"));
+        send_reply(sockfd, client_addr, *cached);
+        return;
+    }
 
-        // Регистрируем сокет в epoll
-        epoll_event event{};
-        event.events = EPOLLIN;
-        event.data.fd = sockfd.get();
-        if (epoll_ctl(epollfd.get(), EPOLL_CTL_ADD, sockfd.get(), &event) < 0) {
-            spdlog::critical("Не удалось добавить сокет в epoll: {}", strerror(errno));
-            running_ = false;
+    // Чужой IMSI уходит владельцу, пересланный другим узлом запрос не пересылается повторно
+    if (hash_ring_ && (!header || header->opcode != opcode_forwarded_create)) {
+        const size_t owner = hash_ring_->owner_index(imsi);
+        if (owner != self_index_) {
+            worker.hitters.add_imsi(imsi, false);
+            forward_request(forward_fd, owner, client_addr, header, request, payload);
+            return;
+        }
+    }
+
+    // Отправляем ответ
+    if (trace) {
+        trace->mark(latency_stage::decode);
+    }
+    std::string response = worker.sessions->process_request(imsi, trace ? &*trace : nullptr);
+    worker.hitters.add_imsi(imsi, response == "rejected");
+    std::string reply = header ? make_packet(header->opcode | opcode_response_flag, header->seq, response) : response;
+    worker.cache.store(client_addr, request, reply);
+    send_reply(sockfd, client_addr, reply);
+    if (trace) {
+        trace->mark(latency_stage::send);
+        latency_stats_->record(*trace);
+    }
+}
+
+bool pgw_server::from_cluster_node(const sockaddr_in& addr) const {
+    return std::ranges::any_of(node_addrs_, [&addr](const sockaddr_in& node) {
+        return node.sin_addr.s_addr == addr.sin_addr.s_addr;
+    });
+}
+
+bool pgw_server::forwarded_by_node(const httplib::Request& req) const {
+    if (!req.has_header("X-PGW-Forwarded")) {
+        return false;
+    }
+    in_addr remote{};
+    if (inet_pton(AF_INET, req.remote_addr.c_str(), &remote) > 0) {
+        for (const cluster_node& node : config_.cluster.nodes) {
+            in_addr http{};
+            if (inet_pton(AF_INET, node.http_ip.c_str(), &http) > 0 && http.s_addr == remote.s_addr) {
+                return true;
+            }
+        }
+        sockaddr_in addr{};
+        addr.sin_addr = remote;
+        if (from_cluster_node(addr)) {
+            return true;
+        }
+    }
+    spdlog::debug("X-PGW-Forwarded не от узла кластера ({}), запрос обрабатывается как обычный", req.remote_addr);
+    return false;
+}
+
+void pgw_server::answer_status_query(udp_worker& worker, const sockaddr_in& client_addr, uint64_t seq,
+    std::string_view payload) {
+    const auto bcd_imsis = parse_status_query(payload);
+    if (!bcd_imsis || bcd_imsis->empty()) {
+        spdlog::warn("Получен некорректный запрос статуса длиной {} байт", payload.size());
+        return;
+    }
+    worker.status_queries.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<std::string> imsis;
+    imsis.reserve(bcd_imsis->size());
+    for (const std::string_view bcd : *bcd_imsis) {
+        imsis.push_back(bcd_to_imsi(std::vector<uint8_t>(bcd.begin(), bcd.end())));
+    }
+
+    std::vector<bool> active;
+    if (workers_.size() == 1) {
+        active = worker.sessions->are_sessions_active(imsis);
+    } else {
+        active.resize(imsis.size());
+        std::vector<std::vector<size_t>> positions(workers_.size());
+        for (size_t i = 0; i < imsis.size(); ++i) {
+            positions[imsi_shard(imsis[i], workers_.size())].push_back(i);
+        }
+        for (size_t shard = 0; shard < workers_.size(); ++shard) {
+            if (positions[shard].empty()) {
+                continue;
+            }
+            std::vector<std::string> shard_imsis;
+            shard_imsis.reserve(positions[shard].size());
+            for (const size_t i : positions[shard]) {
+                shard_imsis.push_back(std::move(imsis[i]));
+            }
+            const std::vector<bool> shard_active = workers_[shard]->sessions->are_sessions_active(shard_imsis);
+            for (size_t k = 0; k < positions[shard].size(); ++k) {
+                active[positions[shard][k]] = shard_active[k];
+            }
+        }
+    }
+    send_reply(worker.socket.get(), client_addr,
+        make_packet(opcode_status | opcode_response_flag, seq, make_status_bitmap(active)));
+}
+
+void pgw_server::hand_off(udp_worker& owner, const sockaddr_in& client_addr, std::string_view request,
+    int64_t kernel_rx_ns) {
+    handoffs_.fetch_add(1, std::memory_order_relaxed);
+    const bool posted = owner.mailbox.post([this, &owner, client_addr, request = std::string(request), kernel_rx_ns] {
+        handle_request(owner, -1, client_addr, request, kernel_rx_ns);
+    });
+    if (!posted) {
+        spdlog::debug("Поток {} остановлен, запрос отброшен", owner.index);
+    }
+}
+
+json pgw_server::heavy_hitters_json(const std::vector<heavy_hitters_report>& reports) const {
+    std::chrono::milliseconds elapsed{0};
+    std::vector<heavy_hitter> imsis;
+    std::unordered_map<std::string, uint64_t> sources;
+    for (const heavy_hitters_report& report : reports) {
+        elapsed = std::max(elapsed, report.elapsed);
+        imsis.insert(imsis.end(), report.imsi.begin(), report.imsi.end());
+        for (const heavy_hitter& source : report.source) {
+            sources[source.key] += source.count;
+        }
+    }
+
+    const size_t top_k = config_.heavy_hitters_top_k;
+    auto rate = [elapsed](uint64_t count) {
+        return elapsed.count() == 0 ? 0.0 : static_cast<double>(count) * 1000.0 / static_cast<double>(elapsed.count());
+    };
+
+    std::ranges::sort(imsis, std::greater{}, &heavy_hitter::count);
+    json imsi_list = json::array();
+    for (size_t i = 0; i < std::min(top_k, imsis.size()); ++i) {
+        imsi_list.push_back({{"imsi", imsis[i].key}, {"count", imsis[i].count}, {"rate", rate(imsis[i].count)},
+            {"rejected", imsis[i].rejected}});
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> sorted_sources(sources.begin(), sources.end());
+    std::ranges::sort(sorted_sources, std::greater{}, &std::pair<std::string, uint64_t>::second);
+    json source_list = json::array();
+    for (size_t i = 0; i < std::min(top_k, sorted_sources.size()); ++i) {
+        source_list.push_back({{"addr", sorted_sources[i].first}, {"count", sorted_sources[i].second},
+            {"rate", rate(sorted_sources[i].second)}});
+    }
+    return {{"elapsed_ms", elapsed.count()}, {"imsi", imsi_list}, {"sources", source_list}};
+}
+
+void pgw_server::forward_request(int forward_fd, size_t owner, const sockaddr_in& client_addr,
+    const std::optional<packet_header>& header, std::string_view request, std::string_view bcd) {
+    const uint64_t seq = next_forward_seq_++;
+    std::string packet = make_packet(opcode_forwarded_create, seq, bcd);
+
+    const sockaddr_in &owner_addr = node_addrs_[owner];
+    if (sendto(forward_fd, packet.data(), packet.size(), 0, reinterpret_cast<const sockaddr*> (&owner_addr),
+        sizeof(owner_addr)) < 0) {
+        spdlog::error("Не удалось переслать запрос узлу {}: {}", hash_ring_->nodes()[owner], strerror(errno));
+        return;
+    }
+
+    pending_forwards_[seq] = pending_forward{client_addr, header, std::string(request),
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.cluster.forward_timeout_ms)};
+    forwarded_.fetch_add(1, std::memory_order_relaxed);
+    spdlog::debug("Запрос переслан узлу {}, номер пересылки {}", hash_ring_->nodes()[owner], seq);
+}
+
+void pgw_server::handle_forward_reply(udp_worker& worker, std::string_view reply) {
+    auto header = parse_packet_header(reply);
+    if (!header || header->opcode != (opcode_forwarded_create | opcode_response_flag)) {
+        spdlog::warn("Получен некорректный ответ от узла кластера");
+        return;
+    }
+
+    auto it = pending_forwards_.find(header->seq);
+    if (it == pending_forwards_.end()) {
+        spdlog::debug("Ответ на пересылку {} пришёл после таймаута", header->seq);
+        return;
+    }
+
+    const pending_forward &pending = it->second;
+    std::string_view response = reply.substr(packet_header_size);
+    std::string client_reply = pending.client_header
+        ? make_packet(pending.client_header->opcode | opcode_response_flag, pending.client_header->seq, response)
+        : std::string(response);
+    worker.cache.store(pending.client_addr, pending.request, client_reply);
+    send_reply(worker.socket.get(), pending.client_addr, client_reply);
+    pending_forwards_.erase(it);
+}
+
+void pgw_server::expire_forwards() {
+    if (pending_forwards_.empty()) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const size_t expired = std::erase_if(pending_forwards_, [now](const auto& item) {
+        return item.second.deadline < now;
+    });
+    if (expired > 0) {
+        forward_timeouts_.fetch_add(expired, std::memory_order_relaxed);
+        spdlog::warn("{} пересланных запросов остались без ответа владельца", expired);
+    }
+}
+
+io_task pgw_server::serve_clients(udp_worker& worker, int forward_fd) {
+    datagram_buffer buffer;
+    while (true) {
+        const size_t buffer_size = udp_buffer_size_.load(std::memory_order_relaxed);
+        const ssize_t n = co_await worker.scheduler.recv(worker.socket.get(), buffer.prepare(buffer_size));
+        if (!received(n, buffer)) {
+            continue;
+        }
+        worker.requests.fetch_add(1, std::memory_order_relaxed);
+        worker.hitters.add_source(buffer.addr.sin_addr.s_addr);
+
+        const int64_t kernel_rx_ns = buffer.kernel_rx_ns();
+        const std::string_view request(buffer.data.data(), n);
+        if (capture_) {
+            capture_->append(kernel_rx_ns > 0 ? kernel_rx_ns : realtime_now_ns(), buffer.addr, request);
+        }
+        handle_request(worker, forward_fd, buffer.addr, request, kernel_rx_ns);
+    }
+}
+
+io_task pgw_server::serve_forward_replies(udp_worker& worker, int forward_fd) {
+    datagram_buffer buffer;
+    while (true) {
+        const size_t buffer_size = udp_buffer_size_.load(std::memory_order_relaxed);
+        const ssize_t n = co_await worker.scheduler.recv(forward_fd, buffer.prepare(buffer_size));
+        if (received(n, buffer)) {
+            handle_forward_reply(worker, std::string_view(buffer.data.data(), n));
+        }
+    }
+}
+
+io_task pgw_server::expire_forwards_periodically(io_scheduler& scheduler) {
+    const std::chrono::milliseconds period(config_.cluster.forward_timeout_ms);
+    while (true) {
+        co_await scheduler.sleep_for(period);
+        expire_forwards();
+    }
+}
+
+io_task pgw_server::flush_capture_periodically(io_scheduler& scheduler) {
+    while (true) {
+        co_await scheduler.sleep_for(capture_flush_interval);
+        capture_->flush();
+    }
+}
+
+io_task pgw_server::rotate_heavy_hitters(udp_worker& worker) {
+    const std::chrono::seconds period(config_.heavy_hitters_window_sec);
+    while (true) {
+        co_await worker.scheduler.sleep_for(period);
+        worker.hitters.rotate();
+    }
+}
+
+io_task pgw_server::serve_mailbox(udp_worker& worker) {
+    while (true) {
+        co_await worker.scheduler.readable(worker.mailbox.fd());
+        worker.mailbox.drain();
+    }
+}
+
+io_task pgw_server::stop_on_event(io_scheduler& scheduler) {
+    co_await scheduler.readable(stop_event_.get());
+    scheduler.stop();
+}
+
+socket_raii pgw_server::open_udp_socket(int port, bool reuseport) const {
+    socket_raii sockfd(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+    if (sockfd.get() < 0) {
+        throw std::runtime_error(std::string("Не удалось создать UDP сокет: ") + strerror(errno));
+    }
+
+    int enable = 1;
+    if (reuseport && setsockopt(sockfd.get(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        throw std::runtime_error(std::string("Не удалось включить SO_REUSEPORT: ") + strerror(errno));
+    }
+
+    // Настриваем IP адрес
+    sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, config_.udp_ip.c_str(), &server_addr.sin_addr) <= 0) {
+        throw std::runtime_error("Неправильный IP адрес " + config_.udp_ip);
+    }
+
+    // Привязываем сокет к адресу
+    if (bind(sockfd.get(), reinterpret_cast<sockaddr*> (&server_addr), sizeof(server_addr)) < 0) {
+        throw std::runtime_error(std::string("Не удалось привязать UDP сокет к адресу: ") + strerror(errno));
+    }
+
+    // Ядро помечает каждый пакет временем приёма, по нему считается ожидание в очереди сокета
+    // и восстанавливаются интервалы между пакетами при воспроизведении захвата
+    if ((latency_stats_ || capture_)
+        && setsockopt(sockfd.get(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        spdlog::warn("SO_TIMESTAMPNS недоступен, время в очереди сокета не измеряется: {}", strerror(errno));
+    }
+    return sockfd;
+}
+
+void pgw_server::open_udp_sockets() {
+    const bool reuseport = workers_.size() > 1;
+    int port = config_.udp_port;
+    for (const auto& worker : workers_) {
+        worker->socket = open_udp_socket(port, reuseport);
+        // Порт 0 выбирает ядро при первой привязке, остальные сокеты группы встают на тот же
+        if (port == 0) {
+            sockaddr_in bound{};
+            socklen_t length = sizeof(bound);
+            if (getsockname(worker->socket.get(), reinterpret_cast<sockaddr*>(&bound), &length) < 0) {
+                throw std::runtime_error(std::string("Не удалось получить порт UDP сокета: ") + strerror(errno));
+            }
+            port = ntohs(bound.sin_port);
+        }
+    }
+    udp_port_.store(port);
+    if (reuseport) {
+        try {
+            attach_steering_program(workers_[0]->socket.get(), workers_.size());
+            spdlog::info("Пакеты распределяются по {} потокам UDP по IMSI", workers_.size());
+        } catch (const std::exception& e) {
+            spdlog::warn("{}. Запросы передаются владельцам через почтовые ящики", e.what());
+        }
+    }
+}
+
+void pgw_server::pin_udp_thread(size_t index) const {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+    size_t target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t pinned;
+            CPU_ZERO(&pinned);
+            CPU_SET(cpu, &pinned);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) != 0) {
+                spdlog::warn("Не удалось закрепить поток UDP {} за ядром {}", index, cpu);
+            }
+            return;
+        }
+    }
+}
+
+void pgw_server::run_udp_server(udp_worker& worker) {
+    if (workers_.size() > 1) {
+        pin_udp_thread(worker.index);
+    }
+    spdlog::info("UDP сервер {}:{} запущен, поток {}", config_.udp_ip, udp_port_.load(), worker.index);
+
+    // В кластере запросы к чужим IMSI пересылаются владельцу через отдельный сокет
+    socket_raii forward_fd(-1);
+    if (hash_ring_) {
+        forward_fd = socket_raii(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+        sockaddr_in forward_addr{};
+        forward_addr.sin_family = AF_INET;
+        if (forward_fd.get() < 0 || inet_pton(AF_INET, config_.udp_ip.c_str(), &forward_addr.sin_addr) <= 0
+            || bind(forward_fd.get(), reinterpret_cast<sockaddr*> (&forward_addr), sizeof(forward_addr)) < 0) {
+            spdlog::critical("Не удалось создать сокет для пересылки в кластере: {}", strerror(errno));
+            request_stop();
             return;
         }
-        spdlog::debug("Сокет добавлен в epoll для отслеживания");
+        spdlog::info("Узел кластера {} готов пересылать запросы", config_.cluster.node_id);
+    }
+
+    // Клиентский сокет, сокет пересылки, таймер пересылок, почтовый ящик и остановка -
+    // отдельные корутины планировщика потока
+    try {
+        io_scheduler &scheduler = worker.scheduler;
+        scheduler.spawn(serve_clients(worker, forward_fd.get()));
+        if (hash_ring_) {
+            scheduler.spawn(serve_forward_replies(worker, forward_fd.get()));
+            scheduler.spawn(expire_forwards_periodically(scheduler));
+        }
+        // Захват пишет единственный поток UDP: capture_file несовместим с udp_workers > 1
+        if (capture_) {
+            scheduler.spawn(flush_capture_periodically(scheduler));
+        }
+        if (worker.hitters.enabled()) {
+            scheduler.spawn(rotate_heavy_hitters(worker));
+        }
+        scheduler.spawn(serve_mailbox(worker));
+        scheduler.spawn(stop_on_event(scheduler));
+        scheduler.run(&worker.busy_ns);
+    } catch (const std::exception& e) {
+        spdlog::critical("Ошибка UDP сервера: {}", e.what());
+        request_stop();
+    }
+
+    worker.mailbox.close();
+    spdlog::info("UDP сервер остановлен, поток {}", worker.index);
+}
+
+void pgw_server::publish_stats() {
+    auto to_ns = [](std::chrono::steady_clock::time_point time) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count());
+    };
+    auto set_thread = [](stats_thread_load& thread, std::string_view name, uint64_t busy_ns, uint64_t handled) {
+        name.copy(thread.name.data(), thread.name.size() - 1);
+        thread.busy_ns = busy_ns;
+        thread.handled = handled;
+    };
+
+    // Поток спит в epoll до срабатывания таймера или остановки
+    const timer_fd_raii timer(std::chrono::milliseconds(100));
+    epoll_raii epoll;
+    try {
+        watch(epoll, timer.get());
+        watch(epoll, stop_event_.get());
+    } catch (const std::exception& e) {
+        spdlog::error("Публикация статистики остановлена: {}", e.what());
+        return;
+    }
+
+    while (true) {
+        const session_stats sessions = sessions_stats();
+
+        stats_snapshot snapshot;
+        snapshot.timestamp_ns = to_ns(std::chrono::steady_clock::now());
+        snapshot.start_timestamp_ns = to_ns(started_at_);
+        snapshot.udp_requests = udp_requests();
+        snapshot.http_requests = http_requests_.load(std::memory_order_relaxed);
+        snapshot.created = sessions.created;
+        snapshot.rejected_blacklist = sessions.rejected_blacklist;
+        snapshot.rejected_duplicate = sessions.rejected_duplicate;
+        snapshot.rejected_limit = sessions.rejected_limit;
+        snapshot.evicted = sessions.evicted;
+        snapshot.expired = sessions.expired;
+        snapshot.active_sessions = sessions.active_sessions;
+        snapshot.max_sessions = sessions.max_sessions;
+        snapshot.expiry_backlog = sessions.expiry_backlog;
+        snapshot.cdr_queue_depth = sessions.cdr_pending;
+        snapshot.retransmit_hits = 0;
+        for (const auto& worker : workers_) {
+            snapshot.retransmit_hits += worker->cache.hits();
+        }
+
+        // Потоки UDP по отдельности, если помещаются в сегмент вместе с HTTP, иначе одной группой
+        if (workers_.size() == 1 || workers_.size() >= stats_shm_max_threads) {
+            uint64_t busy_ns = 0;
+            for (const auto& worker : workers_) {
+                busy_ns += worker->busy_ns.load(std::memory_order_relaxed);
+            }
+            set_thread(snapshot.threads[snapshot.thread_count++], "udp", busy_ns, snapshot.udp_requests);
+        } else {
+            for (const auto& worker : workers_) {
+                set_thread(snapshot.threads[snapshot.thread_count++], "udp" + std::to_string(worker->index),
+                    worker->busy_ns.load(std::memory_order_relaxed), worker->requests.load(std::memory_order_relaxed));
+            }
+        }
+        set_thread(snapshot.threads[snapshot.thread_count++], "http", http_busy_ns_.load(std::memory_order_relaxed),
+            snapshot.http_requests);
+        stats_shm_->publish(snapshot);
 
-        // Настриваем IP адрес
-        sockaddr_in server_addr{};
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(config_.udp_port);
-        if (inet_pton(AF_INET, config_.udp_ip.c_str(), &server_addr.sin_addr) <= 0) {
-            spdlog::critical("Неправильный IP адрес {}", config_.udp_ip);
-            running_ = false;
+        epoll_event event{};
+        if (epoll_wait(epoll.get(), &event, 1, -1) < 0 && errno != EINTR) {
+            spdlog::error("Ошибка epoll_wait в потоке статистики: {}", strerror(errno));
+            break;
+        }
+        if (event.data.fd == stop_event_.get()) {
+            break;
+        }
+        timer.consume();
+    }
+}
+
+void pgw_server::run_http_server() {
+    spdlog::info("HTTP сервер {}:{} запускается...", config_.http_ip, config_.http_port);
+
+    // Время обработки запросов всеми потоками httplib: от маршрутизации до записи в лог
+    static thread_local std::chrono::steady_clock::time_point http_request_start;
+    http_server_.set_pre_routing_handler([](const httplib::Request&, httplib::Response&) {
+        http_request_start = std::chrono::steady_clock::now();
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    http_server_.set_logger([this](const httplib::Request&, const httplib::Response&) {
+        http_requests_.fetch_add(1, std::memory_order_relaxed);
+        http_busy_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - http_request_start).count(), std::memory_order_relaxed);
+    });
+
+    // Настройка ручек
+    http_server_.Get("/check_subscriber", [this](const httplib::Request& req, httplib::Response& res) {
+        // Нет IMSI
+        if (!req.has_param("imsi")) {
+            spdlog::warn("Получен http запрос без imsi");
+            res.set_content("Ошибка: требуется imsi", "text/plain");
+            res.status = 400;
             return;
         }
-        spdlog::debug("IP адрес настроен");
 
-        // Привязываем сокет к адресу
-        if (bind(sockfd.get(), reinterpret_cast<sockaddr*> (&server_addr), sizeof(server_addr)) < 0) {
-            spdlog::critical("Не удалось привязать UDP сокет к адресу: {}", strerror(errno));
-            running_ = false;
+        std::string imsi = req.get_param_value("imsi");
+        if (!is_digits_imsi(imsi)) {
+            spdlog::warn("Получен http запрос с некорректным imsi");
+            res.set_content("Ошибка: imsi должен состоять из 1 - 15 цифр", "text/plain");
+            res.status = 400;
             return;
         }
-        spdlog::info("UDP сервер запущен");
+        spdlog::info("Получен http запрос на проверку сессии с imsi {}", imsi);
 
-        // Создаём буфер для событий epoll
-        epoll_event events[config_.epoll_max_events];
+        // В кластере спрашиваем узел-владелец, если запрос не пришёл от другого узла
+        if (hash_ring_ && !forwarded_by_node(req)) {
+            const size_t owner = hash_ring_->owner_index(imsi);
+            if (owner != self_index_) {
+                const cluster_node &node = config_.cluster.nodes[owner];
+                httplib::Headers headers{{"X-PGW-Forwarded", config_.cluster.node_id}};
+                auto result = peer_pools_[owner]->call([&](httplib::Client& client) {
+                    return client.Get("/check_subscriber?imsi=" + imsi, headers);
+                });
+                if (!result) {
+                    spdlog::error("Узел-владелец {} не ответил на проверку imsi {}", node.id, imsi);
+                    res.set_content("Ошибка: узел-владелец недоступен", "text/plain");
+                    res.status = 502;
+                    return;
+                }
+                res.set_content(result->body, "text/plain");
+                res.status = result->status;
+                return;
+            }
+        }
 
-        // Создаём буфер для данных
-        char buffer[config_.udp_buffer_size];
-        sockaddr_in client_addr{};
-        socklen_t addr_len = sizeof(client_addr);
+        const size_t shard = imsi_shard(imsi, workers_.size());
+        if (on_shard(shard, [&imsi](session_manager& sessions) { return sessions.is_session_active(imsi); })) {
+            res.set_content("active", "text/plain");
+        } else {
+            res.set_content("not active", "text/plain");
+        }
+        res.status = 200;
+    });
+
+    // Пакетная проверка: ответ - строка из 0 и 1 в порядке IMSI в запросе
+    http_server_.Post("/check_subscribers", [this](const httplib::Request& req, httplib::Response& res) {
+        auto imsis = parse_imsi_list(req.body);
+        if (!imsis) {
+            res.set_content("Ошибка: тело должно содержать IMSI по одному в строке или JSON массив", "text/plain");
+            res.status = 400;
+            return;
+        }
+        if (imsis->size() > static_cast<size_t>(config_.http_max_batch)) {
+            res.set_content("Ошибка: больше " + std::to_string(config_.http_max_batch) + " IMSI в запросе", "text/plain");
+            res.status = 413;
+            return;
+        }
+        // Тело пересылается владельцам построчно, поэтому перевод строки внутри IMSI недопустим
+        if (!std::ranges::all_of(*imsis, is_digits_imsi)) {
+            res.set_content("Ошибка: каждый IMSI должен состоять из 1 - 15 цифр", "text/plain");
+            res.status = 400;
+            return;
+        }
+        spdlog::info("Получен http запрос на проверку {} сессий", imsis->size());
 
-        // Читаем данные от клиентов
-        while (running_) {
-            int n_events = epoll_wait(epollfd.get(), events, config_.epoll_max_events,
-                1000 * config_.epoll_timeout_sec);
+        // В кластере IMSI группируются по владельцам, каждому владельцу уходит один запрос
+        std::string statuses(imsis->size(), '0');
+        std::vector<std::string> local;
+        std::vector<size_t> local_positions;
+        if (hash_ring_ && !forwarded_by_node(req)) {
+            std::vector<std::vector<size_t>> by_owner(config_.cluster.nodes.size());
+            for (size_t i = 0; i < imsis->size(); ++i) {
+                by_owner[hash_ring_->owner_index((*imsis)[i])].push_back(i);
+            }
 
-            if (n_events < 0) {
-                if (errno == EINTR) {
+            for (size_t owner = 0; owner < by_owner.size(); ++owner) {
+                if (by_owner[owner].empty()) {
                     continue;
                 }
-                spdlog::critical("Ошибка epoll_wait: {}", strerror(errno));
-                running_ = false;
-                break;
-            }
-
-            for (int i = 0; i < n_events; i++) {
-                if (events[i].data.fd == sockfd.get()) {
-                    while (true) {
-                        ssize_t n = recvfrom(sockfd.get(), buffer, sizeof(buffer), 0,
-                            reinterpret_cast<sockaddr*> (&client_addr), &addr_len);
-
-                        if (n < 0) {
-                            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                                break;
-                            }
-                            spdlog::error("Ошибка recvfrom: {}", strerror(errno));
-                            break;
-                        }
-
-                        if (n == sizeof(buffer)) {
-                            spdlog::warn("Возможно, запрос был обрезан (получено максимум байт)");
-                        }
-
-                        // Декодируем bcd
-                        std::vector<uint8_t> bcd(buffer, buffer + n);
-                        std::string imsi = bcd_to_imsi(bcd);
-                        spdlog::debug("Получен UDP запрос для imsi {}", imsi);
-
-                        // Отправляем ответ
-                        std::string response = session_manager_->process_request(imsi);
-                        if (sendto(sockfd.get(), response.c_str(), response.length(), 0,
-                            reinterpret_cast<sockaddr*> (&client_addr), addr_len) < 0) {
-                            spdlog::error("Не удалось отправить ответ для imsi {}: {}", imsi, strerror(errno));
-                            }
+                if (owner == self_index_) {
+                    for (const size_t i : by_owner[owner]) {
+                        local.push_back(std::move((*imsis)[i]));
                     }
+                    local_positions = std::move(by_owner[owner]);
+                    continue;
+                }
+
+                std::string body;
+                for (const size_t i : by_owner[owner]) {
+                    body += (*imsis)[i];
+                    body += '\n';
+                }
+                const cluster_node &node = config_.cluster.nodes[owner];
+                httplib::Headers headers{{"X-PGW-Forwarded", config_.cluster.node_id}};
+                auto result = peer_pools_[owner]->call([&](httplib::Client& client) {
+                    return client.Post("/check_subscribers", headers, body, "text/plain");
+                });
+                if (!result || result->status != 200 || result->body.size() != by_owner[owner].size()) {
+                    spdlog::error("Узел-владелец {} не ответил на пакетную проверку", node.id);
+                    res.set_content("Ошибка: узел-владелец недоступен", "text/plain");
+                    res.status = 502;
+                    return;
+                }
+                for (size_t j = 0; j < by_owner[owner].size(); ++j) {
+                    statuses[by_owner[owner][j]] = result->body[j];
                 }
             }
+        } else {
+            local = std::move(*imsis);
+            local_positions.resize(local.size());
+            std::iota(local_positions.begin(), local_positions.end(), 0);
         }
 
-        spdlog::info("UDP сервер остановлен");
-    }
+        // Свои IMSI раскладываются по потокам-владельцам, каждому потоку - одна задача
+        std::vector<std::vector<std::string>> by_shard(workers_.size());
+        std::vector<std::vector<size_t>> shard_positions(workers_.size());
+        for (size_t j = 0; j < local.size(); ++j) {
+            const size_t shard = imsi_shard(local[j], workers_.size());
+            by_shard[shard].push_back(std::move(local[j]));
+            shard_positions[shard].push_back(local_positions[j]);
+        }
+        for (size_t shard = 0; shard < by_shard.size(); ++shard) {
+            if (by_shard[shard].empty()) {
+                continue;
+            }
+            const std::vector<bool> active = on_shard(shard, [&by_shard, shard](session_manager& sessions) {
+                return sessions.are_sessions_active(by_shard[shard]);
+            });
+            for (size_t j = 0; j < active.size(); ++j) {
+                statuses[shard_positions[shard][j]] = active[j] ? '1' : '0';
+            }
+        }
+        res.set_content(statuses, "text/plain");
+        res.status = 200;
+    });
 
-    // Запуск HTTP сервера
-    void run_http_server() {
-        spdlog::info("HTTP сервер {}:{} запускается...", config_.http_ip, config_.http_port);
+    // Выгрузка активных сессий частями по chunked transfer encoding. Таблица обходится порциями
+    // с коротким захватом мьютекса между ними, поэтому выгрузка не останавливает создание сессий
+    http_server_.Get("/sessions", [this](const httplib::Request& req, httplib::Response& res) {
+        // Возраст больше 100 лет не отбирает ни одной сессии, а в миллисекундах уже не переполняет int64
+        constexpr int64_t max_min_age_sec = 100LL * 365 * 24 * 3600;
+        const std::string prefix = req.get_param_value("prefix");
+        const std::optional<int64_t> min_age_param = req.has_param("min_age_sec")
+            ? parse_non_negative(req.get_param_value("min_age_sec")) : std::optional<int64_t>(0);
+        if (!min_age_param || prefix.find_first_not_of("0123456789") != std::string::npos) {
+            res.set_content("Ошибка: prefix из цифр и неотрицательный min_age_sec", "text/plain");
+            res.status = 400;
+            return;
+        }
+        const int64_t min_age_sec = std::min(*min_age_param, max_min_age_sec);
+        spdlog::info("Получен http запрос на выгрузку сессий, prefix: {}, min_age_sec: {}", prefix, min_age_sec);
 
-        // Настройка ручек
-        http_server_.Get("/check_subscriber", [this](const httplib::Request& req, httplib::Response& res) {
-            // Нет IMSI
-            if (!req.has_param("imsi")) {
-                spdlog::warn("Получен http запрос без imsi");
-                res.set_content("Ошибка: требуется imsi", "text/plain");
-                res.status = 400;
-                return;
+        // Части сессий выгружаются по очереди
+        struct export_state {
+            size_t shard = 0;
+            std::optional<size_t> cursor = 0;
+            bool header_sent = false;
+            std::vector<session_export_entry> entries;
+        };
+        auto state = std::make_shared<export_state>();
+        const std::chrono::milliseconds min_age = std::chrono::seconds(min_age_sec);
+
+        res.set_chunked_content_provider("text/csv",
+            [this, state, prefix, min_age](size_t, httplib::DataSink& sink) {
+                constexpr size_t scan_per_lock = 4096;
+                constexpr size_t chunk_bytes = 64 * 1024;
+
+                std::string chunk;
+                if (!state->header_sent) {
+                    chunk = "imsi,age_ms,ttl_ms\n";
+                    state->header_sent = true;
+                }
+                while (state->cursor && chunk.size() < chunk_bytes) {
+                    state->entries.clear();
+                    // Поток-владелец уже остановлен: выгрузка обрывается
+                    try {
+                        state->cursor = on_shard(state->shard, [&](session_manager& sessions) {
+                            return sessions.export_sessions(*state->cursor, scan_per_lock, prefix, min_age,
+                                state->entries);
+                        });
+                    } catch (const std::exception& e) {
+                        spdlog::warn("Выгрузка сессий прервана: {}", e.what());
+                        return false;
+                    }
+                    if (!state->cursor && state->shard + 1 < workers_.size()) {
+                        ++state->shard;
+                        state->cursor = 0;
+                    }
+                    for (const auto& entry : state->entries) {
+                        chunk += std::format("{},{},{}\n", entry.imsi, entry.age.count(), entry.remaining.count());
+                    }
+                }
+
+                if (!chunk.empty() && !sink.write(chunk.data(), chunk.size())) {
+                    return false;
+                }
+                if (!state->cursor) {
+                    sink.done();
+                }
+                return true;
+            });
+    });
+
+    // Поиск CDR абонента по индексу, файлы читаются через mmap в потоке HTTP без блокировок UDP
+    http_server_.Get("/cdr", [this](const httplib::Request& req, httplib::Response& res) {
+        if (config_.cdr_sink.type != "file") {
+            res.set_content("Ошибка: CDR отправляются на коллектор, локального файла нет", "text/plain");
+            res.status = 404;
+            return;
+        }
+
+        const std::string imsi = req.get_param_value("imsi");
+        if (imsi.empty() || imsi.size() > 15 || imsi.find_first_not_of("0123456789") != std::string::npos) {
+            res.set_content("Ошибка: требуется imsi из цифр", "text/plain");
+            res.status = 400;
+            return;
+        }
+
+        const auto from = req.has_param("from") ? parse_query_time(req.get_param_value("from")) : std::optional<int64_t>(0);
+        const auto to = req.has_param("to") ? parse_query_time(req.get_param_value("to"))
+            : std::optional<int64_t>(std::numeric_limits<int64_t>::max());
+        size_t limit = 1000;
+        try {
+            if (req.has_param("limit")) {
+                limit = std::stoul(req.get_param_value("limit"));
             }
+        } catch (const std::exception&) {
+            limit = 0;
+        }
+        if (!from || !to || limit == 0) {
+            res.set_content("Ошибка: неправильные from, to или limit", "text/plain");
+            res.status = 400;
+            return;
+        }
+
+        try {
+            const std::string cdr_file = workers_.size() == 1 ? config_.cdr_file
+                : shard_file(config_.cdr_file, imsi_shard(imsi, workers_.size()));
+            const cdr_search_result found = search_cdr("logs/" + cdr_file, imsi, *from, *to, limit);
+            spdlog::info("Поиск CDR imsi {}: {} записей, просмотрено блоков {} из {}", imsi,
+                found.records.size(), found.blocks_scanned, found.blocks_total);
 
-            std::string imsi = req.get_param_value("imsi");
-            spdlog::info("Получен http запрос на проверку сессии с imsi {}", imsi);
-            if (session_manager_->is_session_active(imsi)) {
-                res.set_content("active", "text/plain");
-            } else {
-                res.set_content("not active", "text/plain");
+            std::string body;
+            for (const auto& record : found.records) {
+                body += record;
+                body += '\n';
+            }
+            res.set_header("X-PGW-CDR-Blocks", std::to_string(found.blocks_scanned) + "/" + std::to_string(found.blocks_total));
+            if (found.truncated) {
+                res.set_header("X-PGW-CDR-Truncated", "1");
             }
+            res.set_content(body, "text/csv");
             res.status = 200;
-        });
+        } catch (const std::exception& e) {
+            spdlog::error("Ошибка поиска CDR: {}", e.what());
+            res.set_content("Ошибка: не удалось прочитать CDR", "text/plain");
+            res.status = 500;
+        }
+    });
 
-        http_server_.Get("/stop", [this](const httplib::Request&, httplib::Response& res) {
-            spdlog::warn("Получен /stop http запрос.");
-            res.set_content("Остановка запущена", "text/plain");
-            res.status = 200;
-            running_ = false;
+    http_server_.Get("/stats", [this](const httplib::Request&, httplib::Response& res) {
+        json stats;
+        session_stats sessions = sessions_stats();
+        stats["sessions"] = {
+            {"active", sessions.active_sessions},
+            {"max", sessions.max_sessions},
+            {"occupancy", sessions.max_sessions == 0 ? 0.0
+                : static_cast<double>(sessions.active_sessions) / static_cast<double>(sessions.max_sessions)},
+            {"created", sessions.created},
+            {"rejected_blacklist", sessions.rejected_blacklist},
+            {"rejected_duplicate", sessions.rejected_duplicate},
+            {"rejected_limit", sessions.rejected_limit},
+            {"evicted", sessions.evicted},
+            {"expired", sessions.expired},
+            {"peak", sessions.peak_sessions}
+        };
+        stats["cdr"] = {
+            {"sink", config_.cdr_sink.type},
+            {"pending", sessions.cdr_pending}
+        };
+        if (hash_ring_) {
+            stats["cluster"] = {
+                {"node_id", config_.cluster.node_id},
+                {"nodes", hash_ring_->nodes().size()},
+                {"forwarded", forwarded_.load(std::memory_order_relaxed)},
+                {"forward_timeouts", forward_timeouts_.load(std::memory_order_relaxed)}
+            };
+        }
+        if (config_.replication.enabled) {
+            const replication_stats replication = replication_publisher_ ? replication_publisher_->stats()
+                : replication_subscriber_->stats();
+            stats["replication"] = {
+                {"role", promoted_ ? "promoted" : config_.replication.role},
+                {"standbys", replication.standbys},
+                {"connected", replication.connected},
+                {"events", replication.events},
+                {"batches", replication.batches},
+                {"bytes", replication.bytes},
+                {"queued_events", replication.queued_events},
+                {"dropped_standbys", replication.dropped_standbys},
+                {"lag_ms", replication.lag_ms},
+                {"max_lag_ms", replication.max_lag_ms},
+                {"resyncs", replication.resyncs}
+            };
+        }
+        if (latency_stats_) {
+            json latency;
+            for (size_t i = 0; i < latency_stage_count; ++i) {
+                const auto stage = static_cast<latency_stage>(i);
+                const latency_histogram &histogram = latency_stats_->histogram(stage);
+                json buckets = json::array();
+                for (auto [upper_ns, count] : histogram.buckets()) {
+                    buckets.push_back({{"le_ns", upper_ns}, {"count", count}});
+                }
+                latency[latency_stage_name(stage)] = {
+                    {"count", histogram.count()},
+                    {"avg_ns", histogram.count() == 0 ? 0 : histogram.sum_ns() / histogram.count()},
+                    {"p50_ns", histogram.percentile_ns(50)},
+                    {"p99_ns", histogram.percentile_ns(99)},
+                    {"p999_ns", histogram.percentile_ns(99.9)},
+                    {"max_ns", histogram.max_ns()},
+                    {"buckets", buckets}
+                };
+            }
+            stats["latency"] = latency;
+        }
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        json workers = json::array();
+        for (const auto& worker : workers_) {
+            hits += worker->cache.hits();
+            misses += worker->cache.misses();
+            workers.push_back({
+                {"requests", worker->requests.load(std::memory_order_relaxed)},
+                {"status_queries", worker->status_queries.load(std::memory_order_relaxed)},
+                {"busy_ns", worker->busy_ns.load(std::memory_order_relaxed)}
+            });
+        }
+        stats["retransmit_cache"] = {
+            {"enabled", workers_[0]->cache.enabled()},
+            {"hits", hits},
+            {"misses", misses},
+            {"hit_rate", hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses)}
+        };
+        stats["udp"] = {
+            {"workers", workers},
+            {"handoffs", handoffs_.load(std::memory_order_relaxed)}
+        };
+        if (event_stream_) {
+            const event_stream_stats events = event_stream_->stats();
+            stats["events"] = {
+                {"subscribers", events.subscribers},
+                {"events", events.events},
+                {"delivered", events.delivered},
+                {"dropped", events.dropped}
+            };
+        }
+        res.set_content(stats.dump(), "application/json");
+        res.status = 200;
+    });
+
+    // Самые частые IMSI и отправители в текущем и прошлом окне, rate - запросов в секунду
+    http_server_.Get("/heavy_hitters", [this](const httplib::Request&, httplib::Response& res) {
+        if (!workers_[0]->hitters.enabled()) {
+            res.set_content("Ошибка: учёт выключен (heavy_hitters_top_k = 0)", "text/plain");
+            res.status = 404;
+            return;
+        }
+
+        json body = {{"top_k", config_.heavy_hitters_top_k}, {"window_sec", config_.heavy_hitters_window_sec}};
+        for (const bool current : {true, false}) {
+            std::vector<heavy_hitters_report> reports;
+            for (const auto& worker : workers_) {
+                reports.push_back(current ? worker->hitters.current() : worker->hitters.previous());
+            }
+            body[current ? "current" : "previous"] = heavy_hitters_json(reports);
+        }
+        res.set_content(body.dump(), "application/json");
+        res.status = 200;
+    });
+
+    // Лента событий сессий по Server-Sent Events: created, evicted, expired, released и dropped
+    // с числом потерянных из-за переполнения буфера событий. Без событий раз в секунду уходит комментарий,
+    // по нему обнаруживается закрытое соединение. Подписчик занимает поток HTTP
+    http_server_.Get("/events", [this](const httplib::Request& req, httplib::Response& res) {
+        if (!event_stream_) {
+            res.set_content("Ошибка: лента событий выключена (event_stream_max_subscribers = 0)", "text/plain");
+            res.status = 404;
+            return;
+        }
+        const std::string prefix = req.get_param_value("prefix");
+        if (prefix.find_first_not_of("0123456789") != std::string::npos) {
+            res.set_content("Ошибка: prefix из цифр", "text/plain");
+            res.status = 400;
+            return;
+        }
+        std::shared_ptr<session_event_stream::subscription> subscription = event_stream_->subscribe(prefix);
+        if (!subscription) {
+            res.set_content("Ошибка: достигнуто число подписчиков event_stream_max_subscribers", "text/plain");
+            res.status = 503;
+            return;
+        }
+        spdlog::info("Новый подписчик на события сессий, prefix: {}", prefix);
+
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream", [subscription](size_t, httplib::DataSink& sink) {
+            std::vector<stream_event> events;
+            uint64_t dropped = 0;
+            if (!subscription->wait(events, dropped, std::chrono::seconds(1))) {
+                sink.done();
+                return true;
+            }
+
+            std::string chunk;
+            if (dropped > 0) {
+                chunk += std::format("event: dropped\ndata: {{\"dropped\":{}}}\n\n", dropped);
+            }
+            for (const stream_event& event : events) {
+                chunk += std::format("id: {}\nevent: {}\ndata: {{\"imsi\":\"{}\",\"time_ms\":{}}}\n\n",
+                    event.seq, session_event_name(event.type), event.imsi, event.time_ms);
+            }
+            if (chunk.empty()) {
+                chunk = ": ping\n\n";
+            }
+            return sink.write(chunk.data(), chunk.size());
         });
+    });
+
+    // Текущие настройки, которые меняются без перезапуска, и история версий
+    http_server_.Get("/admin/config", [this](const httplib::Request&, httplib::Response& res) {
+        std::lock_guard lock(tunables_mutex_);
+        json history = json::array();
+        for (const tunables_version& entry : tunables_history_) {
+            history.push_back({{"version", entry.version}, {"tunables", tunables_to_json(entry.tunables)}});
+        }
+        const json body = {{"version", tunables_history_.back().version},
+            {"tunables", tunables_to_json(tunables_history_.back().tunables)}, {"history", history}};
+        res.set_content(body.dump(), "application/json");
+        res.status = 200;
+    });
+
+    // Изменение настроек: тело - JSON объект с частью полей. Все поля проверяются до применения,
+    // при ошибке ничего не меняется. version - ожидаемая текущая версия, иначе 409
+    http_server_.Post("/admin/config", [this](const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard lock(tunables_mutex_);
+        const uint64_t current = tunables_history_.back().version;
+        if (req.has_param("version") && req.get_param_value("version") != std::to_string(current)) {
+            res.set_content("Ошибка: текущая версия настроек " + std::to_string(current), "text/plain");
+            res.status = 409;
+            return;
+        }
 
-        spdlog::info("HTTP сервер {}:{} запустился", config_.http_ip, config_.http_port);
-        http_server_.listen(config_.http_ip, config_.http_port);
-        spdlog::info("HTTP сервер остановлен");
+        runtime_tunables tunables;
+        try {
+            tunables = merge_tunables(tunables_history_.back().tunables, json::parse(req.body));
+        } catch (const std::exception& e) {
+            res.set_content(std::string("Ошибка: ") + e.what(), "text/plain");
+            res.status = 400;
+            return;
+        }
+        res.set_content(push_tunables_locked(tunables).dump(), "application/json");
+        res.status = 200;
+    });
+
+    // Откат к версии из истории (по умолчанию к предыдущей), откат сам становится новой версией
+    http_server_.Post("/admin/rollback", [this](const httplib::Request& req, httplib::Response& res) {
+        std::lock_guard lock(tunables_mutex_);
+        std::optional<runtime_tunables> target;
+        if (!req.has_param("version")) {
+            if (tunables_history_.size() > 1) {
+                target = tunables_history_[tunables_history_.size() - 2].tunables;
+            }
+        } else {
+            const std::string version = req.get_param_value("version");
+            for (const tunables_version& entry : tunables_history_) {
+                if (std::to_string(entry.version) == version) {
+                    target = entry.tunables;
+                }
+            }
+        }
+        if (!target) {
+            res.set_content("Ошибка: версии нет в истории", "text/plain");
+            res.status = 404;
+            return;
+        }
+        res.set_content(push_tunables_locked(*target).dump(), "application/json");
+        res.status = 200;
+    });
+
+    http_server_.Get("/stop", [this](const httplib::Request&, httplib::Response& res) {
+        spdlog::warn("Получен /stop http запрос.");
+        res.set_content("Остановка запущена", "text/plain");
+        res.status = 200;
+        request_stop();
+    });
+
+    // Пакетные проверки идут по keep-alive соединениям, поэтому лимит запросов на соединение выше,
+    // чем по умолчанию в cpp-httplib
+    if (config_.http_threads > 0) {
+        const size_t threads = config_.http_threads;
+        http_server_.new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
     }
-public:
-    explicit pgw_server(const server_config& config) : config_(config),
-    session_manager_(std::make_shared<session_manager>(config)) {}
+    http_server_.set_keep_alive_max_count(config_.http_keep_alive_max_count);
+    http_server_.set_keep_alive_timeout(config_.http_keep_alive_timeout_sec);
+    // IMSI и перевод строки, с запасом на JSON
+    http_server_.set_payload_max_length(static_cast<size_t>(config_.http_max_batch) * 32);
 
-    // Запуск PGW сервера
-    void start() {
-        spdlog::info("PGW сервер запускается...");
+    const int port = config_.http_port == 0 ? http_server_.bind_to_any_port(config_.http_ip)
+        : http_server_.bind_to_port(config_.http_ip, config_.http_port) ? config_.http_port : -1;
+    if (port < 0) {
+        spdlog::error("Не удалось привязать HTTP сервер к {}:{}", config_.http_ip, config_.http_port);
+        return;
+    }
+    http_port_.store(port);
+    spdlog::info("HTTP сервер {}:{} запустился", config_.http_ip, port);
+    http_server_.listen_after_bind();
+    spdlog::info("HTTP сервер остановлен");
+}
 
-        // Запускаем потоки для чистки сессий, udp и http
-        running_ = true;
-        session_manager_->start_cleaning();
-        udp_thread_ = std::jthread(&pgw_server::run_udp_server, this);
-        http_thread_ = std::jthread(&pgw_server::run_http_server, this);
+bool pgw_server::wait_control(const epoll_raii& control, const signal_fd_raii& signals) {
+    while (true) {
+        epoll_event events[3];
+        int n_events = epoll_wait(control.get(), events, 3, -1);
+        if (n_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            spdlog::critical("Ошибка epoll_wait в цикле управления: {}", strerror(errno));
+            request_stop();
+            return false;
+        }
 
-        spdlog::info("PGW сервер запустился");
-        while (running_) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+        bool promoted = false;
+        for (int i = 0; i < n_events; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == signals.get()) {
+                if (const int sig = signals.consume(); sig != 0) {
+                    spdlog::warn("Получен сигнал: {}.", sig);
+                    request_stop();
+                    return false;
+                }
+            } else if (fd == stop_event_.get()) {
+                return false;
+            } else if (fd == promote_event_.get()) {
+                promote_event_.consume();
+                promoted = true;
+            }
         }
+        if (promoted) {
+            return true;
+        }
+    }
+}
 
-        stop();
+void pgw_server::start(const signal_fd_raii& signals) {
+    spdlog::info("PGW сервер запускается...");
+
+    epoll_raii control;
+    watch(control, signals.get());
+    watch(control, stop_event_.get());
+    watch(control, promote_event_.get());
+
+    // Запускаем потоки для чистки сессий, udp и http
+    http_thread_ = std::jthread(&pgw_server::run_http_server, this);
+    if (stats_shm_) {
+        stats_thread_ = std::jthread(&pgw_server::publish_stats, this);
     }
-};
 
-int main() {
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    // Резервный узел только принимает репликацию, пока основной жив
+    if (replication_subscriber_) {
+        replication_subscriber_->start();
+        spdlog::info("PGW сервер запущен в резерве");
+        if (!wait_control(control, signals)) {
+            stop();
+            return;
+        }
+    }
 
+    if (replication_publisher_) {
+        replication_publisher_->start();
+    }
+    // Сокеты открываются до запуска потоков: порядок привязки задаёт номера сокетов в группе.
+    // Чистка при нескольких потоках ставится в планировщик потока до его запуска
+    for (const auto& worker : workers_) {
+        worker->sessions->start_cleaning();
+    }
     try {
-        server_config config = load_server_config("configs/server.json");
-        setup_logger(config.log_file, config.log_level);
-        spdlog::info("Конфиг и логгер загружен");
-
-        pgw_server server(config);
-        server.start();
+        open_udp_sockets();
+        for (const auto& worker : workers_) {
+            udp_threads_.emplace_back(&pgw_server::run_udp_server, this, std::ref(*worker));
+        }
     } catch (const std::exception& e) {
-        std::cerr << e.what() << '\n';
-        return 1;
+        spdlog::critical("{}", e.what());
+        request_stop();
+        // Ящики незапущенных потоков закрываются, иначе запросы HTTP к их сессиям ждали бы вечно
+        for (size_t i = udp_threads_.size(); i < workers_.size(); ++i) {
+            workers_[i]->mailbox.close();
+        }
+    }
+
+    spdlog::info("PGW сервер запустился");
+    // Переключения резерва здесь уже не будет, цикл ждёт только остановки
+    while (wait_control(control, signals)) {
     }
 
-    return 0;
-}
\ No newline at end of file
+    stop();
+}
+
+void pgw_server::request_stop() {
+    stop_event_.notify();
+}
+
+int pgw_server::udp_port() const {
+    return udp_port_.load();
+}
+
+int pgw_server::http_port() const {
+    return http_port_.load();
+}
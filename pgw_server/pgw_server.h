@@ -0,0 +1,224 @@
+#pragma once
+
+#include <deque>
+#include <httplib.h>
+
+#include "capture_file.h"
+#include "epoll_raii.h"
+#include "event_fd_raii.h"
+#include "hash_ring.h"
+#include "heavy_hitters.h"
+#include "io_scheduler.h"
+#include "latency_stats.h"
+#include "protocol.h"
+#include "replication.h"
+#include "retransmit_cache.h"
+#include "session_event_stream.h"
+#include "session_manager.h"
+#include "shard_mailbox.h"
+#include "signal_fd_raii.h"
+#include "socket_raii.h"
+#include "stats_shm.h"
+
+// PGW сервер: потоки UDP со своими частями сессий, HTTP API, кластер, репликация и статистика.
+// Запускается из main и в процессе теста производительности
+class pgw_server {
+    // Поток UDP со своей частью сессий. При udp_workers > 1 у каждого потока свой сокет в группе
+    // SO_REUSEPORT и ядро кладёт пакет в сокет потока-владельца IMSI (reuseport_steering.h).
+    // Другие потоки к сессиям и кэшу потока не обращаются, а передают задачи через его почтовый ящик.
+    // С одним потоком сессии, как и раньше, доступны всем потокам под мьютексом session_manager
+    struct udp_worker {
+        size_t index;
+        io_scheduler scheduler;
+        shard_mailbox mailbox;
+        retransmit_cache cache;
+        heavy_hitters hitters;
+        std::shared_ptr<session_manager> sessions;
+        socket_raii socket{-1};
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> status_queries{0};
+        std::atomic<uint64_t> busy_ns{0};
+
+        // Чистка сессий при нескольких потоках идёт корутиной в потоке-владельце
+        udp_worker(const server_config& config, size_t index);
+    };
+
+    // Запрос, пересланный владельцу и ждущий его ответа
+    struct pending_forward {
+        sockaddr_in client_addr;
+        std::optional<packet_header> client_header; // nullopt для обычного запроса без заголовка
+        std::string request;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    // Пул соединений HTTP с узлом кластера для пересланных проверок. httplib::Client не потокобезопасен,
+    // поэтому поток HTTP берёт клиент из пула на время запроса и возвращает его с открытым соединением.
+    // Клиентов создаётся столько, сколько параллельных проверок, простаивающих хранится до max_idle
+    class peer_pool {
+        static constexpr size_t max_idle = 8;
+
+        cluster_node node_;
+        std::chrono::milliseconds timeout_;
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<httplib::Client>> idle_;
+
+    public:
+        peer_pool(const cluster_node& node, std::chrono::milliseconds timeout);
+
+        std::unique_ptr<httplib::Client> acquire();
+        // Клиент после ошибки не возвращается: его соединение могло остаться в неизвестном состоянии
+        void release(std::unique_ptr<httplib::Client> client);
+
+        template<typename F>
+        httplib::Result call(F&& f) {
+            std::unique_ptr<httplib::Client> client = acquire();
+            httplib::Result result = f(*client);
+            if (result) {
+                release(std::move(client));
+            }
+            return result;
+        }
+    };
+
+    // Применённые через /admin/config настройки
+    struct tunables_version {
+        uint64_t version;
+        runtime_tunables tunables;
+    };
+
+    server_config config_;
+    // Настройки из /admin/config: горячий путь читает атомарные копии, а не config_.
+    // История хранит последние версии для отката, версия 1 - из файла конфига
+    std::atomic<int> udp_buffer_size_;
+    std::mutex tunables_mutex_;
+    std::deque<tunables_version> tunables_history_;
+    // Остановка: eventfd не сбрасывается, после notify он читаемый во всех epoll, где зарегистрирован.
+    // Объявлены до потоков, чтобы их пережить
+    event_fd_raii stop_event_;
+    event_fd_raii promote_event_;
+    // Лента событий для /events, объявлена до частей сессий, чтобы их пережить (только при подписчиках в конфиге)
+    std::unique_ptr<session_event_stream> event_stream_;
+    std::vector<std::unique_ptr<udp_worker>> workers_;
+    std::unique_ptr<latency_stats> latency_stats_; // только при latency_tracing
+    std::unique_ptr<capture_writer> capture_;      // только при capture_file, пишет поток UDP
+    httplib::Server http_server_;
+    std::vector<std::jthread> udp_threads_;
+    std::jthread http_thread_;
+
+    // Кластер: кольцо есть только при заданной секции cluster
+    std::unique_ptr<hash_ring> hash_ring_;
+    std::vector<sockaddr_in> node_addrs_;
+    std::vector<std::unique_ptr<peer_pool>> peer_pools_; // по индексу узла, у своего узла nullptr
+    size_t self_index_{};
+    std::unordered_map<uint64_t, pending_forward> pending_forwards_; // только в потоке UDP
+    uint64_t next_forward_seq_ = 1;
+    std::atomic<uint64_t> forwarded_{0};
+    std::atomic<uint64_t> forward_timeouts_{0};
+    std::atomic<uint64_t> handoffs_{0};  // пакеты, которые ядро положило не в сокет владельца
+
+    // Репликация: publisher на основном узле, subscriber на резервном до переключения
+    std::unique_ptr<replication_publisher> replication_publisher_;
+    std::unique_ptr<replication_subscriber> replication_subscriber_;
+    std::atomic<bool> promoted_{false};
+
+    // Статистика в разделяемой памяти для pgw_top
+    std::unique_ptr<stats_shm_writer> stats_shm_;
+    std::jthread stats_thread_;
+    const std::chrono::steady_clock::time_point started_at_ = std::chrono::steady_clock::now();
+    std::atomic<uint64_t> http_requests_{0};
+    std::atomic<uint64_t> http_busy_ns_{0};
+    // Порты после привязки сокетов, 0 до неё
+    std::atomic<int> udp_port_{0};
+    std::atomic<int> http_port_{0};
+
+    // Запрос к сессиям потока-владельца. При нескольких потоках выполняется в потоке-владельце
+    // через его почтовый ящик, с одним - сразу, как раньше: сессии доступны и до запуска UDP,
+    // например на резервном узле
+    template<typename F>
+    auto on_shard(size_t shard, F&& f) {
+        udp_worker &worker = *workers_[shard];
+        if (workers_.size() == 1) {
+            return f(*worker.sessions);
+        }
+        return worker.mailbox.call([&worker, &f] { return f(*worker.sessions); });
+    }
+
+    uint64_t udp_requests() const;
+    // Счётчики всех частей сессий: читаются напрямую, мьютекс части берётся ненадолго
+    session_stats sessions_stats();
+    // Применение проверенных настроек к логгеру, потокам UDP и всем частям сессий. Каждое значение
+    // записывается атомарно, потоки видят его со следующего запроса или прохода чистки без блокировок.
+    // Вызывается под tunables_mutex_, поэтому версии применяются по очереди
+    void apply_tunables(const runtime_tunables& tunables);
+    // Новая версия настроек, старые версии сверх max_tunables_history забываются
+    json push_tunables_locked(const runtime_tunables& tunables);
+    // Остановка PGW сервера
+    void stop();
+    // Обработка одного UDP запроса в потоке worker
+    void handle_request(udp_worker& worker, int forward_fd, const sockaddr_in& client_addr, std::string_view request,
+        int64_t kernel_rx_ns);
+    // Пакет пришёл с IP адреса одного из узлов кластера: только таким доверяется opcode_forwarded_create
+    bool from_cluster_node(const sockaddr_in& addr) const;
+    // HTTP запрос переслан другим узлом: заголовок X-PGW-Forwarded учитывается только с адреса узла кластера
+    // (UDP или HTTP адрес из конфига), иначе клиент получил бы ответ узла без обращения к владельцу
+    bool forwarded_by_node(const httplib::Request& req) const;
+    // Ответ на запрос статуса битовой картой. Проверка - тот же are_sessions_active, что у /check_subscribers.
+    // При нескольких потоках IMSI группируются по частям сессий, чужая часть читается под её мьютексом,
+    // как счётчики /stats: ответ не ждёт очереди почтового ящика владельца. В кластере ответ - по сессиям
+    // этого узла, клиент спрашивает владельца IMSI
+    void answer_status_query(udp_worker& worker, const sockaddr_in& client_addr, uint64_t seq,
+        std::string_view payload);
+    // Передача запроса потоку-владельцу, он ответит клиенту со своего сокета того же адреса
+    void hand_off(udp_worker& owner, const sockaddr_in& client_addr, std::string_view request, int64_t kernel_rx_ns);
+    // Топ окна по всем потокам. IMSI принадлежит одному потоку, а запросы одного отправителя
+    // расходятся по потокам, поэтому счётчики адресов складываются
+    json heavy_hitters_json(const std::vector<heavy_hitters_report>& reports) const;
+    // Пересылка запроса узлу-владельцу, ответ придёт на сокет пересылки
+    void forward_request(int forward_fd, size_t owner, const sockaddr_in& client_addr,
+        const std::optional<packet_header>& header, std::string_view request, std::string_view bcd);
+    // Ответ владельца возвращается клиенту в том формате, в котором пришёл запрос
+    void handle_forward_reply(udp_worker& worker, std::string_view reply);
+    // Забываем пересылки без ответа, клиент повторит запрос сам
+    void expire_forwards();
+    // Запросы клиентов
+    io_task serve_clients(udp_worker& worker, int forward_fd);
+    // Ответы владельцев на пересланные запросы
+    io_task serve_forward_replies(udp_worker& worker, int forward_fd);
+    io_task expire_forwards_periodically(io_scheduler& scheduler);
+    // Сброс буфера захвата раз в capture_flush_interval, чтобы падение не уносило последние пакеты
+    io_task flush_capture_periodically(io_scheduler& scheduler);
+    // Закрытие окна учёта частых IMSI и отправителей
+    io_task rotate_heavy_hitters(udp_worker& worker);
+    // Задачи других потоков: запросы HTTP к сессиям потока и переданные пакеты
+    static io_task serve_mailbox(udp_worker& worker);
+    // Остановка приходит событием: eventfd не сбрасывается и остаётся читаемым
+    io_task stop_on_event(io_scheduler& scheduler);
+    // Создание и привязка UDP сокета, runtime_error при ошибке. Сокеты группы SO_REUSEPORT
+    // привязываются к одному адресу, номер сокета в группе - порядок привязки
+    socket_raii open_udp_socket(int port, bool reuseport) const;
+    // Сокеты всех потоков UDP. При нескольких потоках к группе подключается программа распределения;
+    // без неё ядро распределяет пакеты по хэшу адресов, и потоки передают чужие запросы владельцам
+    void open_udp_sockets();
+    // Поток на ядро: поток i закрепляется за i-м из доступных процессу ядер
+    void pin_udp_thread(size_t index) const;
+    // Запуск UDP сервера в потоке worker, сокет уже открыт
+    void run_udp_server(udp_worker& worker);
+    // Публикация счётчиков в разделяемую память 10 раз в секунду
+    void publish_stats();
+    // Запуск HTTP сервера
+    void run_http_server();
+    // Цикл управления: ждёт в epoll сигналов, остановки и переключения резерва.
+    // true - резервный узел переключен, false - пора останавливаться
+    bool wait_control(const epoll_raii& control, const signal_fd_raii& signals);
+
+public:
+    explicit pgw_server(const server_config& config);
+    // Запуск PGW сервера. Возвращается после остановки по сигналу из signals или /stop
+    void start(const signal_fd_raii& signals);
+    // Запрос остановки из любого потока: будит цикл управления, UDP сервер и поток статистики
+    void request_stop();
+    // Порты, к которым привязаны сокеты, 0 до привязки. Порт 0 в конфиге - свободный порт,
+    // выбранный ядром: так сервер запускают тесты внутри своего процесса
+    int udp_port() const;
+    int http_port() const;
+};
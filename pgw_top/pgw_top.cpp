@@ -0,0 +1,108 @@
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+#include "spdlog/spdlog.h"
+#include "stats_shm.h"
+
+// Монитор pgw_server: читает снимки счётчиков из разделяемой памяти 10 раз в секунду.
+// К серверу не обращается, сервер не замечает, сколько мониторов запущено
+
+std::atomic running_ = true;
+
+void signal_handler(int) {
+    running_ = false;
+}
+
+namespace {
+    constexpr auto refresh_interval = std::chrono::milliseconds(100);
+    // Скорости считаются по окну в секунду, чтобы цифры не прыгали
+    constexpr size_t rate_window = 10;
+
+    double per_second(uint64_t now, uint64_t before, double seconds) {
+        return seconds > 0 ? static_cast<double>(now - before) / seconds : 0.0;
+    }
+
+    void render(const stats_snapshot& now, const stats_snapshot& before, int64_t pid, bool stale) {
+        const double seconds = static_cast<double>(now.timestamp_ns - before.timestamp_ns) / 1e9;
+        const double uptime = static_cast<double>(now.timestamp_ns - now.start_timestamp_ns) / 1e9;
+
+        std::string out = "\033[H\033[2J";
+        out += fmt::format("pgw_server pid {}, работает {:.0f} с{}\n\n", pid, uptime,
+            stale ? "   [нет обновлений, сервер остановлен?]" : "");
+
+        out += fmt::format("Запросы/с      UDP {:>10.0f}   HTTP {:>8.0f}   ретрансмиты {:>8.0f}\n",
+            per_second(now.udp_requests, before.udp_requests, seconds),
+            per_second(now.http_requests, before.http_requests, seconds),
+            per_second(now.retransmit_hits, before.retransmit_hits, seconds));
+        out += fmt::format("Результаты/с   created {:>8.0f}   blacklist {:>8.0f}   duplicate {:>8.0f}   limit {:>8.0f}\n",
+            per_second(now.created, before.created, seconds),
+            per_second(now.rejected_blacklist, before.rejected_blacklist, seconds),
+            per_second(now.rejected_duplicate, before.rejected_duplicate, seconds),
+            per_second(now.rejected_limit, before.rejected_limit, seconds));
+        out += fmt::format("Удаления/с     expired {:>8.0f}   evicted {:>8.0f}\n\n",
+            per_second(now.expired, before.expired, seconds),
+            per_second(now.evicted, before.evicted, seconds));
+
+        if (now.max_sessions > 0) {
+            out += fmt::format("Сессии         {} из {} ({:.1f}%)\n", now.active_sessions, now.max_sessions,
+                100.0 * static_cast<double>(now.active_sessions) / static_cast<double>(now.max_sessions));
+        } else {
+            out += fmt::format("Сессии         {} (без ограничения)\n", now.active_sessions);
+        }
+        out += fmt::format("Ждут удаления  {}\n", now.expiry_backlog);
+        out += fmt::format("Очередь CDR    {}\n\n", now.cdr_queue_depth);
+
+        out += fmt::format("{:<16} {:>8} {:>14}\n", "Поток", "Загрузка", "Обработано/с");
+        for (size_t i = 0; i < std::min<uint64_t>(now.thread_count, stats_shm_max_threads); ++i) {
+            const stats_thread_load& thread = now.threads[i];
+            const stats_thread_load& previous = before.threads[i];
+            const double load = seconds > 0
+                ? static_cast<double>(thread.busy_ns - previous.busy_ns) / (seconds * 1e9) * 100.0 : 0.0;
+            out += fmt::format("{:<16} {:>7.1f}% {:>14.0f}\n", std::string_view(thread.name.data()),
+                load, per_second(thread.handled, previous.handled, seconds));
+        }
+
+        std::cout << out << std::flush;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    try {
+        if (argc > 2) {
+            std::cerr << "Использование: pgw_top [имя сегмента, по умолчанию /pgw_stats]" << '\n';
+            return 1;
+        }
+
+        spdlog::set_level(spdlog::level::off);
+        const stats_shm_reader reader(argc == 2 ? argv[1] : "/pgw_stats");
+
+        std::vector<stats_snapshot> history;
+        uint64_t last_timestamp = 0;
+        auto last_update = std::chrono::steady_clock::now();
+        while (running_) {
+            if (auto snapshot = reader.read()) {
+                const auto now = std::chrono::steady_clock::now();
+                if (snapshot->timestamp_ns != last_timestamp) {
+                    last_timestamp = snapshot->timestamp_ns;
+                    last_update = now;
+                }
+
+                history.push_back(*snapshot);
+                if (history.size() > rate_window + 1) {
+                    history.erase(history.begin());
+                }
+                render(history.back(), history.front(), reader.pid(), now - last_update > std::chrono::seconds(1));
+            }
+            std::this_thread::sleep_for(refresh_interval);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,344 @@
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <httplib.h>
+#include <sys/wait.h>
+
+#include "bcd.h"
+#include "config.h"
+#include "hash_ring.h"
+#include "protocol.h"
+#include "socket_raii.h"
+
+// Интеграционный тест кластера: несколько процессов pgw_server на loopback портах.
+// Путь к pgw_server передаётся первым аргументом
+std::string server_binary;
+
+class cluster_test : public ::testing::Test {
+protected:
+    struct node {
+        std::string id;
+        int udp_port;
+        int http_port;
+        pid_t pid;
+    };
+
+    static constexpr int nodes_count = 3;
+    static constexpr int virtual_nodes = 64;
+
+    std::filesystem::path dir;
+    std::vector<node> nodes;
+    std::unique_ptr<hash_ring> ring;
+
+    void SetUp() override {
+        dir = std::filesystem::temp_directory_path() / ("pgw_cluster_test_" + std::to_string(getpid()));
+        std::filesystem::create_directories(dir);
+
+        // Порты зависят от pid, чтобы параллельные прогоны не пересекались
+        const int base_port = 20000 + getpid() % 20000;
+        json cluster = {{"virtual_nodes", virtual_nodes}, {"nodes", json::array()}};
+        std::vector<std::string> ids;
+        for (int i = 0; i < nodes_count; ++i) {
+            nodes.push_back({"node" + std::to_string(i), base_port + i, base_port + nodes_count + i, -1});
+            cluster["nodes"].push_back({
+                {"id", nodes.back().id},
+                {"udp_ip", "127.0.0.1"},
+                {"udp_port", nodes.back().udp_port},
+                {"http_ip", "127.0.0.1"},
+                {"http_port", nodes.back().http_port}
+            });
+            ids.push_back(nodes.back().id);
+        }
+        ring = std::make_unique<hash_ring>(ids, virtual_nodes);
+
+        for (node& n : nodes) {
+            json config = {
+                {"udp_ip", "127.0.0.1"},
+                {"udp_port", n.udp_port},
+                {"http_ip", "127.0.0.1"},
+                {"http_port", n.http_port},
+                {"session_timeout_sec", 60},
+                {"graceful_shutdown_rate", 1000},
+                {"cdr_file", n.id + ".csv"},
+                {"log_file", n.id + ".log"},
+                {"log_level", "warn"},
+                {"stats_shm_name", ""},
+                {"cluster", cluster}
+            };
+            config["cluster"]["node_id"] = n.id;
+
+            const std::filesystem::path config_path = dir / (n.id + ".json");
+            std::ofstream(config_path) << config.dump(2);
+
+            n.pid = fork();
+            if (n.pid == 0) {
+                std::filesystem::current_path(dir);
+                execl(server_binary.c_str(), server_binary.c_str(), config_path.c_str(), nullptr);
+                _exit(127);
+            }
+            ASSERT_GT(n.pid, 0);
+        }
+
+        // Ждём, пока все узлы начнут отвечать по HTTP
+        for (const node& n : nodes) {
+            httplib::Client client("127.0.0.1", n.http_port);
+            bool ready = false;
+            for (int attempt = 0; attempt < 100 && !ready; ++attempt) {
+                ready = static_cast<bool>(client.Get("/stats"));
+                if (!ready) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }
+            ASSERT_TRUE(ready) << "Узел " << n.id << " не запустился";
+        }
+    }
+
+    void TearDown() override {
+        for (const node& n : nodes) {
+            if (n.pid > 0) {
+                httplib::Client("127.0.0.1", n.http_port).Get("/stop");
+            }
+        }
+
+        // Даём узлам завершиться самим, иначе добиваем
+        for (const node& n : nodes) {
+            if (n.pid <= 0) {
+                continue;
+            }
+            int status = 0;
+            for (int attempt = 0; attempt < 100 && waitpid(n.pid, &status, WNOHANG) == 0; ++attempt) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            if (waitpid(n.pid, &status, WNOHANG) == 0) {
+                kill(n.pid, SIGKILL);
+                waitpid(n.pid, &status, 0);
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+    // IMSI, которым владеет узел owner
+    std::string imsi_owned_by(size_t owner) const {
+        for (uint64_t i = 0;; ++i) {
+            std::string imsi = std::to_string(250010000000000ULL + i);
+            if (ring->owner_index(imsi) == owner) {
+                return imsi;
+            }
+        }
+    }
+
+    // Запрос на создание сессии через UDP порт узла, каждый раз с нового сокета
+    static std::string send_udp(int port, const std::string& imsi) {
+        socket_raii sockfd(socket(AF_INET, SOCK_DGRAM, 0));
+        timeval tv{};
+        tv.tv_sec = 2;
+        setsockopt(sockfd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+        std::vector<uint8_t> bcd = imsi_to_bcd(imsi);
+        sendto(sockfd.get(), bcd.data(), bcd.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+        char buffer[64];
+        ssize_t n = recvfrom(sockfd.get(), buffer, sizeof(buffer), 0, nullptr, nullptr);
+        return n < 0 ? "timeout" : std::string(buffer, n);
+    }
+
+    // Расширенный пакет с адреса source_ip, ответ целиком с заголовком
+    static std::string send_framed(int port, uint8_t opcode, const std::string& imsi, const std::string& source_ip) {
+        socket_raii sockfd(socket(AF_INET, SOCK_DGRAM, 0));
+        timeval tv{};
+        tv.tv_sec = 2;
+        setsockopt(sockfd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        sockaddr_in source{};
+        source.sin_family = AF_INET;
+        inet_pton(AF_INET, source_ip.c_str(), &source.sin_addr);
+        if (bind(sockfd.get(), reinterpret_cast<sockaddr*>(&source), sizeof(source)) < 0) {
+            return "bind error";
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+        const std::vector<uint8_t> bcd = imsi_to_bcd(imsi);
+        const std::string packet = make_packet(opcode, 1, std::string_view(reinterpret_cast<const char*>(bcd.data()),
+            bcd.size()));
+        sendto(sockfd.get(), packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+        char buffer[64];
+        ssize_t n = recvfrom(sockfd.get(), buffer, sizeof(buffer), 0, nullptr, nullptr);
+        return n < 0 ? "timeout" : std::string(buffer, n);
+    }
+
+    // Одинаковые запросы с одного сокета, как ретрансмиты клиента. Ответы по порядку
+    static std::vector<std::string> send_udp_repeated(int port, const std::string& imsi, int count) {
+        socket_raii sockfd(socket(AF_INET, SOCK_DGRAM, 0));
+        timeval tv{};
+        tv.tv_sec = 2;
+        setsockopt(sockfd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+        const std::vector<uint8_t> bcd = imsi_to_bcd(imsi);
+        std::vector<std::string> replies;
+        for (int i = 0; i < count; ++i) {
+            sendto(sockfd.get(), bcd.data(), bcd.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            char buffer[64];
+            ssize_t n = recvfrom(sockfd.get(), buffer, sizeof(buffer), 0, nullptr, nullptr);
+            replies.push_back(n < 0 ? "timeout" : std::string(buffer, n));
+        }
+        return replies;
+    }
+
+    // HTTP GET с адреса source_ip и заголовком X-PGW-Forwarded, тело ответа
+    static std::string forwarded_get(int http_port, const std::string& path, const std::string& source_ip) {
+        socket_raii sockfd(socket(AF_INET, SOCK_STREAM, 0));
+        timeval tv{};
+        tv.tv_sec = 2;
+        setsockopt(sockfd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        sockaddr_in source{};
+        source.sin_family = AF_INET;
+        inet_pton(AF_INET, source_ip.c_str(), &source.sin_addr);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(http_port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (bind(sockfd.get(), reinterpret_cast<sockaddr*>(&source), sizeof(source)) < 0
+            || connect(sockfd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            return "connect error";
+        }
+
+        const std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+            "X-PGW-Forwarded: node0\r\nConnection: close\r\n\r\n";
+        send(sockfd.get(), request.data(), request.size(), MSG_NOSIGNAL);
+
+        std::string response;
+        char buffer[4096];
+        for (ssize_t n; (n = recv(sockfd.get(), buffer, sizeof(buffer), 0)) > 0;) {
+            response.append(buffer, n);
+        }
+        const size_t body = response.find("\r\n\r\n");
+        return body == std::string::npos ? "error" : response.substr(body + 4);
+    }
+
+    static json stats(int http_port) {
+        auto result = httplib::Client("127.0.0.1", http_port).Get("/stats");
+        return result ? json::parse(result->body) : json();
+    }
+
+    static std::string check_subscriber(int http_port, const std::string& imsi) {
+        auto result = httplib::Client("127.0.0.1", http_port).Get("/check_subscriber?imsi=" + imsi);
+        return result ? result->body : "error";
+    }
+};
+
+// Запрос к чужому узлу пересылается владельцу, ответ возвращается клиенту
+TEST_F(cluster_test, request_forwarded_to_owner) {
+    const std::string imsi = imsi_owned_by(1);
+
+    EXPECT_EQ(send_udp(nodes[0].udp_port, imsi), "created");
+    EXPECT_EQ(send_udp(nodes[2].udp_port, imsi), "rejected");
+    EXPECT_EQ(send_udp(nodes[1].udp_port, imsi), "rejected");
+}
+
+// Код пересылки от клиента не с адреса узла кластера не обходит владельца: запрос пересылается ему
+TEST_F(cluster_test, forwarded_opcode_from_client_goes_to_owner) {
+    const std::string imsi = imsi_owned_by(1);
+
+    // Узлы слушают 127.0.0.1, клиент отправляет с другого адреса loopback
+    const std::string reply = send_framed(nodes[0].udp_port, opcode_forwarded_create, imsi, "127.0.0.2");
+    const auto header = parse_packet_header(reply);
+    ASSERT_TRUE(header) << reply;
+    EXPECT_EQ(header->opcode, opcode_create | opcode_response_flag);
+    EXPECT_EQ(reply.substr(packet_header_size), "created");
+
+    const json non_owner = stats(nodes[0].http_port);
+    EXPECT_EQ(non_owner["sessions"]["active"], 0);
+    EXPECT_EQ(non_owner["cluster"]["forwarded"], 1);
+    EXPECT_EQ(stats(nodes[1].http_port)["sessions"]["active"], 1);
+}
+
+// Ретрансмиты, на которые отвечает кэш, тоже считаются в частых IMSI: шторм одинаковых запросов виден в топе
+TEST_F(cluster_test, retransmits_counted_in_heavy_hitters) {
+    constexpr int retransmits = 20;
+    const std::string imsi = imsi_owned_by(0);
+    const std::vector<std::string> replies = send_udp_repeated(nodes[0].udp_port, imsi, retransmits);
+    for (const std::string& reply : replies) {
+        EXPECT_EQ(reply, "created");
+    }
+
+    auto result = httplib::Client("127.0.0.1", nodes[0].http_port).Get("/heavy_hitters");
+    ASSERT_TRUE(result);
+    const json top = json::parse(result->body)["current"]["imsi"];
+    ASSERT_FALSE(top.empty());
+    EXPECT_EQ(top[0]["imsi"], imsi);
+    EXPECT_EQ(top[0]["count"], retransmits);
+}
+
+// Проверка сессии через любой узел отвечает состоянием у владельца
+TEST_F(cluster_test, check_subscriber_resolved_through_owner) {
+    const std::string imsi = imsi_owned_by(2);
+    ASSERT_EQ(send_udp(nodes[2].udp_port, imsi), "created");
+
+    for (const node& n : nodes) {
+        EXPECT_EQ(check_subscriber(n.http_port, imsi), "active") << n.id;
+    }
+    EXPECT_EQ(check_subscriber(nodes[0].http_port, imsi_owned_by(1)), "not active");
+}
+
+// X-PGW-Forwarded от клиента не с адреса узла кластера не отменяет запрос к владельцу
+TEST_F(cluster_test, forwarded_header_from_client_goes_to_owner) {
+    const std::string imsi = imsi_owned_by(1);
+    ASSERT_EQ(send_udp(nodes[1].udp_port, imsi), "created");
+
+    EXPECT_EQ(forwarded_get(nodes[0].http_port, "/check_subscriber?imsi=" + imsi, "127.0.0.2"), "active");
+}
+
+// IMSI не из цифр отклоняется до пересылки владельцу
+TEST_F(cluster_test, invalid_imsi_rejected_before_forwarding) {
+    auto result = httplib::Client("127.0.0.1", nodes[0].http_port).Get("/check_subscriber?imsi=25001%26x%3D1");
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result->status, 400);
+}
+
+// Пакетная проверка через любой узел собирает ответы владельцев в порядке запроса
+TEST_F(cluster_test, batch_check_resolved_through_owners) {
+    std::vector<std::string> imsis;
+    for (size_t owner = 0; owner < nodes_count; ++owner) {
+        imsis.push_back(imsi_owned_by(owner));
+    }
+    ASSERT_EQ(send_udp(nodes[1].udp_port, imsis[1]), "created");
+    ASSERT_EQ(send_udp(nodes[0].udp_port, imsis[2]), "created");
+
+    httplib::Client client("127.0.0.1", nodes[0].http_port);
+    client.set_keep_alive(true);
+    auto text = client.Post("/check_subscribers", imsis[0] + "\n" + imsis[1] + "\n" + imsis[2] + "\n", "text/plain");
+    ASSERT_TRUE(text);
+    EXPECT_EQ(text->body, "011");
+
+    // JSON и повторный запрос по тому же соединению
+    auto json_result = client.Post("/check_subscribers", json(imsis).dump(), "application/json");
+    ASSERT_TRUE(json_result);
+    EXPECT_EQ(json_result->body, "011");
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    if (argc < 2) {
+        std::cerr << "Использование: cluster_test <путь к pgw_server>" << '\n';
+        return 1;
+    }
+    server_binary = std::filesystem::absolute(argv[1]);
+    return RUN_ALL_TESTS();
+}
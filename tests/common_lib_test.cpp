@@ -3,7 +3,10 @@
 #include <gtest/gtest.h>
 
 #include "bcd.h"
+#include "config.h"
 #include "logger.h"
+#include "protocol.h"
+#include "stats_shm.h"
 
 // Тесты bcd
 
@@ -24,6 +27,64 @@ TEST(bcd_test, not_a_number_in_imsi) {
     ASSERT_THROW(imsi_to_bcd("34605160239662x"), std::invalid_argument);
 }
 
+// Тесты расширенного формата пакетов
+
+// Сборка и разбор заголовка
+TEST(protocol_test, make_and_parse_packet) {
+    const std::vector<uint8_t> bcd = imsi_to_bcd("346051602396626");
+    const std::string payload(bcd.begin(), bcd.end());
+    const std::string packet = make_packet(opcode_create, 0x0102030405060708ULL, payload);
+
+    ASSERT_EQ(packet.size(), packet_header_size + payload.size());
+    ASSERT_TRUE(is_framed_packet(packet));
+
+    auto header = parse_packet_header(packet);
+    ASSERT_TRUE(header.has_value());
+    EXPECT_EQ(header->opcode, opcode_create);
+    EXPECT_EQ(header->seq, 0x0102030405060708ULL);
+    EXPECT_EQ(packet.substr(packet_header_size), payload);
+}
+
+// Обычный BCD запрос не похож на расширенный пакет
+TEST(protocol_test, plain_bcd_is_not_framed) {
+    const std::vector<uint8_t> bcd = imsi_to_bcd("999999999999999");
+    const std::string packet(bcd.begin(), bcd.end());
+
+    EXPECT_FALSE(is_framed_packet(packet));
+    EXPECT_FALSE(parse_packet_header(packet).has_value());
+}
+
+// Обрезанный заголовок не разбирается
+TEST(protocol_test, truncated_header) {
+    const std::string packet = make_packet(opcode_create, 1, "");
+    EXPECT_FALSE(parse_packet_header(packet.substr(0, packet_header_size - 1)).has_value());
+}
+
+// Запрос статуса разбирается в исходные IMSI, битовая карта читается в порядке запроса
+TEST(protocol_test, status_query_and_bitmap) {
+    std::vector<std::vector<uint8_t>> bcd_imsis;
+    for (int i = 0; i < 10; ++i) {
+        bcd_imsis.push_back(imsi_to_bcd("34605160239662" + std::to_string(i)));
+    }
+    const std::string payload = make_status_query(bcd_imsis);
+
+    const auto parsed = parse_status_query(payload);
+    ASSERT_TRUE(parsed.has_value());
+    ASSERT_EQ(parsed->size(), bcd_imsis.size());
+    EXPECT_EQ(bcd_to_imsi(std::vector<uint8_t>((*parsed)[9].begin(), (*parsed)[9].end())), "346051602396629");
+
+    const std::vector<bool> active{true, false, false, true, false, false, false, false, false, true};
+    const std::string bitmap = make_status_bitmap(active);
+    ASSERT_EQ(bitmap.size(), 2u);
+    for (size_t i = 0; i < active.size(); ++i) {
+        EXPECT_EQ(status_bit(bitmap, i), active[i]) << i;
+    }
+
+    // Длина IMSI больше оставшихся данных
+    EXPECT_FALSE(parse_status_query(payload.substr(0, payload.size() - 1)).has_value());
+    EXPECT_THROW(make_status_query({std::vector<uint8_t>(9, 0x11)}), std::invalid_argument);
+}
+
 // Тесты настройки логгера
 class logger_test : public ::testing::Test {
 protected:
@@ -73,6 +134,67 @@ TEST_F(logger_test, invalid_log_level) {
     ASSERT_THROW(setup_logger("test.log", "invalid"), std::invalid_argument);
 }
 
+// Изменение части настроек на ходу: остальные поля сохраняются, ошибка не меняет ничего
+TEST(runtime_tunables_test, merge_validates_whole_change) {
+    server_config config;
+    config.session_timeout_sec = 5;
+    config.graceful_shutdown_rate = 10;
+    config.udp_buffer_size = 1024;
+    config.retransmit_cache_ttl_ms = 2000;
+    config.log_level = "info";
+    const runtime_tunables base = tunables_of(config);
+
+    const runtime_tunables merged = merge_tunables(base, json{{"session_timeout_sec", 30}, {"log_level", "debug"}});
+    EXPECT_EQ(merged.session_timeout_sec, 30);
+    EXPECT_EQ(merged.log_level, "debug");
+    EXPECT_EQ(merged.udp_buffer_size, 1024);
+    EXPECT_EQ(tunables_to_json(merged)["graceful_shutdown_rate"], 10);
+
+    EXPECT_THROW(merge_tunables(base, json{{"session_timeout_sec", 30}, {"udp_buffer_size", 100}}), std::runtime_error);
+    EXPECT_THROW(merge_tunables(base, json{{"log_level", "loud"}}), std::runtime_error);
+    EXPECT_THROW(merge_tunables(base, json{{"udp_port", 9001}}), std::runtime_error);
+    EXPECT_THROW(merge_tunables(base, json{{"session_timeout_sec", "30"}}), std::runtime_error);
+    EXPECT_THROW(merge_tunables(base, json::array()), std::runtime_error);
+}
+
+// Снимок статистики проходит через разделяемую память без изменений
+TEST(stats_shm_test, publish_and_read) {
+    const std::string name = "/pgw_stats_test_" + std::to_string(getpid());
+    stats_shm_writer writer(name);
+    stats_shm_reader reader(name);
+    EXPECT_EQ(reader.pid(), getpid());
+
+    stats_snapshot snapshot;
+    snapshot.udp_requests = 42;
+    snapshot.active_sessions = 7;
+    snapshot.thread_count = 1;
+    std::string_view("udp").copy(snapshot.threads[0].name.data(), 3);
+    snapshot.threads[0].busy_ns = 1000;
+    writer.publish(snapshot);
+
+    auto read = reader.read();
+    ASSERT_TRUE(read.has_value());
+    EXPECT_EQ(read->udp_requests, 42);
+    EXPECT_EQ(read->active_sessions, 7);
+    EXPECT_EQ(std::string_view(read->threads[0].name.data()), "udp");
+    EXPECT_EQ(read->threads[0].busy_ns, 1000);
+}
+
+// Второй писатель с тем же именем не трогает сегмент первого
+TEST(stats_shm_test, second_writer_rejected) {
+    const std::string name = "/pgw_stats_busy_" + std::to_string(getpid());
+    stats_shm_writer writer(name);
+    EXPECT_THROW(stats_shm_writer second(name), std::runtime_error);
+
+    stats_shm_reader reader(name);
+    EXPECT_EQ(reader.pid(), getpid());
+}
+
+// Нет сегмента - исключение с понятным текстом
+TEST(stats_shm_test, missing_segment) {
+    EXPECT_THROW(stats_shm_reader("/pgw_stats_missing_" + std::to_string(getpid())), std::runtime_error);
+}
+
 
 int main() {
     testing::InitGoogleTest();
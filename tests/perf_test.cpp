@@ -0,0 +1,208 @@
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <gtest/gtest.h>
+
+#include "bcd.h"
+#include "pgw_server.h"
+#include "signal_fd_raii.h"
+
+// Тест производительности: pgw_server запускается в процессе теста на свободных портах loopback
+// с временным файлом CDR, несколько потоков-генераторов шлют ему запросы на создание сессий.
+// Пропускная способность и p99 задержки сравниваются с эталоном с допуском, результаты пишутся в JSON
+// вместе с типом сборки. Допуск из командной строки заменяет допуск эталона: так ctest сравнивает
+// с общим эталоном, когда эталона этой машины нет (PGW_PERF_BASELINE).
+// Запуск: perf_test <эталон.json> [результаты.json] [допуск]
+std::filesystem::path baseline_path;
+std::filesystem::path results_path;
+std::optional<double> tolerance_override;
+
+using perf_clock = std::chrono::steady_clock;
+
+class perf_test : public ::testing::Test {
+protected:
+    std::filesystem::path dir;
+    std::filesystem::path original_dir;
+    json baseline;
+    // Сигнал не используется: сервер останавливается через request_stop, но циклу управления нужен signalfd
+    std::unique_ptr<signal_fd_raii> signals;
+    std::unique_ptr<pgw_server> server;
+    std::jthread server_thread;
+
+    void SetUp() override {
+        std::ifstream baseline_file(baseline_path);
+        ASSERT_TRUE(baseline_file.is_open()) << "Нет эталона " << baseline_path;
+        baseline = json::parse(baseline_file);
+
+        dir = std::filesystem::temp_directory_path() / ("pgw_perf_test_" + std::to_string(getpid()));
+        std::filesystem::create_directories(dir);
+        // CDR пишутся в logs/ от рабочего каталога, как у отдельного процесса в cluster_test
+        original_dir = std::filesystem::current_path();
+        std::filesystem::current_path(dir);
+
+        // Порты 0: сервер слушает на свободных портах, выбранных ядром, и сообщает их после привязки
+        const json config_data = {
+            {"udp_ip", "127.0.0.1"},
+            {"udp_port", 0},
+            {"udp_workers", baseline.value("udp_workers", 1)},
+            {"http_ip", "127.0.0.1"},
+            {"http_port", 0},
+            {"session_timeout_sec", 1},
+            {"max_sessions", 1000000},
+            {"graceful_shutdown_rate", 1000000},
+            {"cdr_file", "cdr.csv"},
+            {"log_level", "warn"},
+            {"stats_shm_name", ""}
+        };
+        const std::filesystem::path config_path = dir / "server.json";
+        std::ofstream(config_path) << config_data.dump(2);
+        const server_config config = load_server_config(config_path);
+        spdlog::set_level(spdlog::level::warn);
+
+        signals = std::make_unique<signal_fd_raii>(std::initializer_list<int>{SIGUSR1});
+        server = std::make_unique<pgw_server>(config);
+        server_thread = std::jthread([this] {
+            server->start(*signals);
+        });
+
+        for (int attempt = 0; attempt < 100 && (server->udp_port() == 0 || server->http_port() == 0); ++attempt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        ASSERT_NE(server->udp_port(), 0) << "UDP сервер не запустился";
+        ASSERT_NE(server->http_port(), 0) << "HTTP сервер не запустился";
+    }
+
+    void TearDown() override {
+        if (server) {
+            server->request_stop();
+        }
+        if (server_thread.joinable()) {
+            server_thread.join();
+        }
+        server.reset();
+        if (!original_dir.empty()) {
+            std::filesystem::current_path(original_dir);
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    struct generator_result {
+        std::vector<uint32_t> latency_us;
+        uint64_t lost{};
+    };
+
+    // Генератор: один запрос в полёте, новый IMSI на каждый запрос, задержка - время до ответа
+    generator_result generate(size_t index, perf_clock::time_point deadline) const {
+        generator_result result;
+        socket_raii sockfd(socket(AF_INET, SOCK_DGRAM, 0));
+        timeval tv{1, 0};
+        setsockopt(sockfd.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(server->udp_port());
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        connect(sockfd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+        char reply[64];
+        for (uint64_t i = 0; perf_clock::now() < deadline; ++i) {
+            const std::vector<uint8_t> bcd = imsi_to_bcd(std::to_string(250010000000000ULL + index * 1'000'000'000ULL + i));
+            const auto sent = perf_clock::now();
+            send(sockfd.get(), bcd.data(), bcd.size(), 0);
+            if (recv(sockfd.get(), reply, sizeof(reply), 0) <= 0) {
+                ++result.lost;
+                continue;
+            }
+            result.latency_us.push_back(static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(perf_clock::now() - sent).count()));
+        }
+        return result;
+    }
+};
+
+// Создание сессий по UDP не медленнее эталона: пропускная способность и p99 в пределах допуска
+TEST_F(perf_test, udp_create_throughput_and_p99) {
+    const size_t threads = baseline.at("generator_threads").get<size_t>();
+    const auto duration = std::chrono::milliseconds(baseline.at("duration_ms").get<int>());
+    const double tolerance = tolerance_override.value_or(baseline.at("tolerance").get<double>());
+
+    std::vector<generator_result> results(threads);
+    const auto start = perf_clock::now();
+    {
+        std::vector<std::jthread> generators;
+        for (size_t i = 0; i < threads; ++i) {
+            generators.emplace_back([this, &results, i, deadline = start + duration] {
+                results[i] = generate(i, deadline);
+            });
+        }
+    }
+    const double seconds = std::chrono::duration<double>(perf_clock::now() - start).count();
+
+    std::vector<uint32_t> latency_us;
+    uint64_t lost = 0;
+    for (generator_result& result : results) {
+        latency_us.insert(latency_us.end(), result.latency_us.begin(), result.latency_us.end());
+        lost += result.lost;
+    }
+    ASSERT_FALSE(latency_us.empty()) << "Сервер не ответил ни на один запрос";
+    std::ranges::sort(latency_us);
+    const auto percentile = [&latency_us](double p) {
+        return latency_us[std::min(latency_us.size() - 1, static_cast<size_t>(p * static_cast<double>(latency_us.size())))];
+    };
+
+    const double requests_per_sec = static_cast<double>(latency_us.size()) / seconds;
+    const double min_requests_per_sec = baseline.at("min_requests_per_sec").get<double>() * (1 - tolerance);
+    const double max_p99_us = baseline.at("max_p99_us").get<double>() * (1 + tolerance);
+    const uint32_t p99 = percentile(0.99);
+
+    const json report = {
+        {"test", "udp_create_throughput_and_p99"},
+        {"build_type", std::string_view(PGW_BUILD_TYPE).empty() ? "none" : PGW_BUILD_TYPE},
+        {"baseline", baseline_path.string()},
+        {"tolerance", tolerance},
+        {"generator_threads", threads},
+        {"elapsed_ms", static_cast<int64_t>(seconds * 1000)},
+        {"requests", latency_us.size()},
+        {"lost", lost},
+        {"requests_per_sec", requests_per_sec},
+        {"latency_us", {
+            {"p50", percentile(0.5)},
+            {"p99", p99},
+            {"p999", percentile(0.999)},
+            {"max", latency_us.back()}
+        }},
+        {"limits", {
+            {"min_requests_per_sec", min_requests_per_sec},
+            {"max_p99_us", max_p99_us}
+        }},
+        {"passed", requests_per_sec >= min_requests_per_sec && p99 <= max_p99_us}
+    };
+    std::cout << report.dump(2) << '\n';
+    if (!results_path.empty()) {
+        std::ofstream(results_path) << report.dump(2) << '\n';
+    }
+    RecordProperty("requests_per_sec", std::to_string(static_cast<uint64_t>(requests_per_sec)));
+    RecordProperty("p99_us", std::to_string(p99));
+
+    EXPECT_GE(requests_per_sec, min_requests_per_sec);
+    EXPECT_LE(p99, max_p99_us);
+    // На loopback при одном запросе в полёте потери - признак зависшего потока UDP
+    EXPECT_LE(lost, latency_us.size() / 1000);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    if (argc < 2) {
+        std::cerr << "Использование: perf_test <эталон.json> [результаты.json] [допуск]" << '\n';
+        return 1;
+    }
+    // Тест меняет рабочий каталог, поэтому пути от текущего каталога запуска
+    baseline_path = std::filesystem::absolute(argv[1]);
+    if (argc > 2) {
+        results_path = std::filesystem::absolute(argv[2]);
+    }
+    if (argc > 3) {
+        tolerance_override = std::stod(argv[3]);
+    }
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+
+#include "async_client.h"
+#include "bcd.h"
+#include "protocol.h"
+
+// Тесты async_client против поддельного сервера на loopback
+class async_client_test : public ::testing::Test {
+protected:
+    // Принятый запрос: номер, IMSI и адрес клиента
+    struct received_request {
+        uint64_t seq;
+        std::string imsi;
+        sockaddr_in from;
+    };
+
+    socket_raii server{socket(AF_INET, SOCK_DGRAM, 0)};
+    client_config config;
+
+    void SetUp() override {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(bind(server.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        socklen_t len = sizeof(addr);
+        getsockname(server.get(), reinterpret_cast<sockaddr*>(&addr), &len);
+
+        timeval tv{2, 0};
+        setsockopt(server.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        config.server_ip = "127.0.0.1";
+        config.server_port = ntohs(addr.sin_port);
+        config.udp_buffer_size = 1024;
+        config.udp_timer_sec = 1;
+        config.retransmit_interval_ms = 100;
+        config.retransmit_backoff = 2.0;
+        config.max_in_flight = 16;
+    }
+
+    std::optional<received_request> receive() {
+        char buffer[1024];
+        sockaddr_in from{};
+        socklen_t len = sizeof(from);
+        const ssize_t n = recvfrom(server.get(), buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &len);
+        if (n < 0) {
+            return std::nullopt;
+        }
+        const std::string_view packet(buffer, n);
+        const auto header = parse_packet_header(packet);
+        EXPECT_TRUE(header);
+        EXPECT_EQ(header->opcode, opcode_create);
+        const std::string_view bcd = packet.substr(packet_header_size);
+        return received_request{header->seq, bcd_to_imsi(std::vector<uint8_t>(bcd.begin(), bcd.end())), from};
+    }
+
+    void reply(const received_request& request, std::string_view response) {
+        const std::string packet = make_packet(opcode_create | opcode_response_flag, request.seq, response);
+        sendto(server.get(), packet.data(), packet.size(), 0, reinterpret_cast<const sockaddr*>(&request.from),
+            sizeof(request.from));
+    }
+};
+
+// Ответы в обратном порядке находят свои запросы, потерянный запрос уходит повтором с тем же номером
+TEST_F(async_client_test, out_of_order_replies_and_retransmit) {
+    async_client client(config);
+    const std::vector<std::string> imsis = {"111111111111111", "222222222222222", "333333333333333"};
+    auto futures = client.send_batch(imsis);
+
+    std::vector<received_request> requests;
+    for (size_t i = 0; i < imsis.size(); ++i) {
+        auto request = receive();
+        ASSERT_TRUE(request);
+        requests.push_back(*request);
+    }
+
+    // Первая отправка второго IMSI "потерялась", ждём его повтор, остальные повторы пропускаем
+    std::optional<received_request> retransmit;
+    while ((retransmit = receive()) && retransmit->imsi != requests[1].imsi) {
+    }
+    ASSERT_TRUE(retransmit);
+    EXPECT_EQ(retransmit->seq, requests[1].seq);
+
+    reply(requests[2], "created");
+    reply(requests[0], "rejected");
+    reply(*retransmit, "created");
+
+    std::vector<std::string> responses;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        const client_result result = futures[i].get();
+        EXPECT_EQ(result.status, client_status::ok);
+        EXPECT_EQ(result.imsi, imsis[i]);
+        responses.push_back(result.response);
+    }
+    EXPECT_EQ(responses, (std::vector<std::string>{"rejected", "created", "created"}));
+
+    // Ответ на уже завершённый запрос не сопоставляется
+    reply(requests[1], "created");
+    const client_stats stats = client.stats();
+    EXPECT_EQ(stats.sent, 3);
+    EXPECT_GE(stats.retransmits, 1);
+    EXPECT_EQ(stats.replies, 3);
+    EXPECT_EQ(stats.in_flight, 0);
+}
+
+// Без ответа запрос повторяется с растущим интервалом и завершается по дедлайну
+TEST_F(async_client_test, deadline_after_backoff) {
+    async_client client(config);
+    std::future<client_result> future = client.send("111111111111111");
+
+    const client_result result = future.get();
+    EXPECT_EQ(result.status, client_status::timeout);
+    // Отправки через 0, 100, 300 и 700 мс, дедлайн через 1 с
+    EXPECT_EQ(result.attempts, 4);
+    EXPECT_GE(result.latency, std::chrono::seconds(1));
+    EXPECT_EQ(client.stats().timeouts, 1);
+}
+
+// Уничтожение клиента завершает запросы в полёте
+TEST_F(async_client_test, destroy_completes_pending) {
+    std::optional<client_result> result;
+    {
+        async_client client(config);
+        client.send("111111111111111", [&result](const client_result& r) { result = r; });
+    }
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result->status, client_status::closed);
+}
+
+int main() {
+    testing::InitGoogleTest();
+    spdlog::set_level(spdlog::level::off);
+    return RUN_ALL_TESTS();
+}
@@ -1,6 +1,30 @@
 #include <gtest/gtest.h>
 
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#include "bcd.h"
+#include "capture_file.h"
+#include "cdr_aggregator.h"
+#include "cdr_index.h"
+#include "cdr_stream.h"
+#include "cdr_writer.h"
+#include "epoll_raii.h"
+#include "event_fd_raii.h"
+#include "hash_ring.h"
+#include "heavy_hitters.h"
+#include "io_scheduler.h"
+#include "latency_stats.h"
+#include "protocol.h"
+#include "replication.h"
+#include "retransmit_cache.h"
+#include "reuseport_steering.h"
+#include "session_event_stream.h"
 #include "session_manager.h"
+#include "shard_mailbox.h"
+#include "socket_raii.h"
+#include "timer_fd_raii.h"
 
 // Тесты для cdr_writer
 class cdr_writer_test : public ::testing::Test {
@@ -140,6 +164,47 @@ TEST_F(cdr_writer_test, empty_strings) {
     ASSERT_EQ(line_count, 3);
 }
 
+// Поиск по индексу находит все записи IMSI и просматривает малую часть блоков
+TEST_F(cdr_writer_test, indexed_search) {
+    auto imsi = [](int i) { return std::to_string(250010000000000 + i); };
+    {
+        cdr_writer writer(test_filename);
+        for (int round = 0; round < 4; ++round) {
+            for (int i = 0; i < 500; ++i) {
+                writer.write(imsi(i), round % 2 == 0 ? "Сессия создана" : "Сессия закрыта по времени");
+            }
+        }
+    }
+
+    const std::string path = "logs/" + test_filename;
+    cdr_search_result found = search_cdr(path, imsi(42), 0, std::numeric_limits<int64_t>::max(), 100);
+    ASSERT_EQ(found.records.size(), 4);
+    EXPECT_TRUE(found.records[0].ends_with("," + imsi(42) + ",Сессия создана"));
+    EXPECT_TRUE(found.records[1].ends_with("," + imsi(42) + ",Сессия закрыта по времени"));
+    EXPECT_EQ(found.blocks_total, 2000 / cdr_index_block_records);
+    EXPECT_LE(found.blocks_scanned, 4 + 1);
+    EXPECT_FALSE(found.truncated);
+
+    // Префикс другого IMSI не совпадает, limit обрезает, будущее время ничего не находит
+    EXPECT_TRUE(search_cdr(path, imsi(42).substr(0, 14), 0, std::numeric_limits<int64_t>::max(), 100).records.empty());
+    EXPECT_TRUE(search_cdr(path, imsi(42), 0, std::numeric_limits<int64_t>::max(), 2).truncated);
+    EXPECT_TRUE(search_cdr(path, imsi(42), 4102444800, std::numeric_limits<int64_t>::max(), 100).records.empty());
+
+    // После перезапуска хвост дочитывается, удалённый индекс строится заново
+    {
+        cdr_writer writer(test_filename);
+        writer.write(imsi(42), "Сессия вытеснена");
+    }
+    EXPECT_EQ(search_cdr(path, imsi(42), 0, std::numeric_limits<int64_t>::max(), 100).records.size(), 5);
+    std::filesystem::remove(path + ".idx");
+    {
+        cdr_writer writer(test_filename);
+    }
+    found = search_cdr(path, imsi(42), 0, std::numeric_limits<int64_t>::max(), 100);
+    EXPECT_EQ(found.records.size(), 5);
+    EXPECT_EQ(found.blocks_total, 2001 / cdr_index_block_records);
+}
+
 // Тесты session_managerа
 class session_manager_test : public ::testing::Test {
 protected:
@@ -195,6 +260,127 @@ TEST_F(session_manager_test, reject_blacklist_imsi) {
     EXPECT_FALSE(manager->is_session_active(blacklisted_imsi));
 }
 
+// Отклонение слишком длинного imsi
+TEST_F(session_manager_test, reject_too_long_imsi) {
+    std::string imsi = "1234567890123456";
+
+    EXPECT_EQ(manager->process_request(imsi), "rejected");
+    EXPECT_FALSE(manager->is_session_active(imsi));
+}
+
+// Отказ при достижении max_sessions
+TEST_F(session_manager_test, max_sessions_reject_policy) {
+    config.max_sessions = 2;
+    config.session_limit_policy = "reject";
+    manager = std::make_unique<session_manager>(config);
+
+    EXPECT_EQ(manager->process_request("111111111111111"), "created");
+    EXPECT_EQ(manager->process_request("222222222222222"), "created");
+    EXPECT_EQ(manager->process_request("333333333333333"), "rejected");
+    EXPECT_EQ(manager->process_request("111111111111111"), "rejected");
+
+    session_stats stats = manager->stats();
+    EXPECT_EQ(stats.active_sessions, 2);
+    EXPECT_EQ(stats.rejected_limit, 1);
+    EXPECT_EQ(stats.rejected_duplicate, 1);
+    EXPECT_EQ(stats.evicted, 0);
+}
+
+// Пакет даёт те же ответы и CDR, что и запросы по одному, включая повторы внутри пакета
+TEST_F(session_manager_test, process_requests_matches_single_requests) {
+    config.max_sessions = 3;
+    config.session_limit_policy = "evict_oldest";
+    const std::vector<std::string> imsis = {"111111111111111", "999999999999999", "222222222222222",
+        "111111111111111", "1234567890123456", "333333333333333", "444444444444444", "222222222222222"};
+
+    auto read_cdr = [this] {
+        std::ifstream file("logs/" + config.cdr_file);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    };
+
+    std::vector<std::string> expected;
+    {
+        session_manager single(config);
+        for (const std::string& imsi : imsis) {
+            expected.push_back(single.process_request(imsi));
+        }
+    }
+    const std::string single_cdr = read_cdr();
+    std::filesystem::remove_all("logs");
+
+    manager = std::make_unique<session_manager>(config);
+    std::vector<std::string_view> results(imsis.size());
+    manager->process_requests(imsis, results);
+    EXPECT_EQ(std::vector<std::string>(results.begin(), results.end()), expected);
+
+    // Время в записях может не совпасть, сравниваются imsi и действия
+    auto strip_time = [](const std::string& cdr) {
+        std::string stripped;
+        std::istringstream stream(cdr);
+        for (std::string line; std::getline(stream, line);) {
+            stripped += line.substr(line.find(',')) + '\n';
+        }
+        return stripped;
+    };
+    EXPECT_EQ(strip_time(read_cdr()), strip_time(single_cdr));
+
+    session_stats stats = manager->stats();
+    EXPECT_EQ(stats.created, 4);
+    EXPECT_EQ(stats.evicted, 1);
+    EXPECT_EQ(stats.rejected_duplicate, 2);
+    EXPECT_EQ(stats.rejected_blacklist, 1);
+    EXPECT_THROW(manager->process_requests(imsis, std::span(results).first(2)), std::invalid_argument);
+}
+
+// Вытеснение самой старой сессии при достижении max_sessions
+TEST_F(session_manager_test, max_sessions_evict_oldest_policy) {
+    config.max_sessions = 2;
+    config.session_limit_policy = "evict_oldest";
+    manager = std::make_unique<session_manager>(config);
+
+    EXPECT_EQ(manager->process_request("111111111111111"), "created");
+    EXPECT_EQ(manager->process_request("222222222222222"), "created");
+    EXPECT_EQ(manager->process_request("333333333333333"), "created");
+
+    EXPECT_FALSE(manager->is_session_active("111111111111111"));
+    EXPECT_TRUE(manager->is_session_active("222222222222222"));
+    EXPECT_TRUE(manager->is_session_active("333333333333333"));
+
+    // Дубликат при полной таблице ничего не вытесняет
+    EXPECT_EQ(manager->process_request("222222222222222"), "rejected");
+
+    session_stats stats = manager->stats();
+    EXPECT_EQ(stats.active_sessions, 2);
+    EXPECT_EQ(stats.evicted, 1);
+    EXPECT_EQ(stats.created, 3);
+
+    std::ifstream file("logs/" + config.cdr_file);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    EXPECT_TRUE(buffer.str().contains("111111111111111,Сессия вытеснена"));
+}
+
+// Пакетная проверка: порядок ответа совпадает с порядком IMSI, слишком длинные не активны
+TEST_F(session_manager_test, are_sessions_active_batch) {
+    std::vector<std::string> imsis;
+    for (int i = 0; i < 3000; ++i) {
+        imsis.push_back(std::to_string(250010000000000 + i));
+        if (i % 3 == 0) {
+            EXPECT_EQ(manager->process_request(imsis.back()), "created");
+        }
+    }
+    imsis.emplace_back("1234567890123456");
+
+    const std::vector<bool> active = manager->are_sessions_active(imsis);
+    ASSERT_EQ(active.size(), imsis.size());
+    for (int i = 0; i < 3000; ++i) {
+        EXPECT_EQ(active[i], i % 3 == 0) << i;
+    }
+    EXPECT_FALSE(active.back());
+}
+
 // Проверка активности сессии
 TEST_F(session_manager_test, session_not_active) {
     std::string imsi = "111111111111111";
@@ -222,8 +408,11 @@ TEST_F(session_manager_test, session_deleted_by_time) {
     manager->stop_cleaning();
 }
 
-// Удаление нескольких сессий по таймеру
+// Удаление нескольких сессий по таймеру, время виртуальное
 TEST_F(session_manager_test, multiple_session_deleted_by_time) {
+    auto clock = std::make_shared<manual_session_clock>();
+    manager = std::make_unique<session_manager>(config, clock);
+
     std::vector<std::string> imsis = {
         "111111111111111",
         "222222222222222",
@@ -238,10 +427,14 @@ TEST_F(session_manager_test, multiple_session_deleted_by_time) {
 
     manager->start_cleaning();
 
-    // Ждем истечения таймаута
-    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+    // Проход чистки на первой секунде ещё ничего не удаляет
+    clock->advance(std::chrono::milliseconds(1900));
+    for (const std::string& imsi : imsis) {
+        EXPECT_TRUE(manager->is_session_active(imsi));
+    }
 
-    // Проверяем, что все сессии удалены
+    // Проход на второй секунде удаляет все сессии
+    clock->advance(std::chrono::milliseconds(200));
     for (const std::string& imsi : imsis) {
         EXPECT_FALSE(manager->is_session_active(imsi));
     }
@@ -249,6 +442,130 @@ TEST_F(session_manager_test, multiple_session_deleted_by_time) {
     manager->stop_cleaning();
 }
 
+// Истечение сессий по виртуальному времени, без ожидания
+TEST_F(session_manager_test, manual_clock_expiry) {
+    auto clock = std::make_shared<manual_session_clock>();
+    manager = std::make_unique<session_manager>(config, clock);
+
+    EXPECT_EQ(manager->process_request("111111111111111"), "created");
+    clock->advance(std::chrono::seconds(1));
+    EXPECT_EQ(manager->process_request("222222222222222"), "created");
+
+    // Таймаут 1 секунда: сессия удаляется, когда прошло больше целой секунды
+    clock->advance(std::chrono::seconds(1));
+    EXPECT_EQ(manager->expire_sessions(), 1);
+    EXPECT_FALSE(manager->is_session_active("111111111111111"));
+    EXPECT_TRUE(manager->is_session_active("222222222222222"));
+
+    session_stats stats = manager->stats();
+    EXPECT_EQ(stats.peak_sessions, 2);
+    EXPECT_EQ(stats.expired, 1);
+}
+
+// Таймаут, изменённый на ходу, действует на уже созданные сессии со следующего прохода чистки
+TEST_F(session_manager_test, timeout_changes_without_restart) {
+    auto clock = std::make_shared<manual_session_clock>();
+    manager = std::make_unique<session_manager>(config, clock);
+    manager->process_request("111111111111111");
+    manager->start_cleaning();
+
+    runtime_tunables tunables = tunables_of(config);
+    tunables.session_timeout_sec = 10;
+    manager->apply_tunables(tunables);
+    clock->advance(std::chrono::seconds(5));
+    EXPECT_TRUE(manager->is_session_active("111111111111111"));
+
+    tunables.session_timeout_sec = 2;
+    manager->apply_tunables(tunables);
+    clock->advance(std::chrono::seconds(1));
+    EXPECT_FALSE(manager->is_session_active("111111111111111"));
+
+    manager->stop_cleaning();
+}
+
+// Лента событий: подписчик получает события по своему префиксу, переполнение буфера учитывается,
+// накопленное до закрытия ленты отдаётся
+TEST_F(session_manager_test, event_stream_delivers_and_counts_drops) {
+    auto clock = std::make_shared<manual_session_clock>();
+    manager = std::make_unique<session_manager>(config, clock);
+    session_event_stream stream(2, 1);
+    stream.attach(*manager);
+
+    auto subscription = stream.subscribe("25001");
+    ASSERT_NE(subscription, nullptr);
+    EXPECT_EQ(stream.subscribe(), nullptr);
+
+    manager->process_request("250010000000001");
+    manager->process_request("001010000000001");
+    manager->start_cleaning();
+    clock->advance(std::chrono::seconds(2));
+
+    std::vector<stream_event> events;
+    uint64_t dropped = 0;
+    ASSERT_TRUE(subscription->wait(events, dropped, std::chrono::milliseconds(0)));
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0].type, session_event_type::created);
+    EXPECT_EQ(events[0].imsi, "250010000000001");
+    EXPECT_EQ(events[1].type, session_event_type::expired);
+    EXPECT_EQ(dropped, 0);
+
+    // Буфер на 2 события: третье теряется
+    for (int i = 2; i <= 4; ++i) {
+        manager->process_request("25001000000000" + std::to_string(i));
+    }
+    stream.close();
+    ASSERT_TRUE(subscription->wait(events, dropped, std::chrono::milliseconds(0)));
+    EXPECT_EQ(events.size(), 2);
+    EXPECT_EQ(dropped, 1);
+    EXPECT_FALSE(subscription->wait(events, dropped, std::chrono::milliseconds(0)));
+
+    const event_stream_stats stats = stream.stats();
+    EXPECT_EQ(stats.events, 7);
+    EXPECT_EQ(stats.delivered, 4);
+    EXPECT_EQ(stats.dropped, 1);
+    manager->stop_cleaning();
+}
+
+// Выгрузка порциями: каждая сессия ровно один раз, фильтры по префиксу и возрасту, остаток таймаута
+TEST_F(session_manager_test, export_sessions_in_chunks) {
+    config.session_timeout_sec = 60;
+    auto clock = std::make_shared<manual_session_clock>();
+    manager = std::make_unique<session_manager>(config, clock);
+
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(manager->process_request(std::to_string(250010000000000 + i)), "created");
+    }
+    clock->advance(std::chrono::seconds(10));
+    for (int i = 0; i < 500; ++i) {
+        EXPECT_EQ(manager->process_request(std::to_string(250020000000000 + i)), "created");
+    }
+
+    auto export_all = [&](std::string_view prefix, std::chrono::milliseconds min_age) {
+        std::vector<session_export_entry> entries;
+        std::optional<size_t> cursor = 0;
+        while (cursor) {
+            cursor = manager->export_sessions(*cursor, 64, prefix, min_age, entries);
+        }
+        return entries;
+    };
+
+    std::vector<session_export_entry> all = export_all("", std::chrono::milliseconds::zero());
+    ASSERT_EQ(all.size(), 1500);
+    std::unordered_set<std::string> unique;
+    for (const auto& entry : all) {
+        unique.insert(entry.imsi);
+    }
+    EXPECT_EQ(unique.size(), 1500);
+
+    std::vector<session_export_entry> old = export_all("", std::chrono::seconds(5));
+    ASSERT_EQ(old.size(), 1000);
+    EXPECT_EQ(old[0].age, std::chrono::seconds(10));
+    EXPECT_EQ(old[0].remaining, std::chrono::seconds(50));
+
+    EXPECT_EQ(export_all("25002", std::chrono::milliseconds::zero()).size(), 500);
+    EXPECT_EQ(export_all("2500100000001", std::chrono::milliseconds::zero()).size(), 100);
+}
+
 // Выключение
 TEST_F(session_manager_test, graceful_shutdown) {
     std::vector<std::string> imsis = {
@@ -311,6 +628,21 @@ TEST_F(session_manager_test, concurrent_session_creation) {
     EXPECT_EQ(created_count, threads_count * sessions_per_thread);
 }
 
+// Метки этапов внутри process_request
+TEST_F(session_manager_test, request_trace_marks_stages) {
+    latency_stats stats;
+    request_trace trace;
+    trace.set_queueing_ns(5000);
+    EXPECT_EQ(manager->process_request("111111111111111", &trace), "created");
+    stats.record(trace);
+
+    EXPECT_EQ(stats.histogram(latency_stage::lock_wait).count(), 1);
+    EXPECT_EQ(stats.histogram(latency_stage::table_op).count(), 1);
+    EXPECT_EQ(stats.histogram(latency_stage::cdr).count(), 1);
+    EXPECT_EQ(stats.histogram(latency_stage::queueing).max_ns(), 5000);
+    EXPECT_GE(stats.histogram(latency_stage::total).max_ns(), 5000);
+}
+
 // Начало чистки дважды
 TEST_F(session_manager_test, start_cleaning_twice) {
     manager->start_cleaning();
@@ -327,6 +659,989 @@ TEST_F(session_manager_test, stop_cleaning_without_start) {
     manager->stop_cleaning();
 }
 
+// Тесты кэша ретрансмитов
+class retransmit_cache_test : public ::testing::Test {
+protected:
+    static sockaddr_in make_addr(const char* ip, uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, ip, &addr.sin_addr);
+        return addr;
+    }
+};
+
+// Повторный пакет от того же отправителя получает исходный ответ
+TEST_F(retransmit_cache_test, retransmit_returns_original_response) {
+    retransmit_cache cache(16, std::chrono::milliseconds(1000));
+    sockaddr_in addr = make_addr("127.0.0.1", 5000);
+
+    EXPECT_FALSE(cache.find(addr, "request").has_value());
+    cache.store(addr, "request", "created");
+
+    auto cached = cache.find(addr, "request");
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(*cached, "created");
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_EQ(cache.misses(), 1);
+    EXPECT_DOUBLE_EQ(cache.hit_rate(), 0.5);
+}
+
+// Другой адрес, порт или содержимое не попадают в кэш
+TEST_F(retransmit_cache_test, different_source_or_payload_miss) {
+    retransmit_cache cache(16, std::chrono::milliseconds(1000));
+    cache.store(make_addr("127.0.0.1", 5000), "request", "created");
+
+    EXPECT_FALSE(cache.find(make_addr("127.0.0.2", 5000), "request").has_value());
+    EXPECT_FALSE(cache.find(make_addr("127.0.0.1", 5001), "request").has_value());
+    EXPECT_FALSE(cache.find(make_addr("127.0.0.1", 5000), "other").has_value());
+}
+
+// Запись устаревает по ttl
+TEST_F(retransmit_cache_test, entry_expires_after_ttl) {
+    retransmit_cache cache(16, std::chrono::milliseconds(20));
+    sockaddr_in addr = make_addr("127.0.0.1", 5000);
+    cache.store(addr, "request", "created");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_FALSE(cache.find(addr, "request").has_value());
+}
+
+// Нулевой размер отключает кэш
+TEST_F(retransmit_cache_test, zero_capacity_disables_cache) {
+    retransmit_cache cache(0, std::chrono::milliseconds(1000));
+    sockaddr_in addr = make_addr("127.0.0.1", 5000);
+    cache.store(addr, "request", "created");
+
+    EXPECT_FALSE(cache.enabled());
+    EXPECT_FALSE(cache.find(addr, "request").has_value());
+}
+
+// Тесты таблицы сессий
+
+// Вставка, поиск и удаление
+TEST(session_table_test, insert_find_erase) {
+    session_table table(16);
+    const auto now = std::chrono::steady_clock::now();
+
+    EXPECT_TRUE(table.insert("123456789012345", now));
+    EXPECT_FALSE(table.insert("123456789012345", now));
+    EXPECT_EQ(table.size(), 1);
+
+    auto created = table.find("123456789012345");
+    ASSERT_TRUE(created.has_value());
+    EXPECT_EQ(*created, now);
+
+    EXPECT_TRUE(table.erase("123456789012345"));
+    EXPECT_FALSE(table.erase("123456789012345"));
+    EXPECT_FALSE(table.contains("123456789012345"));
+    EXPECT_TRUE(table.empty());
+}
+
+// Рост индекса сверх начальной ёмкости не теряет сессии
+TEST(session_table_test, incremental_rehash_keeps_sessions) {
+    session_table table;
+    const size_t initial_capacity = table.index_capacity();
+    const auto now = std::chrono::steady_clock::now();
+    constexpr int count = 100000;
+
+    for (int i = 0; i < count; ++i) {
+        ASSERT_TRUE(table.insert(std::to_string(i), now));
+        // Во время переноса сессии должны находиться в обоих индексах
+        ASSERT_TRUE(table.contains(std::to_string(i / 2)));
+    }
+    for (int i = 0; i < count; i += 2) {
+        ASSERT_TRUE(table.erase(std::to_string(i)));
+    }
+
+    EXPECT_GT(table.index_capacity(), initial_capacity);
+    EXPECT_EQ(table.size(), count / 2);
+    for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(table.contains(std::to_string(i)), i % 2 == 1);
+    }
+}
+
+// Удаление по условию и обход
+TEST(session_table_test, erase_if_and_for_each) {
+    session_table table;
+    const auto now = std::chrono::steady_clock::now();
+    table.insert("111111111111111", now - std::chrono::seconds(10));
+    table.insert("222222222222222", now);
+    table.insert("333333333333333", now - std::chrono::seconds(10));
+
+    size_t erased = table.erase_if([now](std::string_view, std::chrono::steady_clock::time_point created) {
+        return now - created > std::chrono::seconds(5);
+    });
+    EXPECT_EQ(erased, 2);
+
+    std::vector<std::string> left;
+    table.for_each([&left](std::string_view imsi, std::chrono::steady_clock::time_point) {
+        left.emplace_back(imsi);
+    });
+    ASSERT_EQ(left.size(), 1);
+    EXPECT_EQ(left[0], "222222222222222");
+
+    table.clear();
+    EXPECT_TRUE(table.empty());
+    EXPECT_FALSE(table.contains("222222222222222"));
+}
+
+// Самая старая сессия и удаление по порядку создания
+TEST(session_table_test, oldest_first_order) {
+    session_table table;
+    const auto now = std::chrono::steady_clock::now();
+    table.insert("111111111111111", now);
+    table.insert("222222222222222", now + std::chrono::seconds(1));
+    table.insert("333333333333333", now + std::chrono::seconds(2));
+    table.erase("222222222222222");
+    table.insert("444444444444444", now + std::chrono::seconds(3));
+
+    std::vector<std::string> order;
+    table.for_each_oldest_first([&order](std::string_view imsi, std::chrono::steady_clock::time_point) {
+        order.emplace_back(imsi);
+    });
+    EXPECT_EQ(order, (std::vector<std::string>{"111111111111111", "333333333333333", "444444444444444"}));
+    EXPECT_EQ(table.oldest()->first, "111111111111111");
+
+    size_t erased = table.erase_oldest_while([now](std::string_view, std::chrono::steady_clock::time_point created) {
+        return created < now + std::chrono::seconds(3);
+    });
+    EXPECT_EQ(erased, 2);
+    EXPECT_EQ(table.oldest()->first, "444444444444444");
+    EXPECT_EQ(table.size(), 1);
+}
+
+// Слишком длинный imsi не помещается в таблицу
+TEST(session_table_test, too_long_imsi) {
+    session_table table;
+    EXPECT_THROW(table.insert("1234567890123456", std::chrono::steady_clock::now()), std::invalid_argument);
+    EXPECT_FALSE(table.contains("1234567890123456"));
+}
+
+// Тесты консистентного хэширования
+
+// Владелец IMSI одинаков для одинаковых колец
+TEST(hash_ring_test, deterministic_owner) {
+    hash_ring first({"node0", "node1", "node2"}, 64);
+    hash_ring second({"node0", "node1", "node2"}, 64);
+
+    for (int i = 0; i < 1000; ++i) {
+        std::string imsi = std::to_string(250010000000000ULL + i);
+        EXPECT_EQ(first.owner(imsi), second.owner(imsi));
+    }
+}
+
+// IMSI распределяются по узлам примерно поровну
+TEST(hash_ring_test, balanced_distribution) {
+    hash_ring ring({"node0", "node1", "node2", "node3"}, 128);
+    std::vector<int> counts(4);
+    constexpr int total = 40000;
+
+    for (int i = 0; i < total; ++i) {
+        ++counts[ring.owner_index(std::to_string(250010000000000ULL + i))];
+    }
+    for (int count : counts) {
+        EXPECT_GT(count, total / 4 * 7 / 10);
+        EXPECT_LT(count, total / 4 * 13 / 10);
+    }
+}
+
+// При добавлении узла переезжают только IMSI, доставшиеся новому узлу
+TEST(hash_ring_test, adding_node_moves_only_its_share) {
+    hash_ring before({"node0", "node1", "node2"}, 128);
+    hash_ring after({"node0", "node1", "node2", "node3"}, 128);
+    int moved = 0;
+    constexpr int total = 30000;
+
+    for (int i = 0; i < total; ++i) {
+        std::string imsi = std::to_string(250010000000000ULL + i);
+        if (before.owner(imsi) != after.owner(imsi)) {
+            EXPECT_EQ(after.owner(imsi), "node3");
+            ++moved;
+        }
+    }
+    EXPECT_LT(moved, total / 3);
+}
+
+// Виртуальные часы выполняют задачи по порядку сроков, now() равен сроку задачи
+TEST(manual_session_clock_test, runs_due_tasks_in_order) {
+    manual_session_clock clock;
+    const auto start = clock.now();
+    std::vector<std::pair<char, std::chrono::milliseconds>> runs;
+    auto record = [&](char name) {
+        return [&runs, &clock, start, name] {
+            runs.emplace_back(name, std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - start));
+        };
+    };
+
+    auto a = clock.schedule_every(std::chrono::milliseconds(300), record('a'));
+    auto b = clock.schedule_every(std::chrono::milliseconds(500), record('b'));
+    clock.advance(std::chrono::milliseconds(1000));
+
+    using namespace std::chrono_literals;
+    std::vector<std::pair<char, std::chrono::milliseconds>> expected = {
+        {'a', 300ms}, {'b', 500ms}, {'a', 600ms}, {'a', 900ms}, {'b', 1000ms}
+    };
+    EXPECT_EQ(runs, expected);
+    EXPECT_EQ(clock.now() - start, 1000ms);
+
+    // Отменённая задача больше не выполняется
+    a.reset();
+    runs.clear();
+    clock.advance(std::chrono::milliseconds(500));
+    expected = {{'b', 1500ms}};
+    EXPECT_EQ(runs, expected);
+}
+
+// Задача steady_session_clock выполняется по таймеру, отмена не ждёт конца периода
+TEST(steady_session_clock_test, runs_and_cancels_immediately) {
+    steady_session_clock clock;
+    std::atomic<int> runs{0};
+    auto task = clock.schedule_every(std::chrono::milliseconds(10), [&runs] { ++runs; });
+    while (runs < 3) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    auto long_task = clock.schedule_every(std::chrono::hours(1), [] {});
+    const auto start = std::chrono::steady_clock::now();
+    long_task.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
+
+// eventfd будит epoll без таймаута и остаётся читаемым до consume, timerfd считает срабатывания
+TEST(event_fd_test, wakes_epoll_until_consumed) {
+    event_fd_raii event;
+    epoll_raii epoll;
+    epoll_event registration{};
+    registration.events = EPOLLIN;
+    registration.data.fd = event.get();
+    ASSERT_EQ(epoll_ctl(epoll.get(), EPOLL_CTL_ADD, event.get(), &registration), 0);
+
+    epoll_event ready{};
+    EXPECT_EQ(epoll_wait(epoll.get(), &ready, 1, 0), 0);
+    event.notify();
+    event.notify();
+    EXPECT_EQ(epoll_wait(epoll.get(), &ready, 1, 0), 1);
+    EXPECT_EQ(epoll_wait(epoll.get(), &ready, 1, 0), 1);
+    EXPECT_EQ(event.consume(), 2);
+    EXPECT_EQ(epoll_wait(epoll.get(), &ready, 1, 0), 0);
+    EXPECT_EQ(event.consume(), 0);
+
+    const timer_fd_raii timer(std::chrono::milliseconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_GE(timer.consume(), 2);
+    EXPECT_THROW(timer_fd_raii(std::chrono::nanoseconds::zero()), std::invalid_argument);
+}
+
+// Корутины: очередь сокета переполняется и отправитель ждёт записи, пакетов больше бюджета,
+// таймеры срабатывают по сроку, а не по порядку co_await
+TEST(io_scheduler_test, datagrams_and_timers) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds), 0);
+    const socket_raii receiver(fds[0]);
+    const socket_raii sender(fds[1]);
+    constexpr uint32_t count = 1000;
+
+    io_scheduler scheduler;
+    uint32_t received = 0;
+    bool in_order = true;
+    std::vector<int> woken;
+    size_t finished = 0;
+    auto done = [&] {
+        if (++finished == 5) {
+            scheduler.stop();
+        }
+    };
+
+    auto receive = [&]() -> io_task {
+        uint32_t value = 0;
+        iovec iov{&value, sizeof(value)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        while (received < count) {
+            EXPECT_EQ(co_await scheduler.recv(receiver.get(), msg), sizeof(value));
+            in_order = in_order && value == received;
+            ++received;
+        }
+        done();
+    };
+    auto send = [&]() -> io_task {
+        for (uint32_t i = 0; i < count; ++i) {
+            iovec iov{&i, sizeof(i)};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            EXPECT_EQ(co_await scheduler.send(sender.get(), msg), sizeof(i));
+        }
+        done();
+    };
+    auto sleep = [&](int ms) -> io_task {
+        co_await scheduler.sleep_for(std::chrono::milliseconds(ms));
+        woken.push_back(ms);
+        done();
+    };
+
+    scheduler.spawn(receive());
+    scheduler.spawn(sleep(30));
+    scheduler.spawn(send());
+    scheduler.spawn(sleep(10));
+    scheduler.spawn(sleep(20));
+    scheduler.run();
+
+    EXPECT_EQ(received, count);
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(woken, (std::vector<int>{10, 20, 30}));
+    EXPECT_EQ(scheduler.waiting(), 0);
+}
+
+// Остановка из другого потока через eventfd, ждущие корутины уничтожаются вместе с планировщиком
+TEST(io_scheduler_test, stop_destroys_waiting_coroutines) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds), 0);
+    const socket_raii receiver(fds[0]);
+    const socket_raii sender(fds[1]);
+    event_fd_raii stop_event;
+    auto resource = std::make_shared<int>(0);
+
+    {
+        io_scheduler scheduler;
+        auto wait_packet = [&](std::shared_ptr<int> held) -> io_task {
+            char buffer[16];
+            iovec iov{buffer, sizeof(buffer)};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            co_await scheduler.recv(receiver.get(), msg);
+            ++*held;
+        };
+        auto wait_timer = [&](std::shared_ptr<int> held) -> io_task {
+            co_await scheduler.sleep_for(std::chrono::hours(1));
+            ++*held;
+        };
+        auto wait_stop = [&]() -> io_task {
+            co_await scheduler.readable(stop_event.get());
+            scheduler.stop();
+        };
+
+        scheduler.spawn(wait_packet(resource));
+        scheduler.spawn(wait_timer(resource));
+        scheduler.spawn(wait_stop());
+        // Не переданная в spawn корутина уничтожается вместе с io_task
+        { io_task unused = wait_timer(resource); }
+        EXPECT_EQ(resource.use_count(), 3);
+
+        std::jthread notifier([&stop_event] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            stop_event.notify();
+        });
+        scheduler.run();
+        EXPECT_EQ(scheduler.waiting(), 2);
+    }
+    EXPECT_EQ(resource.use_count(), 1);
+    EXPECT_EQ(*resource, 0);
+}
+
+// Программа SO_REUSEPORT кладёт пакет в сокет того потока, который вычисляет steering_shard,
+// для простых и расширенных пакетов с одним IMSI это один поток
+TEST(reuseport_steering_test, kernel_matches_steering_shard) {
+    constexpr size_t shards = 4;
+    std::vector<socket_raii> sockets;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (size_t i = 0; i < shards; ++i) {
+        sockets.emplace_back(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+        int enable = 1;
+        ASSERT_EQ(setsockopt(sockets[i].get(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)), 0);
+        ASSERT_EQ(bind(sockets[i].get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+        // Первый сокет получает свободный порт, остальные присоединяются к нему
+        socklen_t len = sizeof(addr);
+        getsockname(sockets[i].get(), reinterpret_cast<sockaddr*>(&addr), &len);
+    }
+    attach_steering_program(sockets[0].get(), shards);
+
+    const socket_raii sender(socket(AF_INET, SOCK_DGRAM, 0));
+    std::vector<size_t> per_shard(shards);
+    for (uint64_t i = 0; i < 200; ++i) {
+        const std::string imsi = std::to_string(250'010'000'000'000ULL + i * 7919);
+        const std::vector<uint8_t> bcd = imsi_to_bcd(imsi);
+        const std::string plain(bcd.begin(), bcd.end());
+        const size_t shard = imsi_shard(imsi, shards);
+        ASSERT_EQ(steering_shard(plain, shards), shard);
+        ++per_shard[shard];
+
+        for (const std::string& packet : {plain, make_packet(opcode_create, i, plain)}) {
+            sendto(sender.get(), packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            char buffer[64];
+            EXPECT_EQ(recv(sockets[shard].get(), buffer, sizeof(buffer), 0), static_cast<ssize_t>(packet.size()))
+                << "IMSI " << imsi;
+        }
+    }
+    // Распределение без пустых потоков
+    for (const size_t count : per_shard) {
+        EXPECT_GT(count, 20);
+    }
+    EXPECT_THROW(make_steering_program(0), std::invalid_argument);
+}
+
+// Задачи выполняются в потоке-владельце, после закрытия ящика call бросает исключение
+TEST(shard_mailbox_test, call_runs_in_owner_thread) {
+    shard_mailbox mailbox;
+    std::atomic<bool> closing = false;
+    std::thread::id owner_id;
+    std::jthread owner([&] {
+        owner_id = std::this_thread::get_id();
+        while (!closing) {
+            pollfd pfd{mailbox.fd(), POLLIN, 0};
+            poll(&pfd, 1, 10);
+            mailbox.drain();
+        }
+        mailbox.close();
+    });
+
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(mailbox.call([i, &owner_id] {
+            EXPECT_EQ(std::this_thread::get_id(), owner_id);
+            return i * 2;
+        }), i * 2);
+    }
+    EXPECT_THROW(mailbox.call([]() -> int { throw std::invalid_argument("задача"); }), std::invalid_argument);
+
+    closing = true;
+    owner.join();
+    EXPECT_FALSE(mailbox.post([] {}));
+    EXPECT_THROW(mailbox.call([] { return 0; }), std::runtime_error);
+}
+
+// Файл захвата: датаграммы читаются в том же порядке и с теми же метками
+TEST(capture_file_test, write_and_read_back) {
+    const std::string path = "test_capture.bin";
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(4000);
+    inet_pton(AF_INET, "10.0.0.1", &addr.sin_addr);
+    {
+        capture_writer writer(path);
+        writer.append(1'700'000'000'000'000'000, addr, "first");
+        writer.append(1'700'000'000'000'500'000, addr, std::string(300, 'x'));
+        EXPECT_EQ(writer.records(), 2);
+    }
+    // Обрезанная последняя запись, как после падения сервера
+    std::ofstream(path, std::ios::binary | std::ios::app) << '\x05';
+
+    capture_reader reader(path);
+    auto first = reader.next();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->timestamp_ns, 1'700'000'000'000'000'000);
+    EXPECT_EQ(first->data, "first");
+    EXPECT_EQ(first->addr.sin_port, htons(4000));
+    EXPECT_EQ(first->addr.sin_addr.s_addr, addr.sin_addr.s_addr);
+
+    auto second = reader.next();
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->timestamp_ns, 1'700'000'000'000'500'000);
+    EXPECT_EQ(second->data.size(), 300);
+    EXPECT_FALSE(reader.next().has_value());
+
+    std::filesystem::remove(path);
+}
+
+// После flush записи видны в файле, пока писатель ещё открыт, как после SIGKILL сервера
+TEST(capture_file_test, flushed_records_survive_without_close) {
+    const std::string path = "test_capture_flush.bin";
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    capture_writer writer(path);
+    writer.append(1'700'000'000'000'000'000, addr, "first");
+    writer.flush();
+
+    capture_reader reader(path);
+    auto first = reader.next();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->data, "first");
+    EXPECT_FALSE(reader.next().has_value());
+
+    std::filesystem::remove(path);
+}
+
+// Гистограмма задержек: корзины по степеням двойки
+TEST(latency_histogram_test, percentiles_and_buckets) {
+    latency_histogram histogram;
+    for (int i = 0; i < 99; ++i) {
+        histogram.record(1000);
+    }
+    histogram.record(1'000'000);
+
+    EXPECT_EQ(histogram.count(), 100);
+    EXPECT_EQ(histogram.max_ns(), 1'000'000);
+    EXPECT_EQ(histogram.percentile_ns(50), 1024);
+    EXPECT_EQ(histogram.percentile_ns(99.9), 1'000'000);
+    EXPECT_EQ(histogram.buckets().size(), 2);
+}
+
+// Тесты репликации на loopback
+class replication_test : public session_manager_test {
+protected:
+    replication_config replication;
+    std::unique_ptr<session_manager> standby;
+
+    void SetUp() override {
+        session_manager_test::SetUp();
+        config.session_timeout_sec = 60;
+        manager = std::make_unique<session_manager>(config);
+        standby = std::make_unique<session_manager>(config);
+
+        replication.enabled = true;
+        replication.ip = "127.0.0.1";
+        replication.port = 0;
+        replication.batch_interval_ms = 5;
+        replication.max_lag_events = 1000;
+        replication.failover_timeout_ms = 200;
+    }
+
+    template<typename Pred>
+    static bool wait_for(Pred pred) {
+        for (int i = 0; i < 200 && !pred(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return pred();
+    }
+};
+
+// Резервный узел получает снимок и поток событий, после падения основного узла принимает нагрузку
+TEST_F(replication_test, standby_takes_over_after_primary_loss) {
+    // Сессия, созданная до подключения резервного узла, приходит в снимке
+    EXPECT_EQ(manager->process_request("111111111111111"), "created");
+
+    replication_publisher publisher(*manager, replication);
+    publisher.start();
+    replication.port = publisher.port();
+
+    std::atomic<bool> promoted = false;
+    replication_subscriber subscriber(*standby, replication, [&promoted] { promoted = true; });
+    subscriber.start();
+
+    ASSERT_TRUE(wait_for([&] { return standby->is_session_active("111111111111111"); }));
+    EXPECT_EQ(manager->process_request("222222222222222"), "created");
+    ASSERT_TRUE(wait_for([&] { return standby->is_session_active("222222222222222"); }));
+    EXPECT_EQ(publisher.stats().standbys, 1);
+
+    publisher.stop();
+    ASSERT_TRUE(wait_for([&] { return promoted.load(); }));
+
+    // Все сессии на месте, дубликат отклоняется
+    EXPECT_EQ(standby->process_request("111111111111111"), "rejected");
+    EXPECT_EQ(standby->process_request("222222222222222"), "rejected");
+    EXPECT_EQ(standby->process_request("333333333333333"), "created");
+    EXPECT_GE(subscriber.stats().events, 3);
+}
+
+// Вытеснение на основном узле удаляет сессию и на резервном
+TEST_F(replication_test, eviction_is_replicated) {
+    config.max_sessions = 1;
+    config.session_limit_policy = "evict_oldest";
+    manager = std::make_unique<session_manager>(config);
+
+    replication_publisher publisher(*manager, replication);
+    publisher.start();
+    replication.port = publisher.port();
+    replication_subscriber subscriber(*standby, replication, [] {});
+    subscriber.start();
+
+    ASSERT_TRUE(wait_for([&] { return subscriber.stats().connected; }));
+    EXPECT_EQ(manager->process_request("111111111111111"), "created");
+    EXPECT_EQ(manager->process_request("222222222222222"), "created");
+
+    ASSERT_TRUE(wait_for([&] { return standby->is_session_active("222222222222222"); }));
+    EXPECT_FALSE(standby->is_session_active("111111111111111"));
+
+    subscriber.stop();
+}
+
+// Отставший резервный узел отключается основным, переподключается за свежим снимком и не принимает нагрузку
+TEST_F(replication_test, lagging_standby_resyncs_without_failover) {
+    // Пачка событий между отправками больше лимита отставания: pending.size() > limit
+    replication.batch_interval_ms = 100;
+    replication.max_lag_events = 5;
+
+    replication_publisher publisher(*manager, replication);
+    publisher.start();
+    replication.port = publisher.port();
+
+    std::atomic<bool> promoted = false;
+    replication_subscriber subscriber(*standby, replication, [&promoted] { promoted = true; });
+    subscriber.start();
+    ASSERT_TRUE(wait_for([&] { return subscriber.stats().connected && publisher.stats().standbys == 1; }));
+
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(manager->process_request(std::to_string(100000000000000 + i)), "created");
+    }
+
+    ASSERT_TRUE(wait_for([&] { return subscriber.stats().resyncs >= 1; }));
+    EXPECT_GE(publisher.stats().dropped_standbys, 1);
+    ASSERT_TRUE(wait_for([&] {
+        for (int i = 0; i < 20; ++i) {
+            if (!standby->is_session_active(std::to_string(100000000000000 + i))) {
+                return false;
+            }
+        }
+        return true;
+    }));
+
+    // Дольше failover_timeout_ms: переключения так и не было, резервный узел снова получает события
+    std::this_thread::sleep_for(std::chrono::milliseconds(replication.failover_timeout_ms * 2));
+    EXPECT_FALSE(promoted.load());
+    EXPECT_TRUE(subscriber.stats().connected);
+    EXPECT_EQ(publisher.stats().standbys, 1);
+
+    subscriber.stop();
+}
+
+// Резервный узел, который не читает снимок, не задерживает события и heartbeat другому резервному узлу
+TEST_F(replication_test, stalled_standby_does_not_block_others) {
+    replication.failover_timeout_ms = 1000;
+    replication.max_lag_events = 1'000'000;
+    for (int i = 0; i < 250'000; ++i) {
+        manager->process_request(std::to_string(100000000000000 + i));
+    }
+
+    replication_publisher publisher(*manager, replication);
+    publisher.start();
+    replication.port = publisher.port();
+
+    // Маленький приёмный буфер и ни одного чтения: снимок застревает в сокете основного узла
+    socket_raii stalled(socket(AF_INET, SOCK_STREAM, 0));
+    int rcvbuf = 4096;
+    setsockopt(stalled.get(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(publisher.port());
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    ASSERT_EQ(connect(stalled.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    ASSERT_TRUE(wait_for([&] { return publisher.stats().standbys == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::atomic<bool> promoted = false;
+    replication_subscriber subscriber(*standby, replication, [&promoted] { promoted = true; });
+    subscriber.start();
+    ASSERT_TRUE(wait_for([&] { return standby->is_session_active("100000000249999"); }));
+    EXPECT_EQ(publisher.stats().standbys, 2);
+
+    // Событие доходит раньше, чем основной узел отключит застрявший резервный узел
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(manager->process_request("888888888888888"), "created");
+    ASSERT_TRUE(wait_for([&] { return standby->is_session_active("888888888888888"); }));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+    EXPECT_EQ(publisher.stats().standbys, 2);
+
+    // Застрявший резервный узел отключается через failover_timeout_ms, второй остаётся на связи
+    ASSERT_TRUE(wait_for([&] { return publisher.stats().standbys == 1; }));
+    EXPECT_GE(publisher.stats().dropped_standbys, 1);
+    EXPECT_TRUE(subscriber.stats().connected);
+    EXPECT_FALSE(promoted.load());
+
+    subscriber.stop();
+}
+
+// Остановка не ждёт таймаута подключения к недоступному основному узлу
+TEST_F(replication_test, stop_interrupts_pending_connect) {
+    // Очередь слушателя без accept заполнена, новые SYN отбрасываются и подключение висит
+    socket_raii listener(socket(AF_INET, SOCK_STREAM, 0));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    ASSERT_EQ(bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(listen(listener.get(), 0), 0);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    std::vector<socket_raii> fillers;
+    for (int i = 0; i < 2; ++i) {
+        fillers.emplace_back(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0));
+        connect(fillers.back().get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+
+    replication.port = ntohs(addr.sin_port);
+    replication.failover_timeout_ms = 60'000;
+    replication_subscriber subscriber(*standby, replication, [] {});
+    subscriber.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const auto start = std::chrono::steady_clock::now();
+    subscriber.stop();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    EXPECT_FALSE(subscriber.stats().connected);
+}
+
+// Тесты потокового приёмника CDR
+class stream_cdr_sink_test : public ::testing::Test {
+protected:
+    cdr_sink_config sink_config;
+    std::mutex mutex;
+    std::vector<std::string> received;
+
+    void SetUp() override {
+        sink_config.type = "stream";
+        sink_config.batch_size = 4;
+        sink_config.flush_interval_ms = 10;
+        sink_config.max_buffered_records = 8;
+        sink_config.spill_file = "test_cdr_spill.bin";
+        sink_config.reconnect_interval_ms = 20;
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all("logs");
+    }
+
+    std::function<void(std::string_view)> collect() {
+        return [this](std::string_view record) {
+            std::lock_guard lock(mutex);
+            received.emplace_back(record);
+        };
+    }
+
+    size_t received_count() {
+        std::lock_guard lock(mutex);
+        return received.size();
+    }
+
+    template<typename Pred>
+    static bool wait_for(Pred pred) {
+        for (int i = 0; i < 300 && !pred(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return pred();
+    }
+};
+
+// Записи через session_manager доходят до коллектора по Unix сокету
+TEST_F(stream_cdr_sink_test, streams_records_to_collector) {
+    sink_config.address = "unix:///tmp/pgw_cdr_collector_test.sock";
+    sink_config.max_buffered_records = 64;
+    cdr_collector collector(sink_config.address, collect());
+    collector.start();
+
+    server_config config;
+    config.session_timeout_sec = 60;
+    config.cdr_sink = sink_config;
+    auto manager = std::make_unique<session_manager>(config);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(manager->process_request("10000000000000" + std::to_string(i)), "created");
+    }
+
+    // Неполный пакет уходит по flush_interval_ms
+    ASSERT_TRUE(wait_for([&] { return received_count() == 10; }));
+    ASSERT_TRUE(wait_for([&] { return manager->stats().cdr_pending == 0; }));
+    EXPECT_TRUE(received[0].ends_with(",100000000000000,Сессия создана"));
+    manager.reset();
+    collector.stop();
+}
+
+// Пока коллектора нет, записи копятся в памяти и в файле подкачки, после его запуска доставляются все
+TEST_F(stream_cdr_sink_test, spills_while_collector_down) {
+    // Свободный порт: коллектор открывается и сразу закрывается
+    int port;
+    {
+        cdr_collector probe("tcp://127.0.0.1:0", [](std::string_view) {});
+        probe.start();
+        port = probe.port();
+    }
+    sink_config.address = "tcp://127.0.0.1:" + std::to_string(port);
+
+    stream_cdr_sink sink(sink_config);
+    for (int i = 0; i < 20; ++i) {
+        sink.write(std::to_string(i), "Сессия создана");
+    }
+    EXPECT_EQ(sink.pending(), 20);
+    EXPECT_EQ(sink.stats().spilled, 12);
+    EXPECT_TRUE(std::filesystem::exists("logs/test_cdr_spill.bin"));
+
+    cdr_collector collector(sink_config.address, collect());
+    collector.start();
+    ASSERT_TRUE(wait_for([&] { return received_count() == 20; }));
+    ASSERT_TRUE(wait_for([&] { return sink.pending() == 0; }));
+    EXPECT_FALSE(std::filesystem::exists("logs/test_cdr_spill.bin"));
+
+    // Сначала файл подкачки, затем память
+    std::lock_guard lock(mutex);
+    EXPECT_TRUE(received.front().ends_with(",8,Сессия создана"));
+    EXPECT_TRUE(received.back().ends_with(",7,Сессия создана"));
+}
+
+// Файл подкачки пишется блоками без сброса на каждую запись: записи меньше spill_flush_records
+// попадают на диск сбросом из потока отправки, пока коллектор недоступен
+TEST_F(stream_cdr_sink_test, spill_flushed_by_sender_thread) {
+    int port;
+    {
+        cdr_collector probe("tcp://127.0.0.1:0", [](std::string_view) {});
+        probe.start();
+        port = probe.port();
+    }
+    sink_config.address = "tcp://127.0.0.1:" + std::to_string(port);
+
+    stream_cdr_sink sink(sink_config);
+    for (int i = 0; i < 20; ++i) {
+        sink.write(std::to_string(i), "Сессия создана");
+    }
+    ASSERT_LT(sink.stats().spilled, stream_cdr_sink::spill_flush_records);
+    EXPECT_TRUE(wait_for([] {
+        std::error_code ec;
+        return std::filesystem::file_size("logs/test_cdr_spill.bin", ec) > 0 && !ec;
+    }));
+    EXPECT_EQ(sink.stats().spilled, 12);
+}
+
+// Заголовок с числом записей больше, чем помещается в пакет, закрывает соединение, а коллектор продолжает работать
+TEST_F(stream_cdr_sink_test, collector_rejects_oversized_count) {
+    cdr_collector collector("tcp://127.0.0.1:0", collect());
+    collector.start();
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(collector.port());
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    socket_raii fd(socket(AF_INET, SOCK_STREAM, 0));
+    ASSERT_EQ(connect(fd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+
+    // Длина 8: число записей и одна пустая запись, число записей 2^32 - 1
+    const char frame[] = {0, 0, 0, 8, '\xFF', '\xFF', '\xFF', '\xFF', 0, 0, 0, 0};
+    ASSERT_EQ(send(fd.get(), frame, sizeof(frame), MSG_NOSIGNAL), static_cast<ssize_t>(sizeof(frame)));
+    // Коллектор закрывает соединение без подтверждения, непрочитанные данные дают сброс вместо EOF
+    char ack[4];
+    EXPECT_LE(recv(fd.get(), ack, sizeof(ack), 0), 0);
+    fd = socket_raii(-1);
+
+    sink_config.address = "tcp://127.0.0.1:" + std::to_string(collector.port());
+    stream_cdr_sink sink(sink_config);
+    sink.write("1", "Сессия создана");
+    ASSERT_TRUE(wait_for([&] { return received_count() == 1; }));
+    EXPECT_EQ(collector.records(), 1);
+}
+
+// Время записи CDR из начала строки, UTC
+TEST(cdr_index_test, parse_cdr_time) {
+    EXPECT_EQ(parse_cdr_time("1970-01-01 00:00:00,1,a"), 0);
+    EXPECT_EQ(parse_cdr_time("2024-02-29 12:34:56"), 1709210096);
+    EXPECT_EQ(parse_cdr_time("2023-02-29 12:34:56"), -1);
+    EXPECT_EQ(parse_cdr_time("summary"), -1);
+}
+
+// Приёмник CDR в память для проверки агрегации
+class memory_cdr_sink : public cdr_sink {
+public:
+    std::vector<std::string> records;
+
+    void write(const std::string& imsi, const std::string& action) override {
+        records.push_back(imsi + ',' + action);
+    }
+    void write_record(const std::string& record) override {
+        records.push_back(record.substr(record.find(',') + 1)); // без времени
+    }
+    uint64_t pending() const override {
+        return 0;
+    }
+};
+
+// Сводки по MCC/MNC и действию за интервал, полные записи только для detail_prefixes
+TEST(cdr_aggregator_test, summaries_per_interval_and_detail_prefixes) {
+    cdr_aggregation_config config;
+    config.enabled = true;
+    config.interval_sec = 60;
+    config.mnc_digits = 2;
+    config.detail_prefixes = {"25002"};
+
+    auto clock = std::make_shared<manual_session_clock>();
+    auto sink = std::make_unique<memory_cdr_sink>();
+    memory_cdr_sink& records = *sink;
+    cdr_aggregator aggregator(config, std::move(sink), clock);
+
+    for (int i = 0; i < 1000; ++i) {
+        aggregator.write("25001" + std::to_string(1000000000 + i), "Сессия создана");
+    }
+    aggregator.write("250010000000001", "Сессия закрыта по времени");
+    aggregator.write("250020000000001", "Сессия создана");
+    EXPECT_EQ(records.records, std::vector<std::string>{"250020000000001,Сессия создана"});
+
+    clock->advance(std::chrono::seconds(60));
+    const std::vector<std::string> expected = {
+        "250020000000001,Сессия создана",
+        "summary,25001,Сессия закрыта по времени,1,60",
+        "summary,25001,Сессия создана,1000,60",
+        "summary,25002,Сессия создана,1,60"
+    };
+    EXPECT_EQ(records.records, expected);
+
+    // Пустой интервал ничего не выпускает
+    clock->advance(std::chrono::seconds(60));
+    EXPECT_EQ(records.records.size(), 4);
+
+    const cdr_aggregation_stats stats = aggregator.stats();
+    EXPECT_EQ(stats.events, 1002);
+    EXPECT_EQ(stats.detailed, 1);
+    EXPECT_EQ(stats.summaries, 3);
+}
+
+// Выборка по хэшу IMSI: примерно заданная доля абонентов, все события абонента в выборке
+TEST(cdr_aggregator_test, sample_is_per_subscriber) {
+    cdr_aggregation_config config;
+    config.enabled = true;
+    config.interval_sec = 60;
+    config.mnc_digits = 2;
+    config.sample_rate = 0.1;
+
+    auto sink = std::make_unique<memory_cdr_sink>();
+    memory_cdr_sink& records = *sink;
+    cdr_aggregator aggregator(config, std::move(sink), std::make_shared<manual_session_clock>());
+
+    for (int i = 0; i < 10000; ++i) {
+        const std::string imsi = "25001" + std::to_string(1000000000 + i);
+        aggregator.write(imsi, "Сессия создана");
+        aggregator.write(imsi, "Сессия закрыта по времени");
+    }
+
+    EXPECT_EQ(records.records.size() % 2, 0);
+    EXPECT_GT(records.records.size(), 2 * 800);
+    EXPECT_LT(records.records.size(), 2 * 1200);
+}
+
+// Шторм одного IMSI среди множества редких ключей: sketch не недооценивает,
+// а топ находит источник шторма и считает его отказы
+TEST(heavy_hitters_test, storm_is_found_among_background) {
+    count_min_sketch sketch(1000, 4);
+    EXPECT_EQ(sketch.width(), 1024);
+    EXPECT_THROW(count_min_sketch(0, 4), std::invalid_argument);
+
+    heavy_hitter_tracker tracker(5, 1024);
+    for (int i = 0; i < 20000; ++i) {
+        tracker.add("25001" + std::to_string(1000000000 + i));
+        if (i % 4 == 0) {
+            tracker.add("001010123456789", true);
+        }
+        if (i % 10 == 0) {
+            tracker.add("250010000000002");
+        }
+    }
+
+    const std::vector<heavy_hitter> top = tracker.top();
+    ASSERT_EQ(top.size(), 5);
+    EXPECT_EQ(top[0].key, "001010123456789");
+    EXPECT_GE(top[0].count, 5000);
+    EXPECT_LT(top[0].count, 5500);
+    EXPECT_GT(top[0].rejected, 4000);
+    EXPECT_EQ(top[1].key, "250010000000002");
+    EXPECT_GE(top[1].count, 2000);
+
+    // Окно закрывается: топ переходит в previous, адреса в текстовом виде
+    heavy_hitters hitters(3, 256);
+    hitters.add_imsi("001010123456789", false);
+    hitters.add_source(htonl(INADDR_LOOPBACK));
+    hitters.rotate();
+    EXPECT_TRUE(hitters.current().imsi.empty());
+    const heavy_hitters_report previous = hitters.previous();
+    ASSERT_EQ(previous.source.size(), 1);
+    EXPECT_EQ(previous.source[0].key, "127.0.0.1");
+    EXPECT_EQ(previous.imsi[0].count, 1);
+}
 
 int main() {
     testing::InitGoogleTest();
@@ -0,0 +1,36 @@
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <gtest/gtest.h>
+
+// Проверка, что точки USDT есть в pgw_server: readelf показывает заметки stapsdt.
+// Путь к pgw_server передаётся первым аргументом
+std::string server_binary;
+
+TEST(usdt_probes_test, all_probes_present) {
+    std::string output;
+    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(("readelf -n " + server_binary).c_str(), "r"), pclose);
+    ASSERT_NE(pipe, nullptr);
+
+    std::array<char, 4096> buffer{};
+    while (fgets(buffer.data(), buffer.size(), pipe.get())) {
+        output += buffer.data();
+    }
+
+    EXPECT_TRUE(output.contains("stapsdt"));
+    EXPECT_TRUE(output.contains("Provider: pgw"));
+    for (const char* probe : {"udp_receive", "udp_reply", "session_blacklisted", "session_rejected_limit",
+        "session_evicted", "session_duplicate", "session_created", "sessions_expired", "cdr_write", "cdr_flush"}) {
+        EXPECT_TRUE(output.contains(std::string("Name: ") + probe)) << "нет точки " << probe;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    if (argc < 2) {
+        std::cerr << "Использование: usdt_probes_test <путь к pgw_server>" << '\n';
+        return 1;
+    }
+    server_binary = std::filesystem::absolute(argv[1]);
+    return RUN_ALL_TESTS();
+}